@@ -50,6 +50,7 @@
 #include "kvm-cpus.h"
 #include "system/dirtylimit.h"
 #include "qemu/range.h"
+#include "block/thread-pool.h"
 
 #include "hw/boards.h"
 #include "system/stats.h"
@@ -820,9 +821,13 @@ static bool kvm_slot_get_dirty_log(KVMState *s, KVMSlot *slot)
     return ret == 0;
 }
 
-/* Should be with all slots_lock held for the address spaces. */
+/*
+ * Should be with all slots_lock held for the address spaces.  @atomic
+ * must be set when other threads may mark pages at the same time.
+ */
 static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_id,
-                                     uint32_t slot_id, uint64_t offset)
+                                     uint32_t slot_id, uint64_t offset,
+                                     bool atomic)
 {
     KVMMemoryListener *kml;
     KVMSlot *mem;
@@ -839,7 +844,11 @@ static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_id,
         return;
     }
 
-    set_bit(offset, mem->dirty_bmap);
+    if (atomic) {
+        set_bit_atomic(offset, mem->dirty_bmap);
+    } else {
+        set_bit(offset, mem->dirty_bmap);
+    }
 }
 
 static bool dirty_gfn_is_dirtied(struct kvm_dirty_gfn *gfn)
@@ -876,7 +885,8 @@ static void dirty_gfn_set_collected(struct kvm_dirty_gfn *gfn)
  * Should be with all slots_lock held for the address spaces.  It returns the
  * dirty page we've collected on this dirty ring.
  */
-static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
+static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu,
+                                        bool atomic)
 {
     struct kvm_dirty_gfn *dirty_gfns = cpu->kvm_dirty_gfns, *cur;
     uint32_t ring_size = s->kvm_dirty_ring_size;
@@ -900,7 +910,7 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
             break;
         }
         kvm_dirty_ring_mark_page(s, cur->slot >> 16, cur->slot & 0xffff,
-                                 cur->offset);
+                                 cur->offset, atomic);
         dirty_gfn_set_collected(cur);
         trace_kvm_dirty_ring_page(cpu->cpu_index, fetch, cur->offset);
         fetch++;
@@ -912,6 +922,67 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
     return count;
 }
 
+typedef struct KVMDirtyRingReapJob {
+    KVMState *s;
+    CPUState **cpus;
+    int nr_cpus;
+    uint64_t total;
+} KVMDirtyRingReapJob;
+
+static int kvm_dirty_ring_reap_job(void *opaque)
+{
+    KVMDirtyRingReapJob *job = opaque;
+    int i;
+
+    for (i = 0; i < job->nr_cpus; i++) {
+        job->total += kvm_dirty_ring_reap_one(job->s, job->cpus[i], true);
+    }
+
+    return 0;
+}
+
+/*
+ * Collect the rings of all vCPUs with s->reap_pool, each worker taking
+ * a contiguous group of vCPUs.  Workers set bits in the shared slot
+ * bitmaps atomically, so the results need no merging.
+ *
+ * The caller holds the BQL, which keeps the vCPU list stable.
+ */
+static uint64_t kvm_dirty_ring_reap_parallel(KVMState *s)
+{
+    g_autofree CPUState **cpus = NULL;
+    g_autofree KVMDirtyRingReapJob *jobs = NULL;
+    int nr_cpus = 0, nr_jobs, per_job, i;
+    uint64_t total = 0;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        nr_cpus++;
+    }
+    cpus = g_new(CPUState *, nr_cpus);
+    i = 0;
+    CPU_FOREACH(cpu) {
+        cpus[i++] = cpu;
+    }
+
+    nr_jobs = MIN(s->kvm_dirty_ring_reap_threads, nr_cpus);
+    per_job = DIV_ROUND_UP(nr_cpus, nr_jobs);
+    jobs = g_new0(KVMDirtyRingReapJob, nr_jobs);
+    for (i = 0; i < nr_jobs; i++) {
+        jobs[i].s = s;
+        jobs[i].cpus = cpus + i * per_job;
+        jobs[i].nr_cpus = MAX(MIN(per_job, nr_cpus - i * per_job), 0);
+        thread_pool_submit(s->reap_pool, kvm_dirty_ring_reap_job,
+                           &jobs[i], NULL);
+    }
+    thread_pool_wait(s->reap_pool);
+
+    for (i = 0; i < nr_jobs; i++) {
+        total += jobs[i].total;
+    }
+    return total;
+}
+
 /* Must be with slots_lock held */
 static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState* cpu)
 {
@@ -922,10 +993,12 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState* cpu)
     stamp = get_clock();
 
     if (cpu) {
-        total = kvm_dirty_ring_reap_one(s, cpu);
+        total = kvm_dirty_ring_reap_one(s, cpu, false);
+    } else if (s->reap_pool) {
+        total = kvm_dirty_ring_reap_parallel(s);
     } else {
         CPU_FOREACH(cpu) {
-            total += kvm_dirty_ring_reap_one(s, cpu);
+            total += kvm_dirty_ring_reap_one(s, cpu, false);
         }
     }
 
@@ -1115,6 +1188,18 @@ static int kvm_log_clear_one_slot(KVMSlot *mem, int as_id, uint64_t start,
     assert(bmap_start % BITS_PER_LONG == 0);
     /* We should never do log_clear before log_sync */
     assert(mem->dirty_bmap);
+
+    /*
+     * Only bits set in the cached bitmap are ever cleared remotely, so a
+     * clean range needs no ioctl at all.  Sparsely dirtying guests hit
+     * this for most of their memory on every iteration.
+     */
+    if (find_next_bit(mem->dirty_bmap, bmap_start + start_delta + size / psize,
+                      bmap_start + start_delta) >=
+        bmap_start + start_delta + size / psize) {
+        return 0;
+    }
+
     if (start_delta || bmap_npages - size / psize) {
         /* Slow path - we need to manipulate a temp bitmap */
         bmap_clear = bitmap_new(bmap_npages);
@@ -1661,6 +1746,12 @@ static void kvm_dirty_ring_reaper_init(KVMState *s)
 {
     struct KVMDirtyRingReaper *r = &s->reaper;
 
+    if (s->kvm_dirty_ring_reap_threads > 1) {
+        s->reap_pool = thread_pool_new();
+        thread_pool_set_max_threads(s->reap_pool,
+                                    s->kvm_dirty_ring_reap_threads);
+    }
+
     qemu_thread_create(&r->reaper_thr, "kvm-reaper",
                        kvm_dirty_ring_reaper_thread,
                        s, QEMU_THREAD_JOINABLE);
@@ -1753,6 +1844,76 @@ static void kvm_region_del(MemoryListener *listener,
     QSIMPLEQ_INSERT_TAIL(&kml->transaction_del, update, next);
 }
 
+/*
+ * A section that is removed and added back with the same backing memory
+ * (e.g. because only an attribute KVM does not care about changed) maps
+ * to a memslot that is already correct.  Called with the slots lock held.
+ */
+static bool kvm_section_slot_unchanged(KVMMemoryListener *kml,
+                                       MemoryRegionSection *old,
+                                       MemoryRegionSection *new)
+{
+    MemoryRegion *mr = new->mr;
+    hwaddr start_addr, size;
+    KVMSlot *mem;
+
+    if (old->mr != mr || !memory_region_is_ram(mr) ||
+        old->offset_within_address_space != new->offset_within_address_space ||
+        old->offset_within_region != new->offset_within_region ||
+        int128_ne(old->size, new->size)) {
+        return false;
+    }
+
+    size = kvm_align_section(new, &start_addr);
+    if (!size || size > kvm_max_slot_size) {
+        return false;
+    }
+
+    mem = kvm_lookup_matching_slot(kml, start_addr, size);
+    return mem && mem->flags == kvm_mem_flags(mr) &&
+           mem->ram == memory_region_get_ram_ptr(mr) +
+                        new->offset_within_region + start_addr -
+                        new->offset_within_address_space;
+}
+
+/*
+ * Drop del/add pairs that would re-create an identical memslot, so that
+ * they neither cost two ioctls nor force an ioctl inhibit.  Both lists
+ * are ordered by address.
+ */
+static void kvm_region_drop_unchanged(KVMMemoryListener *kml)
+{
+    QSIMPLEQ_HEAD(, KVMMemoryUpdate) del = QSIMPLEQ_HEAD_INITIALIZER(del);
+    QSIMPLEQ_HEAD(, KVMMemoryUpdate) add = QSIMPLEQ_HEAD_INITIALIZER(add);
+    KVMMemoryUpdate *u1, *u2;
+
+    while ((u1 = QSIMPLEQ_FIRST(&kml->transaction_del)) &&
+           (u2 = QSIMPLEQ_FIRST(&kml->transaction_add))) {
+        hwaddr a1 = u1->section.offset_within_address_space;
+        hwaddr a2 = u2->section.offset_within_address_space;
+
+        if (a1 == a2 &&
+            kvm_section_slot_unchanged(kml, &u1->section, &u2->section)) {
+            /* The memslot keeps the reference taken when it was added. */
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_del, next);
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_add, next);
+            g_free(u1);
+            g_free(u2);
+        } else if (a1 <= a2) {
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_del, next);
+            QSIMPLEQ_INSERT_TAIL(&del, u1, next);
+        } else {
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_add, next);
+            QSIMPLEQ_INSERT_TAIL(&add, u2, next);
+        }
+    }
+
+    QSIMPLEQ_CONCAT(&del, &kml->transaction_del);
+    QSIMPLEQ_CONCAT(&add, &kml->transaction_add);
+    QSIMPLEQ_CONCAT(&kml->transaction_del, &del);
+    QSIMPLEQ_CONCAT(&kml->transaction_add, &add);
+}
+
 static void kvm_region_commit(MemoryListener *listener)
 {
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener,
@@ -1765,6 +1926,9 @@ static void kvm_region_commit(MemoryListener *listener)
         return;
     }
 
+    kvm_slots_lock();
+    kvm_region_drop_unchanged(kml);
+
     /*
      * We have to be careful when regions to add overlap with ranges to remove.
      * We have to simulate atomic KVM memslot updates by making sure no ioctl()
@@ -1793,7 +1957,6 @@ static void kvm_region_commit(MemoryListener *listener)
         }
     }
 
-    kvm_slots_lock();
     if (need_inhibit) {
         accel_ioctl_inhibit_begin();
     }
@@ -3951,6 +4114,39 @@ static void kvm_set_dirty_ring_size(Object *obj, Visitor *v,
     s->kvm_dirty_ring_size = value;
 }
 
+static void kvm_get_dirty_ring_reap_threads(Object *obj, Visitor *v,
+                                            const char *name, void *opaque,
+                                            Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value = s->kvm_dirty_ring_reap_threads;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void kvm_set_dirty_ring_reap_threads(Object *obj, Visitor *v,
+                                            const char *name, void *opaque,
+                                            Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value;
+
+    if (s->fd != -1) {
+        error_setg(errp, "Cannot set properties after the accelerator has been initialized");
+        return;
+    }
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!value) {
+        error_setg(errp, "dirty-ring-reap-threads must be at least 1.");
+        return;
+    }
+
+    s->kvm_dirty_ring_reap_threads = value;
+}
+
 static char *kvm_get_device(Object *obj,
                             Error **errp G_GNUC_UNUSED)
 {
@@ -3995,6 +4191,7 @@ static void kvm_accel_instance_init(Object *obj)
     s->kernel_irqchip_split = ON_OFF_AUTO_AUTO;
     /* KVM dirty ring is by default off */
     s->kvm_dirty_ring_size = 0;
+    s->kvm_dirty_ring_reap_threads = 1;
     s->kvm_dirty_ring_with_bitmap = false;
     s->kvm_eager_split_size = 0;
     s->notify_vmexit = NOTIFY_VMEXIT_OPTION_RUN;
@@ -4044,6 +4241,13 @@ static void kvm_accel_class_init(ObjectClass *oc, const void *data)
     object_class_property_set_description(oc, "dirty-ring-size",
         "Size of KVM dirty page ring buffer (default: 0, i.e. use bitmap)");
 
+    object_class_property_add(oc, "dirty-ring-reap-threads", "uint32",
+        kvm_get_dirty_ring_reap_threads, kvm_set_dirty_ring_reap_threads,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-ring-reap-threads",
+        "Number of threads collecting the KVM dirty rings of all vCPUs "
+        "(default: 1)");
+
     object_class_property_add_str(oc, "device", kvm_get_device, kvm_set_device);
     object_class_property_set_description(oc, "device",
         "Path to the device node to use (default: /dev/kvm)");
@@ -227,6 +227,7 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, TCGTBCPUState s)
 {
     TranslationBlock *tb;
     CPUJumpCache *jc;
+    CPUJumpCacheEntry *way;
     uint32_t hash;
 
     /* we should never be trying to look up an INVALID tb */
@@ -234,23 +235,30 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, TCGTBCPUState s)
 
     hash = tb_jmp_cache_hash_func(s.pc);
     jc = cpu->tb_jmp_cache;
-
-    tb = qatomic_read(&jc->array[hash].tb);
-    if (likely(tb &&
-               jc->array[hash].pc == s.pc &&
-               tb->cs_base == s.cs_base &&
-               tb->flags == s.flags &&
-               tb_cflags(tb) == s.cflags)) {
-        goto hit;
+    way = jc->array[hash].way;
+
+    for (int i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        tb = qatomic_read(&way[i].tb);
+        if (likely(tb &&
+                   way[i].pc == s.pc &&
+                   tb->cs_base == s.cs_base &&
+                   tb->flags == s.flags &&
+                   tb_cflags(tb) == s.cflags)) {
+            if (i > 0) {
+                tb_jmp_cache_promote(jc, hash, i, s.pc, tb);
+            }
+            qatomic_set(&jc->hit_count, jc->hit_count + 1);
+            goto hit;
+        }
     }
 
+    qatomic_set(&jc->miss_count, jc->miss_count + 1);
     tb = tb_htable_lookup(cpu, s);
     if (tb == NULL) {
         return NULL;
     }
 
-    jc->array[hash].pc = s.pc;
-    qatomic_set(&jc->array[hash].tb, tb);
+    tb_jmp_cache_insert(jc, hash, s.pc, tb);
 
 hit:
     /*
@@ -958,8 +966,7 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  */
                 h = tb_jmp_cache_hash_func(s.pc);
                 jc = cpu->tb_jmp_cache;
-                jc->array[h].pc = s.pc;
-                qatomic_set(&jc->array[h].tb, tb);
+                tb_jmp_cache_insert(jc, h, s.pc, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
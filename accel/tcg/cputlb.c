@@ -159,7 +159,7 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
 
     i0 = tb_jmp_cache_hash_page(page_addr);
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&jc->array[i0 + i].tb, NULL);
+        tb_jmp_cache_clear(jc, i0 + i);
     }
 }
 
@@ -281,8 +281,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
-    desc->large_page_addr = -1;
-    desc->large_page_mask = -1;
+    memset(desc->large_page, -1, sizeof(desc->large_page));
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -349,21 +348,109 @@ void tlb_destroy(CPUState *cpu)
     }
 }
 
-/* flush_all_helper: run fn across all cpus
+typedef CPUTLBFlushRange TLBFlushRangeData;
+
+static void tlb_flush_by_mmuidx_async_work(CPUState *cpu,
+                                           run_on_cpu_data data);
+static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
+                                              TLBFlushRangeData d);
+
+/* Apply the flushes that other CPUs requested from @cpu until now */
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    TLBFlushRangeData ranges[CPU_TLB_PENDING_RANGES];
+    uint16_t full;
+    unsigned i, n;
+
+    qemu_spin_lock(&c->lock);
+    full = c->pending_full;
+    n = c->pending_n;
+    memcpy(ranges, c->pending, n * sizeof(ranges[0]));
+    c->pending_full = 0;
+    c->pending_n = 0;
+    c->pending_queued = false;
+    qemu_spin_unlock(&c->lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        ranges[i].idxmap &= ~full;
+        if (ranges[i].idxmap) {
+            tlb_flush_range_by_mmuidx_async_0(cpu, ranges[i]);
+        }
+    }
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_pending_add_range_locked(CPUTLBCommon *c,
+                                               const TLBFlushRangeData *r)
+{
+    unsigned i;
+
+    for (i = 0; i < c->pending_n; i++) {
+        TLBFlushRangeData *p = &c->pending[i];
+
+        if (p->idxmap == r->idxmap && p->bits == r->bits &&
+            r->addr <= p->addr + p->len && p->addr <= r->addr + r->len) {
+            vaddr end = MAX(p->addr + p->len, r->addr + r->len);
+
+            p->addr = MIN(p->addr, r->addr);
+            p->len = end - p->addr;
+            return;
+        }
+    }
+
+    if (c->pending_n < CPU_TLB_PENDING_RANGES) {
+        c->pending[c->pending_n++] = *r;
+        return;
+    }
+
+    /* Too many distinct ranges already; flush these mmu_idx entirely */
+    c->pending_full |= r->idxmap;
+}
+
+/*
+ * tlb_flush_post_all: request a flush from all cpus but @src
  *
- * If the wait flag is set then the src cpu's helper will be queued as
- * "safe" work and the loop exited creating a synchronisation point
- * where all queued work will be finished before execution starts
+ * The flush is of the mmu_idx in @full entirely if @r is NULL, else of
+ * the range @r.  Requests are merged with those that a cpu has not
+ * applied yet, so that a series of them costs one run_on_cpu work and
+ * one walk per distinct range.  All are applied before @src's own flush,
+ * which the caller queues as "safe" work, creating a synchronisation
+ * point where all queued work will be finished before execution starts
  * again.
  */
-static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
-                             run_on_cpu_data d)
+static void tlb_flush_post_all(CPUState *src, uint16_t full,
+                               const TLBFlushRangeData *r)
 {
     CPUState *cpu;
 
     CPU_FOREACH(cpu) {
-        if (cpu != src) {
-            async_run_on_cpu(cpu, fn, d);
+        CPUTLBCommon *c = &cpu->neg.tlb.c;
+        bool queue;
+
+        if (cpu == src) {
+            continue;
+        }
+
+        qemu_spin_lock(&c->lock);
+        if (r) {
+            tlb_flush_pending_add_range_locked(c, r);
+        } else {
+            c->pending_full |= full;
+        }
+        queue = !c->pending_queued;
+        c->pending_queued = true;
+        if (!queue) {
+            qatomic_set(&c->merged_flush_count, c->merged_flush_count + 1);
+        }
+        qemu_spin_unlock(&c->lock);
+
+        if (queue) {
+            async_run_on_cpu(cpu, tlb_flush_pending_async_work,
+                             RUN_ON_CPU_NULL);
         }
     }
 }
@@ -428,7 +515,7 @@ void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, uint16_t idxmap)
 
     tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
 
-    flush_all_helper(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
+    tlb_flush_post_all(src_cpu, idxmap, NULL);
     async_safe_run_on_cpu(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
 }
 
@@ -501,23 +588,64 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
-static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
+/*
+ * Flush the large page regions that overlap [@addr, @addr + @len).
+ * Each region is flushed page by page and released, unless it is
+ * larger than the tlb: then the whole mmu_idx is flushed and we
+ * return true.
+ */
+static bool tlb_flush_large_pages_locked(CPUState *cpu, int midx,
+                                         vaddr addr, vaddr len)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
-    vaddr lp_mask = cpu->neg.tlb.d[midx].large_page_mask;
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
+    vaddr last = addr + len - 1;
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d (%016"
+    for (int i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+        vaddr lp_addr = lp->addr;
+        vaddr lp_len = ~lp->mask + 1;
+
+        if (lp_addr == (vaddr)-1 ||
+            last < lp_addr || addr > (lp_addr | ~lp->mask)) {
+            continue;
+        }
+
+        if (lp_len == 0 || (lp_len >> TARGET_PAGE_BITS) > tlb_n_entries(f)) {
+            tlb_debug("forcing full flush midx %d (%016"
+                      VADDR_PRIx "/%016" VADDR_PRIx ")\n",
+                      midx, lp_addr, lp->mask);
+            tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+            return true;
+        }
+
+        tlb_debug("flushing large page midx %d (%016"
                   VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
-            tlb_n_used_entries_dec(cpu, midx);
+                  midx, lp_addr, lp->mask);
+        lp->addr = -1;
+        lp->mask = -1;
+        for (vaddr j = 0; j < lp_len; j += TARGET_PAGE_SIZE) {
+            vaddr page = lp_addr + j;
+
+            if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+            tlb_flush_vtlb_page_locked(cpu, midx, page);
         }
-        tlb_flush_vtlb_page_locked(cpu, midx, page);
     }
+    return false;
+}
+
+static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
+{
+    /* Check if we need to flush due to large pages.  */
+    if (tlb_flush_large_pages_locked(cpu, midx, page, TARGET_PAGE_SIZE)) {
+        return;
+    }
+    if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
+        tlb_n_used_entries_dec(cpu, midx);
+    }
+    tlb_flush_vtlb_page_locked(cpu, midx, page);
 }
 
 /**
@@ -620,35 +748,29 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               vaddr addr,
                                               uint16_t idxmap)
 {
+    TLBFlushRangeData r;
+
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    r.addr = addr;
+    r.len = TARGET_PAGE_SIZE;
+    r.idxmap = idxmap;
+    r.bits = target_long_bits();
+    tlb_flush_post_all(src_cpu, 0, &r);
+
     /*
      * Allocate memory to hold addr+idxmap only when needed.
      * See tlb_flush_page_by_mmuidx for details.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
         TLBFlushPageByMMUIdxData *d;
 
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
-
         d = g_new(TLBFlushPageByMMUIdxData, 1);
         d->addr = addr;
         d->idxmap = idxmap;
@@ -666,7 +788,6 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
                                    vaddr addr, vaddr len,
                                    unsigned bits)
 {
-    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
     CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
     vaddr mask = MAKE_64BIT_MASK(0, bits);
 
@@ -688,16 +809,8 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         return;
     }
 
-    /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
-     */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+    /* Check if we need to flush due to large pages.  */
+    if (tlb_flush_large_pages_locked(cpu, midx, addr, len)) {
         return;
     }
 
@@ -712,13 +825,6 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
     }
 }
 
-typedef struct {
-    vaddr addr;
-    vaddr len;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushRangeData;
-
 static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
                                               TLBFlushRangeData d)
 {
@@ -809,7 +915,6 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                unsigned bits)
 {
     TLBFlushRangeData d, *p;
-    CPUState *dst_cpu;
 
     /* If no page bits are significant, this devolves to tlb_flush. */
     if (bits < TARGET_PAGE_BITS) {
@@ -831,14 +936,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
-    CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
-            p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
-        }
-    }
+    tlb_flush_post_all(src_cpu, 0, &d);
 
     p = g_memdup(&d, sizeof(d));
     async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
@@ -977,23 +1075,43 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
 static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
                                vaddr addr, uint64_t size)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[mmu_idx].large_page_addr;
+    CPUTLBLargePage *lp = cpu->neg.tlb.d[mmu_idx].large_page;
     vaddr lp_mask = ~(size - 1);
+    vaddr best_mask = 0;
+    int i, free = -1, best = 0;
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        vaddr mask;
 
-    if (lp_addr == (vaddr)-1) {
-        /* No previous large page.  */
-        lp_addr = addr;
+        if (lp[i].addr == (vaddr)-1) {
+            free = i;
+            continue;
+        }
+        mask = lp_mask & lp[i].mask;
+        while (((lp[i].addr ^ addr) & mask) != 0) {
+            mask <<= 1;
+        }
+        if (mask == lp[i].mask) {
+            /* Already covered by this region.  */
+            return;
+        }
+        if (mask > best_mask) {
+            best = i;
+            best_mask = mask;
+        }
+    }
+
+    if (free >= 0) {
+        /* Track the new page in a region of its own.  */
+        lp[free].addr = addr & lp_mask;
+        lp[free].mask = lp_mask;
     } else {
-        /* Extend the existing region to include the new page.
+        /* Extend the region that grows least to include the new page.
            This is a compromise between unnecessary flushes and
            the cost of maintaining a full variable size TLB.  */
-        lp_mask &= cpu->neg.tlb.d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ addr) & lp_mask) != 0) {
-            lp_mask <<= 1;
-        }
+        lp[best].addr &= best_mask;
+        lp[best].mask = best_mask;
     }
-    cpu->neg.tlb.d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    cpu->neg.tlb.d[mmu_idx].large_page_mask = lp_mask;
 }
 
 static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
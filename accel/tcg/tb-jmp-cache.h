@@ -14,6 +14,12 @@
 
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+/*
+ * Each hash bucket holds the most recently used TBs for any of its PCs,
+ * so that indirect branches alternating between two targets that hash
+ * alike do not evict each other.
+ */
+#define TB_JMP_CACHE_WAYS 2
 
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
@@ -21,13 +27,60 @@
  * no need for qatomic_rcu_read() and pc is always consistent with a
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
+ *
+ * Entries may move between the ways of a bucket while a TB is being
+ * invalidated and thus survive; lookups never match them because
+ * CF_INVALID is part of the compared cflags.
  */
+typedef struct CPUJumpCacheEntry {
+    TranslationBlock *tb;
+    vaddr pc;
+} CPUJumpCacheEntry;
+
 typedef struct CPUJumpCache {
     struct rcu_head rcu;
+    /* Lookups found in the cache and not, written by the owning CPU only */
+    size_t hit_count;
+    size_t miss_count;
     struct {
-        TranslationBlock *tb;
-        vaddr pc;
+        /* Most recently used first */
+        CPUJumpCacheEntry way[TB_JMP_CACHE_WAYS];
     } array[TB_JMP_CACHE_SIZE];
 } CPUJumpCache;
 
+/*
+ * tb_jmp_cache_promote: make @tb the most recently used TB of bucket @h,
+ * replacing the entry in way @n
+ */
+static inline void tb_jmp_cache_promote(CPUJumpCache *jc, uint32_t h, int n,
+                                        vaddr pc, TranslationBlock *tb)
+{
+    CPUJumpCacheEntry *way = jc->array[h].way;
+
+    for (int i = n; i > 0; i--) {
+        way[i].pc = way[i - 1].pc;
+        qatomic_set(&way[i].tb, qatomic_read(&way[i - 1].tb));
+    }
+    way[0].pc = pc;
+    qatomic_set(&way[0].tb, tb);
+}
+
+/*
+ * tb_jmp_cache_insert: make @tb the most recently used TB of bucket @h,
+ * evicting the least recently used one
+ */
+static inline void tb_jmp_cache_insert(CPUJumpCache *jc, uint32_t h,
+                                       vaddr pc, TranslationBlock *tb)
+{
+    tb_jmp_cache_promote(jc, h, TB_JMP_CACHE_WAYS - 1, pc, tb);
+}
+
+/* tb_jmp_cache_clear: drop all TBs of bucket @h */
+static inline void tb_jmp_cache_clear(CPUJumpCache *jc, uint32_t h)
+{
+    for (int i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        qatomic_set(&jc->array[h].way[i].tb, NULL);
+    }
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
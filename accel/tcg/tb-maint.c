@@ -891,8 +891,10 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
         CPU_FOREACH(cpu) {
             CPUJumpCache *jc = cpu->tb_jmp_cache;
 
-            if (qatomic_read(&jc->array[h].tb) == tb) {
-                qatomic_set(&jc->array[h].tb, NULL);
+            for (int i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+                if (qatomic_read(&jc->array[h].way[i].tb) == tb) {
+                    qatomic_set(&jc->array[h].way[i].tb, NULL);
+                }
             }
         }
     }
@@ -16,6 +16,7 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 #include <math.h>
 
 static void dump_drift_info(GString *buf)
@@ -132,34 +133,63 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                             size_t *pmerged)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, merged = 0;
 
     CPU_FOREACH(cpu) {
         full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
         part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
         elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        merged += qatomic_read(&cpu->neg.tlb.c.merged_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *pmerged = merged;
+}
+
+static void tb_jmp_cache_counts(size_t *phit, size_t *pmiss)
+{
+    CPUState *cpu;
+    size_t hit = 0, miss = 0;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->tb_jmp_cache) {
+            hit += qatomic_read(&cpu->tb_jmp_cache->hit_count);
+            miss += qatomic_read(&cpu->tb_jmp_cache->miss_count);
+        }
+    }
+    *phit = hit;
+    *pmiss = miss;
 }
 
 static void tcg_dump_flush_info(GString *buf)
 {
-    size_t flush_full, flush_part, flush_elide;
+    size_t flush_full, flush_part, flush_elide, flush_merged;
 
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide, &flush_merged);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB merged flushes  %zu\n", flush_merged);
+}
+
+static void tcg_dump_jmp_cache_info(GString *buf)
+{
+    size_t hit, miss;
+
+    tb_jmp_cache_counts(&hit, &miss);
+    g_string_append_printf(buf, "TB jmp cache hits   %zu (%zu%%)\n", hit,
+                           hit + miss ? hit * 100 / (hit + miss) : 0);
+    g_string_append_printf(buf, "TB jmp cache misses %zu\n", miss);
 }
 
 static void dump_exec_info(GString *buf)
@@ -204,6 +234,7 @@ static void dump_exec_info(GString *buf)
 
     g_string_append_printf(buf, "\nStatistics:\n");
     tcg_dump_flush_info(buf);
+    tcg_dump_jmp_cache_info(buf);
 }
 
 void tcg_get_stats(AccelState *accel, GString *buf)
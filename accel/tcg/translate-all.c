@@ -628,6 +628,6 @@ void tcg_flush_jmp_cache(CPUState *cpu)
     }
 
     for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&jc->array[i].tb, NULL);
+        tb_jmp_cache_clear(jc, i);
     }
 }
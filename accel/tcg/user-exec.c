@@ -24,6 +24,7 @@
 #include "tcg/tcg.h"
 #include "qemu/bitops.h"
 #include "qemu/rcu.h"
+#include "qemu/seqlock.h"
 #include "accel/tcg/cpu-ldst-common.h"
 #include "accel/tcg/helper-retaddr.h"
 #include "accel/tcg/probe.h"
@@ -160,6 +161,13 @@ typedef struct PageFlagsNode {
 
 static IntervalTreeRoot pageflags_root;
 
+/*
+ * Bumped around every modification of pageflags_root, which happens
+ * with the mmap lock held.  A lockless lookup that finds nothing is
+ * exact if no modification overlapped it.
+ */
+static QemuSeqLock pageflags_seq;
+
 static PageFlagsNode *pageflags_find(vaddr start, vaddr last)
 {
     IntervalTreeNode *n;
@@ -231,17 +239,19 @@ void page_dump(FILE *f)
 
 int page_get_flags(vaddr address)
 {
+    unsigned seq = seqlock_read_begin(&pageflags_seq);
     PageFlagsNode *p = pageflags_find(address, address);
 
     /*
      * See util/interval-tree.c re lockless lookups: no false positives but
-     * there are false negatives.  If we find nothing, retry with the mmap
-     * lock acquired.
+     * there are false negatives while the tree is modified.  If we find
+     * nothing and the tree may have changed meanwhile, retry with the
+     * mmap lock acquired.
      */
     if (p) {
         return p->flags;
     }
-    if (have_mmap_lock()) {
+    if (have_mmap_lock() || !seqlock_read_retry(&pageflags_seq, seq)) {
         return 0;
     }
 
@@ -525,6 +535,7 @@ void page_set_flags(vaddr start, vaddr last, int flags)
         }
     }
 
+    seqlock_write_begin(&pageflags_seq);
     if (!flags || reset) {
         page_reset_target_data(start, last);
         inval_tb |= pageflags_unset(start, last);
@@ -533,6 +544,7 @@ void page_set_flags(vaddr start, vaddr last, int flags)
         inval_tb |= pageflags_set_clear(start, last, flags,
                                         ~(reset ? 0 : PAGE_STICKY));
     }
+    seqlock_write_end(&pageflags_seq);
     if (inval_tb) {
         tb_invalidate_phys_range(NULL, start, last);
     }
@@ -555,14 +567,15 @@ bool page_check_range(vaddr start, vaddr len, int flags)
 
     locked = have_mmap_lock();
     while (true) {
+        unsigned seq = seqlock_read_begin(&pageflags_seq);
         PageFlagsNode *p = pageflags_find(start, last);
         int missing;
 
         if (!p) {
-            if (!locked) {
+            if (!locked && seqlock_read_retry(&pageflags_seq, seq)) {
                 /*
-                 * Lockless lookups have false negatives.
-                 * Retry with the lock held.
+                 * Lockless lookups have false negatives while the
+                 * tree is modified.  Retry with the lock held.
                  */
                 mmap_lock();
                 locked = -1;
@@ -695,7 +708,9 @@ void tb_lock_page0(tb_page_addr_t address)
     }
 
     if (prot & PAGE_WRITE) {
+        seqlock_write_begin(&pageflags_seq);
         pageflags_set_clear(start, last, 0, PAGE_WRITE);
+        seqlock_write_end(&pageflags_seq);
         mprotect(g2h_untagged(start), last - start + 1,
                  prot & (PAGE_READ | PAGE_EXEC) ? PROT_READ : PROT_NONE);
     }
@@ -752,7 +767,9 @@ int page_unprotect(CPUState *cpu, tb_page_addr_t address, uintptr_t pc)
             start = address & TARGET_PAGE_MASK;
             len = TARGET_PAGE_SIZE;
             prot = p->flags | PAGE_WRITE;
+            seqlock_write_begin(&pageflags_seq);
             pageflags_set_clear(start, start + len - 1, PAGE_WRITE, 0);
+            seqlock_write_end(&pageflags_seq);
             current_tb_invalidated =
                 tb_invalidate_phys_page_unwind(cpu, start, pc);
         } else {
@@ -768,8 +785,10 @@ int page_unprotect(CPUState *cpu, tb_page_addr_t address, uintptr_t pc)
                     prot |= p->flags;
                     if (p->flags & PAGE_WRITE_ORG) {
                         prot |= PAGE_WRITE;
+                        seqlock_write_begin(&pageflags_seq);
                         pageflags_set_clear(addr, addr + TARGET_PAGE_SIZE - 1,
                                             PAGE_WRITE, 0);
+                        seqlock_write_end(&pageflags_seq);
                     }
                 }
                 /*
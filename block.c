@@ -5656,9 +5656,13 @@ fail:
  * Returns 0 if the check could be completed (it doesn't mean that the image is
  * free of errors) or -errno when an internal error occurred. The results of the
  * check are stored in res.
+ *
+ * @parallel is the number of metadata requests that the driver may issue
+ * concurrently while checking; drivers are free to ignore it.
  */
 int coroutine_fn bdrv_co_check(BlockDriverState *bs,
-                               BdrvCheckResult *res, BdrvCheckMode fix)
+                               BdrvCheckResult *res, BdrvCheckMode fix,
+                               int parallel)
 {
     IO_CODE();
     assert_bdrv_graph_readable();
@@ -5669,8 +5673,9 @@ int coroutine_fn bdrv_co_check(BlockDriverState *bs,
         return -ENOTSUP;
     }
 
+    assert(parallel > 0);
     memset(res, 0, sizeof(*res));
-    return bs->drv->bdrv_co_check(bs, res, fix);
+    return bs->drv->bdrv_co_check(bs, res, fix, parallel);
 }
 
 /*
@@ -26,6 +26,7 @@
 #include "qemu/osdep.h"
 #include "block/accounting.h"
 #include "block/block_int.h"
+#include "qemu/host-utils.h"
 #include "qemu/timer.h"
 #include "system/qtest.h"
 
@@ -68,9 +69,21 @@ void block_acct_setup(BlockAcctStats *stats, enum OnOffAuto account_invalid,
 void block_acct_cleanup(BlockAcctStats *stats)
 {
     BlockAcctTimedStats *s, *next;
+    BlockAcctLatencyHdr *hdr, *hdr_next;
+
     QSLIST_FOREACH_SAFE(s, &stats->intervals, entries, next) {
         g_free(s);
     }
+    for (hdr = stats->latency_hdr; hdr; hdr = hdr_next) {
+        int type;
+
+        hdr_next = hdr->next;
+        for (type = 0; type < BLOCK_MAX_IOTYPE; type++) {
+            g_free(hdr->bins[type]);
+        }
+        g_free(hdr);
+    }
+    stats->latency_hdr = NULL;
     qemu_mutex_destroy(&stats->lock);
 }
 
@@ -200,6 +213,84 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
     }
 }
 
+static unsigned block_acct_latency_hdr_index(uint64_t latency_ns)
+{
+    unsigned msb;
+
+    if (latency_ns < (2 << BLOCK_ACCT_HDR_SUB_BITS)) {
+        return latency_ns;
+    }
+
+    msb = 63 - clz64(latency_ns);
+    if (msb >= BLOCK_ACCT_HDR_MAX_BITS) {
+        return BLOCK_ACCT_HDR_OVERFLOW;
+    }
+
+    /* The top BLOCK_ACCT_HDR_SUB_BITS + 1 bits select the bucket */
+    return ((msb - BLOCK_ACCT_HDR_SUB_BITS) << BLOCK_ACCT_HDR_SUB_BITS) +
+           (latency_ns >> (msb - BLOCK_ACCT_HDR_SUB_BITS));
+}
+
+/* Find or create the histogram for @ctx, without taking stats->lock */
+static BlockAcctLatencyHdr *block_acct_latency_hdr_get(BlockAcctStats *stats,
+                                                       AioContext *ctx)
+{
+    BlockAcctLatencyHdr *head, *hdr, *new_hdr = NULL;
+
+    head = qatomic_load_acquire(&stats->latency_hdr);
+    for (;;) {
+        for (hdr = head; hdr; hdr = hdr->next) {
+            if (hdr->ctx == ctx) {
+                g_free(new_hdr);
+                return hdr;
+            }
+        }
+
+        if (!new_hdr) {
+            new_hdr = g_new0(BlockAcctLatencyHdr, 1);
+            new_hdr->ctx = ctx;
+        }
+        new_hdr->next = head;
+
+        hdr = qatomic_cmpxchg(&stats->latency_hdr, head, new_hdr);
+        if (hdr == head) {
+            return new_hdr;
+        }
+        /* Someone else added a histogram, maybe for @ctx; look again */
+        head = hdr;
+    }
+}
+
+/* Find or create the buckets of row @type of @hdr */
+static Stat64 *block_acct_latency_hdr_row(BlockAcctLatencyHdr *hdr,
+                                          enum BlockAcctType type)
+{
+    Stat64 *row = qatomic_load_acquire(&hdr->bins[type]);
+    Stat64 *old;
+
+    if (likely(row)) {
+        return row;
+    }
+
+    row = g_new0(Stat64, BLOCK_ACCT_HDR_BUCKETS);
+    old = qatomic_cmpxchg(&hdr->bins[type], NULL, row);
+    if (old) {
+        g_free(row);
+        return old;
+    }
+    return row;
+}
+
+BlockAcctLatencyHdr *block_acct_latency_hdr_next(BlockAcctStats *stats,
+                                                 BlockAcctLatencyHdr *hdr)
+{
+    if (hdr == NULL) {
+        return qatomic_load_acquire(&stats->latency_hdr);
+    } else {
+        return hdr->next;
+    }
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
@@ -217,6 +308,14 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
         return;
     }
 
+    if (!failed || stats->account_failed) {
+        BlockAcctLatencyHdr *hdr =
+            block_acct_latency_hdr_get(stats, qemu_get_current_aio_context());
+        Stat64 *row = block_acct_latency_hdr_row(hdr, cookie->type);
+
+        stat64_add(&row[block_acct_latency_hdr_index(latency_ns)], 1);
+    }
+
     WITH_QEMU_LOCK_GUARD(&stats->lock) {
         if (failed) {
             stats->failed_ops[cookie->type]++;
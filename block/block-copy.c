@@ -33,6 +33,7 @@
 #define BLOCK_COPY_MAX_BUFFER (1 * MiB)
 #define BLOCK_COPY_MAX_MEM (128 * MiB)
 #define BLOCK_COPY_MAX_WORKERS 64
+#define BLOCK_COPY_ADAPTIVE_MAX_CHUNK (64 * MiB)
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
@@ -46,6 +47,32 @@ typedef enum {
 
 static coroutine_fn int block_copy_task_entry(AioTask *task);
 
+typedef enum {
+    BLOCK_COPY_ADAPT_HOLD,
+    BLOCK_COPY_ADAPT_GROW_CHUNK,
+    BLOCK_COPY_ADAPT_SHRINK_CHUNK,
+    BLOCK_COPY_ADAPT_GROW_WORKERS,
+    BLOCK_COPY_ADAPT_SHRINK_WORKERS,
+} BlockCopyAdaptStep;
+
+typedef struct BlockCopyAdaptive {
+    /*
+     * Current limits.  Only accessed by the coroutine running
+     * block_copy_dirty_clusters().
+     */
+    int64_t chunk;
+    int workers;
+    BlockCopyAdaptStep last_step;
+    uint64_t prev_bw;       /* bytes per second in the previous epoch */
+    int64_t prev_latency;   /* average request latency in the previous epoch */
+
+    /* Statistics of the current epoch, protected by lock in BlockCopyState */
+    int64_t epoch_start_ns;
+    int64_t epoch_bytes;
+    int64_t epoch_tasks;
+    int64_t epoch_latency_ns;
+} BlockCopyAdaptive;
+
 typedef struct BlockCopyCallState {
     /* Fields initialized in block_copy_async() and never changed. */
     BlockCopyState *s;
@@ -53,6 +80,7 @@ typedef struct BlockCopyCallState {
     int64_t bytes;
     int max_workers;
     int64_t max_chunk;
+    bool adaptive;
     bool ignore_ratelimit;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
@@ -66,6 +94,19 @@ typedef struct BlockCopyCallState {
     /* To reference all call states from BlockCopyState */
     QLIST_ENTRY(BlockCopyCallState) list;
 
+    /*
+     * Block status of the source as found by the last query, reused by
+     * following tasks that start inside it.  Only accessed by the coroutine
+     * running block_copy_dirty_clusters().
+     */
+    int64_t status_offset;
+    int64_t status_bytes;
+    int status_ret;
+    bool status_skip_unallocated;
+
+    /* Chunk size and worker count tuning, if @adaptive */
+    BlockCopyAdaptive adapt;
+
     /*
      * Fields that report information about return values and errors.
      * Protected by lock in BlockCopyState.
@@ -193,7 +234,12 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
     int64_t max_chunk;
 
     QEMU_LOCK_GUARD(&s->lock);
-    max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    if (call_state->adaptive && s->method != COPY_READ_WRITE_CLUSTER) {
+        max_chunk = MIN(call_state->adapt.chunk, s->max_transfer);
+    } else {
+        max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s),
+                                 call_state->max_chunk);
+    }
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -584,6 +630,7 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     BlockCopyState *s = t->s;
     bool error_is_read = false;
     BlockCopyMethod method = t->method;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     int ret = -1;
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -596,6 +643,17 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
             s->method = method;
         }
 
+        /* Zero writes say nothing about the data path, leave them out */
+        if (t->call_state->adaptive && ret == 0 &&
+            t->method != COPY_WRITE_ZEROES) {
+            BlockCopyAdaptive *a = &t->call_state->adapt;
+
+            a->epoch_bytes += t->req.bytes;
+            a->epoch_tasks++;
+            a->epoch_latency_ns +=
+                qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns;
+        }
+
         if (ret < 0) {
             if (!t->call_state->ret) {
                 t->call_state->ret = ret;
@@ -619,22 +677,47 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     return ret;
 }
 
+/*
+ * Return the block status of the source at @offset.  Unlike the task, the
+ * query covers everything up to @end, so that a large unallocated or zero
+ * area costs a single query however many tasks it spans.  *@pnum may
+ * therefore be larger than the task the caller asks for.
+ */
 static coroutine_fn GRAPH_RDLOCK
-int block_copy_block_status(BlockCopyState *s, int64_t offset, int64_t bytes,
-                            int64_t *pnum)
+int block_copy_block_status(BlockCopyState *s, BlockCopyCallState *call_state,
+                            int64_t offset, int64_t end, int64_t *pnum)
 {
     int64_t num;
     BlockDriverState *base;
+    bool skip_unallocated = qatomic_read(&s->skip_unallocated);
     int ret;
 
-    if (qatomic_read(&s->skip_unallocated)) {
-        base = bdrv_backing_chain_next(s->source->bs);
+    if (call_state->status_bytes &&
+        call_state->status_skip_unallocated == skip_unallocated &&
+        offset >= call_state->status_offset &&
+        offset - call_state->status_offset < call_state->status_bytes) {
+        num = call_state->status_offset + call_state->status_bytes - offset;
+        ret = call_state->status_ret;
     } else {
-        base = NULL;
+        if (skip_unallocated) {
+            base = bdrv_backing_chain_next(s->source->bs);
+        } else {
+            base = NULL;
+        }
+
+        ret = bdrv_co_block_status_above(s->source->bs, base, offset,
+                                         MIN(end, s->len) - offset, &num,
+                                         NULL, NULL);
+        if (ret >= 0) {
+            call_state->status_offset = offset;
+            call_state->status_bytes = num;
+            call_state->status_ret = ret;
+            call_state->status_skip_unallocated = skip_unallocated;
+        } else {
+            call_state->status_bytes = 0;
+        }
     }
 
-    ret = bdrv_co_block_status_above(s->source->bs, base, offset, bytes, &num,
-                                     NULL, NULL);
     if (ret < 0 || num < s->cluster_size) {
         /*
          * On error or if failed to obtain large enough chunk just fallback to
@@ -736,6 +819,123 @@ int64_t coroutine_fn block_copy_reset_unallocated(BlockCopyState *s,
     return ret;
 }
 
+/*
+ * Adjust chunk size and worker count of an adaptive call by hill climbing on
+ * its throughput.  Once per BLOCK_COPY_SLICE_TIME, the bandwidth of the last
+ * epoch is compared with the one before:
+ * - if it improved, the last step is repeated (or, if that limit is at its
+ *   bound, the other one is raised): larger chunks first, then more workers
+ * - if it dropped, the last step is undone
+ * - if it stayed about the same but requests got much slower, the target is
+ *   saturated and one more worker only adds queueing delay, so drop some
+ *
+ * Runs in the coroutine of block_copy_dirty_clusters().
+ */
+static void coroutine_fn block_copy_adapt(BlockCopyCallState *call_state)
+{
+    BlockCopyState *s = call_state->s;
+    BlockCopyAdaptive *a = &call_state->adapt;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t max_chunk = MIN_NON_ZERO(call_state->max_chunk,
+                                     BLOCK_COPY_ADAPTIVE_MAX_CHUNK);
+    int worker_step = MAX(1, a->workers / 4);
+    BlockCopyAdaptStep step;
+    uint64_t bw;
+    int64_t latency;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        if (!a->chunk) {
+            /* Start from the static limits */
+            a->chunk = MIN_NON_ZERO(block_copy_chunk_size(s),
+                                    call_state->max_chunk);
+            a->workers = call_state->max_workers;
+            a->epoch_start_ns = now;
+            return;
+        }
+        if (now - a->epoch_start_ns < BLOCK_COPY_SLICE_TIME) {
+            return;
+        }
+        if (a->epoch_tasks < 2) {
+            /* Not enough data yet, e.g. throttled or mostly zeroes */
+            return;
+        }
+
+        bw = a->epoch_bytes * (double)NANOSECONDS_PER_SECOND /
+             (now - a->epoch_start_ns);
+        latency = a->epoch_latency_ns / a->epoch_tasks;
+
+        a->epoch_start_ns = now;
+        a->epoch_bytes = 0;
+        a->epoch_tasks = 0;
+        a->epoch_latency_ns = 0;
+    }
+
+    if (!a->prev_bw) {
+        step = BLOCK_COPY_ADAPT_GROW_CHUNK;
+    } else if (bw > a->prev_bw + a->prev_bw / 16) {
+        switch (a->last_step) {
+        case BLOCK_COPY_ADAPT_GROW_WORKERS:
+            step = a->workers < call_state->max_workers ?
+                BLOCK_COPY_ADAPT_GROW_WORKERS : BLOCK_COPY_ADAPT_GROW_CHUNK;
+            break;
+        case BLOCK_COPY_ADAPT_HOLD:
+        case BLOCK_COPY_ADAPT_GROW_CHUNK:
+            step = a->chunk < max_chunk ?
+                BLOCK_COPY_ADAPT_GROW_CHUNK : BLOCK_COPY_ADAPT_GROW_WORKERS;
+            break;
+        default:
+            /* Shrinking helped, stay here */
+            step = BLOCK_COPY_ADAPT_HOLD;
+            break;
+        }
+    } else if (bw < a->prev_bw - a->prev_bw / 16) {
+        switch (a->last_step) {
+        case BLOCK_COPY_ADAPT_GROW_CHUNK:
+            step = BLOCK_COPY_ADAPT_SHRINK_CHUNK;
+            break;
+        case BLOCK_COPY_ADAPT_SHRINK_CHUNK:
+            step = BLOCK_COPY_ADAPT_GROW_CHUNK;
+            break;
+        case BLOCK_COPY_ADAPT_GROW_WORKERS:
+            step = BLOCK_COPY_ADAPT_SHRINK_WORKERS;
+            break;
+        case BLOCK_COPY_ADAPT_SHRINK_WORKERS:
+            step = BLOCK_COPY_ADAPT_GROW_WORKERS;
+            break;
+        default:
+            step = BLOCK_COPY_ADAPT_HOLD;
+            break;
+        }
+    } else if (latency > a->prev_latency + a->prev_latency / 2) {
+        step = BLOCK_COPY_ADAPT_SHRINK_WORKERS;
+    } else {
+        step = BLOCK_COPY_ADAPT_HOLD;
+    }
+
+    switch (step) {
+    case BLOCK_COPY_ADAPT_GROW_CHUNK:
+        a->chunk = MIN(a->chunk * 2, max_chunk);
+        break;
+    case BLOCK_COPY_ADAPT_SHRINK_CHUNK:
+        a->chunk = MAX(a->chunk / 2, s->cluster_size);
+        break;
+    case BLOCK_COPY_ADAPT_GROW_WORKERS:
+        a->workers = MIN(a->workers + worker_step, call_state->max_workers);
+        break;
+    case BLOCK_COPY_ADAPT_SHRINK_WORKERS:
+        a->workers = MAX(a->workers - worker_step, 1);
+        break;
+    default:
+        break;
+    }
+
+    a->last_step = step;
+    a->prev_bw = bw;
+    a->prev_latency = latency;
+
+    trace_block_copy_adapt(s, bw, latency, a->chunk, a->workers);
+}
+
 /*
  * block_copy_dirty_clusters
  *
@@ -765,11 +965,18 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
     assert(QEMU_IS_ALIGNED(offset, s->cluster_size));
     assert(QEMU_IS_ALIGNED(bytes, s->cluster_size));
 
+    /* The source may have changed since the last pass */
+    call_state->status_bytes = 0;
+
     while (bytes && aio_task_pool_status(aio) == 0 &&
            !qatomic_read(&call_state->cancelled)) {
         BlockCopyTask *task;
         int64_t status_bytes;
 
+        if (call_state->adaptive) {
+            block_copy_adapt(call_state);
+        }
+
         task = block_copy_task_create(s, call_state, offset, bytes);
         if (!task) {
             /* No more dirty bits in the bitmap */
@@ -782,7 +989,7 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
 
         found_dirty = true;
 
-        ret = block_copy_block_status(s, task->req.offset, task->req.bytes,
+        ret = block_copy_block_status(s, call_state, task->req.offset, end,
                                       &status_bytes);
         assert(ret >= 0); /* never fail */
         if (status_bytes < task->req.bytes) {
@@ -793,6 +1000,15 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
             block_copy_task_end(task, 0);
             trace_block_copy_skip_range(s, task->req.offset, task->req.bytes);
             offset = task_end(task);
+
+            /* Drop the rest of the unallocated area in one go */
+            status_bytes = MIN(task->req.offset + status_bytes, end) - offset;
+            if (status_bytes > 0) {
+                block_copy_reset(s, offset, status_bytes);
+                trace_block_copy_skip_range(s, offset, status_bytes);
+                offset += status_bytes;
+            }
+
             bytes = end - offset;
             g_free(task);
             continue;
@@ -824,6 +1040,9 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         if (!aio && bytes) {
             aio = aio_task_pool_new(call_state->max_workers);
         }
+        if (aio && call_state->adaptive) {
+            aio_task_pool_set_max_busy_tasks(aio, call_state->adapt.workers);
+        }
 
         ret = block_copy_task_run(aio, task);
         if (ret < 0) {
@@ -972,6 +1191,7 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t start, int64_t bytes,
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque)
 {
@@ -983,6 +1203,7 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .adaptive = adaptive,
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -33,6 +33,8 @@
 struct BdrvDirtyBitmap {
     BlockDriverState *bs;
     HBitmap *bitmap;            /* Dirty bitmap implementation */
+    int meta_chunk_size;        /* Bits of @bitmap per meta bit, 0 if there is
+                                   no meta bitmap tracking changes */
     bool busy;                  /* Bitmap is busy, it can't be used via QMP */
     BdrvDirtyBitmap *successor; /* Anonymous child, if any. */
     char *name;                 /* Optional non-empty unique ID */
@@ -260,6 +262,9 @@ static void bdrv_release_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap)
     assert(!bdrv_dirty_bitmap_busy(bitmap));
     assert(!bdrv_dirty_bitmap_has_successor(bitmap));
     QLIST_REMOVE(bitmap, list);
+    if (bitmap->meta_chunk_size) {
+        hbitmap_free_meta(bitmap->bitmap);
+    }
     hbitmap_free(bitmap->bitmap);
     g_free(bitmap->name);
     g_free(bitmap);
@@ -571,6 +576,23 @@ void bdrv_reset_dirty_bitmap(BdrvDirtyBitmap *bitmap,
     bdrv_dirty_bitmaps_unlock(bitmap->bs);
 }
 
+/*
+ * Called after bitmap->bitmap has been replaced by a new HBitmap: move the
+ * meta bitmap from @old and mark everything as changed.
+ */
+static void bdrv_dirty_bitmap_move_meta(BdrvDirtyBitmap *bitmap, HBitmap *old)
+{
+    HBitmap *meta;
+
+    if (!bitmap->meta_chunk_size) {
+        return;
+    }
+
+    hbitmap_free_meta(old);
+    meta = hbitmap_create_meta(bitmap->bitmap, bitmap->meta_chunk_size);
+    hbitmap_set(meta, 0, bitmap->size);
+}
+
 void bdrv_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap **out)
 {
     IO_CODE();
@@ -582,6 +604,7 @@ void bdrv_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap **out)
         HBitmap *backup = bitmap->bitmap;
         bitmap->bitmap = hbitmap_alloc(bitmap->size,
                                        hbitmap_granularity(backup));
+        bdrv_dirty_bitmap_move_meta(bitmap, backup);
         *out = backup;
     }
     bdrv_dirty_bitmaps_unlock(bitmap->bs);
@@ -593,9 +616,72 @@ void bdrv_restore_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap *backup)
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     GLOBAL_STATE_CODE();
     bitmap->bitmap = backup;
+    bdrv_dirty_bitmap_move_meta(bitmap, tmp);
     hbitmap_free(tmp);
 }
 
+/**
+ * bdrv_create_meta_dirty_bitmap:
+ * @chunk_size: how many bytes of serialized bitmap data one bit of the meta
+ *              bitmap covers.  Must be a power of two.
+ *
+ * Start tracking which parts of @bitmap change.  This is used to write back
+ * only the modified parts of a persistent bitmap.
+ */
+void bdrv_create_meta_dirty_bitmap(BdrvDirtyBitmap *bitmap, int chunk_size)
+{
+    assert(chunk_size > 0 && !(chunk_size & (chunk_size - 1)));
+    assert(!bitmap->meta_chunk_size);
+
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    bitmap->meta_chunk_size = chunk_size * BITS_PER_BYTE;
+    hbitmap_create_meta(bitmap->bitmap, bitmap->meta_chunk_size);
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
+}
+
+void bdrv_release_meta_dirty_bitmap(BdrvDirtyBitmap *bitmap)
+{
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    if (bitmap->meta_chunk_size) {
+        hbitmap_free_meta(bitmap->bitmap);
+        bitmap->meta_chunk_size = 0;
+    }
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
+}
+
+bool bdrv_dirty_bitmap_has_meta(const BdrvDirtyBitmap *bitmap)
+{
+    return bitmap->meta_chunk_size;
+}
+
+/*
+ * Return true if any bit of @bitmap in [@offset, @offset + @bytes) changed
+ * since the meta bitmap was created or last reset.
+ */
+bool bdrv_dirty_bitmap_get_meta(BdrvDirtyBitmap *bitmap,
+                                int64_t offset, int64_t bytes)
+{
+    HBitmap *meta;
+    bool dirty;
+
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    assert(bitmap->meta_chunk_size);
+    meta = hbitmap_meta(bitmap->bitmap);
+    dirty = hbitmap_next_dirty(meta, offset, bytes) >= 0;
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
+
+    return dirty;
+}
+
+void bdrv_dirty_bitmap_reset_meta(BdrvDirtyBitmap *bitmap,
+                                  int64_t offset, int64_t bytes)
+{
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    assert(bitmap->meta_chunk_size);
+    hbitmap_reset(hbitmap_meta(bitmap->bitmap), offset, bytes);
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
+}
+
 uint64_t bdrv_dirty_bitmap_serialization_size(const BdrvDirtyBitmap *bitmap,
                                               uint64_t offset, uint64_t bytes)
 {
@@ -795,6 +881,14 @@ bool bdrv_dirty_bitmap_next_dirty_area(BdrvDirtyBitmap *bitmap,
                                    dirty_start, dirty_count);
 }
 
+int bdrv_dirty_bitmap_next_dirty_extents(BdrvDirtyBitmap *bitmap,
+        int64_t start, int64_t end, int64_t max_dirty_count,
+        HBitmapExtent *extents, int nb_extents)
+{
+    return hbitmap_next_dirty_extents(bitmap->bitmap, start, end,
+                                      max_dirty_count, extents, nb_extents);
+}
+
 bool bdrv_dirty_bitmap_status(BdrvDirtyBitmap *bitmap, int64_t offset,
                               int64_t bytes, int64_t *count)
 {
@@ -876,6 +970,7 @@ void bdrv_dirty_bitmap_merge_internal(BdrvDirtyBitmap *dest,
     if (backup) {
         *backup = dest->bitmap;
         dest->bitmap = hbitmap_alloc(dest->size, hbitmap_granularity(*backup));
+        bdrv_dirty_bitmap_move_meta(dest, *backup);
         hbitmap_merge(*backup, src->bitmap, dest->bitmap);
     } else {
         hbitmap_merge(dest->bitmap, src->bitmap, dest->bitmap);
@@ -36,6 +36,7 @@
 #include "block/thread-pool.h"
 #include "qemu/iov.h"
 #include "block/raw-aio.h"
+#include "system/memory.h" /* for ram_block_discard_disable() */
 #include "qobject/qdict.h"
 #include "qobject/qstring.h"
 
@@ -79,6 +80,10 @@
 #include <linux/hdreg.h>
 #include <linux/magic.h>
 #include <scsi/sg.h>
+#ifdef HAVE_NVME_URING_CMD
+#include <linux/nvme_ioctl.h>
+#include "block/nvme.h"
+#endif
 #ifdef __s390__
 #include <asm/dasd.h>
 #endif
@@ -156,6 +161,14 @@
  */
 #define SG_IO_MAX_RETRIES 8
 
+/*
+ * Limits for NVMe passthrough requests.  The kernel rejects requests that
+ * exceed the limits of the request queue, which can't be queried through
+ * the generic character device, so stay below the NVMe driver's maximums.
+ */
+#define NVME_URING_MAX_TRANSFER (4 * MiB)
+#define NVME_URING_MAX_SEGS     127
+
 typedef struct BDRVRawState {
     int fd;
     bool use_lock;
@@ -183,8 +196,18 @@ typedef struct BDRVRawState {
     bool use_linux_aio:1;
     bool has_laio_fdsync:1;
     bool use_linux_io_uring:1;
+    /* Buffers are registered as io_uring fixed buffers (aio=io_uring) */
+    bool use_luring_bufs:1;
     bool use_mpath:1;
+    /* NVMe generic character device, accessed with io_uring passthrough */
+    bool use_nvme_uring_cmd:1;
+    bool nvme_write_zeroes:1;
     int page_cache_inconsistent; /* errno from fdatasync failure */
+    /*
+     * struct iovec of buffers registered with luring_register_buf(); RAM
+     * discards are disabled while it is not empty
+     */
+    GArray *luring_bufs;
     bool has_fallocate;
     bool needs_alignment;
     bool force_alignment;
@@ -197,6 +220,11 @@ typedef struct BDRVRawState {
     } stats;
 
     PRManager *pr_mgr;
+
+    uint32_t nvme_nsid;
+    int nvme_blkshift;
+    uint64_t nvme_nsze;
+    uint32_t nvme_max_transfer;
 } BDRVRawState;
 
 typedef struct BDRVRawReopenState {
@@ -424,8 +452,9 @@ static void raw_probe_alignment(BlockDriverState *bs, int fd, Error **errp)
     size_t alignments[] = {1, 512, 1024, 2048, 4096};
 
     /* For SCSI generic devices the alignment is not really used.
-       With buffered I/O, we don't have any restrictions. */
-    if (bdrv_is_sg(bs) || !s->needs_alignment) {
+       With buffered I/O, we don't have any restrictions.
+       NVMe passthrough uses the LBA size instead, see raw_refresh_limits(). */
+    if (bdrv_is_sg(bs) || s->use_nvme_uring_cmd || !s->needs_alignment) {
         bs->bl.request_alignment = 1;
         s->buf_align = 1;
         return;
@@ -585,6 +614,14 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+#ifdef CONFIG_LINUX_IO_URING
+        {
+            .name = "aio-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM as io_uring fixed buffers, "
+                    "disables RAM discards (default: off)",
+        },
+#endif
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -662,6 +699,12 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     s->use_linux_aio = (aio == BLOCKDEV_AIO_OPTIONS_NATIVE);
 #ifdef CONFIG_LINUX_IO_URING
     s->use_linux_io_uring = (aio == BLOCKDEV_AIO_OPTIONS_IO_URING);
+    s->use_luring_bufs = qemu_opt_get_bool(opts, "aio-fixed-buffers", false);
+    if (s->use_luring_bufs && !s->use_linux_io_uring) {
+        error_setg(errp, "aio-fixed-buffers=on requires aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
@@ -1543,6 +1586,20 @@ static void raw_refresh_limits(BlockDriverState *bs, Error **errp)
     BDRVRawState *s = bs->opaque;
     struct stat st;
 
+    if (s->use_nvme_uring_cmd) {
+        /* NVMe only needs dword aligned buffers */
+        bs->bl.request_alignment = 1 << s->nvme_blkshift;
+        bs->bl.min_mem_alignment = 4;
+        bs->bl.opt_mem_alignment = qemu_real_host_page_size();
+        bs->bl.max_hw_transfer = s->nvme_max_transfer;
+        bs->bl.max_hw_iov = NVME_URING_MAX_SEGS;
+
+        /* The number of blocks is a 16 bit field in Write Zeroes */
+        bs->bl.max_pwrite_zeroes = 1ULL << (s->nvme_blkshift + 16);
+        bs->bl.pwrite_zeroes_alignment = bs->bl.request_alignment;
+        return;
+    }
+
     s->needs_alignment = raw_needs_alignment(bs);
     raw_probe_alignment(bs, s->fd, errp);
 
@@ -2564,6 +2621,115 @@ static inline bool raw_check_linux_aio(BDRVRawState *s)
 }
 #endif
 
+#ifdef HAVE_NVME_URING_CMD
+static int coroutine_fn raw_nvme_co_cmd(BlockDriverState *bs, uint32_t cmd_op,
+                                        struct nvme_uring_cmd *cmd)
+{
+    BDRVRawState *s = bs->opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
+    Error *local_err = NULL;
+    int ret;
+
+    /* There is no fallback, the device only takes passthrough commands */
+    if (unlikely(!aio_setup_linux_io_uring_cmd(ctx, &local_err))) {
+        error_report_err(local_err);
+        return -EIO;
+    }
+
+    cmd->nsid = s->nvme_nsid;
+    ret = luring_co_submit_uring_cmd(bs, s->fd, cmd_op, cmd, sizeof(*cmd));
+    trace_file_nvme_uring_cmd(bs, cmd->opcode, cmd->cdw10, cmd->cdw11,
+                              cmd->cdw12, ret);
+
+    /* Positive values are NVMe status codes */
+    switch (ret > 0 ? ret & 0x7ff : ret) {
+    case NVME_SUCCESS:
+        return 0;
+    case NVME_INVALID_OPCODE:
+        return -ENOTSUP;
+    case NVME_INVALID_FIELD:
+    case NVME_LBA_RANGE:
+        return -EINVAL;
+    default:
+        return ret < 0 ? ret : -EIO;
+    }
+}
+
+/*
+ * Reads and writes on NVMe generic character devices, which don't support
+ * read(2)/write(2).  The block layer takes care of alignment and splits
+ * requests according to the limits set in raw_refresh_limits().
+ */
+static int coroutine_fn raw_nvme_co_prw(BlockDriverState *bs, uint64_t offset,
+                                        QEMUIOVector *qiov, int type,
+                                        BdrvRequestFlags flags)
+{
+    BDRVRawState *s = bs->opaque;
+    uint64_t slba = offset >> s->nvme_blkshift;
+    uint32_t nlb = (qiov->size >> s->nvme_blkshift) - 1;
+    struct nvme_uring_cmd cmd = {
+        .opcode = type == QEMU_AIO_WRITE ? NVME_CMD_WRITE : NVME_CMD_READ,
+        .cdw10 = slba & 0xffffffff,
+        .cdw11 = slba >> 32,
+        .cdw12 = (nlb & 0xffff) | ((flags & BDRV_REQ_FUA) ? 1 << 30 : 0),
+    };
+    uint32_t cmd_op;
+
+    assert(type == QEMU_AIO_READ || type == QEMU_AIO_WRITE);
+    assert(((uint64_t)(nlb + 1) << s->nvme_blkshift) == qiov->size);
+
+    if (qiov->niov == 1) {
+        cmd.addr = (uintptr_t)qiov->iov[0].iov_base;
+        cmd.data_len = qiov->iov[0].iov_len;
+        cmd_op = NVME_URING_CMD_IO;
+    } else {
+        cmd.addr = (uintptr_t)qiov->iov;
+        cmd.data_len = qiov->niov;
+        cmd_op = NVME_URING_CMD_IO_VEC;
+    }
+
+    return raw_nvme_co_cmd(bs, cmd_op, &cmd);
+}
+
+static int coroutine_fn raw_nvme_co_flush(BlockDriverState *bs)
+{
+    struct nvme_uring_cmd cmd = {
+        .opcode = NVME_CMD_FLUSH,
+    };
+
+    return raw_nvme_co_cmd(bs, NVME_URING_CMD_IO, &cmd);
+}
+
+static int coroutine_fn raw_nvme_co_pwrite_zeroes(BlockDriverState *bs,
+                                                  int64_t offset,
+                                                  int64_t bytes,
+                                                  BdrvRequestFlags flags)
+{
+    BDRVRawState *s = bs->opaque;
+    uint64_t slba = offset >> s->nvme_blkshift;
+    uint32_t cdw12 = ((bytes >> s->nvme_blkshift) - 1) & 0xffff;
+    struct nvme_uring_cmd cmd = {
+        .opcode = NVME_CMD_WRITE_ZEROES,
+        .cdw10 = slba & 0xffffffff,
+        .cdw11 = slba >> 32,
+    };
+
+    if (!s->nvme_write_zeroes) {
+        return -ENOTSUP;
+    }
+
+    /* pwrite_zeroes_alignment and max_pwrite_zeroes guarantee this */
+    assert(((int64_t)(cdw12 + 1) << s->nvme_blkshift) == bytes);
+
+    if (flags & BDRV_REQ_MAY_UNMAP) {
+        cdw12 |= 1 << 25;
+    }
+    cmd.cdw12 = cdw12;
+
+    return raw_nvme_co_cmd(bs, NVME_URING_CMD_IO, &cmd);
+}
+#endif
+
 static int coroutine_fn GRAPH_RDLOCK
 raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr, uint64_t bytes,
            QEMUIOVector *qiov, int type, int flags)
@@ -2575,6 +2741,12 @@ raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr, uint64_t bytes,
 
     if (fd_open(bs) < 0)
         return -EIO;
+#ifdef HAVE_NVME_URING_CMD
+    if (s->use_nvme_uring_cmd) {
+        assert(qiov->size == bytes);
+        return raw_nvme_co_prw(bs, offset, qiov, type, flags);
+    }
+#endif
 #if defined(CONFIG_BLKZONED)
     if ((type & (QEMU_AIO_WRITE | QEMU_AIO_ZONE_APPEND)) &&
         bs->bl.zoned != BLK_Z_NONE) {
@@ -2691,6 +2863,11 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
         .aio_type       = QEMU_AIO_FLUSH,
     };
 
+#ifdef HAVE_NVME_URING_CMD
+    if (s->use_nvme_uring_cmd) {
+        return raw_nvme_co_flush(bs);
+    }
+#endif
 #ifdef CONFIG_LINUX_IO_URING
     if (raw_check_linux_io_uring(s)) {
         return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH, 0);
@@ -2704,6 +2881,88 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
     return raw_thread_pool_submit(handle_aiocb_flush, &acb);
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * With aio-fixed-buffers=on, registered buffers are used as io_uring fixed
+ * buffers, which saves the kernel from pinning and unpinning the pages for
+ * every request.  This is only an optimisation, so failing to register is
+ * not an error.
+ *
+ * The kernel keeps fixed buffers pinned for as long as they are registered,
+ * so discarding guest RAM (virtio-balloon, virtio-mem) would leave the ring
+ * pointing at stale pages.  Fixed buffers therefore disable discards while
+ * they are registered, which is why they are opt-in; if something already
+ * relies on discards, the node keeps using vectored I/O.
+ */
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+    int ret;
+
+    if (!s->use_luring_bufs) {
+        return true;
+    }
+
+    if (!s->luring_bufs) {
+        ret = ram_block_discard_disable(true);
+        trace_file_luring_discard_disable(bs, ret);
+        if (ret < 0) {
+            warn_report("%s: RAM discards are in use, not using io_uring "
+                        "fixed buffers", bs->filename);
+            s->use_luring_bufs = false;
+            return true;
+        }
+        s->luring_bufs = g_array_new(false, false, sizeof(struct iovec));
+    }
+
+    g_array_append_val(s->luring_bufs, ((struct iovec) {
+        .iov_base = host,
+        .iov_len = size,
+    }));
+    luring_register_buf(host, size);
+    return true;
+}
+
+static void raw_unregister_luring_bufs(BDRVRawState *s)
+{
+    struct iovec *iov;
+    unsigned i;
+
+    for (i = 0; i < s->luring_bufs->len; i++) {
+        iov = &g_array_index(s->luring_bufs, struct iovec, i);
+        luring_unregister_buf(iov->iov_base, iov->iov_len);
+    }
+    g_array_free(s->luring_bufs, true);
+    s->luring_bufs = NULL;
+    ram_block_discard_disable(false);
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+    struct iovec *iov;
+    unsigned i;
+
+    if (!s->luring_bufs) {
+        return;
+    }
+
+    for (i = 0; i < s->luring_bufs->len; i++) {
+        iov = &g_array_index(s->luring_bufs, struct iovec, i);
+        if (iov->iov_base == host && iov->iov_len == size) {
+            luring_unregister_buf(host, size);
+            g_array_remove_index_fast(s->luring_bufs, i);
+            break;
+        }
+    }
+
+    if (s->luring_bufs->len == 0) {
+        raw_unregister_luring_bufs(s);
+    }
+}
+#endif
+
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
@@ -2715,6 +2974,13 @@ static void raw_close(BlockDriverState *bs)
         qemu_close(s->fd);
         s->fd = -1;
     }
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->luring_bufs) {
+        /* Buffers that are still registered go away with the node */
+        raw_unregister_luring_bufs(s);
+    }
+#endif
 }
 
 /**
@@ -2945,6 +3211,10 @@ static int64_t raw_getlength(BlockDriverState *bs)
         return ret;
     }
 
+    if (s->use_nvme_uring_cmd) {
+        return s->nvme_nsze << s->nvme_blkshift;
+    }
+
     size = lseek(s->fd, 0, SEEK_END);
     if (size < 0) {
         return -errno;
@@ -3998,6 +4268,10 @@ BlockDriver bdrv_file = {
     .bdrv_co_pwritev        = raw_co_pwritev,
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_co_pdiscard       = raw_co_pdiscard,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
@@ -4188,6 +4462,107 @@ static bool hdev_is_sg(BlockDriverState *bs)
     return false;
 }
 
+/*
+ * Detect NVMe generic character devices (/dev/ngXnY).  They can only be
+ * accessed with io_uring passthrough commands.
+ *
+ * Returns: 0 if @bs is not an NVMe generic device or has been set up for
+ * passthrough, -errno on failure.
+ */
+static int hdev_probe_nvme_generic(BlockDriverState *bs, Error **errp)
+{
+#ifdef HAVE_NVME_URING_CMD
+    BDRVRawState *s = bs->opaque;
+    QEMU_AUTO_VFREE union {
+        NvmeIdCtrl ctrl;
+        NvmeIdNs ns;
+    } *id = NULL;
+    struct nvme_passthru_cmd cmd = {
+        .opcode = NVME_ADM_CMD_IDENTIFY,
+        .data_len = sizeof(*id),
+        .cdw10 = 0x1,
+    };
+    NvmeLBAF *lbaf;
+    struct stat st;
+    int nsid;
+
+    if (bs->sg || fstat(s->fd, &st) < 0 || !S_ISCHR(st.st_mode)) {
+        return 0;
+    }
+
+    nsid = ioctl(s->fd, NVME_IOCTL_ID);
+    if (nsid <= 0) {
+        return 0;
+    }
+
+    if (!s->use_linux_io_uring) {
+        error_setg(errp, "NVMe generic character devices require aio=io_uring");
+        return -EINVAL;
+    }
+
+    if (!luring_has_uring_cmd()) {
+        error_setg(errp, "NVMe generic character devices require io_uring "
+                   "passthrough commands, which the host kernel does not "
+                   "support");
+        return -ENOTSUP;
+    }
+
+    id = qemu_memalign(qemu_real_host_page_size(), sizeof(*id));
+    cmd.addr = (uintptr_t)id;
+
+    if (ioctl(s->fd, NVME_IOCTL_ADMIN_CMD, &cmd) != 0) {
+        error_setg_errno(errp, errno, "Failed to identify controller");
+        return -EIO;
+    }
+
+    /* MDTS is in units of the minimum page size, which is at least 4k */
+    s->nvme_max_transfer = NVME_URING_MAX_TRANSFER;
+    if (id->ctrl.mdts && id->ctrl.mdts < 10) {
+        s->nvme_max_transfer = MIN(s->nvme_max_transfer,
+                                   (4 * KiB) << id->ctrl.mdts);
+    }
+    s->nvme_write_zeroes =
+        !!(le16_to_cpu(id->ctrl.oncs) & NVME_ONCS_WRITE_ZEROES);
+
+    cmd.nsid = nsid;
+    cmd.cdw10 = 0;
+    if (ioctl(s->fd, NVME_IOCTL_ADMIN_CMD, &cmd) != 0) {
+        error_setg_errno(errp, errno, "Failed to identify namespace");
+        return -EIO;
+    }
+
+    lbaf = &id->ns.lbaf[NVME_ID_NS_FLBAS_INDEX(id->ns.flbas)];
+    if (lbaf->ms) {
+        error_setg(errp, "Namespaces with metadata are not supported");
+        return -ENOTSUP;
+    }
+    if (lbaf->ds < BDRV_SECTOR_BITS || lbaf->ds > 12) {
+        error_setg(errp, "Namespace has unsupported block size (2^%d)",
+                   lbaf->ds);
+        return -ENOTSUP;
+    }
+
+    bs->supported_zero_flags = s->nvme_write_zeroes ? BDRV_REQ_NO_FALLBACK : 0;
+    if (NVME_ID_NS_DLFEAT_WRITE_ZEROES(id->ns.dlfeat) &&
+        NVME_ID_NS_DLFEAT_READ_BEHAVIOR(id->ns.dlfeat) ==
+            NVME_ID_NS_DLFEAT_READ_BEHAVIOR_ZEROES) {
+        bs->supported_zero_flags |= BDRV_REQ_MAY_UNMAP;
+    }
+    bs->supported_write_flags = BDRV_REQ_FUA;
+
+    s->nvme_nsid = nsid;
+    s->nvme_blkshift = lbaf->ds;
+    s->nvme_nsze = le64_to_cpu(id->ns.nsze);
+    s->use_nvme_uring_cmd = true;
+    /* The block layer aligns requests, there is no need for bounce buffers */
+    s->needs_alignment = false;
+    s->use_mpath = false;
+
+    trace_file_hdev_nvme_generic(nsid, lbaf->ds, s->nvme_nsze);
+#endif
+    return 0;
+}
+
 static int hdev_open(BlockDriverState *bs, QDict *options, int flags,
                      Error **errp)
 {
@@ -4276,6 +4651,11 @@ hdev_open_Mac_error:
     /* sg devices aren't even block devices and can't use dm-mpath */
     s->use_mpath = !bs->sg;
 
+    ret = hdev_probe_nvme_generic(bs, errp);
+    if (ret < 0) {
+        raw_close(bs);
+    }
+
     return ret;
 }
 
@@ -4418,12 +4798,16 @@ hdev_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
         raw_account_discard(s, bytes, ret);
         return ret;
     }
+    if (s->use_nvme_uring_cmd) {
+        return -ENOTSUP;
+    }
     return raw_do_pdiscard(bs, offset, bytes, true);
 }
 
 static coroutine_fn int hdev_co_pwrite_zeroes(BlockDriverState *bs,
     int64_t offset, int64_t bytes, BdrvRequestFlags flags)
 {
+    BDRVRawState *s = bs->opaque;
     int rc;
 
     rc = fd_open(bs);
@@ -4431,6 +4815,11 @@ static coroutine_fn int hdev_co_pwrite_zeroes(BlockDriverState *bs,
         return rc;
     }
 
+#ifdef HAVE_NVME_URING_CMD
+    if (s->use_nvme_uring_cmd) {
+        return raw_nvme_co_pwrite_zeroes(bs, offset, bytes, flags);
+    }
+#endif
     return raw_do_pwrite_zeroes(bs, offset, bytes, flags, true);
 }
 
@@ -4456,6 +4845,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_pwritev        = raw_co_pwritev,
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_co_pdiscard       = hdev_co_pdiscard,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
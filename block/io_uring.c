@@ -16,6 +16,10 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
+#include "qemu/thread.h"
+#include "qemu/atomic.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "system/block-backend.h"
 #include "trace.h"
@@ -26,9 +30,42 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/*
+ * Limits for fixed buffers imposed by the kernel: a single registered buffer
+ * may not exceed 1 GiB, and there are at most 16384 of them per ring.
+ */
+#define MAX_FIXED_BUF_SIZE (1 * GiB)
+#define MAX_FIXED_BUFS 16384
+
+/*
+ * Buffers registered through luring_register_buf().  The list is global
+ * because rings are per AioContext while buffers (usually guest RAM) are
+ * registered per BlockDriverState.  Every ring keeps its own copy of the
+ * list as registered with the kernel and picks up changes lazily.
+ */
+typedef struct LuringBuf {
+    void *host;
+    size_t size;
+    unsigned refcnt;
+} LuringBuf;
+
+static QemuMutex luring_bufs_lock;
+static GArray *luring_bufs; /* of LuringBuf, protected by luring_bufs_lock */
+static unsigned luring_bufs_gen;
+
+static void __attribute__((__constructor__)) luring_bufs_init(void)
+{
+    qemu_mutex_init(&luring_bufs_lock);
+    luring_bufs = g_array_new(false, false, sizeof(LuringBuf));
+}
+
 typedef struct LuringAIOCB {
     Coroutine *co;
-    struct io_uring_sqe sqeq;
+    union {
+        struct io_uring_sqe sqeq;
+        /* Big SQEs carry the passthrough command in their second half */
+        uint8_t sqe128[128];
+    };
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
@@ -58,6 +95,19 @@ struct LuringState {
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /*
+     * Fixed buffers registered with this ring, sorted by address.  Only used
+     * while fixed_bufs_gen matches luring_bufs_gen, i.e. while the global
+     * list has not changed since the registration.
+     */
+    struct iovec *fixed_bufs;
+    unsigned nr_fixed_bufs;
+    unsigned fixed_bufs_gen;
+    bool fixed_bufs_failed;
+
+    /* Ring uses 128 byte SQEs and 32 byte CQEs, needed for URING_CMD */
+    bool big_sqe;
 };
 
 /**
@@ -102,8 +152,14 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     /* Update sqe */
     luringcb->sqeq.off += nread;
-    luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
-    luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        /* Fixed buffers describe a single contiguous range */
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len -= nread;
+    } else {
+        luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
+        luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    }
 
     luring_resubmit(s, luringcb);
 }
@@ -243,7 +299,8 @@ static int ioq_submit(LuringState *s)
                 break;
             }
             /* Prep sqe for submission */
-            *sqes = luringcb->sqeq;
+            memcpy(sqes, luringcb->sqe128,
+                   s->big_sqe ? sizeof(luringcb->sqe128) : sizeof(*sqes));
             QSIMPLEQ_REMOVE_HEAD(&s->io_q.submit_queue, next);
         }
         ret = io_uring_submit(&s->ring);
@@ -323,6 +380,150 @@ static void luring_deferred_fn(void *opaque)
     }
 }
 
+static int luring_fixed_buf_cmp(const void *a, const void *b)
+{
+    const struct iovec *x = a, *y = b;
+
+    if (x->iov_base == y->iov_base) {
+        return 0;
+    }
+    return (uintptr_t)x->iov_base < (uintptr_t)y->iov_base ? -1 : 1;
+}
+
+/*
+ * Bring the fixed buffers of @s in sync with the global list.  The buffer
+ * table can only be replaced while no request that refers to it by index is
+ * queued or in flight.
+ *
+ * Returns true if the fixed buffers of @s may be used.
+ */
+static bool luring_update_fixed_bufs(LuringState *s)
+{
+    unsigned gen = qatomic_read(&luring_bufs_gen);
+    g_autofree struct iovec *iovs = NULL;
+    unsigned nr = 0;
+    unsigned i;
+    int ret;
+
+    if (s->fixed_bufs_gen == gen) {
+        return s->nr_fixed_bufs > 0;
+    }
+    if (s->io_q.in_queue || s->io_q.in_flight) {
+        return false;
+    }
+
+    qemu_mutex_lock(&luring_bufs_lock);
+    gen = luring_bufs_gen;
+    iovs = g_new(struct iovec, MAX_FIXED_BUFS);
+    for (i = 0; i < luring_bufs->len; i++) {
+        LuringBuf *buf = &g_array_index(luring_bufs, LuringBuf, i);
+        size_t done;
+
+        for (done = 0; done < buf->size && nr < MAX_FIXED_BUFS;
+             done += MAX_FIXED_BUF_SIZE) {
+            iovs[nr++] = (struct iovec) {
+                .iov_base = (uint8_t *)buf->host + done,
+                .iov_len = MIN(buf->size - done, MAX_FIXED_BUF_SIZE),
+            };
+        }
+    }
+    qemu_mutex_unlock(&luring_bufs_lock);
+
+    if (s->nr_fixed_bufs) {
+        io_uring_unregister_buffers(&s->ring);
+        g_free(s->fixed_bufs);
+        s->fixed_bufs = NULL;
+        s->nr_fixed_bufs = 0;
+    }
+    s->fixed_bufs_gen = gen;
+
+    if (!nr || s->fixed_bufs_failed) {
+        return false;
+    }
+
+    qsort(iovs, nr, sizeof(iovs[0]), luring_fixed_buf_cmp);
+    ret = io_uring_register_buffers(&s->ring, iovs, nr);
+    trace_luring_register_buffers(s, nr, ret);
+    if (ret < 0) {
+        /*
+         * Most likely RLIMIT_MEMLOCK is too low.  Don't retry on every
+         * change, regular vectored I/O still works fine.
+         */
+        s->fixed_bufs_failed = true;
+        return false;
+    }
+
+    s->fixed_bufs = g_steal_pointer(&iovs);
+    s->nr_fixed_bufs = nr;
+    return true;
+}
+
+/*
+ * Returns the index of the fixed buffer that contains all of @qiov, or -1 if
+ * the request can't be submitted with a fixed buffer.
+ */
+static int luring_find_fixed_buf(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t start, end;
+    unsigned lo = 0, hi;
+
+    if (qiov->niov != 1 || !luring_update_fixed_bufs(s)) {
+        return -1;
+    }
+
+    start = (uintptr_t)qiov->iov[0].iov_base;
+    end = start + qiov->iov[0].iov_len;
+    hi = s->nr_fixed_bufs;
+
+    /* Find the last buffer that starts at or before @start */
+    while (hi - lo > 1) {
+        unsigned mid = lo + (hi - lo) / 2;
+
+        if ((uintptr_t)s->fixed_bufs[mid].iov_base <= start) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ((uintptr_t)s->fixed_bufs[lo].iov_base <= start &&
+        end <= (uintptr_t)s->fixed_bufs[lo].iov_base +
+               s->fixed_bufs[lo].iov_len) {
+        return lo;
+    }
+    return -1;
+}
+
+/**
+ * luring_enqueue:
+ * @s: AIO state
+ * @luringcb: AIO control block with a prepared sqe
+ *
+ * Adds a request to the pending queue and submits it, either right away if
+ * the ring is full or when the deferred call section ends.
+ */
+static int luring_enqueue(LuringState *s, LuringAIOCB *luringcb)
+{
+    int ret;
+
+    io_uring_sqe_set_data(&luringcb->sqeq, luringcb);
+
+    QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
+    s->io_q.in_queue++;
+    trace_luring_do_submit(s, s->io_q.blocked, s->io_q.in_queue,
+                           s->io_q.in_flight);
+    if (!s->io_q.blocked) {
+        if (s->io_q.in_flight + s->io_q.in_queue >= MAX_ENTRIES) {
+            ret = ioq_submit(s);
+            trace_luring_do_submit_done(s, ret);
+            return ret;
+        }
+
+        defer_call(luring_deferred_fn, s);
+    }
+    return 0;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -337,11 +538,25 @@ static void luring_deferred_fn(void *opaque)
 static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type, BdrvRequestFlags flags)
 {
-    int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    int buf_index = -1;
+
+    if (type == QEMU_AIO_READ || type == QEMU_AIO_WRITE) {
+        buf_index = luring_find_fixed_buf(s, luringcb->qiov);
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->size, offset, buf_index);
+#ifdef HAVE_IO_URING_PREP_WRITEV2
+            sqes->rw_flags = (flags & BDRV_REQ_FUA) ? RWF_DSYNC : 0;
+#else
+            assert(flags == 0);
+#endif
+            break;
+        }
 #ifdef HAVE_IO_URING_PREP_WRITEV2
     {
         int luring_flags = (flags & BDRV_REQ_FUA) ? RWF_DSYNC : 0;
@@ -359,6 +574,11 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                              luringcb->qiov->niov, offset);
         break;
     case QEMU_AIO_READ:
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->size, offset, buf_index);
+            break;
+        }
         io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
                             luringcb->qiov->niov, offset);
         break;
@@ -370,22 +590,8 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
-    io_uring_sqe_set_data(sqes, luringcb);
 
-    QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
-    s->io_q.in_queue++;
-    trace_luring_do_submit(s, s->io_q.blocked, s->io_q.in_queue,
-                           s->io_q.in_flight);
-    if (!s->io_q.blocked) {
-        if (s->io_q.in_flight + s->io_q.in_queue >= MAX_ENTRIES) {
-            ret = ioq_submit(s);
-            trace_luring_do_submit_done(s, ret);
-            return ret;
-        }
-
-        defer_call(luring_deferred_fn, s);
-    }
-    return 0;
+    return luring_enqueue(s, luringcb);
 }
 
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
@@ -415,6 +621,82 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
     return luringcb.ret;
 }
 
+#ifdef HAVE_NVME_URING_CMD
+/**
+ * luring_has_uring_cmd:
+ *
+ * Returns: whether the host kernel can create rings with 128 byte SQEs and
+ * 32 byte CQEs, and supports IORING_OP_URING_CMD on them.
+ */
+bool luring_has_uring_cmd(void)
+{
+    struct io_uring ring;
+    struct io_uring_probe *probe;
+    bool ret;
+
+    if (io_uring_queue_init(1, &ring,
+                            IORING_SETUP_SQE128 | IORING_SETUP_CQE32) < 0) {
+        return false;
+    }
+
+    probe = io_uring_get_probe_ring(&ring);
+    ret = probe && io_uring_opcode_supported(probe, IORING_OP_URING_CMD);
+    io_uring_free_probe(probe);
+    io_uring_queue_exit(&ring);
+    return ret;
+}
+
+/**
+ * luring_co_submit_uring_cmd:
+ * @fd: file descriptor of the character device
+ * @cmd_op: the ioctl-like URING_CMD operation, e.g. NVME_URING_CMD_IO
+ * @cmd: the driver specific command
+ * @cmd_len: size of @cmd
+ *
+ * Submits a passthrough command with IORING_OP_URING_CMD on the passthrough
+ * ring of the thread's current AioContext, which the caller must have set up
+ * with aio_setup_linux_io_uring_cmd().
+ *
+ * Returns: the (non-negative) result of the command as reported by the
+ * driver, or -errno.
+ */
+int coroutine_fn luring_co_submit_uring_cmd(BlockDriverState *bs, int fd,
+                                            uint32_t cmd_op, const void *cmd,
+                                            size_t cmd_len)
+{
+    int ret;
+    AioContext *ctx = qemu_get_current_aio_context();
+    LuringState *s = aio_get_linux_io_uring_cmd(ctx);
+    LuringAIOCB luringcb = {
+        .co         = qemu_coroutine_self(),
+        .ret        = -EINPROGRESS,
+    };
+    struct io_uring_sqe *sqe = &luringcb.sqeq;
+    /* struct io_uring_sqe only declares a zero-length array for this */
+    uint8_t *sqe_cmd = luringcb.sqe128 + offsetof(struct io_uring_sqe, cmd);
+
+    assert(s->big_sqe);
+    assert(cmd_len <= sizeof(luringcb.sqe128) -
+                      offsetof(struct io_uring_sqe, cmd));
+
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = fd;
+    sqe->cmd_op = cmd_op;
+    memcpy(sqe_cmd, cmd, cmd_len);
+
+    trace_luring_co_submit_uring_cmd(bs, s, &luringcb, fd, cmd_op);
+    ret = luring_enqueue(s, &luringcb);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (luringcb.ret == -EINPROGRESS) {
+        qemu_coroutine_yield();
+    }
+    return luringcb.ret;
+}
+#endif
+
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
     aio_set_fd_handler(old_context, s->ring.ring_fd,
@@ -432,15 +714,30 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+/*
+ * @big_sqe creates a ring with 128 byte SQEs and 32 byte CQEs, as needed by
+ * passthrough commands.  Such rings are only created for AioContexts that
+ * actually submit passthrough commands.
+ */
+LuringState *luring_init(bool big_sqe, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
+    unsigned flags = 0;
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    if (big_sqe) {
+#ifdef HAVE_NVME_URING_CMD
+        flags |= IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+#else
+        g_assert_not_reached();
+#endif
+    }
+    s->big_sqe = big_sqe;
+
+    rc = io_uring_queue_init(MAX_ENTRIES, ring, flags);
     if (rc < 0) {
         error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
@@ -456,9 +753,55 @@ void luring_cleanup(LuringState *s)
 {
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
+    g_free(s->fixed_bufs);
     g_free(s);
 }
 
+/*
+ * Make @host available as a fixed buffer for all io_uring rings.  Rings
+ * register the buffer with the kernel the next time they submit a request
+ * while idle; if that fails, the ring keeps using vectored I/O.
+ */
+void luring_register_buf(void *host, size_t size)
+{
+    LuringBuf *buf;
+    unsigned i;
+
+    QEMU_LOCK_GUARD(&luring_bufs_lock);
+    for (i = 0; i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            buf->refcnt++;
+            return;
+        }
+    }
+
+    g_array_append_val(luring_bufs, ((LuringBuf) {
+        .host = host,
+        .size = size,
+        .refcnt = 1,
+    }));
+    qatomic_inc(&luring_bufs_gen);
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    LuringBuf *buf;
+    unsigned i;
+
+    QEMU_LOCK_GUARD(&luring_bufs_lock);
+    for (i = 0; i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            if (--buf->refcnt == 0) {
+                g_array_remove_index_fast(luring_bufs, i);
+                qatomic_inc(&luring_bufs_gen);
+            }
+            return;
+        }
+    }
+}
+
 bool luring_has_fua(void)
 {
 #ifdef HAVE_IO_URING_PREP_WRITEV2
@@ -28,6 +28,9 @@
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
+/* Bounds for how long write-batched mode collects guest writes */
+#define MIRROR_BATCH_WINDOW_MIN_NS (100 * SCALE_US)
+#define MIRROR_BATCH_WINDOW_MAX_NS (4 * SCALE_MS)
 
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
@@ -37,6 +40,7 @@ typedef struct MirrorBuffer {
 } MirrorBuffer;
 
 typedef struct MirrorOp MirrorOp;
+typedef struct MirrorBatchWrite MirrorBatchWrite;
 
 typedef struct MirrorBlockJob {
     BlockJob common;
@@ -92,6 +96,20 @@ typedef struct MirrorBlockJob {
     bool initial_zeroing_ongoing;
     int in_active_write_counter;
     int64_t active_write_bytes_in_flight;
+
+    /*
+     * write-batched mode: guest writes that are complete on the source and
+     * whose data is waiting to be copied to the target by mirror_batch_co().
+     */
+    QSIMPLEQ_HEAD(, MirrorBatchWrite) batch;
+    /* Bytes of guest writes queued in @batch or being written to the target */
+    int64_t batch_bytes;
+    Coroutine *batch_co;
+    QemuCoSleep batch_sleep;
+    int64_t batch_window_ns;
+    bool batch_flush_now;
+    /* Woken whenever a batched write to the target completes */
+    CoQueue batch_waiters;
     bool prepared;
     bool in_drain;
     bool base_ro;
@@ -132,6 +150,22 @@ typedef enum MirrorMethod {
     MIRROR_METHOD_DISCARD,
 } MirrorMethod;
 
+/*
+ * A guest write in write-batched mode.  Its MirrorOp stays in ops_in_flight
+ * until the data has reached the target, so that later writes and background
+ * copying to the same area are ordered after it just like in write-blocking
+ * mode.
+ */
+struct MirrorBatchWrite {
+    MirrorOp *op;
+    uint64_t offset;
+    uint64_t bytes;
+    /* Bounce buffer of the guest write; the data starts at @buf_offset */
+    uint8_t *buf;
+    size_t buf_offset;
+    QSIMPLEQ_ENTRY(MirrorBatchWrite) next;
+};
+
 static BlockErrorAction mirror_error_action(MirrorBlockJob *s, bool read,
                                             int error)
 {
@@ -522,6 +556,7 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
     BlockDriverState *source;
     MirrorOp *pseudo_op;
     int64_t offset;
+    HBitmapExtent extent;
     /* At least the first dirty chunk is mirrored in one iteration. */
     int nb_chunks = 1;
     bool write_zeroes_ok = bdrv_can_write_zeroes_with_unmap(blk_bs(s->target));
@@ -553,28 +588,29 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
     job_pause_point(&s->common.job);
 
     /* Find the number of consecutive dirty chunks following the first dirty
-     * one, and wait for in flight requests in them. */
+     * one, and stop before the first chunk with a request in flight. */
     bdrv_dirty_bitmap_lock(s->dirty_bitmap);
-    while (nb_chunks * s->granularity < s->buf_size) {
-        int64_t next_dirty;
-        int64_t next_offset = offset + nb_chunks * s->granularity;
-        int64_t next_chunk = next_offset / s->granularity;
-        if (next_offset >= s->bdev_length ||
-            !bdrv_dirty_bitmap_get_locked(s->dirty_bitmap, next_offset)) {
-            break;
-        }
-        if (test_bit(next_chunk, s->in_flight_bitmap)) {
-            break;
-        }
+    if (bdrv_dirty_bitmap_next_dirty_extents(s->dirty_bitmap, offset,
+                                             MIN(offset + s->buf_size,
+                                                 s->bdev_length),
+                                             s->buf_size, &extent, 1) &&
+        extent.start == offset)
+    {
+        int64_t first_chunk = offset / s->granularity;
+        int64_t end_chunk = first_chunk +
+                            DIV_ROUND_UP(extent.count, s->granularity);
 
-        next_dirty = bdrv_dirty_iter_next(s->dbi);
-        if (next_dirty > next_offset || next_dirty < 0) {
-            /* The bitmap iterator's cache is stale, refresh it */
-            bdrv_set_dirty_iter(s->dbi, next_offset);
-            next_dirty = bdrv_dirty_iter_next(s->dbi);
-        }
-        assert(next_dirty == next_offset);
-        nb_chunks++;
+        nb_chunks = find_next_bit(s->in_flight_bitmap, end_chunk,
+                                  first_chunk + 1) - first_chunk;
+    }
+    /*
+     * Move the iterator past the area we are about to copy; at the end of the
+     * device, start over just like an exhausted iterator would.
+     */
+    if (offset + nb_chunks * s->granularity < s->bdev_length) {
+        bdrv_set_dirty_iter(s->dbi, offset + nb_chunks * s->granularity);
+    } else {
+        bdrv_set_dirty_iter(s->dbi, 0);
     }
 
     /* Clear dirty bits before querying the block status, because
@@ -697,6 +733,76 @@ static void coroutine_fn mirror_wait_for_all_io(MirrorBlockJob *s)
     }
 }
 
+static void mirror_batch_kick(MirrorBlockJob *s)
+{
+    /*
+     * Without mirror_batch_co() nothing is queued, so there is nothing to
+     * flush; setting the flag would only cut the next window short.
+     */
+    if (s->batch_co) {
+        s->batch_flush_now = true;
+        qemu_co_sleep_wake(&s->batch_sleep);
+    }
+}
+
+/*
+ * Make mirror_batch_co() write out its queue now if @op would otherwise have
+ * to wait for a queued write to the same area until the window closes.
+ */
+static void mirror_batch_kick_conflicts(MirrorOp *op)
+{
+    MirrorBlockJob *s = op->s;
+    uint64_t start_chunk = op->offset / s->granularity;
+    uint64_t end_chunk = DIV_ROUND_UP(op->offset + op->bytes, s->granularity);
+    MirrorBatchWrite *w;
+
+    QSIMPLEQ_FOREACH(w, &s->batch, next) {
+        uint64_t w_start_chunk = w->op->offset / s->granularity;
+        uint64_t w_end_chunk = DIV_ROUND_UP(w->op->offset + w->op->bytes,
+                                            s->granularity);
+
+        if (ranges_overlap(start_chunk, end_chunk - start_chunk,
+                           w_start_chunk, w_end_chunk - w_start_chunk)) {
+            mirror_batch_kick(s);
+            return;
+        }
+    }
+}
+
+/* Wait until all batched guest writes have been written to the target */
+static void coroutine_fn mirror_batch_drain(MirrorBlockJob *s)
+{
+    while (s->batch_bytes) {
+        mirror_batch_kick(s);
+        qemu_co_queue_wait(&s->batch_waiters, NULL);
+    }
+}
+
+/*
+ * Called by mirror_run() to adapt the batching window: if background copying
+ * has to wait for the target, collect guest writes for longer so they reach
+ * the target in fewer and larger requests; once it is idle, go back to short
+ * windows to keep the target close to the source.
+ */
+static void mirror_batch_backoff(MirrorBlockJob *s, bool congested)
+{
+    int64_t window = s->batch_window_ns;
+
+    if (qatomic_read(&s->copy_mode) != MIRROR_COPY_MODE_WRITE_BATCHED) {
+        return;
+    }
+
+    if (congested) {
+        window = MIN(window * 2, MIRROR_BATCH_WINDOW_MAX_NS);
+    } else {
+        window = MAX(window / 2, MIRROR_BATCH_WINDOW_MIN_NS);
+    }
+    if (window != s->batch_window_ns) {
+        trace_mirror_batch_window(s, window);
+        s->batch_window_ns = window;
+    }
+}
+
 /**
  * mirror_exit_common: handle both abort() and prepare() cases.
  * for .prepare, returns 0 on success and -errno on failure.
@@ -1162,6 +1268,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
             if (s->in_flight >= MAX_IN_FLIGHT || s->buf_free_count == 0 ||
                 (cnt == 0 && s->in_flight > 0)) {
                 trace_mirror_yield(s, cnt, s->buf_free_count, s->in_flight);
+                mirror_batch_backoff(s, cnt != 0);
                 mirror_wait_for_free_in_flight_slot(s);
                 continue;
             } else if (cnt != 0) {
@@ -1171,6 +1278,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
 
         should_complete = false;
         if (s->in_flight == 0 && cnt == 0) {
+            mirror_batch_backoff(s, false);
             trace_mirror_before_flush(s);
             if (!job_is_ready(&s->common.job)) {
                 if (mirror_flush(s) < 0) {
@@ -1184,7 +1292,8 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
                  */
                 job_transition_to_ready(&s->common.job);
             }
-            if (qatomic_read(&s->copy_mode) != MIRROR_COPY_MODE_BACKGROUND) {
+            if (qatomic_read(&s->copy_mode) != MIRROR_COPY_MODE_BACKGROUND &&
+                !s->batch_bytes) {
                 qatomic_set(&s->actively_synced, true);
             }
 
@@ -1206,6 +1315,12 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
              */
             trace_mirror_before_drain(s, cnt);
 
+            /*
+             * Batched guest writes were already cleaned in the dirty bitmap,
+             * but the target does not have their data yet.
+             */
+            mirror_batch_drain(s);
+
             s->in_drain = true;
             bdrv_drained_begin(bs);
 
@@ -1249,6 +1364,7 @@ immediate_exit:
         assert(need_drain);
         mirror_wait_for_all_io(s);
     }
+    mirror_batch_drain(s);
 
     assert(s->in_flight == 0);
     qemu_vfree(s->buf);
@@ -1323,7 +1439,7 @@ static bool mirror_drained_poll(BlockJob *job)
         }
     }
 
-    return !!s->in_flight;
+    return !!s->in_flight || !!s->batch_bytes;
 }
 
 static bool mirror_cancel(Job *job, bool force)
@@ -1367,7 +1483,7 @@ static void mirror_change(BlockJob *job, BlockJobChangeOptions *opts,
         return;
     }
 
-    if (change_opts->copy_mode != MIRROR_COPY_MODE_WRITE_BLOCKING) {
+    if (change_opts->copy_mode == MIRROR_COPY_MODE_BACKGROUND) {
         error_setg(errp, "Change to copy mode '%s' is not implemented",
                    MirrorCopyMode_str(change_opts->copy_mode));
         return;
@@ -1425,18 +1541,22 @@ static const BlockJobDriver commit_active_job_driver = {
     .drained_poll           = mirror_drained_poll,
 };
 
-static void coroutine_fn
-do_sync_target_write(MirrorBlockJob *job, MirrorMethod method,
-                     uint64_t offset, uint64_t bytes,
-                     QEMUIOVector *qiov, int flags)
+/*
+ * Shrink an active write to the part that is copied to the target, clean that
+ * part in the dirty bitmap and account it as in flight.  Returns false if
+ * nothing is left to copy.  Every successful call must be paired with
+ * active_write_target_done().
+ */
+static bool coroutine_fn
+active_write_target_begin(MirrorBlockJob *job, uint64_t *offset,
+                          uint64_t *bytes, size_t *qiov_offset)
 {
-    int ret;
-    size_t qiov_offset = 0;
     int64_t dirty_bitmap_offset, dirty_bitmap_end;
-    int64_t zero_bitmap_offset, zero_bitmap_end;
 
-    if (!QEMU_IS_ALIGNED(offset, job->granularity) &&
-        bdrv_dirty_bitmap_get(job->dirty_bitmap, offset))
+    *qiov_offset = 0;
+
+    if (!QEMU_IS_ALIGNED(*offset, job->granularity) &&
+        bdrv_dirty_bitmap_get(job->dirty_bitmap, *offset))
     {
             /*
              * Dirty unaligned padding: ignore it.
@@ -1455,44 +1575,109 @@ do_sync_target_write(MirrorBlockJob *job, MirrorMethod method,
              * even if each write will contribute, as guest is not guaranteed to
              * rewrite the whole disk.
              */
-            qiov_offset = QEMU_ALIGN_UP(offset, job->granularity) - offset;
-            if (bytes <= qiov_offset) {
+            *qiov_offset = QEMU_ALIGN_UP(*offset, job->granularity) - *offset;
+            if (*bytes <= *qiov_offset) {
                 /* nothing to do after shrink */
-                return;
+                return false;
             }
-            offset += qiov_offset;
-            bytes -= qiov_offset;
+            *offset += *qiov_offset;
+            *bytes -= *qiov_offset;
     }
 
-    if (!QEMU_IS_ALIGNED(offset + bytes, job->granularity) &&
-        bdrv_dirty_bitmap_get(job->dirty_bitmap, offset + bytes - 1))
+    if (!QEMU_IS_ALIGNED(*offset + *bytes, job->granularity) &&
+        bdrv_dirty_bitmap_get(job->dirty_bitmap, *offset + *bytes - 1))
     {
-        uint64_t tail = (offset + bytes) % job->granularity;
+        uint64_t tail = (*offset + *bytes) % job->granularity;
 
-        if (bytes <= tail) {
+        if (*bytes <= tail) {
             /* nothing to do after shrink */
-            return;
+            return false;
         }
-        bytes -= tail;
+        *bytes -= tail;
     }
 
     /*
      * Tails are either clean or shrunk, so for dirty bitmap resetting
-     * we safely align the range narrower.  But for zero bitmap, round
-     * range wider for checking or clearing, and narrower for setting.
+     * we safely align the range narrower.
      */
-    dirty_bitmap_offset = QEMU_ALIGN_UP(offset, job->granularity);
-    dirty_bitmap_end = QEMU_ALIGN_DOWN(offset + bytes, job->granularity);
+    dirty_bitmap_offset = QEMU_ALIGN_UP(*offset, job->granularity);
+    dirty_bitmap_end = QEMU_ALIGN_DOWN(*offset + *bytes, job->granularity);
     if (dirty_bitmap_offset < dirty_bitmap_end) {
         bdrv_reset_dirty_bitmap(job->dirty_bitmap, dirty_bitmap_offset,
                                 dirty_bitmap_end - dirty_bitmap_offset);
     }
+
+    job_progress_increase_remaining(&job->common.job, *bytes);
+    job->active_write_bytes_in_flight += *bytes;
+    return true;
+}
+
+/*
+ * Finish accounting for an area passed to active_write_target_begin().  If
+ * the target write failed, the area is marked dirty again so that background
+ * copying picks it up; reporting the error is left to the caller.
+ */
+static void coroutine_fn
+active_write_target_done(MirrorBlockJob *job, uint64_t offset, uint64_t bytes,
+                         int ret)
+{
+    int64_t dirty_bitmap_offset, dirty_bitmap_end;
+
+    job->active_write_bytes_in_flight -= bytes;
+    if (ret >= 0) {
+        job_progress_update(&job->common.job, bytes);
+        return;
+    }
+
+    /*
+     * We failed, so we should mark dirty the whole area, aligned up.
+     * Note that we don't care about shrunk tails if any: they were dirty
+     * at function start, and they must be still dirty, as we've locked
+     * the region for in-flight op.
+     */
+    dirty_bitmap_offset = QEMU_ALIGN_DOWN(offset, job->granularity);
+    dirty_bitmap_end = QEMU_ALIGN_UP(offset + bytes, job->granularity);
+    bdrv_set_dirty_bitmap(job->dirty_bitmap, dirty_bitmap_offset,
+                          dirty_bitmap_end - dirty_bitmap_offset);
+    qatomic_set(&job->actively_synced, false);
+}
+
+static void coroutine_fn
+active_write_target_error(MirrorBlockJob *job, int ret)
+{
+    BlockErrorAction action;
+
+    action = mirror_error_action(job, false, -ret);
+    if (action == BLOCK_ERROR_ACTION_REPORT) {
+        if (!job->ret) {
+            job->ret = ret;
+        }
+    }
+}
+
+static void coroutine_fn
+do_sync_target_write(MirrorBlockJob *job, MirrorMethod method,
+                     uint64_t offset, uint64_t bytes,
+                     QEMUIOVector *qiov, int flags)
+{
+    int ret;
+    size_t qiov_offset;
+    int64_t dirty_bitmap_offset, dirty_bitmap_end;
+    int64_t zero_bitmap_offset, zero_bitmap_end;
+
+    if (!active_write_target_begin(job, &offset, &bytes, &qiov_offset)) {
+        return;
+    }
+
+    /*
+     * For zero bitmap, round range wider for checking or clearing, and
+     * narrower for setting.
+     */
+    dirty_bitmap_offset = QEMU_ALIGN_UP(offset, job->granularity);
+    dirty_bitmap_end = QEMU_ALIGN_DOWN(offset + bytes, job->granularity);
     zero_bitmap_offset = offset / job->granularity;
     zero_bitmap_end = DIV_ROUND_UP(offset + bytes, job->granularity);
 
-    job_progress_increase_remaining(&job->common.job, bytes);
-    job->active_write_bytes_in_flight += bytes;
-
     switch (method) {
     case MIRROR_METHOD_COPY:
         if (job->zero_bitmap) {
@@ -1533,30 +1718,9 @@ do_sync_target_write(MirrorBlockJob *job, MirrorMethod method,
         abort();
     }
 
-    job->active_write_bytes_in_flight -= bytes;
-    if (ret >= 0) {
-        job_progress_update(&job->common.job, bytes);
-    } else {
-        BlockErrorAction action;
-
-        /*
-         * We failed, so we should mark dirty the whole area, aligned up.
-         * Note that we don't care about shrunk tails if any: they were dirty
-         * at function start, and they must be still dirty, as we've locked
-         * the region for in-flight op.
-         */
-        dirty_bitmap_offset = QEMU_ALIGN_DOWN(offset, job->granularity);
-        dirty_bitmap_end = QEMU_ALIGN_UP(offset + bytes, job->granularity);
-        bdrv_set_dirty_bitmap(job->dirty_bitmap, dirty_bitmap_offset,
-                              dirty_bitmap_end - dirty_bitmap_offset);
-        qatomic_set(&job->actively_synced, false);
-
-        action = mirror_error_action(job, false, -ret);
-        if (action == BLOCK_ERROR_ACTION_REPORT) {
-            if (!job->ret) {
-                job->ret = ret;
-            }
-        }
+    active_write_target_done(job, offset, bytes, ret);
+    if (ret < 0) {
+        active_write_target_error(job, ret);
     }
 }
 
@@ -1595,6 +1759,7 @@ static MirrorOp *coroutine_fn active_write_prepare(MirrorBlockJob *s,
      * until the area is copied in full.  Therefore, we must wait for the whole
      * area to become free of concurrent requests.
      */
+    mirror_batch_kick_conflicts(op);
     mirror_wait_on_conflicts(op, s, offset, bytes);
 
     bitmap_set(s->in_flight_bitmap, start_chunk, end_chunk - start_chunk);
@@ -1628,6 +1793,181 @@ static void coroutine_fn GRAPH_RDLOCK active_write_settle(MirrorOp *op)
     g_free(op);
 }
 
+/* Write a run of adjacent batched guest writes to the target */
+static void coroutine_fn mirror_batch_write_co(void *opaque)
+{
+    MirrorBatchWrite **writes = opaque;
+    MirrorBatchWrite *first = writes[0];
+    MirrorBlockJob *s = first->op->s;
+    QEMUIOVector qiov;
+    uint64_t bytes = 0;
+    int i, n, ret;
+
+    for (n = 0; writes[n]; n++) {
+        bytes += writes[n]->bytes;
+    }
+
+    qemu_iovec_init(&qiov, n);
+    for (i = 0; i < n; i++) {
+        qemu_iovec_add(&qiov, writes[i]->buf + writes[i]->buf_offset,
+                       writes[i]->bytes);
+    }
+
+    /*
+     * The guest requests have completed already, so there is no point in
+     * passing on BDRV_REQ_FUA; mirror_flush() takes care of the target cache.
+     */
+    trace_mirror_batch_write(s, first->offset, bytes, n);
+    ret = blk_co_pwritev(s->target, first->offset, bytes, &qiov, 0);
+    trace_mirror_batch_write_done(s, first->offset, bytes, n, ret);
+
+    qemu_iovec_destroy(&qiov);
+
+    for (i = 0; i < n; i++) {
+        active_write_target_done(s, writes[i]->offset, writes[i]->bytes, ret);
+        s->batch_bytes -= writes[i]->bytes;
+        WITH_GRAPH_RDLOCK_GUARD() {
+            active_write_settle(writes[i]->op);
+        }
+        qemu_vfree(writes[i]->buf);
+        g_free(writes[i]);
+    }
+    g_free(writes);
+
+    if (ret < 0) {
+        active_write_target_error(s, ret);
+    }
+    qemu_co_queue_restart_all(&s->batch_waiters);
+}
+
+static int mirror_batch_write_cmp(gconstpointer a, gconstpointer b)
+{
+    const MirrorBatchWrite *wa = *(MirrorBatchWrite * const *)a;
+    const MirrorBatchWrite *wb = *(MirrorBatchWrite * const *)b;
+
+    return wa->offset < wb->offset ? -1 : wa->offset > wb->offset;
+}
+
+/*
+ * Take everything queued in s->batch and write it to the target, merging
+ * writes that are adjacent on disk into one request.
+ *
+ * Queued writes never overlap: a write waits in active_write_prepare() for
+ * any earlier write to the same chunks to be settled, which happens only
+ * once that one has reached the target.  So sorting by offset does not
+ * reorder writes to the same data.
+ */
+static void coroutine_fn mirror_batch_submit(MirrorBlockJob *s)
+{
+    int max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    g_autoptr(GPtrArray) queued = g_ptr_array_new();
+    MirrorBatchWrite *w;
+    guint i = 0;
+
+    while ((w = QSIMPLEQ_FIRST(&s->batch))) {
+        QSIMPLEQ_REMOVE_HEAD(&s->batch, next);
+        g_ptr_array_add(queued, w);
+    }
+    g_ptr_array_sort(queued, mirror_batch_write_cmp);
+
+    while (i < queued->len) {
+        MirrorBatchWrite **run;
+        uint64_t end, bytes;
+        guint n = 1;
+
+        w = g_ptr_array_index(queued, i);
+        end = w->offset + w->bytes;
+        bytes = w->bytes;
+        while (i + n < queued->len && n < s->max_iov) {
+            MirrorBatchWrite *next = g_ptr_array_index(queued, i + n);
+
+            if (next->offset != end || bytes + next->bytes > max_io_bytes) {
+                break;
+            }
+            end += next->bytes;
+            bytes += next->bytes;
+            n++;
+        }
+
+        run = g_new(MirrorBatchWrite *, n + 1);
+        memcpy(run, &queued->pdata[i], n * sizeof(*run));
+        run[n] = NULL;
+        i += n;
+
+        qemu_coroutine_enter(qemu_coroutine_create(mirror_batch_write_co, run));
+    }
+}
+
+static void coroutine_fn mirror_batch_co(void *opaque)
+{
+    MirrorBlockJob *s = opaque;
+
+    while (!QSIMPLEQ_EMPTY(&s->batch)) {
+        if (!s->batch_flush_now) {
+            qemu_co_sleep_ns_wakeable(&s->batch_sleep, QEMU_CLOCK_REALTIME,
+                                      s->batch_window_ns);
+        }
+        s->batch_flush_now = false;
+        mirror_batch_submit(s);
+    }
+    s->batch_co = NULL;
+}
+
+/*
+ * Queue the data of a guest write that has completed on the source for
+ * writing to the target.  On success, @op and @buf are owned by the batch and
+ * true is returned; false means that nothing had to be copied.
+ *
+ * To bound the amount of memory and of not yet mirrored data, the caller is
+ * blocked while more than buf_size bytes are pending.  This keeps the
+ * convergence guarantee of write-blocking mode: the guest cannot write faster
+ * than the target accepts data.
+ */
+static bool coroutine_fn
+mirror_batch_add(MirrorBlockJob *s, MirrorOp *op, uint64_t offset,
+                 uint64_t bytes, void *buf)
+{
+    MirrorBatchWrite *w;
+    size_t buf_offset;
+
+    if (!active_write_target_begin(s, &offset, &bytes, &buf_offset)) {
+        return false;
+    }
+
+    if (s->zero_bitmap) {
+        int64_t zero_bitmap_offset = offset / s->granularity;
+        int64_t zero_bitmap_end = DIV_ROUND_UP(offset + bytes, s->granularity);
+
+        bitmap_clear(s->zero_bitmap, zero_bitmap_offset,
+                     zero_bitmap_end - zero_bitmap_offset);
+    }
+
+    w = g_new(MirrorBatchWrite, 1);
+    *w = (MirrorBatchWrite) {
+        .op         = op,
+        .offset     = offset,
+        .bytes      = bytes,
+        .buf        = buf,
+        .buf_offset = buf_offset,
+    };
+    QSIMPLEQ_INSERT_TAIL(&s->batch, w, next);
+    s->batch_bytes += bytes;
+
+    if (!s->batch_co) {
+        s->batch_co = qemu_coroutine_create_small(mirror_batch_co, s);
+        qemu_coroutine_enter(s->batch_co);
+    }
+    if (s->batch_bytes >= s->buf_size / 2) {
+        mirror_batch_kick(s);
+    }
+
+    while (s->batch_bytes > s->buf_size) {
+        mirror_batch_kick(s);
+        qemu_co_queue_wait(&s->batch_waiters, NULL);
+    }
+    return true;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 bdrv_mirror_top_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                        QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -1639,13 +1979,18 @@ static bool should_copy_to_target(MirrorBDSOpaque *s)
 {
     return s->job && s->job->ret >= 0 &&
         !job_is_cancelled(&s->job->common.job) &&
-        qatomic_read(&s->job->copy_mode) == MIRROR_COPY_MODE_WRITE_BLOCKING;
+        qatomic_read(&s->job->copy_mode) != MIRROR_COPY_MODE_BACKGROUND;
 }
 
+/*
+ * @batch_buf is the bounce buffer behind @qiov for data writes that are
+ * copied to the target.  In write-batched mode, the buffer may be handed over
+ * to the batch, in which case *@batch_buf is set to NULL.
+ */
 static int coroutine_fn GRAPH_RDLOCK
 bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
                          bool copy_to_target, uint64_t offset, uint64_t bytes,
-                         QEMUIOVector *qiov, int flags)
+                         QEMUIOVector *qiov, void **batch_buf, int flags)
 {
     MirrorOp *op = NULL;
     MirrorBDSOpaque *s = bs->opaque;
@@ -1682,7 +2027,15 @@ bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
     }
 
     if (copy_to_target) {
-        do_sync_target_write(s->job, method, offset, bytes, qiov, flags);
+        if (batch_buf && qatomic_read(&s->job->copy_mode) ==
+                         MIRROR_COPY_MODE_WRITE_BATCHED) {
+            if (mirror_batch_add(s->job, op, offset, bytes, *batch_buf)) {
+                *batch_buf = NULL;
+                return ret;
+            }
+        } else {
+            do_sync_target_write(s->job, method, offset, bytes, qiov, flags);
+        }
     }
 
 out:
@@ -1697,7 +2050,7 @@ bdrv_mirror_top_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
                         QEMUIOVector *qiov, BdrvRequestFlags flags)
 {
     QEMUIOVector bounce_qiov;
-    void *bounce_buf;
+    void *bounce_buf = NULL;
     int ret = 0;
     bool copy_to_target = should_copy_to_target(bs->opaque);
 
@@ -1717,7 +2070,8 @@ bdrv_mirror_top_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
     }
 
     ret = bdrv_mirror_top_do_write(bs, MIRROR_METHOD_COPY, copy_to_target,
-                                   offset, bytes, qiov, flags);
+                                   offset, bytes, qiov,
+                                   copy_to_target ? &bounce_buf : NULL, flags);
 
     if (copy_to_target) {
         qemu_iovec_destroy(&bounce_qiov);
@@ -1742,7 +2096,7 @@ bdrv_mirror_top_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
 {
     bool copy_to_target = should_copy_to_target(bs->opaque);
     return bdrv_mirror_top_do_write(bs, MIRROR_METHOD_ZERO, copy_to_target,
-                                    offset, bytes, NULL, flags);
+                                    offset, bytes, NULL, NULL, flags);
 }
 
 static int coroutine_fn GRAPH_RDLOCK
@@ -1750,7 +2104,7 @@ bdrv_mirror_top_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
 {
     bool copy_to_target = should_copy_to_target(bs->opaque);
     return bdrv_mirror_top_do_write(bs, MIRROR_METHOD_DISCARD, copy_to_target,
-                                    offset, bytes, NULL, 0);
+                                    offset, bytes, NULL, NULL, 0);
 }
 
 static void GRAPH_RDLOCK bdrv_mirror_top_refresh_filename(BlockDriverState *bs)
@@ -2084,6 +2438,9 @@ static BlockJob *mirror_start_job(
     bdrv_graph_wrunlock();
 
     QTAILQ_INIT(&s->ops_in_flight);
+    QSIMPLEQ_INIT(&s->batch);
+    qemu_co_queue_init(&s->batch_waiters);
+    s->batch_window_ns = MIRROR_BATCH_WINDOW_MIN_NS;
 
     trace_mirror_start(bs, s, opaque);
     job_start(&s->common.job);
@@ -35,9 +35,13 @@
 #include "block/block_int.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block.h"
+#include "qemu/main-loop.h"
 #include "qobject/qdict.h"
+#include "qom/object.h"
 #include "system/block-backend.h"
 #include "system/blockdev.h"
+#include "system/iothread.h"
+#include "system/stats.h"
 
 static BlockBackend *qmp_get_blk(const char *blk_name, const char *qdev_id,
                                  Error **errp)
@@ -572,3 +576,153 @@ void qmp_block_latency_histogram_set(
         }
     }
 }
+
+static const char *const block_stats_latency_names[BLOCK_MAX_IOTYPE] = {
+    [BLOCK_ACCT_READ]           = "read-latency",
+    [BLOCK_ACCT_WRITE]          = "write-latency",
+    [BLOCK_ACCT_FLUSH]          = "flush-latency",
+    [BLOCK_ACCT_ZONE_APPEND]    = "zone-append-latency",
+    [BLOCK_ACCT_UNMAP]          = "unmap-latency",
+};
+
+typedef struct BlockStatsIOThreadLookup {
+    AioContext *ctx;
+    IOThread *iothread;
+} BlockStatsIOThreadLookup;
+
+static int block_stats_find_iothread(Object *child, void *opaque)
+{
+    BlockStatsIOThreadLookup *lookup = opaque;
+    IOThread *iothread =
+        (IOThread *)object_dynamic_cast(child, TYPE_IOTHREAD);
+
+    if (iothread && iothread_get_aio_context(iothread) == lookup->ctx) {
+        lookup->iothread = iothread;
+        return 1;
+    }
+    return 0;
+}
+
+static StatsList *block_stats_latency_hdr(BlockAcctLatencyHdr *hdr,
+                                          strList *names)
+{
+    StatsList *stats_list = NULL;
+    int type;
+
+    /* Build the list backwards, so that it ends up sorted like the schema */
+    for (type = BLOCK_MAX_IOTYPE - 1; type > BLOCK_ACCT_NONE; type--) {
+        Stat64 *row = qatomic_load_acquire(&hdr->bins[type]);
+        uint64List *bins = NULL;
+        Stats *stats;
+        int last = -1, i;
+
+        if (!apply_str_list_filter(block_stats_latency_names[type], names)) {
+            continue;
+        }
+
+        /* Leave out the trailing empty buckets */
+        if (row) {
+            for (last = BLOCK_ACCT_HDR_BUCKETS - 1; last >= 0; last--) {
+                if (stat64_get(&row[last])) {
+                    break;
+                }
+            }
+        }
+        for (i = last; i >= 0; i--) {
+            QAPI_LIST_PREPEND(bins, stat64_get(&row[i]));
+        }
+
+        stats = g_new0(Stats, 1);
+        stats->name = g_strdup(block_stats_latency_names[type]);
+        stats->value = g_new0(StatsValue, 1);
+        stats->value->type = QTYPE_QLIST;
+        stats->value->u.list = bins;
+        QAPI_LIST_PREPEND(stats_list, stats);
+    }
+
+    return stats_list;
+}
+
+static void block_stats_cb(StatsResultList **result, StatsTarget target,
+                           strList *names, strList *targets, Error **errp)
+{
+    Object *objects = object_get_container("objects");
+    BlockBackend *blk;
+
+    if (target != STATS_TARGET_BLOCK) {
+        return;
+    }
+
+    for (blk = blk_all_next(NULL); blk; blk = blk_all_next(blk)) {
+        BlockAcctStats *acct = blk_get_stats(blk);
+        BlockAcctLatencyHdr *hdr = NULL;
+        DeviceState *dev = blk_get_attached_dev(blk);
+        g_autofree char *qom_path = NULL;
+
+        if (!dev) {
+            continue;
+        }
+        qom_path = object_get_canonical_path(OBJECT(dev));
+        if (!apply_str_list_filter(qom_path, targets)) {
+            continue;
+        }
+
+        while ((hdr = block_acct_latency_hdr_next(acct, hdr))) {
+            BlockStatsIOThreadLookup lookup = { .ctx = hdr->ctx };
+            StatsResult *entry;
+
+            if (hdr->ctx != qemu_get_aio_context()) {
+                /*
+                 * Histograms of IOThreads that have gone away cannot be
+                 * attributed to anything anymore.
+                 */
+                object_child_foreach(objects, block_stats_find_iothread,
+                                     &lookup);
+                if (!lookup.iothread) {
+                    continue;
+                }
+            }
+
+            entry = g_new0(StatsResult, 1);
+            entry->provider = STATS_PROVIDER_BLOCK;
+            entry->qom_path = g_strdup(qom_path);
+            if (lookup.iothread) {
+                entry->iothread = iothread_get_id(lookup.iothread);
+            }
+            entry->stats = block_stats_latency_hdr(hdr, names);
+            QAPI_LIST_PREPEND(*result, entry);
+        }
+    }
+}
+
+static void block_stats_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+    int type;
+
+    for (type = BLOCK_MAX_IOTYPE - 1; type > BLOCK_ACCT_NONE; type--) {
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(block_stats_latency_names[type]);
+        value->type = STATS_TYPE_LOG_LINEAR_HISTOGRAM;
+        value->has_unit = true;
+        value->unit = STATS_UNIT_SECONDS;
+        value->has_base = true;
+        value->base = 10;
+        value->exponent = -9;
+        value->has_bucket_size = true;
+        value->bucket_size = 1 << BLOCK_ACCT_HDR_SUB_BITS;
+        QAPI_LIST_PREPEND(stats_list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_BLOCK, STATS_TARGET_BLOCK,
+                     stats_list);
+}
+
+static void block_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_BLOCK, block_stats_cb,
+                        block_stats_schemas_cb);
+}
+
+type_init(block_stats_init)
@@ -91,6 +91,7 @@ typedef struct Qcow2Bitmap {
     char *name;
 
     BdrvDirtyBitmap *dirty_bitmap;
+    bool in_place; /* Only update the changed clusters of @table */
 
     QSIMPLEQ_ENTRY(Qcow2Bitmap) entry;
 } Qcow2Bitmap;
@@ -105,6 +106,27 @@ static inline bool can_write(BlockDriverState *bs)
     return !bdrv_is_read_only(bs) && !(bdrv_get_flags(bs) & BDRV_O_INACTIVE);
 }
 
+/*
+ * The image data of @bitmap is known to match its in-memory contents.  With
+ * incremental-bitmap-store, start (or restart) tracking which bitmap clusters
+ * change from now on, so that the next store only writes those.
+ */
+static void bitmap_track_changes(BlockDriverState *bs, BdrvDirtyBitmap *bitmap)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (!s->incremental_bitmap_store) {
+        bdrv_release_meta_dirty_bitmap(bitmap);
+        return;
+    }
+
+    if (bdrv_dirty_bitmap_has_meta(bitmap)) {
+        bdrv_dirty_bitmap_reset_meta(bitmap, 0, bdrv_dirty_bitmap_size(bitmap));
+    } else {
+        bdrv_create_meta_dirty_bitmap(bitmap, s->cluster_size);
+    }
+}
+
 static int GRAPH_RDLOCK update_header_sync(BlockDriverState *bs)
 {
     int ret;
@@ -1020,6 +1042,9 @@ qcow2_load_dirty_bitmaps(BlockDriverState *bs,
             /* NB: updated flags only get written if can_write(bs) is true. */
             bm->flags |= BME_FLAG_IN_USE;
             needs_update = true;
+            if (can_write(bs)) {
+                bitmap_track_changes(bs, bitmap);
+            }
         }
         if (!(bm->flags & BME_FLAG_AUTO)) {
             bdrv_disable_dirty_bitmap(bitmap);
@@ -1174,6 +1199,9 @@ int qcow2_reopen_bitmaps_rw(BlockDriverState *bs, Error **errp)
 
             bm->flags |= BME_FLAG_IN_USE;
             need_header_update = true;
+            if (!bdrv_dirty_bitmap_has_meta(bitmap)) {
+                bitmap_track_changes(bs, bitmap);
+            }
         } else {
             /*
              * What if flags already has BME_FLAG_IN_USE ?
@@ -1440,6 +1468,160 @@ fail:
     return ret;
 }
 
+/*
+ * Whether bm->dirty_bitmap can be written back into the existing bitmap
+ * table of @bm: the changes since the table was last written must be
+ * tracked and the table layout must be unchanged.
+ */
+static bool GRAPH_RDLOCK
+can_store_bitmap_in_place(BlockDriverState *bs, Qcow2Bitmap *bm,
+                          BdrvDirtyBitmap *bitmap)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
+    uint32_t granularity = bdrv_dirty_bitmap_granularity(bitmap);
+    uint64_t tb_size;
+
+    if (!s->incremental_bitmap_store || !bdrv_dirty_bitmap_has_meta(bitmap) ||
+        !bm->table.offset)
+    {
+        return false;
+    }
+
+    tb_size = size_to_clusters(s,
+                bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
+
+    return bm->granularity_bits == ctz32(granularity) &&
+           bm->table.size == tb_size;
+}
+
+/* store_bitmap_in_place()
+ * Write the clusters of bm->dirty_bitmap that changed since the table at
+ * bm->table was last in sync with it.  Unchanged clusters are left alone and
+ * the table is rewritten in place if any of its entries changed.
+ *
+ * The bitmap is marked IN_USE in the image while this happens, so a partial
+ * update is harmless: the directory is only updated when everything has been
+ * written.
+ */
+static int GRAPH_RDLOCK
+store_bitmap_in_place(BlockDriverState *bs, Qcow2Bitmap *bm, Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    BdrvDirtyBitmap *bitmap = bm->dirty_bitmap;
+    const char *bm_name = bdrv_dirty_bitmap_name(bitmap);
+    uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
+    uint64_t limit, offset;
+    uint64_t *tb = NULL, *old_tb = NULL;
+    uint8_t *buf = NULL;
+    bool tb_changed = false;
+    uint32_t i;
+    int ret;
+
+    ret = bitmap_table_load(bs, &bm->table, &tb);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to read bitmap table of '%s'",
+                         bm_name);
+        return ret;
+    }
+    old_tb = g_memdup2(tb, bm->table.size * sizeof(tb[0]));
+
+    buf = g_malloc(s->cluster_size);
+    limit = bdrv_dirty_bitmap_serialization_coverage(s->cluster_size, bitmap);
+    assert(DIV_ROUND_UP(bm_size, limit) == bm->table.size);
+
+    for (i = 0, offset = 0; i < bm->table.size; i++, offset += limit) {
+        uint64_t end = MIN(bm_size, offset + limit);
+        uint64_t write_size;
+        int64_t off;
+
+        if (!bdrv_dirty_bitmap_get_meta(bitmap, offset, end - offset)) {
+            continue;
+        }
+
+        if (bdrv_dirty_bitmap_next_dirty(bitmap, offset, end - offset) < 0) {
+            /* The cluster is released once the new table is on disk */
+            tb_changed |= tb[i] != 0;
+            tb[i] = 0;
+            continue;
+        }
+
+        off = tb[i] & BME_TABLE_ENTRY_OFFSET_MASK;
+        if (!off) {
+            off = qcow2_alloc_clusters(bs, s->cluster_size);
+            if (off < 0) {
+                error_setg_errno(errp, -off,
+                                 "Failed to allocate clusters for bitmap '%s'",
+                                 bm_name);
+                ret = off;
+                goto fail;
+            }
+            tb[i] = off;
+            tb_changed = true;
+        }
+
+        write_size = bdrv_dirty_bitmap_serialization_size(bitmap, offset,
+                                                          end - offset);
+        assert(write_size <= s->cluster_size);
+        bdrv_dirty_bitmap_serialize_part(bitmap, buf, offset, end - offset);
+        if (write_size < s->cluster_size) {
+            memset(buf + write_size, 0, s->cluster_size - write_size);
+        }
+
+        ret = qcow2_pre_write_overlap_check(bs, 0, off, s->cluster_size, false);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
+            goto fail;
+        }
+
+        ret = bdrv_pwrite(bs->file, off, s->cluster_size, buf, 0);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
+                             bm_name);
+            goto fail;
+        }
+    }
+
+    if (tb_changed) {
+        ret = qcow2_pre_write_overlap_check(bs, 0, bm->table.offset,
+                                            bm->table.size * sizeof(tb[0]),
+                                            false);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
+            goto fail;
+        }
+
+        bitmap_table_bswap_be(tb, bm->table.size);
+        ret = bdrv_pwrite(bs->file, bm->table.offset,
+                          bm->table.size * sizeof(tb[0]), tb, 0);
+        bitmap_table_bswap_be(tb, bm->table.size);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
+                             bm_name);
+            goto fail;
+        }
+
+        /* Drop the clusters whose contents became all zeroes */
+        for (i = 0; i < bm->table.size; i++) {
+            uint64_t old_off = old_tb[i] & BME_TABLE_ENTRY_OFFSET_MASK;
+
+            if (old_off && !tb[i]) {
+                qcow2_free_clusters(bs, old_off, s->cluster_size,
+                                    QCOW2_DISCARD_ALWAYS);
+            }
+        }
+    }
+
+    ret = 0;
+
+fail:
+    /* Clusters newly allocated on failure are leaked, like in store_bitmap() */
+    g_free(buf);
+    g_free(old_tb);
+    g_free(tb);
+    return ret;
+}
+
 static Qcow2Bitmap *find_bitmap_by_name(Qcow2BitmapList *bm_list,
                                         const char *name)
 {
@@ -1609,10 +1791,14 @@ bool qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs,
                            name);
                 goto fail;
             }
-            tb = g_memdup2(&bm->table, sizeof(bm->table));
-            bm->table.offset = 0;
-            bm->table.size = 0;
-            QSIMPLEQ_INSERT_TAIL(&drop_tables, tb, entry);
+            if (can_store_bitmap_in_place(bs, bm, bitmap)) {
+                bm->in_place = true;
+            } else {
+                tb = g_memdup2(&bm->table, sizeof(bm->table));
+                bm->table.offset = 0;
+                bm->table.size = 0;
+                QSIMPLEQ_INSERT_TAIL(&drop_tables, tb, entry);
+            }
         }
         bm->flags = bdrv_dirty_bitmap_enabled(bitmap) ? BME_FLAG_AUTO : 0;
         bm->granularity_bits = ctz32(bdrv_dirty_bitmap_granularity(bitmap));
@@ -1636,7 +1822,11 @@ bool qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs,
             continue;
         }
 
-        ret = store_bitmap(bs, bm, errp);
+        if (bm->in_place) {
+            ret = store_bitmap_in_place(bs, bm, errp);
+        } else {
+            ret = store_bitmap(bs, bm, errp);
+        }
         if (ret < 0) {
             goto fail;
         }
@@ -1655,6 +1845,15 @@ bool qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs,
         g_free(tb);
     }
 
+    if (!release_stored) {
+        QSIMPLEQ_FOREACH(bm, bm_list, entry) {
+            bitmap = bm->dirty_bitmap;
+            if (bitmap && !bdrv_dirty_bitmap_readonly(bitmap)) {
+                bitmap_track_changes(bs, bitmap);
+            }
+        }
+    }
+
 success:
     if (release_stored) {
         QSIMPLEQ_FOREACH(bm, bm_list, entry) {
@@ -1672,7 +1871,7 @@ success:
 fail:
     QSIMPLEQ_FOREACH(bm, bm_list, entry) {
         if (bm->dirty_bitmap == NULL || bm->table.offset == 0 ||
-            bdrv_dirty_bitmap_readonly(bm->dirty_bitmap))
+            bm->in_place || bdrv_dirty_bitmap_readonly(bm->dirty_bitmap))
         {
             continue;
         }
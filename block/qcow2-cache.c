@@ -40,6 +40,7 @@ struct Qcow2Cache {
     struct Qcow2Cache      *depends;
     int                     size;
     int                     table_size;
+    int                     nb_shards;
     bool                    depends_on_flush;
     void                   *table_array;
     uint64_t                lru_counter;
@@ -59,6 +60,27 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+/*
+ * The cache is split into @nb_shards sets of consecutive entries.  A table
+ * can only ever be stored in the shard selected by its offset, so lookups
+ * and the LRU scan on a miss only have to look at the entries of that shard
+ * instead of the whole cache.  With a single shard this degenerates into
+ * the classic fully associative cache.
+ */
+static inline void qcow2_cache_get_shard(Qcow2Cache *c, uint64_t offset,
+                                         int *start, int *end, int *lookup)
+{
+    uint64_t table_nr = offset / c->table_size;
+    int shard = table_nr % c->nb_shards;
+    int shard_size;
+
+    *start = (int64_t) shard * c->size / c->nb_shards;
+    *end = (int64_t) (shard + 1) * c->size / c->nb_shards;
+    shard_size = *end - *start;
+
+    *lookup = *start + (table_nr / c->nb_shards * 4) % shard_size;
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -121,12 +143,13 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 }
 
 Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
-                               unsigned table_size)
+                               unsigned table_size, int num_shards)
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
 
     assert(num_tables > 0);
+    assert(num_shards > 0 && num_shards <= num_tables);
     assert(is_power_of_2(table_size));
     assert(table_size >= (1 << MIN_CLUSTER_BITS));
     assert(table_size <= s->cluster_size);
@@ -134,6 +157,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
     c->table_size = table_size;
+    c->nb_shards = num_shards;
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
@@ -327,7 +351,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     BDRVQcow2State *s = bs->opaque;
     int i;
     int ret;
-    int lookup_index;
+    int lookup_index, shard_start, shard_end;
     uint64_t min_lru_counter = UINT64_MAX;
     int min_lru_index = -1;
 
@@ -344,7 +368,8 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
+    qcow2_cache_get_shard(c, offset, &shard_start, &shard_end, &lookup_index);
+    i = lookup_index;
     do {
         const Qcow2CachedTable *t = &c->entries[i];
         if (t->offset == offset) {
@@ -354,8 +379,8 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
             min_lru_counter = t->lru_counter;
             min_lru_index = i;
         }
-        if (++i == c->size) {
-            i = 0;
+        if (++i == shard_end) {
+            i = shard_start;
         }
     } while (i != lookup_index);
 
@@ -438,9 +463,14 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i, start, end, lookup;
 
-    for (i = 0; i < c->size; i++) {
+    if (!QEMU_IS_ALIGNED(offset, c->table_size)) {
+        return NULL;
+    }
+
+    qcow2_cache_get_shard(c, offset, &start, &end, &lookup);
+    for (i = start; i < end; i++) {
         if (c->entries[i].offset == offset) {
             return qcow2_cache_get_table_addr(c, i);
         }
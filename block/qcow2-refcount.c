@@ -30,6 +30,7 @@
 #include "qemu/bswap.h"
 #include "qemu/cutils.h"
 #include "qemu/memalign.h"
+#include "block/aio_task.h"
 #include "trace.h"
 
 static int64_t alloc_clusters_noref(BlockDriverState *bs, uint64_t size,
@@ -1851,11 +1852,38 @@ check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
     return 0;
 }
 
+typedef struct CheckL2Task {
+    AioTask task;
+
+    BlockDriverState *bs;
+    BdrvCheckResult *res;
+    void **refcount_table;
+    int64_t *refcount_table_size;
+    int64_t l2_offset;
+    int flags;
+    BdrvCheckMode fix;
+    bool active;
+} CheckL2Task;
+
+static int coroutine_fn GRAPH_RDLOCK check_refcounts_l2_task_entry(AioTask *task)
+{
+    CheckL2Task *t = container_of(task, CheckL2Task, task);
+
+    return check_refcounts_l2(t->bs, t->res, t->refcount_table,
+                              t->refcount_table_size, t->l2_offset, t->flags,
+                              t->fix, t->active);
+}
+
 /*
  * Increases the refcount for the L1 table, its L2 tables and all referenced
  * clusters in the given refcount table. While doing so, performs some checks
  * on L1 and L2 entries.
  *
+ * With @parallel > 1, up to @parallel L2 tables are read and checked
+ * concurrently.  All tasks run in the same AioContext and only yield while
+ * waiting for I/O, so they can safely share @res and @refcount_table: neither
+ * is accessed across a yield point.
+ *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
  */
@@ -1863,11 +1891,12 @@ static int coroutine_fn GRAPH_RDLOCK
 check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
                    void **refcount_table, int64_t *refcount_table_size,
                    int64_t l1_table_offset, int l1_size,
-                   int flags, BdrvCheckMode fix, bool active)
+                   int flags, BdrvCheckMode fix, bool active, int parallel)
 {
     BDRVQcow2State *s = bs->opaque;
     size_t l1_size_bytes = l1_size * L1E_SIZE;
     g_autofree uint64_t *l1_table = NULL;
+    AioTaskPool *aio = NULL;
     uint64_t l2_offset;
     int i, ret;
 
@@ -1900,12 +1929,20 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
         be64_to_cpus(&l1_table[i]);
     }
 
+    if (parallel > 1) {
+        aio = aio_task_pool_new(parallel);
+    }
+
     /* Do the actual checks */
     for (i = 0; i < l1_size; i++) {
         if (!l1_table[i]) {
             continue;
         }
 
+        if (aio && aio_task_pool_status(aio) < 0) {
+            break;
+        }
+
         if (l1_table[i] & L1E_RESERVED_MASK) {
             fprintf(stderr, "ERROR found L1 entry with reserved bits set: "
                     "%" PRIx64 "\n", l1_table[i]);
@@ -1919,7 +1956,7 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
                                        refcount_table, refcount_table_size,
                                        l2_offset, s->cluster_size);
         if (ret < 0) {
-            return ret;
+            goto out;
         }
 
         /* L2 tables are cluster aligned */
@@ -1930,6 +1967,24 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
         }
 
         /* Process and check L2 entries */
+        if (aio) {
+            CheckL2Task *task = g_new(CheckL2Task, 1);
+
+            *task = (CheckL2Task) {
+                .task.func = check_refcounts_l2_task_entry,
+                .bs = bs,
+                .res = res,
+                .refcount_table = refcount_table,
+                .refcount_table_size = refcount_table_size,
+                .l2_offset = l2_offset,
+                .flags = flags,
+                .fix = fix,
+                .active = active,
+            };
+            aio_task_pool_start_task(aio, &task->task);
+            continue;
+        }
+
         ret = check_refcounts_l2(bs, res, refcount_table,
                                  refcount_table_size, l2_offset, flags,
                                  fix, active);
@@ -1938,7 +1993,17 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
         }
     }
 
-    return 0;
+    ret = 0;
+out:
+    if (aio) {
+        aio_task_pool_wait_all(aio);
+        if (ret == 0) {
+            ret = aio_task_pool_status(aio);
+        }
+        aio_task_pool_free(aio);
+    }
+
+    return ret;
 }
 
 /*
@@ -2200,7 +2265,8 @@ resize_fail:
 static int coroutine_fn GRAPH_RDLOCK
 calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
                     BdrvCheckMode fix, bool *rebuild,
-                    void **refcount_table, int64_t *nb_clusters)
+                    void **refcount_table, int64_t *nb_clusters,
+                    int parallel)
 {
     BDRVQcow2State *s = bs->opaque;
     int64_t i;
@@ -2227,7 +2293,7 @@ calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
     /* current L1 table */
     ret = check_refcounts_l1(bs, res, refcount_table, nb_clusters,
                              s->l1_table_offset, s->l1_size, CHECK_FRAG_INFO,
-                             fix, true);
+                             fix, true, parallel);
     if (ret < 0) {
         return ret;
     }
@@ -2257,7 +2323,7 @@ calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
         }
         ret = check_refcounts_l1(bs, res, refcount_table, nb_clusters,
                                  sn->l1_table_offset, sn->l1_size, 0, fix,
-                                 false);
+                                 false, parallel);
         if (ret < 0) {
             return ret;
         }
@@ -2780,7 +2846,8 @@ fail:
  * detected as corrupted, and -errno when an internal error occurred.
  */
 int coroutine_fn GRAPH_RDLOCK
-qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode fix)
+qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode fix,
+                      int parallel)
 {
     BDRVQcow2State *s = bs->opaque;
     BdrvCheckResult pre_compare_res;
@@ -2805,7 +2872,7 @@ qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode
         size_to_clusters(s, bs->total_sectors * BDRV_SECTOR_SIZE);
 
     ret = calculate_refcounts(bs, res, fix, &rebuild, &refcount_table,
-                              &nb_clusters);
+                              &nb_clusters, parallel);
     if (ret < 0) {
         goto fail;
     }
@@ -2838,7 +2905,7 @@ qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode
         rebuild = false;
         memset(refcount_table, 0, refcount_array_byte_size(s, nb_clusters));
         ret = calculate_refcounts(bs, res, 0, &rebuild, &refcount_table,
-                                  &nb_clusters);
+                                  &nb_clusters, parallel);
         if (ret < 0) {
             goto fail;
         }
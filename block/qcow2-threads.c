@@ -33,6 +33,12 @@
 #include <zstd_errors.h>
 #endif
 
+#ifdef CONFIG_QPL
+#include <qpl/qpl.h>
+#endif
+
+#include "qapi/error.h"
+#include "qemu/notify.h"
 #include "qcow2.h"
 #include "block/block-io.h"
 #include "block/thread-pool.h"
@@ -325,6 +331,168 @@ static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
 }
 #endif
 
+#ifdef CONFIG_QPL
+/*
+ * IAA jobs are comparatively expensive to set up, so every worker thread
+ * keeps one around for its lifetime.  qcow2_qpl_unavailable is set when
+ * the hardware path cannot be initialized in this thread, so that we do
+ * not retry for every cluster.
+ */
+static __thread qpl_job *qcow2_qpl_job;
+static __thread bool qcow2_qpl_unavailable;
+static __thread Notifier qcow2_qpl_exit;
+
+static void qcow2_qpl_job_free(Notifier *n, void *unused)
+{
+    qpl_fini_job(qcow2_qpl_job);
+    g_free(qcow2_qpl_job);
+    qcow2_qpl_job = NULL;
+}
+
+static qpl_job *qcow2_qpl_job_new(void)
+{
+    qpl_job *job;
+    uint32_t size = 0;
+
+    if (qpl_get_job_size(qpl_path_hardware, &size) != QPL_STS_OK) {
+        return NULL;
+    }
+
+    job = g_malloc0(size);
+    if (qpl_init_job(qpl_path_hardware, job) != QPL_STS_OK) {
+        g_free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+static qpl_job *qcow2_qpl_get_job(void)
+{
+    if (!qcow2_qpl_job && !qcow2_qpl_unavailable) {
+        qcow2_qpl_job = qcow2_qpl_job_new();
+        if (qcow2_qpl_job) {
+            qcow2_qpl_exit.notify = qcow2_qpl_job_free;
+            qemu_thread_atexit_add(&qcow2_qpl_exit);
+        } else {
+            qcow2_qpl_unavailable = true;
+        }
+    }
+
+    return qcow2_qpl_job;
+}
+
+static bool qcow2_qpl_available(void)
+{
+    qpl_job *job = qcow2_qpl_job_new();
+
+    if (!job) {
+        return false;
+    }
+    qpl_fini_job(job);
+    g_free(job);
+    return true;
+}
+
+/*
+ * qcow2_qpl_compress()
+ *
+ * Compress @src_size bytes of data into a raw deflate stream using IAA.
+ * The accelerator uses a 4 KiB history window, so the result can be read
+ * back by qcow2_zlib_decompress().  Falls back to qcow2_zlib_compress() if
+ * the job cannot be run on the device.
+ *
+ * @dest - destination buffer, @dest_size bytes
+ * @src - source buffer, @src_size bytes
+ *
+ * Returns: compressed size on success
+ *          -ENOMEM destination buffer is not enough to store compressed data
+ *          -EIO    on any other error
+ */
+static ssize_t qcow2_qpl_compress(void *dest, size_t dest_size,
+                                  const void *src, size_t src_size)
+{
+    qpl_job *job = qcow2_qpl_get_job();
+    qpl_status status;
+
+    if (!job || src_size > UINT32_MAX) {
+        return qcow2_zlib_compress(dest, dest_size, src, src_size);
+    }
+
+    job->op = qpl_op_compress;
+    job->next_in_ptr = (uint8_t *)src;
+    job->available_in = src_size;
+    job->next_out_ptr = dest;
+    job->available_out = MIN(dest_size, UINT32_MAX);
+    job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST | QPL_FLAG_OMIT_VERIFY |
+                 QPL_FLAG_DYNAMIC_HUFFMAN;
+    job->level = qpl_default_level;
+
+    status = qpl_execute_job(job);
+    switch (status) {
+    case QPL_STS_OK:
+        return job->total_out;
+    case QPL_STS_MORE_OUTPUT_NEEDED:
+        return -ENOMEM;
+    default:
+        /* Busy queues or device errors: let the CPU do this cluster */
+        return qcow2_zlib_compress(dest, dest_size, src, src_size);
+    }
+}
+#endif
+
+/*
+ * qcow2_compression_accel_resolve()
+ *
+ * Map the user's @accel choice to the engine that will be used for images
+ * with compression type @type and store it in @resolved.  "auto" silently
+ * falls back to software, an explicitly requested engine that cannot be
+ * used is an error.
+ *
+ * Returns: 0 on success, -ENOTSUP with @errp set otherwise
+ */
+int qcow2_compression_accel_resolve(Qcow2CompressionType type,
+                                    Qcow2CompressionAccel accel,
+                                    Qcow2CompressionAccel *resolved,
+                                    Error **errp)
+{
+    switch (accel) {
+    case QCOW2_COMPRESSION_ACCEL_NONE:
+        break;
+
+    case QCOW2_COMPRESSION_ACCEL_AUTO:
+#ifdef CONFIG_QPL
+        if (type == QCOW2_COMPRESSION_TYPE_ZLIB && qcow2_qpl_available()) {
+            *resolved = QCOW2_COMPRESSION_ACCEL_QPL;
+            return 0;
+        }
+#endif
+        accel = QCOW2_COMPRESSION_ACCEL_NONE;
+        break;
+
+#ifdef CONFIG_QPL
+    case QCOW2_COMPRESSION_ACCEL_QPL:
+        if (type != QCOW2_COMPRESSION_TYPE_ZLIB) {
+            error_setg(errp, "compression-accel=qpl requires an image with "
+                       "zlib compression type");
+            return -ENOTSUP;
+        }
+        if (!qcow2_qpl_available()) {
+            error_setg(errp, "compression-accel=qpl: no usable IAA device "
+                       "found");
+            return -ENOTSUP;
+        }
+        break;
+#endif
+
+    default:
+        abort();
+    }
+
+    *resolved = accel;
+    return 0;
+}
+
 static int qcow2_compress_pool_func(void *opaque)
 {
     Qcow2CompressData *data = opaque;
@@ -374,6 +542,11 @@ qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
     switch (s->compression_type) {
     case QCOW2_COMPRESSION_TYPE_ZLIB:
         fn = qcow2_zlib_compress;
+#ifdef CONFIG_QPL
+        if (s->compression_accel == QCOW2_COMPRESSION_ACCEL_QPL) {
+            fn = qcow2_qpl_compress;
+        }
+#endif
         break;
 
 #ifdef CONFIG_ZSTD
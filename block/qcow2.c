@@ -73,6 +73,7 @@ typedef struct {
 #define  QCOW2_EXT_MAGIC_CRYPTO_HEADER 0x0537be77
 #define  QCOW2_EXT_MAGIC_BITMAPS 0x23852875
 #define  QCOW2_EXT_MAGIC_DATA_FILE 0x44415441
+#define  QCOW2_EXT_MAGIC_L2_HINTS 0x4c324854
 
 static int coroutine_fn
 qcow2_co_preadv_compressed(BlockDriverState *bs,
@@ -432,6 +433,35 @@ qcow2_read_extensions(BlockDriverState *bs, uint64_t start_offset,
             break;
         }
 
+        case QCOW2_EXT_MAGIC_L2_HINTS:
+        {
+            int i;
+
+            if (ext.len % sizeof(uint64_t) ||
+                ext.len > QCOW2_MAX_L2_HINTS * sizeof(uint64_t)) {
+                /* Only a hint, so just drop it if it looks bogus */
+                warn_report("Ignoring invalid L2 prefetch hints extension");
+                if (need_update_header != NULL) {
+                    *need_update_header = true;
+                }
+                break;
+            }
+
+            g_free(s->l2_hints);
+            s->nb_l2_hints = ext.len / sizeof(uint64_t);
+            s->l2_hints = g_new(uint64_t, s->nb_l2_hints);
+            ret = bdrv_co_pread(bs->file, offset, ext.len, s->l2_hints, 0);
+            if (ret < 0) {
+                error_setg_errno(errp, -ret,
+                                 "ERROR: Could not read L2 prefetch hints");
+                return ret;
+            }
+            for (i = 0; i < s->nb_l2_hints; i++) {
+                s->l2_hints[i] = be64_to_cpu(s->l2_hints[i]);
+            }
+            break;
+        }
+
         default:
             /* unknown magic - save it in case we need to rewrite the header */
             /* If you add a new feature, make sure to also update the fast
@@ -606,7 +636,7 @@ static void qcow2_add_check_result(BdrvCheckResult *out,
 
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
-                      BdrvCheckMode fix)
+                      BdrvCheckMode fix, int parallel)
 {
     BdrvCheckResult snapshot_res = {};
     BdrvCheckResult refcount_res = {};
@@ -620,7 +650,7 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
         return ret;
     }
 
-    ret = qcow2_check_refcounts(bs, &refcount_res, fix);
+    ret = qcow2_check_refcounts(bs, &refcount_res, fix, parallel);
     qcow2_add_check_result(result, &refcount_res, true);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -645,13 +675,13 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
 
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_check(BlockDriverState *bs, BdrvCheckResult *result,
-               BdrvCheckMode fix)
+               BdrvCheckMode fix, int parallel)
 {
     BDRVQcow2State *s = bs->opaque;
     int ret;
 
     qemu_co_mutex_lock(&s->lock);
-    ret = qcow2_co_check_locked(bs, result, fix);
+    ret = qcow2_co_check_locked(bs, result, fix, parallel);
     qemu_co_mutex_unlock(&s->lock);
     return ret;
 }
@@ -701,6 +731,10 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_L2_CACHE_SHARDS,
+    QCOW2_OPT_L2_PREFETCH_HINTS,
+    QCOW2_OPT_COMPRESSION_ACCEL,
+    QCOW2_OPT_INCREMENTAL_BITMAP_STORE,
     NULL
 };
 
@@ -817,6 +851,27 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_L2_CACHE_SHARDS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of independently indexed L2 cache shards",
+        },
+        {
+            .name = QCOW2_OPT_L2_PREFETCH_HINTS,
+            .type = QEMU_OPT_BOOL,
+            .help = "Record hot L2 tables on close and prefetch them on open",
+        },
+        {
+            .name = QCOW2_OPT_COMPRESSION_ACCEL,
+            .type = QEMU_OPT_STRING,
+            .help = "Offload engine for compressed writes "
+                    "(none, auto, qpl)",
+        },
+        {
+            .name = QCOW2_OPT_INCREMENTAL_BITMAP_STORE,
+            .type = QEMU_OPT_BOOL,
+            .help = "Only write the changed parts of persistent bitmaps",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -878,6 +933,120 @@ static void qcow2_attach_aio_context(BlockDriverState *bs,
     cache_clean_timer_init(bs, new_context);
 }
 
+/*
+ * Remember which L2 slices are currently cached, so that they can be
+ * prefetched the next time the image is opened.  The hints are stored as
+ * guest offsets, which keeps them meaningful even if the image is modified
+ * by a program that does not know about them.
+ */
+static void GRAPH_RDLOCK qcow2_collect_l2_hints(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int slices_per_table = s->l2_size / s->l2_slice_size;
+    size_t slice_bytes = s->l2_slice_size * l2_entry_size(s);
+    g_autofree uint64_t *hints = NULL;
+    int nb_hints = 0;
+    int i, j;
+
+    if (!s->l2_prefetch_hints || !s->l1_table || !bdrv_is_writable(bs)) {
+        return;
+    }
+
+    hints = g_new(uint64_t, QCOW2_MAX_L2_HINTS);
+    for (i = 0; i < s->l1_size && nb_hints < QCOW2_MAX_L2_HINTS; i++) {
+        uint64_t l2_offset = s->l1_table[i] & L1E_OFFSET_MASK;
+
+        if (!l2_offset) {
+            continue;
+        }
+
+        for (j = 0; j < slices_per_table && nb_hints < QCOW2_MAX_L2_HINTS;
+             j++)
+        {
+            if (qcow2_cache_is_table_offset(s->l2_table_cache,
+                                            l2_offset + j * slice_bytes)) {
+                hints[nb_hints++] =
+                    ((uint64_t) i << (s->l2_bits + s->cluster_bits)) +
+                    ((uint64_t) j * s->l2_slice_size << s->cluster_bits);
+            }
+        }
+    }
+
+    if (nb_hints == s->nb_l2_hints &&
+        !memcmp(hints, s->l2_hints, nb_hints * sizeof(uint64_t))) {
+        return;
+    }
+
+    g_free(s->l2_hints);
+    s->l2_hints = g_steal_pointer(&hints);
+    s->nb_l2_hints = nb_hints;
+    s->l2_hints_dirty = true;
+}
+
+static void coroutine_fn qcow2_prefetch_l2_hints_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t disk_size;
+    int i;
+
+    bdrv_graph_co_rdlock();
+    disk_size = bs->total_sectors * BDRV_SECTOR_SIZE;
+
+    for (i = 0; i < s->nb_l2_hints; i++) {
+        uint64_t hint = s->l2_hints[i];
+        unsigned int bytes = 1;
+        uint64_t host_offset;
+        QCow2SubclusterType type;
+        int ret;
+
+        if (hint >= disk_size) {
+            continue;
+        }
+
+        /* Looking up the mapping pulls the L2 slice into the cache */
+        qemu_co_mutex_lock(&s->lock);
+        /*
+         * The hints may have been dropped or replaced while we waited for
+         * the lock.  A stale @hint only costs a useless lookup.
+         */
+        if (i >= s->nb_l2_hints) {
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+        ret = qcow2_get_host_offset(bs, hint, &bytes, &host_offset, &type);
+        qemu_co_mutex_unlock(&s->lock);
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    trace_qcow2_prefetch_l2_hints_done(bs, i);
+    bdrv_graph_co_rdunlock();
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Start loading the L2 slices listed in the prefetch hints in the
+ * background.  The coroutine only runs once the caller has dropped s->lock,
+ * so guest requests that arrive in the meantime simply compete with it for
+ * the lock like any other request.
+ */
+static void qcow2_start_l2_prefetch(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Coroutine *co;
+
+    if (!s->l2_prefetch_hints || !s->nb_l2_hints ||
+        (bdrv_get_flags(bs) & BDRV_O_INACTIVE)) {
+        return;
+    }
+
+    bdrv_inc_in_flight(bs);
+    co = qemu_coroutine_create(qcow2_prefetch_l2_hints_entry, bs);
+    aio_co_schedule(bdrv_get_aio_context(bs), co);
+}
+
 static bool read_cache_sizes(BlockDriverState *bs, QemuOpts *opts,
                              uint64_t *l2_cache_size,
                              uint64_t *l2_cache_entry_size,
@@ -979,6 +1148,9 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    bool l2_prefetch_hints;
+    Qcow2CompressionAccel compression_accel;
+    bool incremental_bitmap_store;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -991,6 +1163,8 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
     const char *opt_overlap_check, *opt_overlap_check_template;
     int overlap_check_template = 0;
     uint64_t l2_cache_size, l2_cache_entry_size, refcount_cache_size;
+    uint64_t l2_cache_shards;
+    int accel;
     int i;
     const char *encryptfmt;
     QDict *encryptopts = NULL;
@@ -1022,6 +1196,19 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    /*
+     * Every shard must be able to hold the tables that a single request can
+     * reference at the same time, so limit the shard count accordingly.
+     */
+    l2_cache_shards = qemu_opt_get_number(opts, QCOW2_OPT_L2_CACHE_SHARDS, 1);
+    if (l2_cache_shards < 1 || l2_cache_shards > MAX_L2_CACHE_SHARDS) {
+        error_setg(errp, QCOW2_OPT_L2_CACHE_SHARDS " must be between 1 and %d",
+                   MAX_L2_CACHE_SHARDS);
+        ret = -EINVAL;
+        goto fail;
+    }
+    l2_cache_shards = MIN(l2_cache_shards, l2_cache_size / MIN_L2_CACHE_SIZE);
+
     refcount_cache_size /= s->cluster_size;
     if (refcount_cache_size < MIN_REFCOUNT_CACHE_SIZE) {
         refcount_cache_size = MIN_REFCOUNT_CACHE_SIZE;
@@ -1052,9 +1239,10 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
 
     r->l2_slice_size = l2_cache_entry_size / l2_entry_size(s);
     r->l2_table_cache = qcow2_cache_create(bs, l2_cache_size,
-                                           l2_cache_entry_size);
+                                           l2_cache_entry_size,
+                                           l2_cache_shards);
     r->refcount_block_cache = qcow2_cache_create(bs, refcount_cache_size,
-                                                 s->cluster_size);
+                                                 s->cluster_size, 1);
     if (r->l2_table_cache == NULL || r->refcount_block_cache == NULL) {
         error_setg(errp, "Could not allocate metadata caches");
         ret = -ENOMEM;
@@ -1150,6 +1338,24 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
 
     r->discard_no_unref = qemu_opt_get_bool(opts, QCOW2_OPT_DISCARD_NO_UNREF,
                                             false);
+    r->l2_prefetch_hints = qemu_opt_get_bool(opts, QCOW2_OPT_L2_PREFETCH_HINTS,
+                                             false);
+    r->incremental_bitmap_store =
+        qemu_opt_get_bool(opts, QCOW2_OPT_INCREMENTAL_BITMAP_STORE, false);
+
+    accel = qapi_enum_parse(&Qcow2CompressionAccel_lookup,
+                            qemu_opt_get(opts, QCOW2_OPT_COMPRESSION_ACCEL),
+                            QCOW2_COMPRESSION_ACCEL_NONE, errp);
+    if (accel < 0) {
+        ret = -EINVAL;
+        goto fail;
+    }
+    ret = qcow2_compression_accel_resolve(s->compression_type, accel,
+                                          &r->compression_accel, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
     if (r->discard_no_unref && s->qcow_version < 3) {
         error_setg(errp,
                    "discard-no-unref is only supported since qcow2 version 3");
@@ -1238,6 +1444,9 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
     }
 
     s->discard_no_unref = r->discard_no_unref;
+    s->l2_prefetch_hints = r->l2_prefetch_hints;
+    s->compression_accel = r->compression_accel;
+    s->incremental_bitmap_store = r->incremental_bitmap_store;
 
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
@@ -1870,7 +2079,7 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
         BdrvCheckResult result = {0};
 
         ret = qcow2_co_check_locked(bs, &result,
-                                    BDRV_FIX_ERRORS | BDRV_FIX_LEAKS);
+                                    BDRV_FIX_ERRORS | BDRV_FIX_LEAKS, 1);
         if (ret < 0 || result.check_errors) {
             if (ret >= 0) {
                 ret = -EIO;
@@ -1883,12 +2092,14 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
 #ifdef DEBUG_ALLOC
     {
         BdrvCheckResult result = {0};
-        qcow2_check_refcounts(bs, &result, 0);
+        qcow2_check_refcounts(bs, &result, 0, 1);
     }
 #endif
 
     qemu_co_queue_init(&s->thread_task_queue);
 
+    qcow2_start_l2_prefetch(bs);
+
     return ret;
 
  fail:
@@ -1903,6 +2114,9 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     }
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
+    g_free(s->l2_hints);
+    s->l2_hints = NULL;
+    s->nb_l2_hints = 0;
     qcow2_free_snapshots(bs);
     qcow2_refcount_close(bs);
     qemu_vfree(s->l1_table);
@@ -2772,6 +2986,8 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
                           bdrv_get_device_or_node_name(bs));
     }
 
+    qcow2_collect_l2_hints(bs);
+
     ret = qcow2_cache_flush(bs, s->l2_table_cache);
     if (ret) {
         result = ret;
@@ -2786,6 +3002,16 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
                      strerror(-ret));
     }
 
+    if (result == 0 && s->l2_hints_dirty) {
+        /* Failing to store the hints only costs performance on next open */
+        ret = qcow2_update_header(bs);
+        if (ret < 0) {
+            warn_report("Failed to store L2 prefetch hints: %s",
+                        strerror(-ret));
+        }
+        s->l2_hints_dirty = false;
+    }
+
     if (result == 0) {
         qcow2_mark_clean(bs);
     }
@@ -2797,6 +3023,12 @@ static void coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_do_close(BlockDriverState *bs, bool close_data_file)
 {
     BDRVQcow2State *s = bs->opaque;
+
+    /* The L1 table is needed to map cached L2 slices back to guest offsets */
+    if (!(s->flags & BDRV_O_INACTIVE)) {
+        qcow2_collect_l2_hints(bs);
+    }
+
     qemu_vfree(s->l1_table);
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
@@ -2815,6 +3047,7 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
 
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
+    g_free(s->l2_hints);
 
     g_free(s->image_data_file);
     g_free(s->image_backing_file);
@@ -3139,6 +3372,37 @@ int qcow2_update_header(BlockDriverState *bs)
         buflen -= ret;
     }
 
+    /*
+     * L2 prefetch hints.  These are optional, so only store as many as fit
+     * into the space left in the first cluster rather than failing.
+     */
+    if (s->nb_l2_hints > 0) {
+        size_t reserved = 2 * sizeof(QCowExtension) +
+            (s->image_backing_file ? strlen(s->image_backing_file) : 0);
+        size_t nb_hints = 0;
+        size_t i;
+
+        if (buflen > reserved) {
+            nb_hints = MIN(s->nb_l2_hints,
+                           (buflen - reserved) / sizeof(uint64_t));
+        }
+        if (nb_hints > 0) {
+            g_autofree uint64_t *hints = g_new(uint64_t, nb_hints);
+
+            for (i = 0; i < nb_hints; i++) {
+                hints[i] = cpu_to_be64(s->l2_hints[i]);
+            }
+            ret = header_ext_add(buf, QCOW2_EXT_MAGIC_L2_HINTS, hints,
+                                 nb_hints * sizeof(uint64_t), buflen);
+            if (ret < 0) {
+                goto fail;
+            }
+
+            buf += ret;
+            buflen -= ret;
+        }
+    }
+
     /* End of header extensions */
     ret = header_ext_add(buf, QCOW2_EXT_MAGIC_END, NULL, 0, buflen);
     if (ret < 0) {
@@ -5023,6 +5287,14 @@ static int GRAPH_RDLOCK qcow2_make_empty(BlockDriverState *bs)
 
     l1_clusters = DIV_ROUND_UP(s->l1_size, s->cluster_size / L1E_SIZE);
 
+    /* The hinted L2 tables are about to disappear */
+    if (s->nb_l2_hints) {
+        g_free(s->l2_hints);
+        s->l2_hints = NULL;
+        s->nb_l2_hints = 0;
+        s->l2_hints_dirty = true;
+    }
+
     if (s->qcow_version >= 3 && !s->snapshots && !s->nb_bitmaps &&
         3 + l1_clusters <= s->refcount_block_size &&
         s->crypt_method_header != QCOW_CRYPT_LUKS &&
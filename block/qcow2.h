@@ -126,6 +126,12 @@
 #define DEFAULT_CACHE_CLEAN_INTERVAL 0
 #endif
 
+/* Maximum number of entries in the L2 prefetch hints header extension */
+#define QCOW2_MAX_L2_HINTS 1024
+
+/* Upper limit for the number of L2 cache shards */
+#define MAX_L2_CACHE_SHARDS 64
+
 #define DEFAULT_CLUSTER_SIZE 65536
 
 #define QCOW2_OPT_DATA_FILE "data-file"
@@ -150,6 +156,10 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_L2_CACHE_SHARDS "l2-cache-shards"
+#define QCOW2_OPT_L2_PREFETCH_HINTS "l2-prefetch-hints"
+#define QCOW2_OPT_COMPRESSION_ACCEL "compression-accel"
+#define QCOW2_OPT_INCREMENTAL_BITMAP_STORE "incremental-bitmap-store"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -348,6 +358,18 @@ typedef struct BDRVQcow2State {
     QEMUTimer *cache_clean_timer;
     unsigned cache_clean_interval;
 
+    /*
+     * Guest offsets of L2 slices that were cached when the image was last
+     * closed (L2 prefetch hints header extension)
+     */
+    uint64_t *l2_hints;
+    int nb_l2_hints;
+    bool l2_hints_dirty;
+    bool l2_prefetch_hints;
+
+    /* Only write back the changed clusters of persistent bitmaps */
+    bool incremental_bitmap_store;
+
     QLIST_HEAD(, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -422,6 +444,12 @@ typedef struct BDRVQcow2State {
      * is to convert the image with the desired compression type set.
      */
     Qcow2CompressionType compression_type;
+
+    /*
+     * Offload engine used for compressing clusters.  The resolved value is
+     * never QCOW2_COMPRESSION_ACCEL_AUTO.
+     */
+    Qcow2CompressionAccel compression_accel;
 } BDRVQcow2State;
 
 typedef struct Qcow2COWRegion {
@@ -888,7 +916,7 @@ qcow2_update_snapshot_refcount(BlockDriverState *bs, int64_t l1_table_offset,
 int GRAPH_RDLOCK qcow2_flush_caches(BlockDriverState *bs);
 int GRAPH_RDLOCK qcow2_write_caches(BlockDriverState *bs);
 int coroutine_fn qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
-                                       BdrvCheckMode fix);
+                                       BdrvCheckMode fix, int parallel);
 
 void GRAPH_RDLOCK qcow2_process_discards(BlockDriverState *bs, int ret);
 
@@ -996,7 +1024,8 @@ qcow2_check_fix_snapshot_table(BlockDriverState *bs, BdrvCheckResult *result,
 
 /* qcow2-cache.c functions */
 Qcow2Cache * GRAPH_RDLOCK
-qcow2_cache_create(BlockDriverState *bs, int num_tables, unsigned table_size);
+qcow2_cache_create(BlockDriverState *bs, int num_tables, unsigned table_size,
+                   int num_shards);
 
 int qcow2_cache_destroy(Qcow2Cache *c);
 
@@ -1058,6 +1087,10 @@ bool qcow2_supports_persistent_dirty_bitmap(BlockDriverState *bs);
 uint64_t qcow2_get_persistent_dirty_bitmap_size(BlockDriverState *bs,
                                                 uint32_t cluster_size);
 
+int qcow2_compression_accel_resolve(Qcow2CompressionType type,
+                                    Qcow2CompressionAccel accel,
+                                    Qcow2CompressionAccel *resolved,
+                                    Error **errp);
 ssize_t coroutine_fn
 qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
                   const void *src, size_t src_size);
@@ -23,12 +23,14 @@
  */
 
 #include "qemu/osdep.h"
+#include <math.h>
 #include "system/block-backend.h"
 #include "block/throttle-groups.h"
 #include "qemu/throttle-options.h"
 #include "qemu/main-loop.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
+#include "qemu/units.h"
 #include "system/qtest.h"
 #include "qapi/error.h"
 #include "qapi/qapi-visit-block-core.h"
@@ -62,6 +64,14 @@ static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
  * blk_set_aio_context()). Therefore in this file a thread will
  * access some other ThrottleGroupMember's timers only after verifying that
  * that ThrottleGroupMember has throttled requests in the queue.
+ *
+ * To keep tg->lock off the path of requests that aren't throttled, members
+ * take small slices of the group budget (ThrottleCredit) and use them up
+ * without the lock, see throttle_group_take_credit().  A slice is accounted
+ * to the group when it is handed out, so the group limits hold no matter
+ * which member or thread ends up using it.  Unused credit is dropped when
+ * the group starts throttling or its configuration changes, which is what
+ * credit_gen tracks.
  */
 struct ThrottleGroup {
     Object parent_obj;
@@ -77,10 +87,20 @@ struct ThrottleGroup {
     bool any_timer_armed[THROTTLE_MAX];
     QEMUClockType clock_type;
 
+    /* Written under the lock, read with atomic operations */
+    unsigned credit_gen[THROTTLE_MAX];
+
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
 };
 
+/* How much of the group budget a member takes at once */
+#define THROTTLE_CREDIT_SLICE_NS (1 * SCALE_MS)
+
+/* Slices below these sizes aren't worth it, the request rate is low anyway */
+#define THROTTLE_CREDIT_MIN_UNITS 4
+#define THROTTLE_CREDIT_MIN_BYTES (256 * KiB)
+
 /* This is protected by the global QEMU mutex */
 static QTAILQ_HEAD(, ThrottleGroup) throttle_groups =
     QTAILQ_HEAD_INITIALIZER(throttle_groups);
@@ -287,11 +307,132 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
     if (must_wait) {
         tg->tokens[direction] = tgm;
         tg->any_timer_armed[direction] = true;
+        /* Members must queue up behind the throttled request from now on */
+        qatomic_inc(&tg->credit_gen[direction]);
     }
 
     return must_wait;
 }
 
+/* Compute the size of a credit slice for a direction. Resources without a
+ * limit are not tracked and get an infinite slice.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @ret: whether members should take credit for this direction
+ */
+static bool throttle_group_credit_slice(ThrottleState *ts,
+                                        ThrottleDirection direction,
+                                        double *units, double *bytes)
+{
+    static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
+        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+    };
+    static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
+        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
+        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
+    };
+    double slice = (double)THROTTLE_CREDIT_SLICE_NS / NANOSECONDS_PER_SECOND;
+    unsigned i;
+
+    *units = *bytes = INFINITY;
+    for (i = 0; i < ARRAY_SIZE(bucket_types_units[THROTTLE_READ]); i++) {
+        uint64_t avg;
+
+        avg = ts->cfg.buckets[bucket_types_units[direction][i]].avg;
+        if (avg) {
+            *units = MIN(*units, avg * slice);
+        }
+        avg = ts->cfg.buckets[bucket_types_size[direction][i]].avg;
+        if (avg) {
+            *bytes = MIN(*bytes, avg * slice);
+        }
+    }
+
+    if (isinf(*units) && isinf(*bytes)) {
+        return false;
+    }
+    return *units >= THROTTLE_CREDIT_MIN_UNITS &&
+           *bytes >= THROTTLE_CREDIT_MIN_BYTES;
+}
+
+/* Hand out a slice of the group budget to a ThrottleGroupMember if the group
+ * isn't throttling requests at the moment.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the ThrottleGroupMember
+ * @direction: the ThrottleDirection
+ */
+static void throttle_group_refill_credit(ThrottleGroupMember *tgm,
+                                         ThrottleDirection direction)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    ThrottleCredit *credit = &tgm->credit[direction];
+    double units, bytes;
+
+    if (tg->any_timer_armed[direction] || tgm->pending_reqs[direction] ||
+        qatomic_read(&tgm->io_limits_disabled) ||
+        !throttle_group_credit_slice(ts, direction, &units, &bytes) ||
+        throttle_would_wait(ts, tg->clock_type, direction)) {
+        return;
+    }
+
+    throttle_account_units(ts, direction, isinf(units) ? 0 : units,
+                           isinf(bytes) ? 0 : bytes);
+
+    qemu_spin_lock(&tgm->credit_lock);
+    if (credit->gen != tg->credit_gen[direction]) {
+        credit->gen = tg->credit_gen[direction];
+        credit->units = 0;
+        credit->bytes = 0;
+    }
+    credit->units += units;
+    credit->bytes += bytes;
+    credit->op_size = ts->cfg.op_size;
+    qemu_spin_unlock(&tgm->credit_lock);
+}
+
+/* Use up credit of a ThrottleGroupMember for an I/O request. This doesn't
+ * need tg->lock.
+ *
+ * @tgm:       the ThrottleGroupMember
+ * @bytes:     the number of bytes for this I/O
+ * @direction: the ThrottleDirection
+ * @ret:       whether the request was covered by the credit
+ */
+static bool throttle_group_take_credit(ThrottleGroupMember *tgm,
+                                       int64_t bytes,
+                                       ThrottleDirection direction)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    ThrottleCredit *credit = &tgm->credit[direction];
+    unsigned gen = qatomic_read(&tg->credit_gen[direction]);
+    double units = 1.0;
+    bool ret = false;
+
+    /* Don't overtake throttled requests of this member */
+    if (qatomic_read(&tgm->pending_reqs[direction])) {
+        return false;
+    }
+
+    qemu_spin_lock(&tgm->credit_lock);
+    if (credit->op_size && bytes > credit->op_size) {
+        units = (double) bytes / credit->op_size;
+    }
+    if (credit->gen == gen && credit->units >= units &&
+        credit->bytes >= bytes) {
+        credit->units -= units;
+        credit->bytes -= bytes;
+        ret = true;
+    }
+    qemu_spin_unlock(&tgm->credit_lock);
+
+    return ret;
+}
+
 /* Start the next pending I/O request for a ThrottleGroupMember. Return whether
  * any request was actually pending.
  *
@@ -369,6 +510,10 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     assert(bytes >= 0);
     assert(direction < THROTTLE_MAX);
 
+    if (throttle_group_take_credit(tgm, bytes, direction)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
 
     /* First we check if this I/O has to be throttled. */
@@ -393,6 +538,9 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* Schedule the next request */
     schedule_next_request(tgm, direction);
 
+    /* Let the next requests of this member bypass the lock */
+    throttle_group_refill_credit(tgm, direction);
+
     qemu_mutex_unlock(&tg->lock);
 }
 
@@ -442,7 +590,7 @@ static void throttle_group_restart_queue(ThrottleGroupMember *tgm,
 
     qatomic_inc(&tgm->restart_pending);
 
-    co = qemu_coroutine_create(throttle_group_restart_queue_entry, rd);
+    co = qemu_coroutine_create_small(throttle_group_restart_queue_entry, rd);
     aio_co_enter(tgm->aio_context, co);
 }
 
@@ -465,6 +613,21 @@ void throttle_group_restart_tgm(ThrottleGroupMember *tgm)
     }
 }
 
+/* Apply a new configuration and drop all credit that was taken under the old
+ * one.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_do_config(ThrottleGroup *tg, ThrottleConfig *cfg)
+{
+    ThrottleDirection dir;
+
+    throttle_config(&tg->ts, tg->clock_type, cfg);
+    for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+        qatomic_inc(&tg->credit_gen[dir]);
+    }
+}
+
 /* Update the throttle configuration for a particular group. Similar
  * to throttle_config(), but guarantees atomicity within the
  * throttling group.
@@ -477,7 +640,7 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     qemu_mutex_lock(&tg->lock);
-    throttle_config(ts, tg->clock_type, cfg);
+    throttle_group_do_config(tg, cfg);
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -551,6 +714,8 @@ void throttle_group_register_tgm(ThrottleGroupMember *tgm,
     tgm->throttle_state = ts;
     tgm->aio_context = ctx;
     qatomic_set(&tgm->restart_pending, 0);
+    qemu_spin_init(&tgm->credit_lock);
+    memset(tgm->credit, 0, sizeof(tgm->credit));
 
     QEMU_LOCK_GUARD(&tg->lock);
     /* If the ThrottleGroup is new set this ThrottleGroupMember as the token */
@@ -902,7 +1067,7 @@ static void throttle_group_set_limits(Object *obj, Visitor *v,
     if (local_err) {
         goto unlock;
     }
-    throttle_config(&tg->ts, tg->clock_type, &cfg);
+    throttle_group_do_config(tg, &cfg);
 
 unlock:
     qemu_mutex_unlock(&tg->lock);
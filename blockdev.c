@@ -2729,6 +2729,9 @@ static BlockJob *do_backup_common(BackupCommon *backup,
         if (backup->x_perf->has_min_cluster_size) {
             perf.min_cluster_size = backup->x_perf->min_cluster_size;
         }
+        if (backup->x_perf->has_adaptive) {
+            perf.adaptive = backup->x_perf->adaptive;
+        }
     }
 
     if ((backup->sync == MIRROR_SYNC_MODE_BITMAP) ||
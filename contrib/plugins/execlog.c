@@ -22,9 +22,17 @@ typedef struct {
     const char *name;
 } Register;
 
+/*
+ * Size beyond which the logged lines of a vCPU are output.  0 outputs
+ * every line at once, so nothing is lost if QEMU crashes or hangs.
+ */
+static size_t output_batch;
+
 typedef struct CPU {
     /* Store last executed instruction on each vCPU as a GString */
     GString *last_exec;
+    /* Logged instructions not output yet */
+    GString *out;
     /* Ptr array of Register */
     GPtrArray *registers;
 } CPU;
@@ -51,6 +59,22 @@ static CPU *get_cpu(int vcpu_index)
     return c;
 }
 
+/**
+ * Queue the last executed instruction for output
+ *
+ * Lines are output in batches rather than one by one, as each
+ * qemu_plugin_outs() takes the log lock and writes out.
+ */
+static void log_last_exec(CPU *cpu)
+{
+    g_string_append_len(cpu->out, cpu->last_exec->str, cpu->last_exec->len);
+    g_string_append_c(cpu->out, '\n');
+    if (cpu->out->len >= output_batch) {
+        qemu_plugin_outs(cpu->out->str);
+        g_string_truncate(cpu->out, 0);
+    }
+}
+
 /**
  * Add memory read or write information to current instruction log
  */
@@ -122,8 +146,7 @@ static void vcpu_insn_exec_with_regs(unsigned int cpu_index, void *udata)
             insn_check_regs(cpu);
         }
 
-        qemu_plugin_outs(cpu->last_exec->str);
-        qemu_plugin_outs("\n");
+        log_last_exec(cpu);
     }
 
     /* Store new instruction in cache */
@@ -143,8 +166,7 @@ static void vcpu_insn_exec_only_regs(unsigned int cpu_index, void *udata)
             insn_check_regs(cpu);
         }
 
-        qemu_plugin_outs(cpu->last_exec->str);
-        qemu_plugin_outs("\n");
+        log_last_exec(cpu);
     }
 
     /* reset */
@@ -158,8 +180,7 @@ static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
 
     /* Print previous instruction in cache */
     if (cpu->last_exec->len) {
-        qemu_plugin_outs(cpu->last_exec->str);
-        qemu_plugin_outs("\n");
+        log_last_exec(cpu);
     }
 
     /* Store new instruction in cache */
@@ -391,6 +412,7 @@ static void vcpu_init(qemu_plugin_id_t id, unsigned int vcpu_index)
 
     c = get_cpu(vcpu_index);
     c->last_exec = g_string_new(NULL);
+    c->out = g_string_sized_new(output_batch + 1);
     c->registers = registers_init(vcpu_index);
 }
 
@@ -403,6 +425,9 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     g_rw_lock_reader_lock(&expand_array_lock);
     for (i = 0; i < cpus->len; i++) {
         CPU *c = get_cpu(i);
+        if (c->out && c->out->len) {
+            qemu_plugin_outs(c->out->str);
+        }
         if (c->last_exec && c->last_exec->str) {
             qemu_plugin_outs(c->last_exec->str);
             qemu_plugin_outs("\n");
@@ -471,6 +496,8 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
                 return -1;
             }
             all_reg_names = g_ptr_array_new();
+        } else if (g_strcmp0(tokens[0], "batch") == 0) {
+            output_batch = g_ascii_strtoull(tokens[1], NULL, 10);
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
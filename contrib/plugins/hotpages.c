@@ -27,6 +27,7 @@ static uint64_t page_mask;
 static int limit = 50;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 static bool track_io;
+static uint64_t sample = 1;
 
 enum sort_type {
     SORT_RW = 0,
@@ -45,8 +46,22 @@ typedef struct {
     uint64_t writes;
 } PageCounters;
 
+/*
+ * Accesses are recorded per vCPU and only merged into the shared table
+ * once the buffer fills up, so that vCPUs don't serialize on the lock.
+ * Each entry is a page address with bit 0 set for stores.
+ */
+#define VCPU_BATCH 256
+
+typedef struct {
+    uint64_t skip;
+    uint64_t n;
+    uint64_t entries[VCPU_BATCH];
+} VCPUBatch;
+
 static GMutex lock;
 static GHashTable *pages;
+static struct qemu_plugin_scoreboard *batches;
 
 static gint cmp_access_count(gconstpointer a, gconstpointer b, gpointer d)
 {
@@ -73,12 +88,44 @@ static gint cmp_access_count(gconstpointer a, gconstpointer b, gpointer d)
 }
 
 
+static void drain_batch(unsigned int cpu_index, VCPUBatch *batch)
+{
+    uint64_t i;
+
+    g_mutex_lock(&lock);
+    for (i = 0; i < batch->n; i++) {
+        uint64_t page = batch->entries[i] & ~page_mask;
+        PageCounters *count = g_hash_table_lookup(pages, &page);
+
+        if (!count) {
+            count = g_new0(PageCounters, 1);
+            count->page_address = page;
+            g_hash_table_insert(pages, &count->page_address, count);
+        }
+        if (batch->entries[i] & 1) {
+            count->writes += sample;
+            count->cpu_write |= (1 << cpu_index);
+        } else {
+            count->reads += sample;
+            count->cpu_read |= (1 << cpu_index);
+        }
+    }
+    g_mutex_unlock(&lock);
+
+    batch->n = 0;
+}
+
 static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
     g_autoptr(GString) report = g_string_new("Addr, RCPUs, Reads, WCPUs, Writes\n");
     int i;
     GList *counts;
 
+    for (i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        drain_batch(i, qemu_plugin_scoreboard_find(batches, i));
+    }
+    qemu_plugin_scoreboard_free(batches);
+
     counts = g_hash_table_get_values(pages);
     if (counts && g_list_next(counts)) {
         GList *it;
@@ -104,16 +151,26 @@ static void plugin_init(void)
 {
     page_mask = (page_size - 1);
     pages = g_hash_table_new(g_int64_hash, g_int64_equal);
+    batches = qemu_plugin_scoreboard_new(sizeof(VCPUBatch));
 }
 
 static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
                        uint64_t vaddr, void *udata)
 {
-    struct qemu_plugin_hwaddr *hwaddr = qemu_plugin_get_hwaddr(meminfo, vaddr);
+    VCPUBatch *batch = qemu_plugin_scoreboard_find(batches, cpu_index);
+    struct qemu_plugin_hwaddr *hwaddr;
     uint64_t page;
-    PageCounters *count;
+
+    /* Only record one access out of every @sample */
+    if (sample > 1) {
+        if (++batch->skip < sample) {
+            return;
+        }
+        batch->skip = 0;
+    }
 
     /* We only get a hwaddr for system emulation */
+    hwaddr = qemu_plugin_get_hwaddr(meminfo, vaddr);
     if (track_io) {
         if (hwaddr && qemu_plugin_hwaddr_is_io(hwaddr)) {
             page = vaddr;
@@ -129,23 +186,10 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
     }
     page &= ~page_mask;
 
-    g_mutex_lock(&lock);
-    count = (PageCounters *) g_hash_table_lookup(pages, &page);
-
-    if (!count) {
-        count = g_new0(PageCounters, 1);
-        count->page_address = page;
-        g_hash_table_insert(pages, &count->page_address, count);
+    batch->entries[batch->n++] = page | qemu_plugin_mem_is_store(meminfo);
+    if (batch->n == VCPU_BATCH) {
+        drain_batch(cpu_index, batch);
     }
-    if (qemu_plugin_mem_is_store(meminfo)) {
-        count->writes++;
-        count->cpu_write |= (1 << cpu_index);
-    } else {
-        count->reads++;
-        count->cpu_read |= (1 << cpu_index);
-    }
-
-    g_mutex_unlock(&lock);
 }
 
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
@@ -189,6 +233,17 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
             }
         } else if (g_strcmp0(tokens[0], "pagesize") == 0) {
             page_size = g_ascii_strtoull(tokens[1], NULL, 10);
+            /* Bit 0 of a batched page address is the store flag */
+            if (page_size < 2) {
+                fprintf(stderr, "invalid value to pagesize: %s\n", tokens[1]);
+                return -1;
+            }
+        } else if (g_strcmp0(tokens[0], "sample") == 0) {
+            sample = g_ascii_strtoull(tokens[1], NULL, 10);
+            if (sample == 0) {
+                fprintf(stderr, "invalid value to sample: %s\n", tokens[1]);
+                return -1;
+            }
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
@@ -389,6 +389,16 @@ static int do_qcrypto_block_cipher_encdec(QCryptoCipher *cipher,
     assert(QEMU_IS_ALIGNED(offset, sectorsize));
     assert(QEMU_IS_ALIGNED(len, sectorsize));
 
+    /*
+     * Only ESSIV uses a cipher object of its own to compute the IV, the
+     * other generators just encode the sector number and can run in
+     * parallel without taking the mutex for every sector.
+     */
+    if (niv &&
+        qcrypto_ivgen_get_algorithm(ivgen) != QCRYPTO_IV_GEN_ALGO_ESSIV) {
+        ivgen_mutex = NULL;
+    }
+
     while (len > 0) {
         size_t nbytes;
         if (niv) {
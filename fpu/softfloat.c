@@ -2901,7 +2901,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2910,6 +2911,38 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ua;
+    union_float32 ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    /*
+     * Inexact is already set, so the only flags a narrowing conversion
+     * can raise come with an infinite result, or with a result that is
+     * tiny before or after rounding from a non-zero input; leave those
+     * to the soft path.
+     */
+    ur.h = ua.h;
+    if (unlikely(f32_is_inf(ur))) {
+        goto soft;
+    } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && !float64_is_zero(ua.s)) {
+        goto soft;
+    }
+    return ur.s;
+
+ soft:
+    return soft_float64_to_float32(ua.s, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
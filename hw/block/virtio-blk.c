@@ -978,11 +978,60 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
     return 0;
 }
 
+/*
+ * With batch-vqs=on, requests from all virtqueues that are handled by a
+ * thread in one event loop iteration are submitted together.  The deferred
+ * call section is closed by a BH, which runs at the start of the next
+ * aio_poll() iteration, before the thread could block.
+ */
+typedef struct {
+    bool active;
+    unsigned nr_vqs;
+    unsigned nr_reqs;
+} VirtIOBlockBatch;
+
+/* Only used outside coroutines, so use __thread */
+static __thread VirtIOBlockBatch virtio_blk_batch;
+
+static void virtio_blk_batch_end_bh(void *opaque)
+{
+    VirtIOBlockBatch *batch = &virtio_blk_batch;
+
+    trace_virtio_blk_batch_end(batch->nr_vqs, batch->nr_reqs);
+    batch->active = false;
+    batch->nr_vqs = 0;
+    batch->nr_reqs = 0;
+    defer_call_end();
+}
+
+static VirtIOBlockBatch *virtio_blk_batch_begin(VirtIOBlock *s)
+{
+    VirtIOBlockBatch *batch = &virtio_blk_batch;
+
+    /*
+     * Without ioeventfd, virtqueues are handled in vCPU threads, which have
+     * no event loop to end the batch.
+     */
+    if (!s->conf.batch_vqs || !s->ioeventfd_started) {
+        return NULL;
+    }
+
+    if (!batch->active) {
+        batch->active = true;
+        defer_call_begin();
+        aio_bh_schedule_oneshot(qemu_get_current_aio_context(),
+                                virtio_blk_batch_end_bh, NULL);
+    }
+    batch->nr_vqs++;
+    return batch;
+}
+
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
     VirtIOBlockReq *req;
     MultiReqBuffer mrb = {};
     bool suppress_notifications = virtio_queue_get_notification(vq);
+    VirtIOBlockBatch *batch = virtio_blk_batch_begin(s);
 
     defer_call_begin();
 
@@ -992,6 +1041,9 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
         }
 
         while ((req = virtio_blk_get_request(s, vq))) {
+            if (batch) {
+                batch->nr_reqs++;
+            }
             if (virtio_blk_handle_request(req, &mrb)) {
                 virtqueue_detach_element(req->vq, &req->elem, 0);
                 g_free(req);
@@ -1869,6 +1921,7 @@ static const Property virtio_blk_properties[] = {
                        VIRTIO_BLK_AUTO_NUM_QUEUES),
     DEFINE_PROP_UINT16("queue-size", VirtIOBlock, conf.queue_size, 256),
     DEFINE_PROP_BOOL("seg-max-adjust", VirtIOBlock, conf.seg_max_adjust, true),
+    DEFINE_PROP_BOOL("batch-vqs", VirtIOBlock, conf.batch_vqs, false),
     DEFINE_PROP_LINK("iothread", VirtIOBlock, conf.iothread, TYPE_IOTHREAD,
                      IOThread *),
     DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIOBlock,
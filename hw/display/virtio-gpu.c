@@ -437,6 +437,8 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
     pixman_format_code_t format;
     struct virtio_gpu_transfer_to_host_2d t2d;
     void *img_data;
+    unsigned int iov_idx = 0;
+    size_t iov_start = 0;
 
     VIRTIO_GPU_FILL_CMD(t2d);
     virtio_gpu_t2d_bswap(&t2d);
@@ -472,7 +474,18 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
             src_offset = t2d.offset + stride * h;
             dst_offset = (t2d.r.y + h) * stride + (t2d.r.x * bpp);
 
-            iov_to_buf(res->iov, res->iov_cnt, src_offset,
+            /*
+             * Lines are copied in increasing source order, so resume the
+             * iovec walk where the previous line left it instead of
+             * skipping over all of the backing entries again.
+             */
+            while (iov_idx < res->iov_cnt &&
+                   iov_start + res->iov[iov_idx].iov_len <= src_offset) {
+                iov_start += res->iov[iov_idx].iov_len;
+                iov_idx++;
+            }
+            iov_to_buf(res->iov + iov_idx, res->iov_cnt - iov_idx,
+                       src_offset - iov_start,
                        (uint8_t *)img_data + dst_offset,
                        t2d.r.width * bpp);
         }
@@ -56,6 +56,9 @@
 
 #define E1000E_MAX_TX_FRAGS (64)
 
+/* Number of TX descriptors fetched with one DMA read */
+#define E1000E_TX_DESC_BURST (16)
+
 union e1000_rx_desc_union {
     struct e1000_rx_desc legacy;
     union e1000_rx_desc_extended extended;
@@ -809,6 +812,25 @@ e1000e_ring_head_descr(E1000ECore *core, const E1000ERingInfo *r)
     return e1000e_ring_base(core, r) + E1000_RING_DESC_LEN * core->mac[r->dh];
 }
 
+/*
+ * Number of descriptors, at most @max, that can be fetched in one go
+ * starting at the head of a non-empty ring: up to the tail, or up to the
+ * end of the ring if the tail has wrapped.
+ */
+static inline uint32_t
+e1000e_ring_head_contig(E1000ECore *core, const E1000ERingInfo *r,
+                        uint32_t max)
+{
+    uint32_t head = core->mac[r->dh];
+    uint32_t tail = core->mac[r->dt];
+    uint32_t len = core->mac[r->dlen] / E1000_RING_DESC_LEN;
+
+    if (head >= len) {
+        return 1;
+    }
+    return MIN((tail > head ? tail : len) - head, max);
+}
+
 static inline void
 e1000e_ring_advance(E1000ECore *core, const E1000ERingInfo *r, uint32_t count)
 {
@@ -895,10 +917,11 @@ static void
 e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
 {
     dma_addr_t base;
-    struct e1000_tx_desc desc;
+    struct e1000_tx_desc descs[E1000E_TX_DESC_BURST];
     bool ide = false;
     const E1000ERingInfo *txi = txr->i;
     uint32_t cause = E1000_ICS_TXQE;
+    uint32_t i, n;
 
     if (!(core->mac[TCTL] & E1000_TCTL_EN)) {
         trace_e1000e_tx_disabled();
@@ -906,17 +929,28 @@ e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
     }
 
     while (!e1000e_ring_empty(core, txi)) {
+        /*
+         * Descriptors between head and tail belong to the device, so fetch
+         * as many of them as possible with a single DMA read, like real
+         * hardware prefetches them.
+         */
         base = e1000e_ring_head_descr(core, txi);
+        n = e1000e_ring_head_contig(core, txi, ARRAY_SIZE(descs));
+
+        pci_dma_read(core->owner, base, descs, n * sizeof(descs[0]));
 
-        pci_dma_read(core->owner, base, &desc, sizeof(desc));
+        for (i = 0; i < n; i++, base += E1000_RING_DESC_LEN) {
+            struct e1000_tx_desc *desc = &descs[i];
 
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.buffer_addr,
-                              desc.lower.data, desc.upper.data);
+            trace_e1000e_tx_descr((void *)(intptr_t)desc->buffer_addr,
+                                  desc->lower.data, desc->upper.data);
 
-        e1000e_process_tx_desc(core, txr->tx, &desc, txi->idx);
-        cause |= e1000e_txdesc_writeback(core, base, &desc, &ide, txi->idx);
+            e1000e_process_tx_desc(core, txr->tx, desc, txi->idx);
+            cause |= e1000e_txdesc_writeback(core, base, desc, &ide,
+                                             txi->idx);
 
-        e1000e_ring_advance(core, txi, 1);
+            e1000e_ring_advance(core, txi, 1);
+        }
     }
 
     if (!ide || !e1000e_intrmgr_delay_tx_causes(core, &cause)) {
@@ -57,6 +57,9 @@
 
 #define E1000E_MAX_TX_FRAGS (64)
 
+/* Number of TX descriptors fetched with one DMA read */
+#define IGB_TX_DESC_BURST (16)
+
 union e1000_rx_desc_union {
     struct e1000_rx_desc legacy;
     union e1000_adv_rx_desc adv;
@@ -720,6 +723,24 @@ igb_ring_head_descr(IGBCore *core, const E1000ERingInfo *r)
     return igb_ring_base(core, r) + E1000_RING_DESC_LEN * core->mac[r->dh];
 }
 
+/*
+ * Number of descriptors, at most @max, that can be fetched in one go
+ * starting at the head of a non-empty ring: up to the tail, or up to the
+ * end of the ring if the tail has wrapped.
+ */
+static inline uint32_t
+igb_ring_head_contig(IGBCore *core, const E1000ERingInfo *r, uint32_t max)
+{
+    uint32_t head = core->mac[r->dh];
+    uint32_t tail = core->mac[r->dt];
+    uint32_t len = core->mac[r->dlen] / E1000_RING_DESC_LEN;
+
+    if (head >= len) {
+        return 1;
+    }
+    return MIN((tail > head ? tail : len) - head, max);
+}
+
 static inline void
 igb_ring_advance(IGBCore *core, const E1000ERingInfo *r, uint32_t count)
 {
@@ -876,9 +897,10 @@ igb_start_xmit(IGBCore *core, const IGB_TxRing *txr)
 {
     PCIDevice *d;
     dma_addr_t base;
-    union e1000_adv_tx_desc desc;
+    union e1000_adv_tx_desc descs[IGB_TX_DESC_BURST];
     const E1000ERingInfo *txi = txr->i;
     uint32_t eic = 0;
+    uint32_t i, n;
 
     if (!igb_tx_enabled(core, txi)) {
         trace_e1000e_tx_disabled();
@@ -891,16 +913,26 @@ igb_start_xmit(IGBCore *core, const IGB_TxRing *txr)
     }
 
     while (!igb_ring_empty(core, txi)) {
+        /*
+         * Descriptors between head and tail belong to the device, so fetch
+         * as many of them as possible with a single DMA read, like real
+         * hardware prefetches them.
+         */
         base = igb_ring_head_descr(core, txi);
+        n = igb_ring_head_contig(core, txi, ARRAY_SIZE(descs));
+
+        pci_dma_read(d, base, descs, n * sizeof(descs[0]));
 
-        pci_dma_read(d, base, &desc, sizeof(desc));
+        for (i = 0; i < n; i++, base += E1000_RING_DESC_LEN) {
+            union e1000_adv_tx_desc *desc = &descs[i];
 
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.read.buffer_addr,
-                              desc.read.cmd_type_len, desc.wb.status);
+            trace_e1000e_tx_descr((void *)(intptr_t)desc->read.buffer_addr,
+                                  desc->read.cmd_type_len, desc->wb.status);
 
-        igb_process_tx_desc(core, d, txr->tx, &desc, txi->idx);
-        igb_ring_advance(core, txi, 1);
-        eic |= igb_txdesc_writeback(core, base, &desc, txi);
+            igb_process_tx_desc(core, d, txr->tx, desc, txi->idx);
+            igb_ring_advance(core, txi, 1);
+            eic |= igb_txdesc_writeback(core, base, desc, txi);
+        }
     }
 
     if (eic) {
@@ -199,6 +199,7 @@
 #include "qemu/log.h"
 #include "qemu/units.h"
 #include "qemu/range.h"
+#include "qemu/timer.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
 #include "system/system.h"
@@ -257,6 +258,7 @@ static const uint32_t nvme_feature_cap[NVME_FID_MAX] = {
     [NVME_ERROR_RECOVERY]           = NVME_FEAT_CAP_CHANGE | NVME_FEAT_CAP_NS,
     [NVME_VOLATILE_WRITE_CACHE]     = NVME_FEAT_CAP_CHANGE,
     [NVME_NUMBER_OF_QUEUES]         = NVME_FEAT_CAP_CHANGE,
+    [NVME_INTERRUPT_COALESCING]     = NVME_FEAT_CAP_CHANGE,
     [NVME_WRITE_ATOMICITY]          = NVME_FEAT_CAP_CHANGE,
     [NVME_ASYNCHRONOUS_EVENT_CONF]  = NVME_FEAT_CAP_CHANGE,
     [NVME_TIMESTAMP]                = NVME_FEAT_CAP_CHANGE,
@@ -688,6 +690,45 @@ static void nvme_irq_assert(NvmeCtrl *n, NvmeCQueue *cq)
     }
 }
 
+static void nvme_cq_coalesce_timer(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    cq->coalesced = 0;
+    if (cq->tail != cq->head) {
+        nvme_irq_assert(cq->ctrl, cq);
+    }
+}
+
+/*
+ * Signal @posted new completion entries on @cq, honoring the Interrupt
+ * Coalescing feature.  The interrupt is delayed until more than the
+ * Aggregation Threshold entries are pending or the Aggregation Time
+ * expires.  The admin vector is never coalesced, as reported through the
+ * Interrupt Vector Configuration feature.
+ */
+static void nvme_cq_notify(NvmeCtrl *n, NvmeCQueue *cq, unsigned posted)
+{
+    uint32_t intc = n->features.int_coalescing;
+
+    if (cq->irq_enabled && NVME_INTC_TIME(intc) &&
+        cq->vector != n->admin_cq.vector) {
+        cq->coalesced += posted;
+        if (cq->coalesced <= NVME_INTC_THR(intc)) {
+            if (!timer_pending(cq->coalesce_timer)) {
+                timer_mod(cq->coalesce_timer,
+                          qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                          NVME_INTC_TIME(intc) * 100 * SCALE_US);
+            }
+            return;
+        }
+        timer_del(cq->coalesce_timer);
+    }
+
+    cq->coalesced = 0;
+    nvme_irq_assert(n, cq);
+}
+
 static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
 {
     if (cq->irq_enabled) {
@@ -1499,6 +1540,7 @@ static void nvme_post_cqes(void *opaque)
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
     bool pending = cq->head != cq->tail;
+    unsigned posted = 0;
     int ret;
 
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
@@ -1532,6 +1574,7 @@ static void nvme_post_cqes(void *opaque)
 
         nvme_inc_cq_tail(cq);
         nvme_sg_unmap(&req->sg);
+        posted++;
 
         if (QTAILQ_EMPTY(&sq->req_list) && !nvme_sq_empty(sq)) {
             qemu_bh_schedule(sq->bh);
@@ -1544,7 +1587,7 @@ static void nvme_post_cqes(void *opaque)
             n->cq_pending++;
         }
 
-        nvme_irq_assert(n, cq);
+        nvme_cq_notify(n, cq, posted);
     }
 }
 
@@ -5509,6 +5552,7 @@ static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 
     n->cq[cq->cqid] = NULL;
     qemu_bh_delete(cq->bh);
+    timer_free(cq->coalesce_timer);
     if (cq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &cq->notifier);
@@ -5583,6 +5627,9 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     n->cq[cqid] = cq;
     cq->bh = qemu_bh_new_guarded(nvme_post_cqes, cq,
                                  &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    cq->coalesce_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                      nvme_cq_coalesce_timer, cq);
+    cq->coalesced = 0;
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeRequest *req)
@@ -6371,6 +6418,9 @@ static uint16_t nvme_get_feature(NvmeCtrl *n, NvmeRequest *req)
     case NVME_ASYNCHRONOUS_EVENT_CONF:
         result = n->features.async_config;
         goto out;
+    case NVME_INTERRUPT_COALESCING:
+        result = n->features.int_coalescing;
+        goto out;
     case NVME_TIMESTAMP:
         return nvme_get_feature_timestamp(n, req);
     case NVME_HOST_BEHAVIOR_SUPPORT:
@@ -6654,6 +6704,9 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeRequest *req)
     case NVME_ASYNCHRONOUS_EVENT_CONF:
         n->features.async_config = dw11;
         break;
+    case NVME_INTERRUPT_COALESCING:
+        n->features.int_coalescing = dw11 & 0xffff;
+        break;
     case NVME_TIMESTAMP:
         return nvme_set_feature_timestamp(n, req);
     case NVME_HOST_BEHAVIOR_SUPPORT:
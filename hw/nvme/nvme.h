@@ -515,6 +515,8 @@ typedef struct NvmeCQueue {
     uint64_t    db_addr;
     uint64_t    ei_addr;
     QEMUBH      *bh;
+    QEMUTimer   *coalesce_timer;
+    uint32_t    coalesced;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
@@ -636,6 +638,7 @@ typedef struct NvmeCtrl {
         };
 
         uint32_t                async_config;
+        uint32_t                int_coalescing;
         NvmeHostBehaviorSupport hbs;
     } features;
 
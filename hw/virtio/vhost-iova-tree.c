@@ -34,6 +34,10 @@ struct VhostIOVATree {
 
     /* GPA->IOVA address memory maps */
     IOVATree *gpa_iova_map;
+
+    /* Last results of the reverse lookups, reset when a mapping goes away */
+    const DMAMap *last_taddr;
+    const DMAMap *last_gpa;
 };
 
 /**
@@ -52,6 +56,8 @@ VhostIOVATree *vhost_iova_tree_new(hwaddr iova_first, hwaddr iova_last)
     tree->iova_taddr_map = iova_tree_new();
     tree->iova_map = iova_tree_new();
     tree->gpa_iova_map = gpa_tree_new();
+    tree->last_taddr = NULL;
+    tree->last_gpa = NULL;
     return tree;
 }
 
@@ -66,6 +72,30 @@ void vhost_iova_tree_delete(VhostIOVATree *iova_tree)
     g_free(iova_tree);
 }
 
+/*
+ * Reverse lookups walk the whole tree, but consecutive buffers usually
+ * fall into the same mapping.  Try the previous result first.
+ */
+static const DMAMap *vhost_iova_tree_find_cached(const IOVATree *iova_tree,
+                                                 const DMAMap **last,
+                                                 const DMAMap *map)
+{
+    const DMAMap *result = *last;
+
+    if (result && map->translated_addr >= result->translated_addr &&
+        map->size <= result->size &&
+        map->translated_addr - result->translated_addr <=
+        result->size - map->size) {
+        return result;
+    }
+
+    result = iova_tree_find_iova(iova_tree, map);
+    if (result) {
+        *last = result;
+    }
+    return result;
+}
+
 /**
  * Find the IOVA address stored from a memory address
  *
@@ -74,10 +104,11 @@ void vhost_iova_tree_delete(VhostIOVATree *iova_tree)
  *
  * Returns the stored IOVA->HVA mapping, or NULL if not found.
  */
-const DMAMap *vhost_iova_tree_find_iova(const VhostIOVATree *tree,
+const DMAMap *vhost_iova_tree_find_iova(VhostIOVATree *tree,
                                         const DMAMap *map)
 {
-    return iova_tree_find_iova(tree->iova_taddr_map, map);
+    return vhost_iova_tree_find_cached(tree->iova_taddr_map,
+                                       &tree->last_taddr, map);
 }
 
 /**
@@ -124,6 +155,7 @@ int vhost_iova_tree_map_alloc(VhostIOVATree *tree, DMAMap *map, hwaddr taddr)
  */
 void vhost_iova_tree_remove(VhostIOVATree *iova_tree, DMAMap map)
 {
+    iova_tree->last_taddr = NULL;
     iova_tree_remove(iova_tree->iova_taddr_map, map);
     iova_tree_remove(iova_tree->iova_map, map);
 }
@@ -136,10 +168,11 @@ void vhost_iova_tree_remove(VhostIOVATree *iova_tree, DMAMap map)
  *
  * Returns the stored GPA->IOVA mapping, or NULL if not found.
  */
-const DMAMap *vhost_iova_tree_find_gpa(const VhostIOVATree *tree,
+const DMAMap *vhost_iova_tree_find_gpa(VhostIOVATree *tree,
                                        const DMAMap *map)
 {
-    return iova_tree_find_iova(tree->gpa_iova_map, map);
+    return vhost_iova_tree_find_cached(tree->gpa_iova_map,
+                                       &tree->last_gpa, map);
 }
 
 /**
@@ -186,6 +219,7 @@ int vhost_iova_tree_map_alloc_gpa(VhostIOVATree *tree, DMAMap *map, hwaddr taddr
  */
 void vhost_iova_tree_remove_gpa(VhostIOVATree *iova_tree, DMAMap map)
 {
+    iova_tree->last_gpa = NULL;
     iova_tree_remove(iova_tree->gpa_iova_map, map);
     iova_tree_remove(iova_tree->iova_map, map);
 }
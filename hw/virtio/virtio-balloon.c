@@ -343,6 +343,9 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
     VirtQueueElement *elem;
 
     while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
+        RAMBlock *pending_rb = NULL;
+        ram_addr_t pending_offset = 0;
+        size_t pending_size = 0;
         unsigned int i;
 
         /*
@@ -388,7 +391,27 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
                 continue;
             }
 
-            ram_block_discard_range(rb, ram_offset, size);
+            /*
+             * Merge ranges that continue the previous one, so that
+             * neighbouring free pages cost a single discard.
+             */
+            if (rb == pending_rb &&
+                ram_offset == pending_offset + pending_size) {
+                pending_size += size;
+                continue;
+            }
+            if (pending_rb) {
+                ram_block_discard_range(pending_rb, pending_offset,
+                                        pending_size);
+            }
+            pending_rb = rb;
+            pending_offset = ram_offset;
+            pending_size = size;
+        }
+
+        /* The pages must be discarded before the guest gets them back */
+        if (pending_rb) {
+            ram_block_discard_range(pending_rb, pending_offset, pending_size);
         }
 
 skip_element:
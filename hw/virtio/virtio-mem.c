@@ -563,6 +563,29 @@ static void virtio_mem_deactivate_unplugged_memslots(VirtIOMEM *vmem,
     memory_region_transaction_commit();
 }
 
+/*
+ * Preallocation threads are only worth creating for this much memory each;
+ * plugging single small blocks stays single-threaded.
+ */
+#define VIRTIO_MEM_PREALLOC_MIN_PER_THREAD (64 * MiB)
+
+/*
+ * Preallocate part of the memory backend, using up to as many threads as
+ * configured for the backend's own preallocation, in its thread context.
+ */
+static bool virtio_mem_prealloc(VirtIOMEM *vmem, uint64_t offset,
+                                uint64_t size, Error **errp)
+{
+    HostMemoryBackend *backend = vmem->memdev;
+    void *area = memory_region_get_ram_ptr(&backend->mr) + offset;
+    int fd = memory_region_get_fd(&backend->mr);
+    uint64_t threads = DIV_ROUND_UP(size, VIRTIO_MEM_PREALLOC_MIN_PER_THREAD);
+
+    threads = MIN(threads, MAX(backend->prealloc_threads, 1));
+    return qemu_prealloc_mem(fd, area, size, threads,
+                             backend->prealloc_context, false, errp);
+}
+
 static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
                                       uint64_t size, bool plug)
 {
@@ -588,11 +611,9 @@ static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
     }
 
     if (vmem->prealloc) {
-        void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-        int fd = memory_region_get_fd(&vmem->memdev->mr);
         Error *local_err = NULL;
 
-        if (!qemu_prealloc_mem(fd, area, size, 1, NULL, false, &local_err)) {
+        if (!virtio_mem_prealloc(vmem, offset, size, &local_err)) {
             static bool warned;
 
             /*
@@ -1249,11 +1270,9 @@ static int virtio_mem_post_load(void *opaque, int version_id)
 static int virtio_mem_prealloc_range_cb(VirtIOMEM *vmem, void *arg,
                                         uint64_t offset, uint64_t size)
 {
-    void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-    int fd = memory_region_get_fd(&vmem->memdev->mr);
     Error *local_err = NULL;
 
-    if (!qemu_prealloc_mem(fd, area, size, 1, NULL, false, &local_err)) {
+    if (!virtio_mem_prealloc(vmem, offset, size, &local_err)) {
         error_report_err(local_err);
         return -ENOMEM;
     }
@@ -28,66 +28,102 @@
 
 typedef struct VirtIODeviceRequest {
     VirtQueueElement elem;
-    int fd;
-    VirtIOPMEM *pmem;
     VirtIODevice *vdev;
     struct virtio_pmem_req req;
     struct virtio_pmem_resp resp;
+    QSIMPLEQ_ENTRY(VirtIODeviceRequest) next;
 } VirtIODeviceRequest;
 
+/* One fsync() of the backing file, completing every request in @reqs */
+typedef struct VirtIOPMEMFlush {
+    VirtIOPMEM *pmem;
+    int fd;
+    int err;
+    QSIMPLEQ_HEAD(, VirtIODeviceRequest) reqs;
+} VirtIOPMEMFlush;
+
+static void virtio_pmem_submit_flush(VirtIOPMEM *pmem);
+
 static int worker_cb(void *opaque)
 {
-    VirtIODeviceRequest *req_data = opaque;
+    VirtIOPMEMFlush *flush = opaque;
     int err = 0;
 
     /* flush raw backing image */
-    err = fsync(req_data->fd);
+    err = fsync(flush->fd);
     trace_virtio_pmem_flush_done(err);
-    if (err != 0) {
-        err = 1;
-    }
-
-    virtio_stl_p(req_data->vdev, &req_data->resp.ret, err);
+    flush->err = err != 0;
 
     return 0;
 }
 
 static void done_cb(void *opaque, int ret)
 {
-    VirtIODeviceRequest *req_data = opaque;
-    int len = iov_from_buf(req_data->elem.in_sg, req_data->elem.in_num, 0,
-                              &req_data->resp, sizeof(struct virtio_pmem_resp));
+    VirtIOPMEMFlush *flush = opaque;
+    VirtIOPMEM *pmem = flush->pmem;
+    VirtIODeviceRequest *req_data;
+    int len;
 
     /* Callbacks are serialized, so no need to use atomic ops. */
-    virtqueue_push(req_data->pmem->rq_vq, &req_data->elem, len);
-    virtio_notify((VirtIODevice *)req_data->pmem, req_data->pmem->rq_vq);
-    trace_virtio_pmem_response();
-    g_free(req_data);
+    while ((req_data = QSIMPLEQ_FIRST(&flush->reqs))) {
+        QSIMPLEQ_REMOVE_HEAD(&flush->reqs, next);
+        virtio_stl_p(req_data->vdev, &req_data->resp.ret, flush->err);
+        len = iov_from_buf(req_data->elem.in_sg, req_data->elem.in_num, 0,
+                           &req_data->resp, sizeof(struct virtio_pmem_resp));
+        virtqueue_push(pmem->rq_vq, &req_data->elem, len);
+        trace_virtio_pmem_response();
+        g_free(req_data);
+    }
+    virtio_notify(VIRTIO_DEVICE(pmem), pmem->rq_vq);
+    g_free(flush);
+
+    pmem->flush_in_flight = false;
+    virtio_pmem_submit_flush(pmem);
+}
+
+/*
+ * Requests that arrive while an fsync() is running wait for it and are
+ * then served together by a single new fsync(), which covers every
+ * write they may have ordered before asking for the flush.
+ */
+static void virtio_pmem_submit_flush(VirtIOPMEM *pmem)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(pmem->memdev);
+    VirtIOPMEMFlush *flush;
+
+    if (pmem->flush_in_flight || QSIMPLEQ_EMPTY(&pmem->pending_flushes)) {
+        return;
+    }
+
+    flush = g_new0(VirtIOPMEMFlush, 1);
+    flush->pmem = pmem;
+    flush->fd = memory_region_get_fd(&backend->mr);
+    QSIMPLEQ_INIT(&flush->reqs);
+    QSIMPLEQ_CONCAT(&flush->reqs, &pmem->pending_flushes);
+    pmem->flush_in_flight = true;
+    thread_pool_submit_aio(worker_cb, flush, done_cb, flush);
 }
 
 static void virtio_pmem_flush(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIODeviceRequest *req_data;
     VirtIOPMEM *pmem = VIRTIO_PMEM(vdev);
-    HostMemoryBackend *backend = MEMORY_BACKEND(pmem->memdev);
 
     trace_virtio_pmem_flush_request();
-    req_data = virtqueue_pop(vq, sizeof(VirtIODeviceRequest));
-    if (!req_data) {
-        virtio_error(vdev, "virtio-pmem missing request data");
-        return;
-    }
 
-    if (req_data->elem.out_num < 1 || req_data->elem.in_num < 1) {
-        virtio_error(vdev, "virtio-pmem request not proper");
-        virtqueue_detach_element(vq, (VirtQueueElement *)req_data, 0);
-        g_free(req_data);
-        return;
+    /* Kicks may be coalesced, so take everything the guest queued */
+    while ((req_data = virtqueue_pop(vq, sizeof(VirtIODeviceRequest)))) {
+        if (req_data->elem.out_num < 1 || req_data->elem.in_num < 1) {
+            virtio_error(vdev, "virtio-pmem request not proper");
+            virtqueue_detach_element(vq, (VirtQueueElement *)req_data, 0);
+            g_free(req_data);
+            break;
+        }
+        req_data->vdev = vdev;
+        QSIMPLEQ_INSERT_TAIL(&pmem->pending_flushes, req_data, next);
     }
-    req_data->fd   = memory_region_get_fd(&backend->mr);
-    req_data->pmem = pmem;
-    req_data->vdev = vdev;
-    thread_pool_submit_aio(worker_cb, req_data, done_cb, req_data);
+
+    virtio_pmem_submit_flush(pmem);
 }
 
 static void virtio_pmem_get_config(VirtIODevice *vdev, uint8_t *config)
@@ -124,6 +160,8 @@ static void virtio_pmem_realize(DeviceState *dev, Error **errp)
     host_memory_backend_set_mapped(pmem->memdev, true);
     virtio_init(vdev, VIRTIO_ID_PMEM, sizeof(struct virtio_pmem_config));
     pmem->rq_vq = virtio_add_queue(vdev, 128, virtio_pmem_flush);
+    QSIMPLEQ_INIT(&pmem->pending_flushes);
+    pmem->flush_in_flight = false;
 }
 
 static void virtio_pmem_unrealize(DeviceState *dev)
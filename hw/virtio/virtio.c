@@ -614,12 +614,12 @@ static void vring_packed_desc_read(VirtIODevice *vdev,
         smp_rmb();
     }
 
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, addr),
-                              &desc->addr, sizeof(desc->addr));
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, id),
-                              &desc->id, sizeof(desc->id));
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, len),
-                              &desc->len, sizeof(desc->len));
+    /* addr, len and id are contiguous and precede flags, read them at once */
+    QEMU_BUILD_BUG_ON(offsetof(VRingPackedDesc, addr) != 0 ||
+                      offsetof(VRingPackedDesc, id) +
+                      sizeof(desc->id) != offsetof(VRingPackedDesc, flags));
+    address_space_read_cached(cache, off, desc,
+                              offsetof(VRingPackedDesc, flags));
     virtio_tswap64s(vdev, &desc->addr);
     virtio_tswap16s(vdev, &desc->id);
     virtio_tswap32s(vdev, &desc->len);
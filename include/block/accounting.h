@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-types-common.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -79,6 +80,35 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
+/*
+ * Log-linear ("HDR") latency histogram, always enabled.  Latencies below
+ * 2 << BLOCK_ACCT_HDR_SUB_BITS nanoseconds get one bucket each; above that,
+ * every power of two [2^k, 2^(k+1)) is split into 1 << BLOCK_ACCT_HDR_SUB_BITS
+ * buckets of equal width, so the relative error is at most 6.25%.  Latencies
+ * of 2^BLOCK_ACCT_HDR_MAX_BITS ns (about 68 seconds) or more all go to the
+ * separate overflow bucket at index BLOCK_ACCT_HDR_OVERFLOW, which comes
+ * after the last regular bucket.
+ *
+ * There is one histogram for each AioContext that completed requests, and
+ * in it one row of buckets for each request type that was seen, so that
+ * per-backend memory only grows with what is actually used.  Histograms
+ * and rows are allocated on first use and only freed together with the
+ * BlockAcctStats, so readers can walk them without locking.
+ */
+#define BLOCK_ACCT_HDR_SUB_BITS 4
+#define BLOCK_ACCT_HDR_MAX_BITS 36
+#define BLOCK_ACCT_HDR_OVERFLOW \
+    ((BLOCK_ACCT_HDR_MAX_BITS - BLOCK_ACCT_HDR_SUB_BITS + 1) << \
+     BLOCK_ACCT_HDR_SUB_BITS)
+#define BLOCK_ACCT_HDR_BUCKETS (BLOCK_ACCT_HDR_OVERFLOW + 1)
+
+typedef struct BlockAcctLatencyHdr BlockAcctLatencyHdr;
+struct BlockAcctLatencyHdr {
+    AioContext *ctx;
+    Stat64 *bins[BLOCK_MAX_IOTYPE]; /* BLOCK_ACCT_HDR_BUCKETS each, or NULL */
+    BlockAcctLatencyHdr *next;
+};
+
 struct BlockAcctStats {
     QemuMutex lock;
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
@@ -92,6 +122,7 @@ struct BlockAcctStats {
     bool account_invalid;
     bool account_failed;
     BlockLatencyHistogram latency_histogram[BLOCK_MAX_IOTYPE];
+    BlockAcctLatencyHdr *latency_hdr;
 };
 
 typedef struct BlockAcctCookie {
@@ -120,5 +151,7 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+BlockAcctLatencyHdr *block_acct_latency_hdr_next(BlockAcctStats *stats,
+                                                 BlockAcctLatencyHdr *hdr);
 
 #endif
@@ -21,6 +21,7 @@
 #include "qemu/queue.h"
 #include "qemu/event_notifier.h"
 #include "qemu/lockcnt.h"
+#include "qemu/stats64.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
 #include "block/graph-lock.h"
@@ -125,6 +126,7 @@ typedef QSLIST_HEAD(, AioHandler) AioHandlerSList;
 
 typedef struct AioPolledEvent {
     int64_t ns;        /* current polling time in nanoseconds */
+    int64_t last_ns;   /* when the last event was handled, 0 if never */
 } AioPolledEvent;
 
 struct AioContext {
@@ -218,6 +220,11 @@ struct AioContext {
 #endif
 #ifdef CONFIG_LINUX_IO_URING
     LuringState *linux_io_uring;
+    /*
+     * Ring with 128 byte SQEs for passthrough commands, only created for
+     * AioContexts that serve such devices
+     */
+    LuringState *linux_io_uring_cmd;
 
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
@@ -240,6 +247,18 @@ struct AioContext {
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
 
+    /*
+     * Event loop statistics.  Only updated by the thread that runs the
+     * event loop, and read by query-stats.
+     */
+    Stat64 stat_polls;           /* aio_poll() iterations */
+    Stat64 stat_poll_hits;       /* ...where busy polling made progress */
+    Stat64 stat_waits;           /* ...that called fdmon_ops->wait() */
+    Stat64 stat_wait_ns;         /* time spent in fdmon_ops->wait() */
+    Stat64 stat_dispatch_ns;     /* time running handlers, BHs and timers */
+    Stat64 stat_dispatch_max_ns; /* longest dispatch of one iteration */
+    Stat64 stat_bhs;             /* bottom halves run */
+
     /*
      * List of handlers participating in userspace polling.  Protected by
      * ctx->list_lock.  Iterated and modified mostly by the event loop thread
@@ -517,6 +536,12 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
 
 /* Return the LuringState bound to this AioContext */
 LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
+/* Setup the LuringState for passthrough commands bound to this AioContext */
+LuringState *aio_setup_linux_io_uring_cmd(AioContext *ctx, Error **errp);
+
+/* Return the LuringState for passthrough commands bound to this AioContext */
+LuringState *aio_get_linux_io_uring_cmd(AioContext *ctx);
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
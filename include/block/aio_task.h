@@ -37,6 +37,12 @@ struct AioTask {
 AioTaskPool *coroutine_fn aio_task_pool_new(int max_busy_tasks);
 void aio_task_pool_free(AioTaskPool *);
 
+/*
+ * Change the limit of parallel tasks.  Tasks already running are not
+ * affected; lowering the limit only delays the start of new ones.
+ */
+void aio_task_pool_set_max_busy_tasks(AioTaskPool *pool, int max_busy_tasks);
+
 /* error code of failed task or 0 if all is OK */
 int aio_task_pool_status(AioTaskPool *pool);
 
@@ -363,7 +363,8 @@ bdrv_truncate(BdrvChild *child, int64_t offset, bool exact,
               PreallocMode prealloc, BdrvRequestFlags flags, Error **errp);
 
 int co_wrapper_mixed_bdrv_rdlock
-bdrv_check(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode fix);
+bdrv_check(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode fix,
+           int parallel);
 
 /* Invalidate any cached metadata used by image formats */
 int co_wrapper_mixed_bdrv_rdlock
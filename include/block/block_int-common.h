@@ -776,10 +776,12 @@ struct BlockDriver {
 
     /*
      * Returns 0 for completed check, -errno for internal errors.
-     * The check results are stored in result.
+     * The check results are stored in result.  @parallel is a hint for
+     * how many metadata requests may be in flight at the same time.
      */
     int coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_check)(
-        BlockDriverState *bs, BdrvCheckResult *result, BdrvCheckMode fix);
+        BlockDriverState *bs, BdrvCheckResult *result, BdrvCheckMode fix,
+        int parallel);
 
     void coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_debug_event)(
         BlockDriverState *bs, BlkdebugEvent event);
@@ -74,7 +74,7 @@ static inline bool laio_has_fua(void)
 #endif
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(bool big_sqe, Error **errp);
 void luring_cleanup(LuringState *s);
 
 /* luring_co_submit: submit I/O requests in the thread's current AioContext. */
@@ -84,6 +84,14 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
 bool luring_has_fua(void);
+void luring_register_buf(void *host, size_t size);
+#ifdef HAVE_NVME_URING_CMD
+bool luring_has_uring_cmd(void);
+int coroutine_fn luring_co_submit_uring_cmd(BlockDriverState *bs, int fd,
+                                            uint32_t cmd_op, const void *cmd,
+                                            size_t cmd_len);
+#endif
+void luring_unregister_buf(void *host, size_t size);
 #else
 static inline bool luring_has_fua(void)
 {
@@ -26,9 +26,20 @@
 #define THROTTLE_GROUPS_H
 
 #include "qemu/coroutine.h"
+#include "qemu/thread.h"
 #include "qemu/throttle.h"
 #include "qom/object.h"
 
+/* Part of the group budget that a ThrottleGroupMember has already accounted
+ * for and can use without taking the ThrottleGroup lock.
+ */
+typedef struct ThrottleCredit {
+    unsigned gen;      /* only valid while it matches the group's */
+    double   units;    /* operations, in units of op_size */
+    double   bytes;
+    uint64_t op_size;
+} ThrottleCredit;
+
 /* The ThrottleGroupMember structure indicates membership in a ThrottleGroup
  * and holds related data.
  */
@@ -57,6 +68,12 @@ typedef struct ThrottleGroupMember {
     unsigned       pending_reqs[THROTTLE_MAX];
     QLIST_ENTRY(ThrottleGroupMember) round_robin;
 
+    /* credit_lock protects the credit, which is used from any thread that
+     * submits requests for this member.
+     */
+    QemuSpin       credit_lock;
+    ThrottleCredit credit[THROTTLE_MAX];
+
 } ThrottleGroupMember;
 
 #define TYPE_THROTTLE_GROUP "throttle-group"
@@ -29,6 +29,10 @@
 
 #define XTS_BLOCK_SIZE 16
 
+/*
+ * Encrypt or decrypt @length bytes in ECB mode.  @length is a multiple
+ * of XTS_BLOCK_SIZE and can cover many blocks; @dst may be equal to @src.
+ */
 typedef void xts_cipher_func(const void *ctx,
                              size_t length,
                              uint8_t *dst,
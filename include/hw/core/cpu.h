@@ -269,19 +269,31 @@ struct CPUTLBEntryFull {
     } extra;
 };
 
+/* Number of regions tracking the large pages of one MMU mode */
+#define CPU_TLB_LARGE_PAGES 4
+
+/*
+ * A region covering some of the large pages allocated into the tlb.
+ * Address A is within the region if (A & mask) == addr.  The region
+ * is unused if addr is -1.
+ */
+typedef struct CPUTLBLargePage {
+    vaddr addr;
+    vaddr mask;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * Describe regions covering all of the large pages allocated
+     * into the tlb.  When any page within a region is flushed, we
+     * must flush every page of the region, or the entire tlb if the
+     * region is larger than it.
      */
-    vaddr large_page_addr;
-    vaddr large_page_mask;
+    CPUTLBLargePage large_page[CPU_TLB_LARGE_PAGES];
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -295,6 +307,17 @@ typedef struct CPUTLBDesc {
     CPUTLBEntryFull *fulltlb;
 } CPUTLBDesc;
 
+/* A range of virtual addresses to flush from a set of mmu_idx */
+typedef struct CPUTLBFlushRange {
+    vaddr addr;
+    vaddr len;
+    uint16_t idxmap;
+    uint16_t bits;
+} CPUTLBFlushRange;
+
+/* Number of distinct ranges that flushes requested by other CPUs keep */
+#define CPU_TLB_PENDING_RANGES 8
+
 /*
  * Data elements that are shared between all MMU modes.
  */
@@ -307,6 +330,16 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Flushes requested by other CPUs and not applied yet.  Requests
+     * arriving while some are pending are merged into them and applied
+     * by the same run_on_cpu work, which is queued if pending_queued is
+     * false.  Protected by tlb_c.lock.
+     */
+    bool pending_queued;
+    uint16_t pending_full;
+    unsigned pending_n;
+    CPUTLBFlushRange pending[CPU_TLB_PENDING_RANGES];
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -315,6 +348,7 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t merged_flush_count;
 } CPUTLBCommon;
 
 /*
@@ -32,6 +32,10 @@ struct VirtIOPMEM {
     VirtQueue *rq_vq;
     uint64_t start;
     HostMemoryBackend *memdev;
+
+    /* Flush requests waiting for the fsync() in flight to complete */
+    QSIMPLEQ_HEAD(, VirtIODeviceRequest) pending_flushes;
+    bool flush_in_flight;
 };
 
 struct VirtIOPMEMClass {
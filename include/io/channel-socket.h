@@ -49,6 +49,8 @@ struct QIOChannelSocket {
     socklen_t remoteAddrLen;
     ssize_t zero_copy_queued;
     ssize_t zero_copy_sent;
+    /* completed zero copy sends for which the kernel copied the data */
+    ssize_t zero_copy_copied;
 };
 
 
@@ -275,4 +277,34 @@ int qio_channel_socket_set_send_buffer(QIOChannelSocket *ioc,
                                        size_t size,
                                        Error **errp);
 
+/**
+ * qio_channel_socket_enable_zero_copy:
+ * @ioc: the socket channel object
+ *
+ * Enable SO_ZEROCOPY on the socket, so that writes can be done with
+ * QIO_CHANNEL_WRITE_FLAG_ZERO_COPY.  Connected sockets enable it on
+ * their own; for accepted sockets it is up to the server to ask for
+ * it.
+ *
+ * Returns: true if QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY is now set.
+ */
+bool qio_channel_socket_enable_zero_copy(QIOChannelSocket *ioc);
+
+/**
+ * qio_channel_socket_zero_copy_poll:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Process the zero copy completion notifications that the kernel has
+ * already queued, without waiting for more.  This updates
+ * @zero_copy_sent and @zero_copy_copied.  Unlike qio_channel_flush(),
+ * it never blocks, so it can be called from coroutine context.  A
+ * buffer passed to a zero copy write may be reused once
+ * @zero_copy_sent has caught up with the value of @zero_copy_queued
+ * right after the write.
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int qio_channel_socket_zero_copy_poll(QIOChannelSocket *ioc, Error **errp);
+
 #endif /* QIO_CHANNEL_SOCKET_H */
@@ -36,6 +36,11 @@ OBJECT_DECLARE_TYPE(QIOChannel, QIOChannelClass,
 
 #define QIO_CHANNEL_READ_FLAG_MSG_PEEK 0x1
 #define QIO_CHANNEL_READ_FLAG_RELAXED_EOF 0x2
+/*
+ * Hint that the caller wants the whole buffer; channels that can, block
+ * until it is filled instead of returning short reads.
+ */
+#define QIO_CHANNEL_READ_FLAG_WAITALL 0x4
 
 typedef enum QIOChannelFeature QIOChannelFeature;
 
@@ -202,6 +202,17 @@ struct VMStateDescription {
      * a QEMU_VM_SECTION_START section.
      */
     bool early_setup;
+    /*
+     * The state of this VMSD may be serialized on a worker thread,
+     * concurrently with other devices, when the non-iterable device
+     * state is saved at switchover.  The migration stream is unchanged:
+     * the output is buffered and sent in the usual order.
+     *
+     * Only set this if pre_save(), post_save() and the field accessors
+     * touch nothing but the device's own state and do not rely on the
+     * BQL being held by the calling thread.
+     */
+    bool parallel_save;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
@@ -76,6 +76,16 @@ typedef void coroutine_fn CoroutineEntry(void *opaque);
  */
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque);
 
+/**
+ * Create a new coroutine with a small stack
+ *
+ * Like qemu_coroutine_create(), but the coroutine gets a stack of only 64 KB
+ * instead of 1 MB.  This is meant for entry points that are known not to call
+ * deep into other subsystems, for example ones that only wake up or schedule
+ * other coroutines.  Overflowing the stack crashes QEMU on the guard page.
+ */
+Coroutine *qemu_coroutine_create_small(CoroutineEntry *entry, void *opaque);
+
 /**
  * Transfer control to a coroutine
  */
@@ -34,6 +34,17 @@ extern __thread void *__safestack_unsafe_stack_ptr;
 #endif
 
 #define COROUTINE_STACK_SIZE (1 << 20)
+#define COROUTINE_STACK_SIZE_SMALL (64 << 10)
+
+/*
+ * Coroutines are pooled separately for every stack size, so that a recycled
+ * coroutine always has the stack size that its creator asked for.
+ */
+typedef enum {
+    COROUTINE_STACK_DEFAULT,
+    COROUTINE_STACK_SMALL,
+    COROUTINE_STACK__MAX,
+} CoroutineStackClass;
 
 typedef enum {
     COROUTINE_YIELD = 1,
@@ -51,6 +62,8 @@ struct Coroutine {
 
     size_t locks_held;
 
+    CoroutineStackClass stack_class;
+
     /* Only used when the coroutine has yielded.  */
     AioContext *ctx;
 
@@ -69,7 +82,7 @@ struct Coroutine {
     QSLIST_ENTRY(Coroutine) co_scheduled_next;
 };
 
-Coroutine *qemu_coroutine_new(void);
+Coroutine *qemu_coroutine_new(size_t stack_size);
 void qemu_coroutine_delete(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
@@ -269,6 +269,40 @@ char *hbitmap_sha256(const HBitmap *bitmap, Error **errp);
  */
 void hbitmap_free(HBitmap *hb);
 
+/**
+ * hbitmap_create_meta:
+ * @hb: HBitmap to operate on.
+ * @chunk_size: How many bits in @hb does one bit in the meta bitmap track.
+ *              Must be a power of two.
+ *
+ * Create a "meta" hbitmap to track changes to @hb.  Every time a bit in @hb
+ * flips, the bit for the covering chunk is set in the meta bitmap.  The meta
+ * bitmap uses the same item numbering as @hb, only with a coarser
+ * granularity.  Operations that replace the contents of @hb wholesale
+ * (hbitmap_merge(), hbitmap_reset_all(), deserialization) mark all of the
+ * affected chunks as changed.
+ *
+ * The meta bitmap belongs to @hb and must be released with
+ * hbitmap_free_meta() before @hb is freed.
+ */
+HBitmap *hbitmap_create_meta(HBitmap *hb, int chunk_size);
+
+/**
+ * hbitmap_free_meta:
+ * @hb: HBitmap whose meta bitmap should be released.
+ *
+ * Stop tracking changes to @hb and free its meta bitmap.
+ */
+void hbitmap_free_meta(HBitmap *hb);
+
+/**
+ * hbitmap_meta:
+ * @hb: HBitmap to operate on.
+ *
+ * Return the meta bitmap of @hb, or NULL if there is none.
+ */
+HBitmap *hbitmap_meta(const HBitmap *hb);
+
 /**
  * hbitmap_iter_init:
  * @hbi: HBitmapIter to initialize.
@@ -329,6 +363,29 @@ bool hbitmap_next_dirty_area(const HBitmap *hb, int64_t start, int64_t end,
                              int64_t max_dirty_count,
                              int64_t *dirty_start, int64_t *dirty_count);
 
+typedef struct HBitmapExtent {
+    int64_t start;
+    int64_t count;
+} HBitmapExtent;
+
+/* hbitmap_next_dirty_extents:
+ * @hb: The HBitmap to operate on
+ * @start: the offset to start from
+ * @end: end of requested area
+ * @max_dirty_count: limit for the length of each extent
+ * @extents: array to fill
+ * @nb_extents: number of elements in @extents, must be positive
+ *
+ * Batched version of hbitmap_next_dirty_area(): store up to @nb_extents
+ * consecutive dirty areas within [@start, @end) in @extents, in ascending
+ * order.  A dirty area longer than @max_dirty_count is split into several
+ * extents.  Returns the number of extents found; if it is less than
+ * @nb_extents, there are no more dirty bits before @end.
+ */
+int hbitmap_next_dirty_extents(const HBitmap *hb, int64_t start, int64_t end,
+                               int64_t max_dirty_count,
+                               HBitmapExtent *extents, int nb_extents);
+
 /*
  * hbitmap_status:
  * @hb: The HBitmap to operate on
@@ -350,4 +407,13 @@ bool hbitmap_status(const HBitmap *hb, int64_t start, int64_t count,
  */
 int64_t hbitmap_iter_next(HBitmapIter *hbi);
 
+/**
+ * test_hbitmap_next_accel:
+ *
+ * Switch to the next slower implementation of the scan kernels used by
+ * hbitmap_next_dirty() and hbitmap_next_zero().  Returns false when the
+ * portable implementation is already in use.  For testing only.
+ */
+bool test_hbitmap_next_accel(void);
+
 #endif
@@ -156,6 +156,9 @@ struct KVMState
     } *as;
     uint64_t kvm_dirty_ring_bytes;  /* Size of the per-vcpu dirty ring */
     uint32_t kvm_dirty_ring_size;   /* Number of dirty GFNs per ring */
+    /* Threads used to collect the rings of all vCPUs */
+    uint32_t kvm_dirty_ring_reap_threads;
+    struct ThreadPool *reap_pool;
     bool kvm_dirty_ring_with_bitmap;
     uint64_t kvm_eager_split_size;  /* Eager Page Splitting chunk size */
     struct KVMDirtyRingReaper reaper;
@@ -1183,6 +1183,8 @@ struct AddressSpace {
     size_t max_bounce_buffer_size;
     /* Total size of bounce buffers currently allocated, atomically accessed */
     size_t bounce_buffer_size;
+    /* Last released bounce buffer kept for reuse, atomically accessed */
+    void *bounce_buffer_cache;
     /* List of callbacks to invoke when buffers free up */
     QemuMutex map_client_list_lock;
     QLIST_HEAD(, AddressSpaceMapClient) map_client_list;
@@ -63,6 +63,12 @@ struct RAMBlock {
     off_t bitmap_offset;
     uint64_t pages_offset;
 
+    /*
+     * Hash of the contents each page was last sent with, or 0 if not
+     * known.  Only used on the source side with page-dedup.
+     */
+    uint64_t *dedup_hash;
+
     /* Bitmap of already received pages.  Only used on destination side. */
     unsigned long *receivedmap;
 
@@ -65,6 +65,7 @@ qio_channel_socket_new(void)
     sioc->fd = -1;
     sioc->zero_copy_queued = 0;
     sioc->zero_copy_sent = 0;
+    sioc->zero_copy_copied = 0;
 
     ioc = QIO_CHANNEL(sioc);
     qio_channel_set_feature(ioc, QIO_CHANNEL_FEATURE_SHUTDOWN);
@@ -156,6 +157,21 @@ qio_channel_socket_new_fd(int fd,
 }
 
 
+bool qio_channel_socket_enable_zero_copy(QIOChannelSocket *ioc)
+{
+#ifdef QEMU_MSG_ZEROCOPY
+    int ret, v = 1;
+    ret = setsockopt(ioc->fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v));
+    if (ret == 0) {
+        /* Zero copy available on host */
+        qio_channel_set_feature(QIO_CHANNEL(ioc),
+                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+        return true;
+    }
+#endif
+    return false;
+}
+
 int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
                                     SocketAddress *addr,
                                     Error **errp)
@@ -175,15 +191,7 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
         return -1;
     }
 
-#ifdef QEMU_MSG_ZEROCOPY
-    int ret, v = 1;
-    ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v));
-    if (ret == 0) {
-        /* Zero copy available on host */
-        qio_channel_set_feature(QIO_CHANNEL(ioc),
-                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
-    }
-#endif
+    qio_channel_socket_enable_zero_copy(ioc);
 
     qio_channel_set_feature(QIO_CHANNEL(ioc),
                             QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
@@ -509,6 +517,96 @@ static void qio_channel_socket_copy_fds(struct msghdr *msg,
 }
 
 
+#ifdef QEMU_MSG_ZEROCOPY
+/*
+ * Process the zero copy notifications on the error queue of @sioc, until
+ * every queued sendmsg() has completed.  If @block is false, stop as soon
+ * as the error queue is empty instead of waiting.
+ *
+ * Returns -1 on error.  When blocking, returns 1 if every notification
+ * reported that the kernel copied the data anyway and 0 otherwise, as for
+ * qio_channel_flush().
+ */
+static int qio_channel_socket_reap_zero_copy(QIOChannelSocket *sioc,
+                                             bool block, Error **errp)
+{
+    struct msghdr msg = {};
+    struct sock_extended_err *serr;
+    struct cmsghdr *cm;
+    char control[CMSG_SPACE(sizeof(*serr))];
+    int received;
+    int ret;
+
+    if (sioc->zero_copy_queued == sioc->zero_copy_sent) {
+        return 0;
+    }
+
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    memset(control, 0, sizeof(control));
+
+    ret = 1;
+
+    while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
+        received = recvmsg(sioc->fd, &msg, MSG_ERRQUEUE);
+        if (received < 0) {
+            switch (errno) {
+            case EAGAIN:
+                if (!block) {
+                    return ret;
+                }
+                /* Nothing on errqueue, wait until something is available */
+                qio_channel_wait(QIO_CHANNEL(sioc), G_IO_ERR);
+                continue;
+            case EINTR:
+                continue;
+            default:
+                error_setg_errno(errp, errno,
+                                 "Unable to read errqueue");
+                return -1;
+            }
+        }
+
+        cm = CMSG_FIRSTHDR(&msg);
+        if (cm->cmsg_level != SOL_IP   && cm->cmsg_type != IP_RECVERR &&
+            cm->cmsg_level != SOL_IPV6 && cm->cmsg_type != IPV6_RECVERR) {
+            error_setg_errno(errp, EPROTOTYPE,
+                             "Wrong cmsg in errqueue");
+            return -1;
+        }
+
+        serr = (void *) CMSG_DATA(cm);
+        if (serr->ee_errno != SO_EE_ORIGIN_NONE) {
+            error_setg_errno(errp, serr->ee_errno,
+                             "Error on socket");
+            return -1;
+        }
+        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+            error_setg_errno(errp, serr->ee_origin,
+                             "Error not from zero copy");
+            return -1;
+        }
+        if (serr->ee_data < serr->ee_info) {
+            error_setg_errno(errp, serr->ee_origin,
+                             "Wrong notification bounds");
+            return -1;
+        }
+
+        /* No errors, count successfully finished sendmsg()*/
+        sioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
+
+        /* If any sendmsg() succeeded using zero copy, return 0 at the end */
+        if (serr->ee_code != SO_EE_CODE_ZEROCOPY_COPIED) {
+            ret = 0;
+        } else {
+            sioc->zero_copy_copied += serr->ee_data - serr->ee_info + 1;
+        }
+    }
+
+    return ret;
+}
+#endif /* QEMU_MSG_ZEROCOPY */
+
 static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
                                         const struct iovec *iov,
                                         size_t niov,
@@ -539,11 +637,25 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
     if (flags & QIO_CHANNEL_READ_FLAG_MSG_PEEK) {
         sflags |= MSG_PEEK;
     }
+    if (flags & QIO_CHANNEL_READ_FLAG_WAITALL) {
+        sflags |= MSG_WAITALL;
+    }
 
  retry:
     ret = recvmsg(sioc->fd, &msg, sflags);
     if (ret < 0) {
         if (errno == EAGAIN) {
+#ifdef QEMU_MSG_ZEROCOPY
+            /*
+             * Pending zero copy notifications make the socket report
+             * POLLERR, which wakes up anyone waiting to read.  Consume
+             * them here so the caller does not spin.
+             */
+            if (sioc->zero_copy_sent < sioc->zero_copy_queued &&
+                qio_channel_socket_reap_zero_copy(sioc, false, errp) < 0) {
+                return -1;
+            }
+#endif
             return QIO_CHANNEL_ERR_BLOCK;
         }
         if (errno == EINTR) {
@@ -658,6 +770,9 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
     if (flags & QIO_CHANNEL_READ_FLAG_MSG_PEEK) {
         sflags |= MSG_PEEK;
     }
+    if (flags & QIO_CHANNEL_READ_FLAG_WAITALL) {
+        sflags |= MSG_WAITALL;
+    }
 
     for (i = 0; i < niov; i++) {
         ssize_t ret;
@@ -739,78 +854,19 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
 static int qio_channel_socket_flush(QIOChannel *ioc,
                                     Error **errp)
 {
-    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
-    struct msghdr msg = {};
-    struct sock_extended_err *serr;
-    struct cmsghdr *cm;
-    char control[CMSG_SPACE(sizeof(*serr))];
-    int received;
-    int ret;
-
-    if (sioc->zero_copy_queued == sioc->zero_copy_sent) {
-        return 0;
-    }
-
-    msg.msg_control = control;
-    msg.msg_controllen = sizeof(control);
-    memset(control, 0, sizeof(control));
-
-    ret = 1;
-
-    while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
-        received = recvmsg(sioc->fd, &msg, MSG_ERRQUEUE);
-        if (received < 0) {
-            switch (errno) {
-            case EAGAIN:
-                /* Nothing on errqueue, wait until something is available */
-                qio_channel_wait(ioc, G_IO_ERR);
-                continue;
-            case EINTR:
-                continue;
-            default:
-                error_setg_errno(errp, errno,
-                                 "Unable to read errqueue");
-                return -1;
-            }
-        }
-
-        cm = CMSG_FIRSTHDR(&msg);
-        if (cm->cmsg_level != SOL_IP   && cm->cmsg_type != IP_RECVERR &&
-            cm->cmsg_level != SOL_IPV6 && cm->cmsg_type != IPV6_RECVERR) {
-            error_setg_errno(errp, EPROTOTYPE,
-                             "Wrong cmsg in errqueue");
-            return -1;
-        }
-
-        serr = (void *) CMSG_DATA(cm);
-        if (serr->ee_errno != SO_EE_ORIGIN_NONE) {
-            error_setg_errno(errp, serr->ee_errno,
-                             "Error on socket");
-            return -1;
-        }
-        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
-            error_setg_errno(errp, serr->ee_origin,
-                             "Error not from zero copy");
-            return -1;
-        }
-        if (serr->ee_data < serr->ee_info) {
-            error_setg_errno(errp, serr->ee_origin,
-                             "Wrong notification bounds");
-            return -1;
-        }
-
-        /* No errors, count successfully finished sendmsg()*/
-        sioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
-
-        /* If any sendmsg() succeeded using zero copy, return 0 at the end */
-        if (serr->ee_code != SO_EE_CODE_ZEROCOPY_COPIED) {
-            ret = 0;
-        }
-    }
-
-    return ret;
+    return qio_channel_socket_reap_zero_copy(QIO_CHANNEL_SOCKET(ioc), true,
+                                             errp);
 }
 
+int qio_channel_socket_zero_copy_poll(QIOChannelSocket *ioc, Error **errp)
+{
+    return qio_channel_socket_reap_zero_copy(ioc, false, errp) < 0 ? -1 : 0;
+}
+#else /* QEMU_MSG_ZEROCOPY */
+int qio_channel_socket_zero_copy_poll(QIOChannelSocket *ioc, Error **errp)
+{
+    return 0;
+}
 #endif /* QEMU_MSG_ZEROCOPY */
 
 static int
@@ -19,6 +19,7 @@
 #include "block/block.h"
 #include "system/event-loop-base.h"
 #include "system/iothread.h"
+#include "system/stats.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-misc.h"
 #include "qemu/error-report.h"
@@ -372,6 +373,124 @@ IOThreadInfoList *qmp_query_iothreads(Error **errp)
     return head;
 }
 
+typedef struct IOThreadStat {
+    const char *name;
+    StatsType type;
+    bool has_unit;
+    StatsUnit unit;
+    size_t offset;
+} IOThreadStat;
+
+#define IOTHREAD_STAT(name_, type_, field_) \
+    { .name = name_, .type = type_, .offset = offsetof(AioContext, field_) }
+#define IOTHREAD_STAT_NS(name_, type_, field_) \
+    { .name = name_, .type = type_, .has_unit = true, \
+      .unit = STATS_UNIT_SECONDS, .offset = offsetof(AioContext, field_) }
+
+static const IOThreadStat iothread_stats[] = {
+    IOTHREAD_STAT("polls", STATS_TYPE_CUMULATIVE, stat_polls),
+    IOTHREAD_STAT("poll-hits", STATS_TYPE_CUMULATIVE, stat_poll_hits),
+    IOTHREAD_STAT("waits", STATS_TYPE_CUMULATIVE, stat_waits),
+    IOTHREAD_STAT_NS("wait-time", STATS_TYPE_CUMULATIVE, stat_wait_ns),
+    IOTHREAD_STAT_NS("dispatch-time", STATS_TYPE_CUMULATIVE,
+                     stat_dispatch_ns),
+    IOTHREAD_STAT_NS("dispatch-max-time", STATS_TYPE_PEAK,
+                     stat_dispatch_max_ns),
+    IOTHREAD_STAT("bottom-halves", STATS_TYPE_CUMULATIVE, stat_bhs),
+};
+
+typedef struct IOThreadStatsArgs {
+    StatsResultList **result;
+    strList *names;
+} IOThreadStatsArgs;
+
+static int iothread_stats_query(Object *obj, void *opaque)
+{
+    IOThreadStatsArgs *args = opaque;
+    IOThread *iothread;
+    AioContext *ctx;
+    StatsList *stats_list = NULL;
+    StatsResult *entry;
+    int i;
+
+    iothread = (IOThread *)object_dynamic_cast(obj, TYPE_IOTHREAD);
+    if (!iothread) {
+        return 0;
+    }
+    ctx = iothread_get_aio_context(iothread);
+
+    /* Build the list backwards, so that it ends up sorted like the schema */
+    for (i = ARRAY_SIZE(iothread_stats) - 1; i >= 0; i--) {
+        const IOThreadStat *s = &iothread_stats[i];
+        Stats *stats;
+
+        if (!apply_str_list_filter(s->name, args->names)) {
+            continue;
+        }
+        stats = g_new0(Stats, 1);
+        stats->name = g_strdup(s->name);
+        stats->value = g_new0(StatsValue, 1);
+        stats->value->type = QTYPE_QNUM;
+        stats->value->u.scalar =
+            stat64_get((Stat64 *)((char *)ctx + s->offset));
+        QAPI_LIST_PREPEND(stats_list, stats);
+    }
+
+    entry = g_new0(StatsResult, 1);
+    entry->provider = STATS_PROVIDER_IOTHREAD;
+    entry->qom_path = object_get_canonical_path(obj);
+    entry->iothread = iothread_get_id(iothread);
+    entry->stats = stats_list;
+    QAPI_LIST_PREPEND(*args->result, entry);
+    return 0;
+}
+
+static void iothread_stats_cb(StatsResultList **result, StatsTarget target,
+                              strList *names, strList *targets, Error **errp)
+{
+    IOThreadStatsArgs args = { .result = result, .names = names };
+
+    if (target != STATS_TARGET_IOTHREAD) {
+        return;
+    }
+    object_child_foreach(object_get_objects_root(), iothread_stats_query,
+                         &args);
+}
+
+static void iothread_stats_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+    int i;
+
+    for (i = ARRAY_SIZE(iothread_stats) - 1; i >= 0; i--) {
+        const IOThreadStat *s = &iothread_stats[i];
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(s->name);
+        value->type = s->type;
+        if (s->has_unit) {
+            value->has_unit = true;
+            value->unit = s->unit;
+            value->has_base = true;
+            value->base = 10;
+            value->exponent = -9;
+        }
+        QAPI_LIST_PREPEND(stats_list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_IOTHREAD, STATS_TARGET_IOTHREAD,
+                     stats_list);
+}
+
+
+static void iothread_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_IOTHREAD, iothread_stats_cb,
+                        iothread_stats_schemas_cb);
+}
+
+type_init(iothread_stats_init)
+
 GMainContext *iothread_get_g_main_context(IOThread *iothread)
 {
     qatomic_set(&iothread->run_gcontext, 1);
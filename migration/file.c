@@ -25,6 +25,10 @@ static struct FileOutgoingArgs {
     char *fname;
 } outgoing_args;
 
+static struct FileIncomingArgs {
+    char *fname;
+} incoming_args;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -50,6 +54,12 @@ void file_cleanup_outgoing_migration(void)
     outgoing_args.fname = NULL;
 }
 
+void file_cleanup_incoming_migration(void)
+{
+    g_free(incoming_args.fname);
+    incoming_args.fname = NULL;
+}
+
 static void file_enable_direct_io(int *flags)
 {
 #ifdef O_DIRECT
@@ -192,9 +202,32 @@ void file_start_incoming_migration(FileMigrationArgs *file_args, Error **errp)
         return;
     }
 
+    g_free(incoming_args.fname);
+    incoming_args.fname = g_strdup(filename);
+
     file_create_incoming_channels(QIO_CHANNEL(fioc), filename, errp);
 }
 
+/*
+ * Open another read-only channel on the file of the current incoming
+ * migration, for users that read RAM pages from it out of band.
+ */
+QIOChannelFile *file_open_incoming_channel(Error **errp)
+{
+    int flags = O_RDONLY;
+
+    if (!incoming_args.fname) {
+        error_setg(errp, "Incoming migration is not from a file");
+        return NULL;
+    }
+
+    if (migrate_direct_io()) {
+        file_enable_direct_io(&flags);
+    }
+
+    return qio_channel_file_new_path(incoming_args.fname, flags, 0, errp);
+}
+
 int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
                             int niov, MultiFDPages_t *pages, Error **errp)
 {
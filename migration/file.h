@@ -9,6 +9,7 @@
 #define QEMU_MIGRATION_FILE_H
 
 #include "qapi/qapi-types-migration.h"
+#include "io/channel-file.h"
 #include "io/task.h"
 #include "channel.h"
 #include "multifd.h"
@@ -19,6 +20,8 @@ void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp);
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp);
 void file_cleanup_outgoing_migration(void);
+void file_cleanup_incoming_migration(void);
+QIOChannelFile *file_open_incoming_channel(Error **errp);
 bool file_send_channel_create(gpointer opaque, Error **errp);
 int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
                             int niov, MultiFDPages_t *pages, Error **errp);
@@ -0,0 +1,474 @@
+/*
+ * Lazy restore of RAM from a mapped-ram migration file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "block/aio.h"
+#include "block/thread-pool.h"
+#include "exec/target_page.h"
+#include "migration/blocker.h"
+#include "system/memory.h"
+#include "system/ramblock.h"
+#include "file.h"
+#include "mapped-ram-lazy.h"
+#include "options.h"
+#include "ram.h"
+#include "trace.h"
+
+#if defined(__linux__) && defined(CONFIG_EVENTFD)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include "qemu/userfaultfd.h"
+
+/* Amount of RAM read and placed by one prefetch request */
+#define MAPPED_RAM_LAZY_CHUNK_SIZE (4 * MiB)
+
+static struct {
+    int uffd;
+    int quit_fd;
+    QIOChannelFile *ioc;
+    QemuThread fault_thread;
+    QemuThread prefetch_thread;
+    bool started;
+    Error *blocker;
+} lazy = {
+    .uffd = -1,
+    .quit_fd = -1,
+};
+
+typedef struct LazyChunk {
+    RAMBlock *block;
+    ram_addr_t offset;
+    size_t len;
+} LazyChunk;
+
+static void lazy_fatal(const char *what, RAMBlock *block, ram_addr_t offset,
+                       Error *err)
+{
+    error_report("mapped-ram lazy load: %s %s:" RAM_ADDR_FMT " failed: %s",
+                 what, block->idstr, offset,
+                 err ? error_get_pretty(err) : strerror(errno));
+    /* The guest can't make progress without the page */
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Read @len bytes of @block at @offset from the file.  Pages past the
+ * end of the file were never written, so they read as zeroes.
+ */
+static void lazy_read(RAMBlock *block, ram_addr_t offset, void *buf,
+                      size_t len)
+{
+    Error *local_err = NULL;
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = qio_channel_pread(QIO_CHANNEL(lazy.ioc),
+                                        (char *)buf + done, len - done,
+                                        block->pages_offset + offset + done,
+                                        &local_err);
+        if (ret < 0) {
+            lazy_fatal("reading", block, offset, local_err);
+        }
+        if (ret == 0) {
+            memset((char *)buf + done, 0, len - done);
+            break;
+        }
+        done += ret;
+    }
+}
+
+static int lazy_place_one(void *host, void *buf, size_t len)
+{
+    if (buf) {
+        struct uffdio_copy copy = {
+            .dst = (uintptr_t)host,
+            .src = (uintptr_t)buf,
+            .len = len,
+        };
+
+        return ioctl(lazy.uffd, UFFDIO_COPY, &copy);
+    } else {
+        struct uffdio_zeropage zero = {
+            .range.start = (uintptr_t)host,
+            .range.len = len,
+        };
+
+        return ioctl(lazy.uffd, UFFDIO_ZEROPAGE, &zero);
+    }
+}
+
+/*
+ * Populate pages of @block at @offset with @buf, or with zeroes if @buf
+ * is NULL.  Pages that are already populated, by either the fault
+ * thread or a prefetch worker, are left alone.
+ */
+static void lazy_place(RAMBlock *block, ram_addr_t offset, void *buf,
+                       size_t len)
+{
+    size_t page_size = qemu_ram_pagesize(block);
+    size_t done;
+
+    if (!lazy_place_one(block->host + offset, buf, len)) {
+        return;
+    }
+    if (errno != EEXIST && errno != EAGAIN) {
+        lazy_fatal("placing", block, offset, NULL);
+    }
+
+    /*
+     * Some pages were populated already, or the range was being changed
+     * under us; go one page at a time.  EAGAIN only means the mapping was
+     * changing, so try again.
+     */
+    for (done = 0; done < len; done += page_size) {
+        int ret;
+
+        do {
+            ret = lazy_place_one(block->host + offset + done,
+                                 buf ? (char *)buf + done : NULL, page_size);
+        } while (ret && errno == EAGAIN);
+
+        if (ret && errno != EEXIST) {
+            lazy_fatal("placing", block, offset + done, NULL);
+        }
+    }
+}
+
+static bool lazy_range_in_file(RAMBlock *block, ram_addr_t offset,
+                               size_t len)
+{
+    unsigned long first = offset >> TARGET_PAGE_BITS;
+    unsigned long end = (offset + len) >> TARGET_PAGE_BITS;
+
+    return find_next_bit(block->file_bmap, end, first) < end;
+}
+
+static void lazy_load_range(RAMBlock *block, ram_addr_t offset, size_t len,
+                            void *buf)
+{
+    /* hugetlbfs has no UFFDIO_ZEROPAGE, so zeroes are copied there */
+    if (lazy_range_in_file(block, offset, len) ||
+        qemu_ram_pagesize(block) != qemu_real_host_page_size()) {
+        lazy_read(block, offset, buf, len);
+        lazy_place(block, offset, buf, len);
+    } else {
+        lazy_place(block, offset, NULL, len);
+    }
+}
+
+static void *mapped_ram_lazy_fault_thread(void *opaque)
+{
+    struct pollfd pfd[2] = {
+        { .fd = lazy.uffd, .events = POLLIN },
+        { .fd = lazy.quit_fd, .events = POLLIN },
+    };
+    size_t buf_size = 0;
+    void *buf = NULL;
+
+    rcu_register_thread();
+
+    while (true) {
+        struct uffd_msg msg;
+        ram_addr_t offset;
+        RAMBlock *block;
+        size_t page_size;
+
+        if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_report("%s: userfault poll: %s", __func__, strerror(errno));
+            break;
+        }
+        if (pfd[1].revents) {
+            break;
+        }
+        if (uffd_read_events(lazy.uffd, &msg, 1) != 1 ||
+            msg.event != UFFD_EVENT_PAGEFAULT) {
+            continue;
+        }
+
+        RCU_READ_LOCK_GUARD();
+        block = qemu_ram_block_from_host(
+                    (void *)(uintptr_t)msg.arg.pagefault.address,
+                    false, &offset);
+        if (!block || !block->file_bmap) {
+            error_report("%s: fault outside of lazily loaded RAM: %" PRIx64,
+                         __func__, (uint64_t)msg.arg.pagefault.address);
+            continue;
+        }
+
+        page_size = qemu_ram_pagesize(block);
+        offset = ROUND_DOWN(offset, page_size);
+        if (buf_size < page_size) {
+            qemu_vfree(buf);
+            buf = qemu_memalign(qemu_real_host_page_size(), page_size);
+            buf_size = page_size;
+        }
+
+        trace_mapped_ram_lazy_fault(block->idstr, offset);
+        lazy_load_range(block, offset, page_size, buf);
+    }
+
+    qemu_vfree(buf);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static int mapped_ram_lazy_load_chunk(void *opaque)
+{
+    LazyChunk *chunk = opaque;
+    void *buf = qemu_memalign(qemu_real_host_page_size(), chunk->len);
+
+    lazy_load_range(chunk->block, chunk->offset, chunk->len, buf);
+    qemu_vfree(buf);
+    return 0;
+}
+
+/* Stop the fault thread and unregister every block that was added */
+static void mapped_ram_lazy_teardown(void)
+{
+    uint64_t eventfd_val = 1;
+    RAMBlock *block;
+
+    if (write(lazy.quit_fd, &eventfd_val, sizeof(eventfd_val)) !=
+        sizeof(eventfd_val)) {
+        error_report("%s: failed to stop the fault thread", __func__);
+    }
+    qemu_thread_join(&lazy.fault_thread);
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            if (block->file_bmap) {
+                uffd_unregister_memory(lazy.uffd, block->host,
+                                       block->used_length);
+                g_free(block->file_bmap);
+                block->file_bmap = NULL;
+            }
+        }
+    }
+
+    uffd_close_fd(lazy.uffd);
+    lazy.uffd = -1;
+    close(lazy.quit_fd);
+    lazy.quit_fd = -1;
+    object_unref(OBJECT(lazy.ioc));
+    lazy.ioc = NULL;
+}
+
+static void mapped_ram_lazy_del_blocker(void *opaque)
+{
+    migrate_del_blocker(&lazy.blocker);
+}
+
+static void *mapped_ram_lazy_prefetch_thread(void *opaque)
+{
+    ThreadPool *pool = thread_pool_new();
+    int64_t start = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    RAMBlock *block;
+
+    rcu_register_thread();
+    thread_pool_set_max_threads(pool, migrate_multifd_channels());
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            size_t chunk_size = ROUND_UP(MAPPED_RAM_LAZY_CHUNK_SIZE,
+                                         qemu_ram_pagesize(block));
+            ram_addr_t offset;
+
+            if (!block->file_bmap) {
+                continue;
+            }
+
+            for (offset = 0; offset < block->used_length;
+                 offset += chunk_size) {
+                LazyChunk *chunk = g_new(LazyChunk, 1);
+
+                chunk->block = block;
+                chunk->offset = offset;
+                chunk->len = MIN(chunk_size, block->used_length - offset);
+                thread_pool_submit(pool, mapped_ram_lazy_load_chunk,
+                                   chunk, g_free);
+            }
+        }
+    }
+
+    thread_pool_wait(pool);
+    thread_pool_free(pool);
+
+    /* Everything is populated, so no more faults can happen */
+    mapped_ram_lazy_teardown();
+
+    trace_mapped_ram_lazy_done(qemu_clock_get_ms(QEMU_CLOCK_REALTIME) - start);
+    aio_bh_schedule_oneshot(qemu_get_aio_context(),
+                            mapped_ram_lazy_del_blocker, NULL);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static bool mapped_ram_lazy_init(Error **errp)
+{
+    uint64_t features = 0;
+
+    if (lazy.uffd >= 0) {
+        return true;
+    }
+
+    if (lazy.blocker) {
+        error_setg(errp, "A previous lazy load is still in progress");
+        return false;
+    }
+
+    if (migrate_postcopy_ram()) {
+        error_setg(errp, "Lazy load of mapped-ram is not compatible with "
+                   "postcopy-ram");
+        return false;
+    }
+
+#ifdef UFFD_FEATURE_MISSING_HUGETLBFS
+    features |= UFFD_FEATURE_MISSING_HUGETLBFS;
+#endif
+#ifdef UFFD_FEATURE_MISSING_SHMEM
+    features |= UFFD_FEATURE_MISSING_SHMEM;
+#endif
+    lazy.uffd = uffd_create_fd(features, true);
+    if (lazy.uffd < 0) {
+        error_setg(errp, "Failed to create userfaultfd for lazy load");
+        return false;
+    }
+
+    lazy.quit_fd = eventfd(0, EFD_CLOEXEC);
+    if (lazy.quit_fd < 0) {
+        error_setg_errno(errp, errno, "Failed to create eventfd");
+        goto err_uffd;
+    }
+
+    lazy.ioc = file_open_incoming_channel(errp);
+    if (!lazy.ioc) {
+        goto err_eventfd;
+    }
+
+    error_setg(&lazy.blocker, "Guest RAM is still being loaded from the "
+               "migration file");
+    if (migrate_add_blocker_internal(&lazy.blocker, errp) < 0) {
+        goto err_ioc;
+    }
+
+    lazy.started = false;
+    qemu_thread_create(&lazy.fault_thread, "mig/dst/lazy-fault",
+                       mapped_ram_lazy_fault_thread, NULL,
+                       QEMU_THREAD_JOINABLE);
+    return true;
+
+err_ioc:
+    object_unref(OBJECT(lazy.ioc));
+    lazy.ioc = NULL;
+err_eventfd:
+    close(lazy.quit_fd);
+    lazy.quit_fd = -1;
+err_uffd:
+    uffd_close_fd(lazy.uffd);
+    lazy.uffd = -1;
+    return false;
+}
+
+bool mapped_ram_lazy_add_block(RAMBlock *block, unsigned long *bitmap,
+                               Error **errp)
+{
+    /*
+     * Other mappings of shared memory (vhost-user back ends, for example)
+     * would see the discarded pages as zeroes, because faults through them
+     * do not reach our userfaultfd.  With discards disabled, something
+     * (such as VFIO) holds pinned pages that discarding would go stale.
+     */
+    if (qemu_ram_is_shared(block)) {
+        error_setg(errp, "Lazy load does not support shared RAMBlock %s",
+                   block->idstr);
+        g_free(bitmap);
+        return false;
+    }
+    if (ram_block_discard_is_disabled()) {
+        error_setg(errp, "Lazy load needs to discard RAM, but discards are "
+                   "disabled");
+        g_free(bitmap);
+        return false;
+    }
+
+    if (!mapped_ram_lazy_init(errp)) {
+        g_free(bitmap);
+        return false;
+    }
+
+    /* The fault thread needs a valid bitmap once the range is registered */
+    block->file_bmap = bitmap;
+
+    if (ram_discard_range(block->idstr, 0, block->used_length) ||
+        uffd_register_memory(lazy.uffd, block->host, block->used_length,
+                             UFFDIO_REGISTER_MODE_MISSING, NULL)) {
+        error_setg(errp, "RAMBlock %s does not support lazy load",
+                   block->idstr);
+        block->file_bmap = NULL;
+        g_free(bitmap);
+        /* Unregister the blocks that were added before this one */
+        mapped_ram_lazy_abort();
+        return false;
+    }
+
+    trace_mapped_ram_lazy_add_block(block->idstr, block->used_length);
+    return true;
+}
+
+void mapped_ram_lazy_start(void)
+{
+    if (lazy.uffd < 0) {
+        return;
+    }
+
+    lazy.started = true;
+    qemu_thread_create(&lazy.prefetch_thread, "mig/dst/lazy-load",
+                       mapped_ram_lazy_prefetch_thread, NULL,
+                       QEMU_THREAD_DETACHED);
+}
+
+void mapped_ram_lazy_abort(void)
+{
+    /* Once started, the prefetch thread owns the teardown */
+    if (lazy.uffd < 0 || lazy.started) {
+        return;
+    }
+
+    mapped_ram_lazy_teardown();
+    migrate_del_blocker(&lazy.blocker);
+}
+
+#else
+
+bool mapped_ram_lazy_add_block(RAMBlock *block, unsigned long *bitmap,
+                               Error **errp)
+{
+    g_free(bitmap);
+    error_setg(errp, "Lazy load of mapped-ram requires userfaultfd");
+    return false;
+}
+
+void mapped_ram_lazy_start(void)
+{
+}
+
+void mapped_ram_lazy_abort(void)
+{
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Lazy restore of RAM from a mapped-ram migration file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_MAPPED_RAM_LAZY_H
+#define QEMU_MIGRATION_MAPPED_RAM_LAZY_H
+
+/*
+ * Instead of reading all of RAM before the guest can run, the pages of
+ * a RAMBlock are populated on first access through userfaultfd, while
+ * worker threads read the rest of the file in the background.
+ */
+
+/**
+ * mapped_ram_lazy_add_block: defer loading of a RAMBlock
+ *
+ * Discards the current contents of @block and registers it with the
+ * userfault handler, which populates its pages from the migration file
+ * as they are accessed.
+ *
+ * Returns true on success.  On failure, sets @errp.
+ *
+ * @block: RAMBlock whose pages are at block->pages_offset in the file
+ * @bitmap: pages present in the file; ownership is passed to the callee
+ * @errp: pointer to Error*, to store an error if it happens
+ */
+bool mapped_ram_lazy_add_block(RAMBlock *block, unsigned long *bitmap,
+                               Error **errp);
+
+/**
+ * mapped_ram_lazy_start: start the background prefetch
+ *
+ * To be called once all RAMBlocks were added.  When the prefetch has
+ * populated everything, the userfault handler is torn down.
+ */
+void mapped_ram_lazy_start(void);
+
+/**
+ * mapped_ram_lazy_abort: undo mapped_ram_lazy_add_block()
+ *
+ * To be called if loading fails before mapped_ram_lazy_start().
+ * Unregisters all RAMBlocks that were added and stops the userfault
+ * handler.  Does nothing if there is nothing to undo.
+ */
+void mapped_ram_lazy_abort(void);
+
+#endif
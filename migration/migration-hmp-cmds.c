@@ -50,6 +50,18 @@ static void migration_global_dump(Monitor *mon)
                    ms->send_switchover_start ? "on" : "off");
     monitor_printf(mon, "  clear-bitmap-shift: %u\n",
                    ms->clear_bitmap_shift);
+    monitor_printf(mon, "  dirty-sync-threads: %u\n",
+                   ms->dirty_sync_threads);
+    monitor_printf(mon, "  parallel-save-threads: %u\n",
+                   ms->parallel_save_threads);
+    monitor_printf(mon, "  multifd-autoscale: %s\n",
+                   ms->multifd_autoscale ? "on" : "off");
+    monitor_printf(mon, "  mapped-ram-lazy-load: %s\n",
+                   ms->mapped_ram_lazy_load ? "on" : "off");
+    monitor_printf(mon, "  dirty-limit-adaptive: %s\n",
+                   ms->dirty_limit_adaptive ? "on" : "off");
+    monitor_printf(mon, "  background-snapshot-writers: %u\n",
+                   ms->background_snapshot_writers);
 }
 
 static const gchar *format_time_str(uint64_t us)
@@ -170,6 +182,14 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                 monitor_printf(mon, ", exp_down=%" PRIu64,
                                info->expected_downtime);
             }
+            if (info->has_predicted_downtime) {
+                monitor_printf(mon, ", pred_down=%" PRIu64,
+                               info->predicted_downtime);
+            }
+            if (info->has_predicted_switchover_time) {
+                monitor_printf(mon, ", pred_switchover=%" PRIu64,
+                               info->predicted_switchover_time);
+            }
             if (info->has_downtime) {
                 monitor_printf(mon, ", down=%" PRIu64,
                                info->downtime);
@@ -243,6 +263,10 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
             monitor_printf(mon, ", zerocopy_fallbacks=%" PRIu64,
                            info->ram->dirty_sync_missed_zero_copy);
         }
+        if (info->ram->dedup_pages) {
+            monitor_printf(mon, ", dedup=%" PRIu64,
+                           info->ram->dedup_pages);
+        }
         monitor_printf(mon, "\n");
     }
 
@@ -34,6 +34,11 @@
  * one thread).
  */
 typedef struct {
+    /*
+     * Number of pages sent as a reference to an identical page that
+     * the destination already has.
+     */
+    Stat64 dedup_pages;
     /*
      * Number of bytes that were dirty last time that we synced with
      * the guest memory.  We use that to calculate the downtime.  As
@@ -494,6 +494,7 @@ void migration_incoming_state_destroy(void)
         mis->postcopy_qemufile_dst = NULL;
     }
 
+    file_cleanup_incoming_migration();
     cpr_set_incoming_mode(MIG_MODE_NONE);
     yank_unregister_instance(MIGRATION_YANK_INSTANCE);
 }
@@ -1265,6 +1266,12 @@ static void populate_time_info(MigrationInfo *info, MigrationState *s)
     } else {
         info->has_expected_downtime = true;
         info->expected_downtime = s->expected_downtime;
+        info->has_predicted_downtime = true;
+        info->predicted_downtime = s->predicted_downtime;
+        if (s->predicted_switchover_time >= 0) {
+            info->has_predicted_switchover_time = true;
+            info->predicted_switchover_time = s->predicted_switchover_time;
+        }
     }
 }
 
@@ -1278,6 +1285,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->duplicate = stat64_get(&mig_stats.zero_pages);
     info->ram->normal = stat64_get(&mig_stats.normal_pages);
     info->ram->normal_bytes = info->ram->normal * page_size;
+    info->ram->dedup_pages = stat64_get(&mig_stats.dedup_pages);
     info->ram->mbps = s->mbps;
     info->ram->dirty_sync_count =
         stat64_get(&mig_stats.dirty_sync_count);
@@ -1786,6 +1794,8 @@ int migrate_init(MigrationState *s, Error **errp)
     s->pages_per_second = 0.0;
     s->downtime = 0;
     s->expected_downtime = 0;
+    s->predicted_downtime = 0;
+    s->predicted_switchover_time = -1;
     s->setup_time = 0;
     s->start_postcopy = false;
     s->migration_thread_running = false;
@@ -2767,6 +2777,14 @@ static int postcopy_start(MigrationState *ms, Error **errp)
      * that are dirty
      */
     if (migrate_postcopy_ram()) {
+        /*
+         * Precopy pages still in flight on the multifd channels must land
+         * before the destination applies the discards.
+         */
+        if (multifd_ram_flush_postcopy()) {
+            error_setg(errp, "%s: Failed to sync multifd channels", __func__);
+            goto fail;
+        }
         ram_postcopy_send_discard_bitmap(ms);
     }
 
@@ -3349,6 +3367,33 @@ static void update_iteration_initial_status(MigrationState *s)
     s->iteration_initial_pages = ram_get_total_transferred_pages();
 }
 
+/*
+ * Predict how precopy goes on if the transfer rate @bw_per_ms and the
+ * dirty page rate stay as they are.  While a walk of the dirty bitmap
+ * sends what is dirty now, the guest dirties a share of it again
+ * proportional to the ratio of both rates, and that is what a
+ * switchover after the walk has to send.  The remaining RAM shrinks by
+ * the difference of both rates until it fits the downtime limit.
+ */
+static void migration_update_prediction(MigrationState *s, double bw_per_ms)
+{
+    double dirty_per_ms = (double)stat64_get(&mig_stats.dirty_pages_rate) *
+                          qemu_target_page_size() / 1000;
+    double remaining = stat64_get(&mig_stats.dirty_bytes_last_sync);
+
+    s->predicted_downtime = MIN(dirty_per_ms / bw_per_ms, 1.0) *
+                            s->expected_downtime;
+
+    if (dirty_per_ms >= bw_per_ms) {
+        s->predicted_switchover_time = -1;
+    } else if (remaining <= s->threshold_size) {
+        s->predicted_switchover_time = 0;
+    } else {
+        s->predicted_switchover_time = (remaining - s->threshold_size) /
+                                       (bw_per_ms - dirty_per_ms);
+    }
+}
+
 static void migration_update_counters(MigrationState *s,
                                       int64_t current_time)
 {
@@ -3398,6 +3443,13 @@ static void migration_update_counters(MigrationState *s,
         transferred > 10000) {
         s->expected_downtime =
             stat64_get(&mig_stats.dirty_bytes_last_sync) / expected_bw_per_ms;
+        migration_update_prediction(s, expected_bw_per_ms);
+    }
+
+    if (migrate_multifd()) {
+        multifd_send_autoscale(time_spent, bandwidth * 1000,
+                               stat64_get(&mig_stats.dirty_pages_rate) *
+                               qemu_target_page_size());
     }
 
     migration_rate_reset();
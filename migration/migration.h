@@ -358,6 +358,9 @@ struct MigrationState {
     int64_t downtime_start;
     int64_t downtime;
     int64_t expected_downtime;
+    /* See MigrationInfo; predicted_switchover_time is -1 if unknown */
+    int64_t predicted_downtime;
+    int64_t predicted_switchover_time;
     bool capabilities[MIGRATION_CAPABILITY__MAX];
     int64_t setup_time;
 
@@ -493,6 +496,48 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Number of threads used to fold the dirty log into the migration
+     * bitmap on each bitmap sync.  RAMBlocks are split into chunks of at
+     * least 1G that are processed in parallel.  1 means the migration
+     * thread does all the work itself.
+     */
+    uint8_t dirty_sync_threads;
+
+    /*
+     * Number of threads used to save the non-iterable state of devices
+     * whose VMSD has parallel_save set.  1 saves everything serially on
+     * the migration thread.
+     */
+    uint8_t parallel_save_threads;
+
+    /*
+     * Let multifd change the number of channels that send at the same
+     * time while migration runs, up to multifd-channels.
+     */
+    bool multifd_autoscale;
+
+    /*
+     * On the destination of a mapped-ram migration, let the guest run
+     * before RAM is read from the file.  Pages are populated through
+     * userfaultfd on access and by background readers.
+     */
+    bool mapped_ram_lazy_load;
+
+    /*
+     * With dirty-limit, derive the per-vCPU quota from the measured
+     * transfer rate instead of using vcpu-dirty-limit as is, so that
+     * only the vCPUs writing more than their share are throttled.
+     * vcpu-dirty-limit becomes the lowest quota that is applied.
+     */
+    bool dirty_limit_adaptive;
+
+    /*
+     * Number of threads writing RAM of a background snapshot to a
+     * mapped-ram file.  1 writes from the migration thread.
+     */
+    uint8_t background_snapshot_writers;
+
     /*
      * This save hostname when out-going migration starts
      */
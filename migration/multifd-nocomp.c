@@ -23,6 +23,8 @@
 #include "qemu/error-report.h"
 #include "trace.h"
 #include "qemu-file.h"
+#include "postcopy-ram.h"
+#include "ram.h"
 
 static MultiFDSendData *multifd_ram_send;
 
@@ -130,6 +132,9 @@ static int multifd_nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
 
     multifd_send_prepare_iovs(p);
     p->flags |= MULTIFD_FLAG_NOCOMP;
+    if (migration_in_postcopy()) {
+        p->flags |= MULTIFD_FLAG_POSTCOPY;
+    }
 
     multifd_send_fill_packet(p);
 
@@ -150,6 +155,11 @@ static int multifd_nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
 static int multifd_nocomp_recv_setup(MultiFDRecvParams *p, Error **errp)
 {
     p->iov = g_new0(struct iovec, multifd_ram_page_count());
+    if (migrate_postcopy_multifd()) {
+        p->postcopy_buf = qemu_memalign(qemu_real_host_page_size(),
+                                        multifd_ram_page_count() *
+                                        multifd_ram_page_size());
+    }
     return 0;
 }
 
@@ -157,11 +167,93 @@ static void multifd_nocomp_recv_cleanup(MultiFDRecvParams *p)
 {
     g_free(p->iov);
     p->iov = NULL;
+    qemu_vfree(p->postcopy_buf);
+    p->postcopy_buf = NULL;
+}
+
+/*
+ * Read @niov iovecs worth of page data, letting the socket wait for the
+ * whole payload instead of returning it piecemeal.
+ */
+static int multifd_nocomp_recv_iov(MultiFDRecvParams *p, int niov,
+                                   Error **errp)
+{
+    int ret = qio_channel_readv_full_all_eof(p->c, p->iov, niov, NULL, NULL,
+                                             QIO_CHANNEL_READ_FLAG_WAITALL,
+                                             errp);
+
+    if (ret == 0) {
+        error_setg(errp, "multifd %u: unexpected EOF while reading pages",
+                   p->id);
+        return -1;
+    }
+    return ret < 0 ? ret : 0;
+}
+
+/*
+ * Pages sent during postcopy are missing from the point of view of
+ * userfaultfd, so they cannot be written to guest memory directly.  Read
+ * them into a bounce buffer and place them one by one, like
+ * ram_load_postcopy() does for the main channel.
+ */
+static int multifd_nocomp_recv_postcopy(MultiFDRecvParams *p, Error **errp)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    uint32_t page_size = multifd_ram_page_size();
+    int ret;
+
+    if (!p->postcopy_buf || qemu_ram_pagesize(p->block) != page_size) {
+        error_setg(errp, "multifd %u: unexpected postcopy packet for "
+                   "RAMBlock %s", p->id, p->block->idstr);
+        return -1;
+    }
+
+    for (int i = 0; i < p->zero_num; i++) {
+        if (ramblock_recv_bitmap_test_byte_offset(p->block, p->zero[i])) {
+            continue;
+        }
+        ret = postcopy_place_page_zero(mis, p->host + p->zero[i], p->block);
+        if (ret) {
+            error_setg_errno(errp, -ret, "multifd %u: failed to place zero "
+                             "page at offset 0x" RAM_ADDR_FMT,
+                             p->id, p->zero[i]);
+            return -1;
+        }
+    }
+
+    if (!p->normal_num) {
+        return 0;
+    }
+
+    p->iov[0].iov_base = p->postcopy_buf;
+    p->iov[0].iov_len = p->normal_num * page_size;
+    ret = multifd_nocomp_recv_iov(p, 1, errp);
+    if (ret) {
+        return ret;
+    }
+
+    for (int i = 0; i < p->normal_num; i++) {
+        if (ramblock_recv_bitmap_test_byte_offset(p->block, p->normal[i])) {
+            continue;
+        }
+        ret = postcopy_place_page(mis, p->host + p->normal[i],
+                                  p->postcopy_buf + i * page_size, p->block);
+        if (ret) {
+            error_setg_errno(errp, -ret, "multifd %u: failed to place "
+                             "page at offset 0x" RAM_ADDR_FMT,
+                             p->id, p->normal[i]);
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 static int multifd_nocomp_recv(MultiFDRecvParams *p, Error **errp)
 {
+    uint32_t page_size = multifd_ram_page_size();
     uint32_t flags;
+    int niov = 0;
 
     if (migrate_mapped_ram()) {
         return multifd_file_recv_data(p, errp);
@@ -175,18 +267,37 @@ static int multifd_nocomp_recv(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    if (p->flags & MULTIFD_FLAG_POSTCOPY) {
+        return multifd_nocomp_recv_postcopy(p, errp);
+    }
+
     multifd_recv_zero_page_process(p);
 
     if (!p->normal_num) {
         return 0;
     }
 
+    /*
+     * The payload is received straight into guest memory.  The sender
+     * queues pages in address order, so most packets describe a few long
+     * runs; merge them so that the kernel copies into large contiguous
+     * buffers.
+     */
     for (int i = 0; i < p->normal_num; i++) {
-        p->iov[i].iov_base = p->host + p->normal[i];
-        p->iov[i].iov_len = multifd_ram_page_size();
+        uint8_t *page = p->host + p->normal[i];
+
+        if (niov &&
+            (uint8_t *)p->iov[niov - 1].iov_base +
+            p->iov[niov - 1].iov_len == page) {
+            p->iov[niov - 1].iov_len += page_size;
+        } else {
+            p->iov[niov].iov_base = page;
+            p->iov[niov].iov_len = page_size;
+            niov++;
+        }
         ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
     }
-    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+    return multifd_nocomp_recv_iov(p, niov, errp);
 }
 
 static void multifd_pages_reset(MultiFDPages_t *pages)
@@ -399,7 +510,8 @@ int multifd_ram_flush_and_sync(QEMUFile *f)
     MultiFDSyncReq req;
     int ret;
 
-    if (!migrate_multifd() || migration_in_postcopy()) {
+    if (!migrate_multifd() ||
+        (migration_in_postcopy() && !migrate_postcopy_multifd())) {
         return 0;
     }
 
@@ -437,6 +549,29 @@ int multifd_ram_flush_and_sync(QEMUFile *f)
     return 0;
 }
 
+/*
+ * Flush and sync the channels before the discard bitmap is sent at the
+ * switch to postcopy.  Nothing goes to the main channel: with
+ * postcopy-multifd the destination syncs on its own before handling the
+ * first discard, so no precopy page can land after a discard or once
+ * userfaultfd is registered.
+ */
+int multifd_ram_flush_postcopy(void)
+{
+    if (!migrate_postcopy_multifd()) {
+        return 0;
+    }
+
+    if (!multifd_payload_empty(multifd_ram_send)) {
+        if (!multifd_send(&multifd_ram_send)) {
+            error_report("%s: multifd_send fail", __func__);
+            return -1;
+        }
+    }
+
+    return multifd_send_sync_main(MULTIFD_SYNC_ALL);
+}
+
 bool multifd_send_prepare_common(MultiFDSendParams *p)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
@@ -101,8 +101,13 @@ void multifd_recv_zero_page_process(MultiFDRecvParams *p)
          *
          * When postcopy is enabled, always write the zero page as and when
          * it is migrated.
+         *
+         * A page that was received before only needs clearing if it is
+         * not zero already; ram_handle_zero() avoids dirtying it otherwise.
          */
-        if (migrate_postcopy_ram() || received) {
+        if (received) {
+            ram_handle_zero(page, multifd_ram_page_size());
+        } else if (migrate_postcopy_ram()) {
             memset(page, 0, multifd_ram_page_size());
         }
         if (!received) {
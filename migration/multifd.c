@@ -14,6 +14,8 @@
 #include "qemu/cutils.h"
 #include "qemu/iov.h"
 #include "qemu/rcu.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #include "exec/target_page.h"
 #include "system/system.h"
 #include "system/ramblock.h"
@@ -79,6 +81,26 @@ struct {
     int exiting;
     /* multifd ops */
     const MultiFDMethods *ops;
+
+    /*
+     * Adaptive channel scaling (x-multifd-autoscale).  At most
+     * active_channels channels work on a job at any time; the others
+     * stay connected but idle, together with their compression state.
+     * See multifd_send_autoscale() for how active_channels is chosen.
+     */
+    bool autoscale;
+    QemuMutex active_lock;
+    QemuCond active_cond;
+    /* protected by active_lock */
+    int active_channels;
+    int busy_channels;
+    /* time multifd_send() waited for a channel, in ns */
+    Stat64 stall_ns;
+    /* time spent by all channels working on jobs, in ns */
+    Stat64 busy_ns;
+    /* only accessed by the migration thread */
+    uint64_t stall_ns_prev;
+    uint64_t busy_ns_prev;
 } *multifd_send_state;
 
 struct {
@@ -91,6 +113,13 @@ struct {
      * uses it to wait for recv threads to finish assigned tasks.
      */
     QemuSemaphore sem_sync;
+    /*
+     * Set once the destination is listening for postcopy pages, i.e. the
+     * discards are done and userfaultfd is registered.  Pages sent during
+     * postcopy can only be placed after that.
+     */
+    QemuEvent postcopy_listen;
+    bool postcopy_listening;
     /* global number of generated multifd packets */
     uint64_t packet_num;
     int exiting;
@@ -334,6 +363,93 @@ static void multifd_send_kick_main(MultiFDSendParams *p)
 {
     qemu_sem_post(&p->sem_sync);
     qemu_sem_post(&multifd_send_state->channels_ready);
+    if (multifd_send_state->autoscale) {
+        WITH_QEMU_LOCK_GUARD(&multifd_send_state->active_lock) {
+            qemu_cond_broadcast(&multifd_send_state->active_cond);
+        }
+    }
+}
+
+/* Wait until one more channel is allowed to work on a job */
+static void multifd_send_wait_active(void)
+{
+    QEMU_LOCK_GUARD(&multifd_send_state->active_lock);
+
+    while (multifd_send_state->busy_channels >=
+           multifd_send_state->active_channels &&
+           !multifd_send_should_exit()) {
+        qemu_cond_wait(&multifd_send_state->active_cond,
+                       &multifd_send_state->active_lock);
+    }
+}
+
+/*
+ * Account for a job handed to a channel; undone by multifd_send_job_done().
+ * Only called once a channel was picked, so that bailing out of
+ * multifd_send() early cannot leave busy_channels raised.
+ */
+static void multifd_send_job_start(void)
+{
+    QEMU_LOCK_GUARD(&multifd_send_state->active_lock);
+    multifd_send_state->busy_channels++;
+}
+
+static void multifd_send_job_done(int64_t busy_ns)
+{
+    stat64_add(&multifd_send_state->busy_ns, busy_ns);
+
+    QEMU_LOCK_GUARD(&multifd_send_state->active_lock);
+    multifd_send_state->busy_channels--;
+    qemu_cond_signal(&multifd_send_state->active_cond);
+}
+
+/*
+ * Adjust the number of channels that may work at the same time, based on
+ * what happened since the last call @period_ms milliseconds ago:
+ *
+ * - if multifd_send() had to wait for a free channel for more than 10% of
+ *   the time, the channels (compression or network) are the bottleneck, so
+ *   allow one more channel to work;
+ *
+ * - if it basically never had to wait and the channels were working on
+ *   less than active_channels - 1 jobs on average, retire one channel,
+ *   unless the guest dirties memory faster (@dirty_rate, in bytes/s) than
+ *   migration currently sends it (@xfer_rate, in bytes/s).
+ *
+ * Called from the migration thread.
+ */
+void multifd_send_autoscale(uint64_t period_ms, uint64_t xfer_rate,
+                            uint64_t dirty_rate)
+{
+    uint64_t period_ns = period_ms * SCALE_MS;
+    uint64_t stall_ns, busy_ns;
+    int active, busy_pct, stall_pct;
+
+    if (!multifd_send_state || !multifd_send_state->autoscale || !period_ns) {
+        return;
+    }
+
+    stall_ns = stat64_get(&multifd_send_state->stall_ns);
+    busy_ns = stat64_get(&multifd_send_state->busy_ns);
+    stall_pct = (stall_ns - multifd_send_state->stall_ns_prev) * 100 /
+                period_ns;
+    busy_pct = (busy_ns - multifd_send_state->busy_ns_prev) * 100 / period_ns;
+    multifd_send_state->stall_ns_prev = stall_ns;
+    multifd_send_state->busy_ns_prev = busy_ns;
+
+    WITH_QEMU_LOCK_GUARD(&multifd_send_state->active_lock) {
+        active = multifd_send_state->active_channels;
+        if (stall_pct > 10 && active < migrate_multifd_channels()) {
+            active++;
+            qemu_cond_signal(&multifd_send_state->active_cond);
+        } else if (stall_pct < 1 && active > 1 &&
+                   busy_pct < (active - 1) * 100 && dirty_rate <= xfer_rate) {
+            active--;
+        }
+        multifd_send_state->active_channels = active;
+    }
+
+    trace_multifd_send_autoscale(active, stall_pct, busy_pct);
 }
 
 /*
@@ -363,8 +479,16 @@ bool multifd_send(MultiFDSendData **send_data)
 
     QEMU_LOCK_GUARD(&multifd_send_state->multifd_send_mutex);
 
-    /* We wait here, until at least one channel is ready */
-    qemu_sem_wait(&multifd_send_state->channels_ready);
+    if (multifd_send_state->autoscale) {
+        int64_t start = get_clock();
+
+        multifd_send_wait_active();
+        qemu_sem_wait(&multifd_send_state->channels_ready);
+        stat64_add(&multifd_send_state->stall_ns, get_clock() - start);
+    } else {
+        /* We wait here, until at least one channel is ready */
+        qemu_sem_wait(&multifd_send_state->channels_ready);
+    }
 
     /*
      * next_channel can remain from a previous migration that was
@@ -403,6 +527,10 @@ bool multifd_send(MultiFDSendData **send_data)
     *send_data = p->data;
     p->data = tmp;
 
+    if (multifd_send_state->autoscale) {
+        multifd_send_job_start();
+    }
+
     /*
      * Making sure p->data is setup before marking pending_job=true. Pairs
      * with the qatomic_load_acquire() in multifd_send_thread().
@@ -451,6 +579,12 @@ static void multifd_send_terminate_threads(void)
      */
     qatomic_set(&multifd_send_state->exiting, 1);
 
+    if (multifd_send_state->autoscale) {
+        WITH_QEMU_LOCK_GUARD(&multifd_send_state->active_lock) {
+            qemu_cond_broadcast(&multifd_send_state->active_cond);
+        }
+    }
+
     /*
      * Firstly, kick all threads out; no matter whether they are just idle,
      * or blocked in an IO system call.
@@ -533,6 +667,8 @@ static void multifd_send_cleanup_state(void)
     qemu_sem_destroy(&multifd_send_state->channels_created);
     qemu_sem_destroy(&multifd_send_state->channels_ready);
     qemu_mutex_destroy(&multifd_send_state->multifd_send_mutex);
+    qemu_cond_destroy(&multifd_send_state->active_cond);
+    qemu_mutex_destroy(&multifd_send_state->active_lock);
     g_free(multifd_send_state->params);
     multifd_send_state->params = NULL;
     g_free(multifd_send_state);
@@ -689,6 +825,7 @@ static void *multifd_send_thread(void *opaque)
          */
         if (qatomic_load_acquire(&p->pending_job)) {
             bool is_device_state = multifd_payload_device_state(p->data);
+            int64_t start = multifd_send_state->autoscale ? get_clock() : 0;
             size_t total_size;
             int write_flags_masked = 0;
 
@@ -742,6 +879,10 @@ static void *multifd_send_thread(void *opaque)
              * multifd_send().
              */
             qatomic_store_release(&p->pending_job, false);
+
+            if (multifd_send_state->autoscale) {
+                multifd_send_job_done(get_clock() - start);
+            }
         } else {
             MultiFDSyncReq req = qatomic_read(&p->pending_sync);
 
@@ -936,6 +1077,11 @@ bool multifd_send_setup(void)
     qemu_mutex_init(&multifd_send_state->multifd_send_mutex);
     qemu_sem_init(&multifd_send_state->channels_created, 0);
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
+    qemu_mutex_init(&multifd_send_state->active_lock);
+    qemu_cond_init(&multifd_send_state->active_cond);
+    multifd_send_state->autoscale = migrate_get_current()->multifd_autoscale &&
+                                    !migrate_mapped_ram();
+    multifd_send_state->active_channels = thread_count;
     qatomic_set(&multifd_send_state->exiting, 0);
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
 
@@ -1071,6 +1217,9 @@ static void multifd_recv_terminate_threads(Error *err)
         }
     }
 
+    /* Release the channels waiting for postcopy to start */
+    qemu_event_set(&multifd_recv_state->postcopy_listen);
+
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDRecvParams *p = &multifd_recv_state->params[i];
 
@@ -1142,6 +1291,7 @@ static void multifd_recv_cleanup_channel(MultiFDRecvParams *p)
 static void multifd_recv_cleanup_state(void)
 {
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
+    qemu_event_destroy(&multifd_recv_state->postcopy_listen);
     g_free(multifd_recv_state->params);
     multifd_recv_state->params = NULL;
     g_free(multifd_recv_state->data);
@@ -1233,6 +1383,20 @@ void multifd_recv_sync_main(void)
     trace_multifd_recv_sync_main(multifd_recv_state->packet_num);
 }
 
+/*
+ * Called by the main thread once POSTCOPY_LISTEN is processed, so that the
+ * channels can start placing the pages sent during postcopy.
+ */
+void multifd_recv_postcopy_listen(void)
+{
+    if (!migrate_multifd()) {
+        return;
+    }
+
+    qatomic_set(&multifd_recv_state->postcopy_listening, true);
+    qemu_event_set(&multifd_recv_state->postcopy_listen);
+}
+
 static int multifd_device_state_recv(MultiFDRecvParams *p, Error **errp)
 {
     g_autofree char *dev_state_buf = NULL;
@@ -1386,11 +1550,31 @@ static void *multifd_recv_thread(void *opaque)
         if (has_data) {
             /*
              * multifd thread should not be active and receive data
-             * when migration is in the Postcopy phase. Two threads
-             * writing the same memory area could easily corrupt
-             * the guest state.
+             * when migration is in the Postcopy phase, unless the pages
+             * are placed atomically. Two threads writing the same memory
+             * area could easily corrupt the guest state.
              */
-            assert(!migration_in_postcopy());
+            if (flags & MULTIFD_FLAG_POSTCOPY) {
+                if (!migrate_postcopy_multifd() ||
+                    migrate_multifd_compression() !=
+                    MULTIFD_COMPRESSION_NONE) {
+                    error_setg(&local_err,
+                               "multifd: unexpected postcopy packet");
+                    break;
+                }
+                /*
+                 * The channel can get ahead of the main channel, so wait
+                 * until POSTCOPY_LISTEN has been processed there.
+                 */
+                qemu_event_wait(&multifd_recv_state->postcopy_listen);
+                if (multifd_recv_should_exit()) {
+                    break;
+                }
+            } else if (qatomic_read(&multifd_recv_state->postcopy_listening)) {
+                error_setg(&local_err,
+                           "multifd: precopy packet received during postcopy");
+                break;
+            }
             if (is_device_state) {
                 assert(use_packets);
                 ret = multifd_device_state_recv(p, &local_err);
@@ -1464,6 +1648,7 @@ int multifd_recv_setup(Error **errp)
     qatomic_set(&multifd_recv_state->count, 0);
     qatomic_set(&multifd_recv_state->exiting, 0);
     qemu_sem_init(&multifd_recv_state->sem_sync, 0);
+    qemu_event_init(&multifd_recv_state->postcopy_listen, false);
     multifd_recv_state->ops = multifd_ops[migrate_multifd_compression()];
 
     for (i = 0; i < thread_count; i++) {
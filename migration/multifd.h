@@ -44,7 +44,10 @@ void multifd_recv_shutdown(void);
 bool multifd_recv_all_channels_created(void);
 void multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
+void multifd_recv_postcopy_listen(void);
 int multifd_send_sync_main(MultiFDSyncReq req);
+void multifd_send_autoscale(uint64_t period_ms, uint64_t xfer_rate,
+                            uint64_t dirty_rate);
 bool multifd_queue_page(RAMBlock *block, ram_addr_t offset);
 bool multifd_recv(void);
 MultiFDRecvData *multifd_get_recv_data(void);
@@ -73,6 +76,13 @@ MultiFDRecvData *multifd_get_recv_data(void);
  */
 #define MULTIFD_FLAG_DEVICE_STATE (32 << 1)
 
+/*
+ * If set it means that the pages in this packet were sent during postcopy,
+ * so the destination must place them atomically instead of writing them to
+ * guest memory directly.
+ */
+#define MULTIFD_FLAG_POSTCOPY (64 << 1)
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
@@ -293,6 +303,8 @@ typedef struct {
     uint32_t zero_num;
     /* used for de-compression methods */
     void *compress_data;
+    /* bounce buffer for the pages received during postcopy */
+    uint8_t *postcopy_buf;
     /* Flags for the QIOChannel */
     int read_flags;
 } MultiFDRecvParams;
@@ -401,6 +413,7 @@ static inline uint32_t multifd_ram_page_count(void)
 void multifd_ram_save_setup(void);
 void multifd_ram_save_cleanup(void);
 int multifd_ram_flush_and_sync(QEMUFile *f);
+int multifd_ram_flush_postcopy(void);
 bool multifd_ram_sync_per_round(void);
 bool multifd_ram_sync_per_section(void);
 void multifd_ram_payload_alloc(MultiFDPages_t *pages);
@@ -99,6 +99,18 @@ const Property migration_properties[] = {
                       multifd_flush_after_each_section, false),
     DEFINE_PROP_UINT8("x-clear-bitmap-shift", MigrationState,
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
+    DEFINE_PROP_UINT8("x-dirty-sync-threads", MigrationState,
+                      dirty_sync_threads, 1),
+    DEFINE_PROP_UINT8("x-parallel-save-threads", MigrationState,
+                      parallel_save_threads, 1),
+    DEFINE_PROP_BOOL("x-multifd-autoscale", MigrationState,
+                     multifd_autoscale, false),
+    DEFINE_PROP_BOOL("x-mapped-ram-lazy-load", MigrationState,
+                     mapped_ram_lazy_load, false),
+    DEFINE_PROP_BOOL("x-dirty-limit-adaptive", MigrationState,
+                     dirty_limit_adaptive, false),
+    DEFINE_PROP_UINT8("x-background-snapshot-writers", MigrationState,
+                      background_snapshot_writers, 1),
     DEFINE_PROP_BOOL("x-preempt-pre-7-2", MigrationState,
                      preempt_pre_7_2, false),
     DEFINE_PROP_BOOL("multifd-clean-tls-termination", MigrationState,
@@ -203,6 +215,9 @@ const Property migration_properties[] = {
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-postcopy-multifd",
+                        MIGRATION_CAPABILITY_POSTCOPY_MULTIFD),
+    DEFINE_PROP_MIG_CAP("x-page-dedup", MIGRATION_CAPABILITY_PAGE_DEDUP),
 };
 const size_t migration_properties_count = ARRAY_SIZE(migration_properties);
 
@@ -276,6 +291,20 @@ bool migrate_late_block_activate(void)
     return s->capabilities[MIGRATION_CAPABILITY_LATE_BLOCK_ACTIVATE];
 }
 
+bool migrate_dirty_limit_adaptive(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->dirty_limit_adaptive;
+}
+
+bool migrate_mapped_ram_lazy_load(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->mapped_ram_lazy_load;
+}
+
 bool migrate_multifd(void)
 {
     MigrationState *s = migrate_get_current();
@@ -283,6 +312,13 @@ bool migrate_multifd(void)
     return s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_page_dedup(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_PAGE_DEDUP];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s = migrate_get_current();
@@ -297,6 +333,13 @@ bool migrate_postcopy_blocktime(void)
     return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_BLOCKTIME];
 }
 
+bool migrate_postcopy_multifd(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_MULTIFD];
+}
+
 bool migrate_postcopy_preempt(void)
 {
     MigrationState *s = migrate_get_current();
@@ -460,6 +503,10 @@ bool migrate_rdma_caps_check(bool *caps, Error **errp)
         error_setg(errp, "RDMA and multifd can't be used together");
         return false;
     }
+    if (caps[MIGRATION_CAPABILITY_PAGE_DEDUP]) {
+        error_setg(errp, "RDMA and page-dedup can't be used together");
+        return false;
+    }
     if (caps[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
         error_setg(errp, "RDMA and postcopy-ram can't be used together");
         return false;
@@ -577,6 +624,27 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_POSTCOPY_MULTIFD]) {
+        if (!new_caps[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT] ||
+            !new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
+            error_setg(errp, "Postcopy multifd requires postcopy-preempt "
+                       "and multifd");
+            return false;
+        }
+
+        if (migrate_multifd_flush_after_each_section()) {
+            error_setg(errp, "Postcopy multifd is not compatible with "
+                       "multifd-flush-after-each-section");
+            return false;
+        }
+
+        if (!migrate_postcopy_multifd() && migrate_incoming_started()) {
+            error_setg(errp,
+                       "Postcopy multifd must be set before incoming starts");
+            return false;
+        }
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
         if (!migrate_multifd() && migrate_incoming_started()) {
             error_setg(errp, "Multifd must be set before incoming starts");
@@ -612,6 +680,17 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_PAGE_DEDUP]) {
+        if (new_caps[MIGRATION_CAPABILITY_XBZRLE] ||
+            new_caps[MIGRATION_CAPABILITY_MULTIFD] ||
+            new_caps[MIGRATION_CAPABILITY_MAPPED_RAM] ||
+            new_caps[MIGRATION_CAPABILITY_X_COLO]) {
+            error_setg(errp, "Page dedup is not compatible with xbzrle, "
+                       "multifd, mapped-ram and x-colo");
+            return false;
+        }
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
         if (new_caps[MIGRATION_CAPABILITY_XBZRLE]) {
             error_setg(errp,
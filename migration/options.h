@@ -32,9 +32,13 @@ bool migrate_events(void);
 bool migrate_mapped_ram(void);
 bool migrate_ignore_shared(void);
 bool migrate_late_block_activate(void);
+bool migrate_dirty_limit_adaptive(void);
+bool migrate_mapped_ram_lazy_load(void);
 bool migrate_multifd(void);
+bool migrate_page_dedup(void);
 bool migrate_pause_before_switchover(void);
 bool migrate_postcopy_blocktime(void);
+bool migrate_postcopy_multifd(void);
 bool migrate_postcopy_preempt(void);
 bool migrate_rdma_pin_all(void);
 bool migrate_release_ram(void);
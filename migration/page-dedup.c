@@ -0,0 +1,108 @@
+/*
+ * Content-addressed page deduplication for RAM migration
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/xxhash.h"
+#include "qapi/error.h"
+#include "exec/target_page.h"
+#include "system/ramblock.h"
+#include "page-dedup.h"
+
+typedef struct PageDedupEntry {
+    uint64_t hash;
+    RAMBlock *block;
+    ram_addr_t offset;
+} PageDedupEntry;
+
+struct PageDedupCache {
+    PageDedupEntry *entries;
+    size_t mask;
+};
+
+PageDedupCache *page_dedup_cache_new(uint64_t cache_size, Error **errp)
+{
+    PageDedupCache *cache;
+    uint64_t nr_entries = cache_size / sizeof(PageDedupEntry);
+
+    if (nr_entries < 1) {
+        error_setg(errp, "Cache too small for page deduplication");
+        return NULL;
+    }
+
+    cache = g_new(PageDedupCache, 1);
+    nr_entries = pow2floor(nr_entries);
+    cache->entries = g_try_new0(PageDedupEntry, nr_entries);
+    if (!cache->entries) {
+        error_setg(errp, "Failed to allocate page deduplication cache");
+        g_free(cache);
+        return NULL;
+    }
+    cache->mask = nr_entries - 1;
+
+    return cache;
+}
+
+void page_dedup_cache_free(PageDedupCache *cache)
+{
+    if (cache) {
+        g_free(cache->entries);
+        g_free(cache);
+    }
+}
+
+uint64_t page_dedup_hash(const uint8_t *buf, size_t len)
+{
+    uint64_t v1 = QEMU_XXHASH_SEED + XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = QEMU_XXHASH_SEED + XXH_PRIME64_2;
+    uint64_t v3 = QEMU_XXHASH_SEED + 0;
+    uint64_t v4 = QEMU_XXHASH_SEED - XXH_PRIME64_1;
+    uint64_t h64;
+    size_t i;
+
+    assert(QEMU_IS_ALIGNED(len, 32));
+    for (i = 0; i < len; i += 32) {
+        v1 = XXH64_round(v1, ldq_le_p(buf + i));
+        v2 = XXH64_round(v2, ldq_le_p(buf + i + 8));
+        v3 = XXH64_round(v3, ldq_le_p(buf + i + 16));
+        v4 = XXH64_round(v4, ldq_le_p(buf + i + 24));
+    }
+    h64 = XXH64_mergerounds(v1, v2, v3, v4) + len;
+    h64 = XXH64_avalanche(h64);
+
+    /* 0 marks pages whose contents are unknown */
+    return h64 ? h64 : 1;
+}
+
+bool page_dedup_cache_lookup(PageDedupCache *cache, uint64_t hash,
+                             RAMBlock **block, ram_addr_t *offset)
+{
+    PageDedupEntry *e = &cache->entries[hash & cache->mask];
+
+    if (e->hash != hash ||
+        e->block->dedup_hash[e->offset >> TARGET_PAGE_BITS] != hash) {
+        return false;
+    }
+
+    *block = e->block;
+    *offset = e->offset;
+    return true;
+}
+
+void page_dedup_page_sent(PageDedupCache *cache, RAMBlock *block,
+                          ram_addr_t offset, uint64_t hash)
+{
+    block->dedup_hash[offset >> TARGET_PAGE_BITS] = hash;
+
+    if (cache && hash) {
+        PageDedupEntry *e = &cache->entries[hash & cache->mask];
+
+        e->hash = hash;
+        e->block = block;
+        e->offset = offset;
+    }
+}
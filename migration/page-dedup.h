@@ -0,0 +1,73 @@
+/*
+ * Content-addressed page deduplication for RAM migration
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_PAGE_DEDUP_H
+#define QEMU_MIGRATION_PAGE_DEDUP_H
+
+#include "exec/cpu-common.h"
+
+/*
+ * Index from the hash of a page's contents to a page that was last
+ * sent with those contents.  The destination already holds a copy of
+ * such a page, so an identical page anywhere else in guest RAM can be
+ * sent as a reference to it.
+ *
+ * Which contents a page was last sent with is tracked in
+ * RAMBlock.dedup_hash, so that entries of pages that were sent again
+ * since they were indexed are recognized as stale.
+ */
+typedef struct PageDedupCache PageDedupCache;
+
+/**
+ * page_dedup_cache_new: allocate an index
+ *
+ * Returns the new index or NULL on error
+ *
+ * @cache_size: memory to use for the index, in bytes
+ * @errp: set *errp on failure
+ */
+PageDedupCache *page_dedup_cache_new(uint64_t cache_size, Error **errp);
+
+/**
+ * page_dedup_cache_free: free an index allocated with page_dedup_cache_new()
+ */
+void page_dedup_cache_free(PageDedupCache *cache);
+
+/**
+ * page_dedup_hash: hash the contents of a page
+ *
+ * Returns a non-zero 64 bit hash of @buf
+ *
+ * @buf: page contents
+ * @len: length of @buf, a multiple of 32
+ */
+uint64_t page_dedup_hash(const uint8_t *buf, size_t len);
+
+/**
+ * page_dedup_cache_lookup: find a page that was sent with a given hash
+ *
+ * Returns true and sets @block and @offset if there is such a page.
+ *
+ * @cache: index to look into
+ * @hash: hash of the contents, as returned by page_dedup_hash()
+ */
+bool page_dedup_cache_lookup(PageDedupCache *cache, uint64_t hash,
+                             RAMBlock **block, ram_addr_t *offset);
+
+/**
+ * page_dedup_page_sent: record the contents a page was sent with
+ *
+ * @cache: index to add the page to, or NULL to only update the
+ *         RAMBlock
+ * @block: RAMBlock containing the page
+ * @offset: offset of the page inside @block
+ * @hash: hash of the contents that were sent, or 0 if they are unknown
+ */
+void page_dedup_page_sent(PageDedupCache *cache, RAMBlock *block,
+                          ram_addr_t offset, uint64_t hash);
+
+#endif
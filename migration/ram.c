@@ -28,11 +28,15 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
+#include "block/thread-pool.h"
 #include "xbzrle.h"
+#include "page-dedup.h"
+#include "mapped-ram-lazy.h"
 #include "ram.h"
 #include "migration.h"
 #include "migration-stats.h"
@@ -138,9 +142,36 @@ struct PageSearchStatus {
     /* The start/end of current host page.  Invalid if host_page_sending==false */
     unsigned long host_page_start;
     unsigned long host_page_end;
+    /*
+     * Copy of the write-protected range being sent, from host_page_start
+     * on.  Pages are saved from here once the guest may write them again.
+     */
+    uint8_t *copyout;
+    /* Pending write of @copyout by the background snapshot writers */
+    struct RAMWriteJob *wp_job;
 };
 typedef struct PageSearchStatus PageSearchStatus;
 
+/*
+ * Write-protected RAM of a background snapshot is saved, and protection
+ * released, in chunks of this size, so that a write fault of the guest
+ * makes room for all its writes nearby.
+ */
+#define WP_CHUNK_SIZE       (2 * MiB)
+/* Maximum number of write faults that are read at once */
+#define WP_FAULT_BATCH      64
+
+typedef struct RAMWriteJob {
+    struct RAMState *rs;
+    QIOChannel *ioc;
+    /* File position of the first page of @buf */
+    off_t pos;
+    uint8_t *buf;
+    /* Pages of @buf that are written */
+    unsigned long *pages;
+    unsigned long npages;
+} RAMWriteJob;
+
 /* struct contains XBZRLE cache and a static page
    used by the compression */
 static struct {
@@ -432,6 +463,31 @@ struct RAMState {
      * Protected by @bitmap_mutex.
      */
     PageLocationHint page_hint;
+    /*
+     * Workers for migration_bitmap_sync(), created on first use when
+     * x-dirty-sync-threads is larger than 1.
+     */
+    ThreadPool *sync_threads;
+    /* Index of sent pages by contents, when page-dedup is enabled */
+    PageDedupCache *dedup;
+    /* Stable copy of the page being sent, that the hash is taken over */
+    uint8_t *dedup_buf;
+    /* Write faults read from uffdio_fd that are not handled yet */
+    uint64_t wp_faults[WP_FAULT_BATCH];
+    unsigned int wp_faults_num;
+    unsigned int wp_faults_next;
+    /* Copy of the chunk being saved, when there are no writer threads */
+    uint8_t *wp_copyout;
+    /*
+     * Threads writing chunks of a background snapshot to a mapped-ram
+     * file, created on first use when x-background-snapshot-writers is
+     * larger than 1.  Chunks are copied out of guest RAM before.
+     */
+    ThreadPool *wp_writers;
+    unsigned int wp_writes_inflight;
+    /* First error of the writers, protected by wp_writer_lock */
+    Error *wp_writer_err;
+    QemuMutex wp_writer_lock;
 };
 typedef struct RAMState RAMState;
 
@@ -709,6 +765,64 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+/**
+ * save_dedup_page: send a page as a reference to an identical page
+ *
+ * Returns: 1 means that we wrote a reference to another page
+ *          -1 means that the page has to be sent normally, from the
+ *             buffer that *current_data now points to
+ *
+ * The page is copied first, so that the hash recorded for it matches
+ * what ends up on the wire even if the guest writes it concurrently.
+ *
+ * @rs: current RAM state
+ * @pss: current PSS channel
+ * @current_data: pointer to the address of the page contents
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int save_dedup_page(RAMState *rs, PageSearchStatus *pss,
+                           uint8_t **current_data, RAMBlock *block,
+                           ram_addr_t offset)
+{
+    QEMUFile *file = pss->pss_channel;
+    RAMBlock *ref_block;
+    ram_addr_t ref_offset;
+    uint64_t hash;
+    size_t len;
+
+    memcpy(rs->dedup_buf, *current_data, TARGET_PAGE_SIZE);
+    *current_data = rs->dedup_buf;
+    hash = page_dedup_hash(rs->dedup_buf, TARGET_PAGE_SIZE);
+
+    /*
+     * The hash tells what the destination holds for the reference page.
+     * Also compare with the current contents of that page on our side,
+     * to make a match between different contents even more unlikely.
+     */
+    if (!page_dedup_cache_lookup(rs->dedup, hash, &ref_block, &ref_offset) ||
+        (ref_block == block && ref_offset == offset) ||
+        memcmp(ref_block->host + ref_offset, rs->dedup_buf,
+               TARGET_PAGE_SIZE)) {
+        page_dedup_page_sent(rs->dedup, block, offset, hash);
+        return -1;
+    }
+
+    len = save_page_header(pss, file, block, offset | RAM_SAVE_FLAG_DEDUP);
+    qemu_put_byte(file, strlen(ref_block->idstr));
+    qemu_put_buffer(file, (uint8_t *)ref_block->idstr,
+                    strlen(ref_block->idstr));
+    qemu_put_be64(file, ref_offset);
+    len += 1 + strlen(ref_block->idstr) + 8;
+    ram_transferred_add(len);
+
+    page_dedup_page_sent(NULL, block, offset, hash);
+    stat64_add(&mig_stats.dedup_pages, 1);
+    trace_save_dedup_page(block->idstr, offset, ref_block->idstr, ref_offset);
+
+    return 1;
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -944,6 +1058,81 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/* Smallest piece of a RAMBlock that is synced by one worker */
+#define RAMBLOCK_SYNC_CHUNK_SIZE (1 * GiB)
+
+typedef struct RAMBlockSyncChunk {
+    RAMBlock *rb;
+    ram_addr_t start;
+    ram_addr_t length;
+    uint64_t new_dirty_pages;
+} RAMBlockSyncChunk;
+
+static int ramblock_sync_dirty_bitmap_chunk(void *opaque)
+{
+    RAMBlockSyncChunk *chunk = opaque;
+
+    /*
+     * No RCU critical section is needed here: the migration thread holds
+     * one for as long as it waits for the workers.
+     */
+    chunk->new_dirty_pages =
+        cpu_physical_memory_sync_dirty_bitmap(chunk->rb, chunk->start,
+                                              chunk->length);
+    return 0;
+}
+
+/*
+ * Sync the dirty bitmaps of all RAMBlocks using rs->sync_threads.
+ *
+ * Chunks are aligned to both the clear bitmap granularity and to whole
+ * words of the dirty bitmaps, so that workers never share a bitmap word
+ * and cpu_physical_memory_sync_dirty_bitmap() can use its fast path.
+ *
+ * Called with RCU critical section and bitmap_mutex held.
+ */
+static void ramblock_sync_dirty_bitmap_parallel(RAMState *rs)
+{
+    g_autofree RAMBlockSyncChunk *chunks = NULL;
+    RAMBlock *block;
+    size_t nr_chunks = 0, i = 0;
+    uint64_t new_dirty_pages = 0;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t chunk_size = MAX(RAMBLOCK_SYNC_CHUNK_SIZE,
+                                    (ram_addr_t)TARGET_PAGE_SIZE <<
+                                    block->clear_bmap_shift);
+        nr_chunks += DIV_ROUND_UP(block->used_length, chunk_size);
+    }
+
+    chunks = g_new(RAMBlockSyncChunk, nr_chunks);
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t chunk_size = MAX(RAMBLOCK_SYNC_CHUNK_SIZE,
+                                    (ram_addr_t)TARGET_PAGE_SIZE <<
+                                    block->clear_bmap_shift);
+        ram_addr_t start;
+
+        for (start = 0; start < block->used_length; start += chunk_size) {
+            RAMBlockSyncChunk *chunk = &chunks[i++];
+
+            chunk->rb = block;
+            chunk->start = start;
+            chunk->length = MIN(chunk_size, block->used_length - start);
+            thread_pool_submit(rs->sync_threads,
+                               ramblock_sync_dirty_bitmap_chunk, chunk, NULL);
+        }
+    }
+    assert(i == nr_chunks);
+
+    thread_pool_wait(rs->sync_threads);
+
+    for (i = 0; i < nr_chunks; i++) {
+        new_dirty_pages += chunks[i].new_dirty_pages;
+    }
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1035,7 +1224,67 @@ static void migration_dirty_limit_guest(void)
     trace_migration_dirty_limit_guest(quota_dirtyrate);
 }
 
-static void migration_trigger_throttle(RAMState *rs)
+static int dirty_rate_cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Adaptive variant of migration_dirty_limit_guest(): the budget of
+ * dirtying that still lets precopy converge is the share
+ * throttle-trigger-threshold of what was transferred in the last period
+ * of @period_ms.  Split it over the vCPUs by water-filling: vCPUs that
+ * dirty less than an equal share keep their rate, and whatever they leave
+ * unused is split among the rest.  The resulting cap is then applied as
+ * the quota of all vCPUs, so that only those above it are throttled.
+ */
+static void migration_dirty_limit_guest_adaptive(uint64_t bytes_xfer_period,
+                                                 int64_t period_ms)
+{
+    MigrationState *s = migrate_get_current();
+    int64_t budget = bytes_xfer_period * migrate_throttle_trigger_threshold() /
+                     100 * 1000 / period_ms / MiB;
+    g_autofree int64_t *rates = NULL;
+    int64_t quota;
+    CPUState *cpu;
+    int n = 0, i;
+
+    /* Per-vCPU rates are only measured once dirty limit is in service */
+    if (!dirtylimit_in_service()) {
+        quota = MAX(budget, s->parameters.vcpu_dirty_limit);
+        qmp_set_vcpu_dirty_limit(false, -1, quota, NULL);
+        trace_migration_dirty_limit_guest(quota);
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        n++;
+    }
+    rates = g_new(int64_t, n);
+    i = 0;
+    CPU_FOREACH(cpu) {
+        rates[i++] = vcpu_dirty_rate_get(cpu->cpu_index);
+    }
+    qsort(rates, n, sizeof(*rates), dirty_rate_cmp);
+
+    /* If all of them fit the budget, the fastest one sets the quota */
+    quota = rates[n - 1];
+    for (i = 0; i < n; i++) {
+        if (rates[i] * (n - i) >= budget) {
+            quota = budget / (n - i);
+            break;
+        }
+        budget -= rates[i];
+    }
+
+    quota = MAX(quota, s->parameters.vcpu_dirty_limit);
+    qmp_set_vcpu_dirty_limit(false, -1, quota, NULL);
+    trace_migration_dirty_limit_guest(quota);
+}
+
+static void migration_trigger_throttle(RAMState *rs, int64_t period_ms)
 {
     uint64_t threshold = migrate_throttle_trigger_threshold();
     uint64_t bytes_xfer_period =
@@ -1058,18 +1307,29 @@ static void migration_trigger_throttle(RAMState *rs)
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
         } else if (migrate_dirty_limit()) {
-            migration_dirty_limit_guest();
+            if (migrate_dirty_limit_adaptive()) {
+                migration_dirty_limit_guest_adaptive(bytes_xfer_period,
+                                                     period_ms);
+            } else {
+                migration_dirty_limit_guest();
+            }
         }
     }
 }
 
 static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
+    MigrationState *ms = migrate_get_current();
     RAMBlock *block;
     int64_t end_time;
 
     stat64_add(&mig_stats.dirty_sync_count, 1);
 
+    if (ms->dirty_sync_threads > 1 && !rs->sync_threads) {
+        rs->sync_threads = thread_pool_new();
+        thread_pool_set_max_threads(rs->sync_threads, ms->dirty_sync_threads);
+    }
+
     if (!rs->time_last_bitmap_sync) {
         rs->time_last_bitmap_sync = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
     }
@@ -1079,8 +1339,12 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
-            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-                ramblock_sync_dirty_bitmap(rs, block);
+            if (rs->sync_threads) {
+                ramblock_sync_dirty_bitmap_parallel(rs);
+            } else {
+                RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                    ramblock_sync_dirty_bitmap(rs, block);
+                }
             }
             stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
         }
@@ -1093,7 +1357,7 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
-        migration_trigger_throttle(rs);
+        migration_trigger_throttle(rs, end_time - rs->time_last_bitmap_sync);
 
         migration_update_rates(rs, end_time);
 
@@ -1149,10 +1413,23 @@ void ram_release_page(const char *rbname, uint64_t offset)
  * @pss: current PSS channel
  * @offset: offset inside the block for the page
  */
+/*
+ * pss_page_host: where the contents of the page at @offset of the
+ * current block are read from
+ */
+static uint8_t *pss_page_host(PageSearchStatus *pss, ram_addr_t offset)
+{
+    if (pss->copyout) {
+        return pss->copyout + offset -
+               ((ram_addr_t)pss->host_page_start << TARGET_PAGE_BITS);
+    }
+    return pss->block->host + offset;
+}
+
 static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
                           ram_addr_t offset)
 {
-    uint8_t *p = pss->block->host + offset;
+    uint8_t *p = pss_page_host(pss, offset);
     QEMUFile *file = pss->pss_channel;
     int len = 0;
 
@@ -1188,6 +1465,11 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
         XBZRLE_cache_unlock();
     }
 
+    /* Likewise, the page can't be a dedup reference anymore */
+    if (rs->dedup) {
+        page_dedup_page_sent(NULL, pss->block, offset, 0);
+    }
+
     return len;
 }
 
@@ -1208,8 +1490,13 @@ static int save_normal_page(PageSearchStatus *pss, RAMBlock *block,
     QEMUFile *file = pss->pss_channel;
 
     if (migrate_mapped_ram()) {
-        qemu_put_buffer_at(file, buf, TARGET_PAGE_SIZE,
-                           block->pages_offset + offset);
+        if (pss->wp_job) {
+            set_bit((offset >> TARGET_PAGE_BITS) - pss->host_page_start,
+                    pss->wp_job->pages);
+        } else {
+            qemu_put_buffer_at(file, buf, TARGET_PAGE_SIZE,
+                               block->pages_offset + offset);
+        }
         set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
     } else {
         ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
@@ -1248,9 +1535,14 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
     ram_addr_t current_addr = block->offset + offset;
 
-    p = block->host + offset;
+    p = pss_page_host(pss, offset);
     trace_ram_save_page(block->idstr, (uint64_t)offset, p);
 
+    /* The copy-out buffer is reused for the next chunk */
+    if (pss->copyout) {
+        send_async = false;
+    }
+
     XBZRLE_cache_lock();
     if (rs->xbzrle_started && !migration_in_postcopy()) {
         pages = save_xbzrle_page(rs, pss, &p, current_addr,
@@ -1263,7 +1555,13 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
         }
     }
 
-    /* XBZRLE overflow or normal page */
+    if (rs->dedup && !migration_in_postcopy()) {
+        pages = save_dedup_page(rs, pss, &p, block, offset);
+        /* The page is sent from rs->dedup_buf, which is reused */
+        send_async = false;
+    }
+
+    /* XBZRLE overflow, no duplicate or normal page */
     if (pages == -1) {
         pages = save_normal_page(pss, block, offset, p, send_async);
     }
@@ -1401,24 +1699,50 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
  */
 static RAMBlock *poll_fault_page(RAMState *rs, ram_addr_t *offset)
 {
-    struct uffd_msg uffd_msg;
+    struct uffd_msg uffd_msg[WP_FAULT_BATCH];
     void *page_address;
     RAMBlock *block;
-    int res;
+    size_t page_size;
+    int res, i;
 
     if (!migrate_background_snapshot()) {
         return NULL;
     }
 
-    res = uffd_read_events(rs->uffdio_fd, &uffd_msg, 1);
-    if (res <= 0) {
-        return NULL;
-    }
+    while (true) {
+        if (rs->wp_faults_next == rs->wp_faults_num) {
+            res = uffd_read_events(rs->uffdio_fd, uffd_msg, WP_FAULT_BATCH);
+            if (res <= 0) {
+                return NULL;
+            }
+            for (i = 0; i < res; i++) {
+                rs->wp_faults[i] = uffd_msg[i].arg.pagefault.address;
+            }
+            rs->wp_faults_num = res;
+            rs->wp_faults_next = 0;
+        }
 
-    page_address = (void *)(uintptr_t) uffd_msg.arg.pagefault.address;
-    block = qemu_ram_block_from_host(page_address, false, offset);
-    assert(block && (block->flags & RAM_UF_WRITEPROTECT) != 0);
-    return block;
+        page_address = (void *)(uintptr_t)rs->wp_faults[rs->wp_faults_next++];
+        block = qemu_ram_block_from_host(page_address, false, offset);
+        assert(block && (block->flags & RAM_UF_WRITEPROTECT) != 0);
+
+        if (test_bit(*offset >> TARGET_PAGE_BITS, block->bmap)) {
+            return block;
+        }
+
+        /*
+         * The page is clean: either it was saved already, which happens
+         * often because faults of a batch tend to hit the same chunk, or
+         * its bit was cleared without saving it (free page hints,
+         * discarded ranges).  In the latter case it is still protected,
+         * so release it here or the vCPU stays blocked until write
+         * tracking stops.  Releasing a saved page again is harmless.
+         */
+        page_size = qemu_ram_pagesize(block);
+        uffd_change_protection(rs->uffdio_fd,
+                               block->host + ROUND_DOWN(*offset, page_size),
+                               page_size, false, false);
+    }
 }
 
 /**
@@ -1451,6 +1775,63 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
     return res;
 }
 
+/**
+ * ram_save_wp_copyout: copy out the write-protected chunk that is about to
+ *   be saved and release its protection
+ *
+ * The chunk is then saved from the copy, so that the guest only waits for
+ * the copy and not for the snapshot to be written.  Host pages larger than
+ * a chunk are still saved from guest RAM and released afterwards.
+ *
+ * Returns 1 if the protection was released, 0 if not, negative value in
+ * case of an error
+ *
+ * @rs: current RAM state
+ * @pss: page-search-status structure, prepared for sending the chunk
+ */
+static int ram_save_wp_copyout(RAMState *rs, PageSearchStatus *pss)
+{
+    MigrationState *s = migrate_get_current();
+    RAMBlock *block = pss->block;
+    unsigned long end = MIN(pss->host_page_end,
+                            block->used_length >> TARGET_PAGE_BITS);
+    size_t len = (end - pss->host_page_start) << TARGET_PAGE_BITS;
+    void *host = block->host + (pss->host_page_start << TARGET_PAGE_BITS);
+    int res;
+
+    if (qemu_ram_pagesize(block) > WP_CHUNK_SIZE) {
+        return 0;
+    }
+
+    if (migrate_mapped_ram() && s->background_snapshot_writers > 1) {
+        RAMWriteJob *job = g_new0(RAMWriteJob, 1);
+
+        if (!rs->wp_writers) {
+            rs->wp_writers = thread_pool_new();
+            thread_pool_set_max_threads(rs->wp_writers,
+                                        s->background_snapshot_writers);
+        }
+        job->rs = rs;
+        job->ioc = qemu_file_get_ioc(pss->pss_channel);
+        job->pos = block->pages_offset +
+                   ((ram_addr_t)pss->host_page_start << TARGET_PAGE_BITS);
+        job->npages = end - pss->host_page_start;
+        job->buf = g_malloc(len);
+        job->pages = bitmap_new(job->npages);
+        pss->wp_job = job;
+        pss->copyout = job->buf;
+    } else {
+        if (!rs->wp_copyout) {
+            rs->wp_copyout = g_malloc(WP_CHUNK_SIZE);
+        }
+        pss->copyout = rs->wp_copyout;
+    }
+
+    memcpy(pss->copyout, host, len);
+    res = uffd_change_protection(rs->uffdio_fd, host, len, false, false);
+    return res < 0 ? res : 1;
+}
+
 /* ram_write_tracking_available: check if kernel supports required UFFD features
  *
  * Returns true if supports, false otherwise
@@ -1748,6 +2129,14 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
     return 0;
 }
 
+static int ram_save_wp_copyout(RAMState *rs, PageSearchStatus *pss)
+{
+    (void) rs;
+    (void) pss;
+
+    return 0;
+}
+
 bool ram_write_tracking_available(void)
 {
     return false;
@@ -1974,6 +2363,21 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
     return 0;
 }
 
+/*
+ * Whether a page can be sent through the multifd channels during postcopy.
+ * Faulted pages are sent by the return path thread through the preempt
+ * channel, so any page that shows up here on the precopy channel is a
+ * background page.  Huge pages must be placed atomically as a whole, which
+ * multifd packets cannot guarantee, so they stay on the main channel.
+ */
+static bool postcopy_multifd_page(RAMState *rs, PageSearchStatus *pss)
+{
+    return migrate_postcopy_multifd() &&
+           migrate_multifd_compression() == MULTIFD_COMPRESSION_NONE &&
+           pss == &rs->pss[RAM_CHANNEL_PRECOPY] &&
+           qemu_ram_pagesize(pss->block) == TARGET_PAGE_SIZE;
+}
+
 /**
  * ram_save_target_page: save one target page to the precopy thread
  * OR to multifd workers.
@@ -2004,7 +2408,8 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
         }
     }
 
-    if (migrate_multifd() && !migration_in_postcopy()) {
+    if (migrate_multifd() &&
+        (!migration_in_postcopy() || postcopy_multifd_page(rs, pss))) {
         return ram_save_multifd_page(pss->block, offset);
     }
 
@@ -2017,6 +2422,11 @@ static void pss_host_page_prepare(PageSearchStatus *pss)
     /* How many guest pages are there in one host page? */
     size_t guest_pfns = qemu_ram_pagesize(pss->block) >> TARGET_PAGE_BITS;
 
+    /* Write-protected RAM is sent a whole chunk at a time */
+    if (pss->block->flags & RAM_UF_WRITEPROTECT) {
+        guest_pfns = MAX(guest_pfns, WP_CHUNK_SIZE >> TARGET_PAGE_BITS);
+    }
+
     pss->host_page_sending = true;
     if (guest_pfns <= 1) {
         /*
@@ -2064,6 +2474,7 @@ static void pss_host_page_finish(PageSearchStatus *pss)
     pss->host_page_sending = false;
     /* This is not needed, but just to reset it */
     pss->host_page_start = pss->host_page_end = 0;
+    pss->copyout = NULL;
 }
 
 static void ram_page_hint_update(RAMState *rs, PageSearchStatus *pss)
@@ -2131,6 +2542,103 @@ out:
     return ret;
 }
 
+static int ram_wp_write(void *opaque)
+{
+    RAMWriteJob *job = opaque;
+    unsigned long start = find_first_bit(job->pages, job->npages), end;
+    Error *err = NULL;
+    ssize_t ret;
+    size_t len;
+
+    while (start < job->npages) {
+        end = find_next_zero_bit(job->pages, job->npages, start);
+        len = (end - start) << TARGET_PAGE_BITS;
+        ret = qio_channel_pwrite(job->ioc,
+                                 (char *)job->buf +
+                                 (start << TARGET_PAGE_BITS), len,
+                                 job->pos + (start << TARGET_PAGE_BITS),
+                                 &err);
+        if (ret >= 0 && ret != len) {
+            error_setg(&err, "Partial write of size %zd, expected %zu",
+                       ret, len);
+        }
+        if (err) {
+            WITH_QEMU_LOCK_GUARD(&job->rs->wp_writer_lock) {
+                error_propagate(&job->rs->wp_writer_err, err);
+            }
+            return -1;
+        }
+        stat64_add(&mig_stats.qemu_file_transferred, len);
+        start = find_next_bit(job->pages, job->npages, end);
+    }
+
+    return 0;
+}
+
+static void ram_wp_write_job_free(void *opaque)
+{
+    RAMWriteJob *job = opaque;
+
+    g_free(job->buf);
+    g_free(job->pages);
+    g_free(job);
+}
+
+/**
+ * ram_wp_writers_wait: wait for all chunks handed to the background
+ *   snapshot writers to be written
+ *
+ * Returns 0 on success, negative value in case of a write error, which is
+ * also set on @f
+ *
+ * @rs: current RAM state
+ * @f: the migration stream
+ */
+static int ram_wp_writers_wait(RAMState *rs, QEMUFile *f)
+{
+    Error *err;
+
+    if (!rs->wp_writers) {
+        return 0;
+    }
+
+    thread_pool_wait(rs->wp_writers);
+    rs->wp_writes_inflight = 0;
+
+    WITH_QEMU_LOCK_GUARD(&rs->wp_writer_lock) {
+        err = g_steal_pointer(&rs->wp_writer_err);
+    }
+    if (err) {
+        qemu_file_set_error_obj(f, -EIO, err);
+        return -EIO;
+    }
+    return 0;
+}
+
+/**
+ * ram_wp_write_submit: hand the chunk saved through @pss to the background
+ *   snapshot writers
+ *
+ * Only so many chunks are copied out at a time; when there are that many,
+ * wait for all of them to be written.
+ *
+ * Returns 0 on success, negative value in case of an error
+ *
+ * @rs: current RAM state
+ * @pss: page-search-status structure
+ */
+static int ram_wp_write_submit(RAMState *rs, PageSearchStatus *pss)
+{
+    MigrationState *s = migrate_get_current();
+
+    thread_pool_submit(rs->wp_writers, ram_wp_write,
+                       g_steal_pointer(&pss->wp_job), ram_wp_write_job_free);
+    if (++rs->wp_writes_inflight < 2 * s->background_snapshot_writers) {
+        return 0;
+    }
+    return ram_wp_writers_wait(rs, pss->pss_channel);
+}
+
 /**
  * ram_save_host_page: save a whole host page
  *
@@ -2159,7 +2667,7 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
     size_t pagesize_bits =
         qemu_ram_pagesize(pss->block) >> TARGET_PAGE_BITS;
     unsigned long start_page = pss->page;
-    int res;
+    int res, released = 0;
 
     if (migrate_ram_is_ignored(pss->block)) {
         error_report("block %s should not be migrated !", pss->block->idstr);
@@ -2169,6 +2677,19 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
     /* Update host page boundary information */
     pss_host_page_prepare(pss);
 
+    /*
+     * A write-protected chunk is saved as a whole before its protection is
+     * released, whatever page of it this started from.
+     */
+    if (pss->block->flags & RAM_UF_WRITEPROTECT) {
+        pss->page = start_page = pss->host_page_start;
+        released = ram_save_wp_copyout(rs, pss);
+        if (released < 0) {
+            pss_host_page_finish(pss);
+            return released;
+        }
+    }
+
     do {
         page_dirty = migration_bitmap_clear_dirty(rs, pss->block, pss->page);
 
@@ -2201,6 +2722,9 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
         }
 
         if (tmppages < 0) {
+            if (pss->wp_job) {
+                ram_wp_write_job_free(g_steal_pointer(&pss->wp_job));
+            }
             pss_host_page_finish(pss);
             return tmppages;
         }
@@ -2208,8 +2732,19 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
         pss_find_next_dirty(pss);
     } while (pss_within_range(pss));
 
+    if (pss->wp_job) {
+        res = ram_wp_write_submit(rs, pss);
+        if (res < 0) {
+            pss_host_page_finish(pss);
+            return res;
+        }
+    }
+
     pss_host_page_finish(pss);
 
+    if (released) {
+        return pages;
+    }
     res = ram_save_release_protection(rs, pss, start_page);
     return (res < 0 ? res : pages);
 }
@@ -2353,6 +2888,17 @@ static void xbzrle_load_cleanup(void)
 static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
+        if ((*rsp)->sync_threads) {
+            thread_pool_free((*rsp)->sync_threads);
+        }
+        if ((*rsp)->wp_writers) {
+            thread_pool_free((*rsp)->wp_writers);
+        }
+        error_free((*rsp)->wp_writer_err);
+        qemu_mutex_destroy(&(*rsp)->wp_writer_lock);
+        g_free((*rsp)->wp_copyout);
+        page_dedup_cache_free((*rsp)->dedup);
+        g_free((*rsp)->dedup_buf);
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
@@ -2388,6 +2934,8 @@ static void ram_bitmaps_destroy(void)
         block->bmap = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
+        g_free(block->dedup_hash);
+        block->dedup_hash = NULL;
     }
 }
 
@@ -2734,6 +3282,7 @@ static bool ram_state_init(RAMState **rsp, Error **errp)
 
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
+    qemu_mutex_init(&(*rsp)->wp_writer_lock);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
     (*rsp)->ram_bytes_total = ram_bytes_total();
 
@@ -2784,6 +3333,9 @@ static void ram_list_init_bitmaps(void)
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
+            if (migrate_page_dedup()) {
+                block->dedup_hash = g_new0(uint64_t, pages);
+            }
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
         }
@@ -2847,6 +3399,16 @@ static int ram_init_all(RAMState **rsp, Error **errp)
         return -1;
     }
 
+    if (migrate_page_dedup()) {
+        (*rsp)->dedup = page_dedup_cache_new(migrate_xbzrle_cache_size(),
+                                             errp);
+        if (!(*rsp)->dedup) {
+            ram_state_cleanup(rsp);
+            return -1;
+        }
+        (*rsp)->dedup_buf = g_malloc(TARGET_PAGE_SIZE);
+    }
+
     if (!ram_init_bitmaps(*rsp, errp)) {
         return -1;
     }
@@ -3333,6 +3895,18 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         }
     }
 
+    if (migration_in_postcopy() && migrate_postcopy_multifd()) {
+        /*
+         * The destination leaves postcopy once it sees the end of the
+         * RAM section, so all pages still in flight on the multifd
+         * channels must be placed before that.
+         */
+        ret = multifd_ram_flush_and_sync(f);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
     if (multifd_ram_sync_per_section()) {
         /*
          * Only the old dest QEMU will need this sync, because each EOS
@@ -3345,6 +3919,12 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
     }
 
     if (migrate_mapped_ram()) {
+        ret = ram_wp_writers_wait(rs, f);
+        if (ret < 0) {
+            error_report("Failed to write RAM to file");
+            return ret;
+        }
+
         ram_save_file_bmap(f);
 
         if (qemu_file_get_error(f)) {
@@ -3496,6 +4076,41 @@ static inline void *host_from_ram_block_offset(RAMBlock *block,
     return block->host + offset;
 }
 
+/*
+ * Copy a page the destination already has to @host.  The page is
+ * identified by its RAMBlock id and offset, as sent by save_dedup_page().
+ */
+static int load_dedup_page(QEMUFile *f, void *host)
+{
+    RAMBlock *ref_block;
+    ram_addr_t ref_offset;
+    void *ref_host;
+    char id[256];
+    int len;
+
+    len = qemu_get_byte(f);
+    qemu_get_buffer(f, (uint8_t *)id, len);
+    id[len] = 0;
+    ref_offset = qemu_get_be64(f);
+
+    ref_block = qemu_ram_block_by_name(id);
+    if (!ref_block) {
+        error_report("Unknown ramblock \"%s\" in dedup page", id);
+        return -1;
+    }
+
+    ref_host = host_from_ram_block_offset(ref_block, ref_offset);
+    if (!ref_host || (ref_offset & ~TARGET_PAGE_MASK) ||
+        !ramblock_recv_bitmap_test_byte_offset(ref_block, ref_offset)) {
+        error_report("Invalid dedup reference %s:" RAM_ADDR_FMT,
+                     id, ref_offset);
+        return -1;
+    }
+
+    memcpy(host, ref_host, TARGET_PAGE_SIZE);
+    return 0;
+}
+
 static void *host_page_from_ram_block_offset(RAMBlock *block,
                                              ram_addr_t offset)
 {
@@ -3857,6 +4472,14 @@ int ram_load_postcopy(QEMUFile *f, int channel)
                                          TARGET_PAGE_SIZE);
             }
             break;
+        case RAM_SAVE_FLAG_MULTIFD_FLUSH:
+            if (!migrate_postcopy_multifd() || channel != RAM_CHANNEL_PRECOPY) {
+                error_report("Unexpected multifd flush (postcopy mode)");
+                ret = -EINVAL;
+                break;
+            }
+            multifd_recv_sync_main();
+            break;
         case RAM_SAVE_FLAG_EOS:
             break;
         default:
@@ -4051,7 +4674,18 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
         return;
     }
 
-    if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+    if (migrate_mapped_ram_lazy_load()) {
+        if (length != block->used_length) {
+            error_setg(errp, "Length mismatch: %s: 0x" RAM_ADDR_FMT
+                       " in != 0x" RAM_ADDR_FMT, block->idstr, length,
+                       block->used_length);
+            return;
+        }
+        if (!mapped_ram_lazy_add_block(block, g_steal_pointer(&bitmap),
+                                       errp)) {
+            return;
+        }
+    } else if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
         return;
     }
 
@@ -4173,7 +4807,7 @@ static int ram_load_precopy(QEMUFile *f)
     if (migrate_mapped_ram()) {
         invalid_flags |= (RAM_SAVE_FLAG_HOOK | RAM_SAVE_FLAG_MULTIFD_FLUSH |
                           RAM_SAVE_FLAG_PAGE | RAM_SAVE_FLAG_XBZRLE |
-                          RAM_SAVE_FLAG_ZERO);
+                          RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_DEDUP);
     }
 
     while (!ret && !(flags & RAM_SAVE_FLAG_EOS)) {
@@ -4210,7 +4844,7 @@ static int ram_load_precopy(QEMUFile *f)
         }
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
-                     RAM_SAVE_FLAG_XBZRLE)) {
+                     RAM_SAVE_FLAG_XBZRLE | RAM_SAVE_FLAG_DEDUP)) {
             RAMBlock *block = ram_block_from_stream(mis, f, flags,
                                                     RAM_CHANNEL_PRECOPY);
 
@@ -4262,6 +4896,9 @@ static int ram_load_precopy(QEMUFile *f)
              */
             if (migrate_mapped_ram()) {
                 multifd_recv_sync_main();
+                if (!ret && migrate_mapped_ram_lazy_load()) {
+                    mapped_ram_lazy_start();
+                }
             }
             break;
 
@@ -4287,6 +4924,11 @@ static int ram_load_precopy(QEMUFile *f)
                 break;
             }
             break;
+        case RAM_SAVE_FLAG_DEDUP:
+            if (load_dedup_page(f, host) < 0) {
+                ret = -EINVAL;
+            }
+            break;
         case RAM_SAVE_FLAG_MULTIFD_FLUSH:
             multifd_recv_sync_main();
             break;
@@ -4320,6 +4962,10 @@ static int ram_load_precopy(QEMUFile *f)
         }
     }
 
+    if (ret < 0 && migrate_mapped_ram_lazy_load()) {
+        mapped_ram_lazy_abort();
+    }
+
     return ret;
 }
 
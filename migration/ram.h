@@ -41,7 +41,9 @@
  *
  * RAM_SAVE_FLAG_FULL (0x01) was obsoleted in 2009.
  *
- * RAM_SAVE_FLAG_COMPRESS_PAGE (0x100) was removed in QEMU 9.1.
+ * RAM_SAVE_FLAG_COMPRESS_PAGE (0x100) was removed in QEMU 9.1.  The
+ * value is reused by RAM_SAVE_FLAG_DEDUP, which older destinations
+ * reject as unknown.
  *
  * RAM_SAVE_FLAG_HOOK is only used in RDMA. Whenever this is found in the
  * data stream, the flags will be passed to rdma functions in the
@@ -59,6 +61,7 @@
 #define RAM_SAVE_FLAG_CONTINUE                0x020
 #define RAM_SAVE_FLAG_XBZRLE                  0x040
 #define RAM_SAVE_FLAG_HOOK                    0x080
+#define RAM_SAVE_FLAG_DEDUP                   0x100
 #define RAM_SAVE_FLAG_MULTIFD_FLUSH           0x200
 
 extern XBZRLECacheStats xbzrle_counters;
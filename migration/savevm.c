@@ -1644,6 +1644,84 @@ ret_fail_abort_threads:
     return -1;
 }
 
+/*
+ * Device state saved on a worker thread into a private buffer, which the
+ * migration thread then copies into the stream in handler order.
+ */
+typedef struct SaveStateParallelJob {
+    SaveStateEntry *se;
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    JSONWriter *vmdesc;
+    QemuEvent done;
+    int64_t duration_us;
+    Error *err;
+    int ret;
+} SaveStateParallelJob;
+
+static int vmstate_save_parallel_job(void *opaque)
+{
+    SaveStateParallelJob *job = opaque;
+    int64_t start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+    job->ret = vmstate_save(job->f, job->se, job->vmdesc, &job->err);
+    if (!job->ret) {
+        job->ret = qemu_fflush(job->f);
+        if (job->ret) {
+            error_setg_errno(&job->err, -job->ret,
+                             "Failed to buffer state of %s", job->se->idstr);
+        }
+    }
+    job->duration_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_ts;
+    qemu_event_set(&job->done);
+    return job->ret;
+}
+
+static void vmstate_save_parallel_job_free(SaveStateParallelJob *job)
+{
+    qemu_fclose(job->f);
+    json_writer_free(job->vmdesc);
+    qemu_event_destroy(&job->done);
+    error_free(job->err);
+    g_free(job);
+}
+
+/*
+ * Start saving every device that opted in with parallel_save on @pool.
+ * Returns a table, indexed like savevm_state.handlers, with the job of
+ * each such device and NULL for everything else.
+ */
+static SaveStateParallelJob **
+qemu_savevm_start_parallel_save(ThreadPool *pool, int nr_handlers,
+                                bool with_vmdesc)
+{
+    SaveStateParallelJob **jobs = g_new0(SaveStateParallelJob *, nr_handlers);
+    SaveStateEntry *se;
+    int i = 0;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (se->vmsd && se->vmsd->parallel_save && !se->vmsd->early_setup) {
+            SaveStateParallelJob *job = g_new0(SaveStateParallelJob, 1);
+
+            job->se = se;
+            job->bioc = qio_channel_buffer_new(4096);
+            qio_channel_set_name(QIO_CHANNEL(job->bioc),
+                                 "migration-parallel-save-buffer");
+            job->f = qemu_file_new_output(QIO_CHANNEL(job->bioc));
+            object_unref(OBJECT(job->bioc));
+            if (with_vmdesc) {
+                job->vmdesc = json_writer_new(false);
+            }
+            qemu_event_init(&job->done, false);
+            jobs[i] = job;
+            thread_pool_submit(pool, vmstate_save_parallel_job, job, NULL);
+        }
+        i++;
+    }
+
+    return jobs;
+}
+
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy)
 {
@@ -1653,25 +1731,56 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     int vmdesc_len;
     SaveStateEntry *se;
     Error *local_err = NULL;
-    int ret;
+    ThreadPool *pool = NULL;
+    SaveStateParallelJob **jobs = NULL;
+    int nr_handlers = 0;
+    int i = 0;
+    int ret = 0;
 
     /* Making sure cpu states are synchronized before saving non-iterable */
     cpu_synchronize_all_states();
 
+    if (ms->parallel_save_threads > 1) {
+        QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+            nr_handlers++;
+        }
+        pool = thread_pool_new();
+        thread_pool_set_max_threads(pool, ms->parallel_save_threads);
+        jobs = qemu_savevm_start_parallel_save(pool, nr_handlers,
+                                               vmdesc != NULL);
+    }
+
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        SaveStateParallelJob *job = jobs ? jobs[i] : NULL;
+
+        i++;
         if (se->vmsd && se->vmsd->early_setup) {
             /* Already saved during qemu_savevm_state_setup(). */
             continue;
         }
 
+        if (job) {
+            qemu_event_wait(&job->done);
+            if (job->ret) {
+                ret = job->ret;
+                error_propagate(&local_err, job->err);
+                job->err = NULL;
+                break;
+            }
+            qemu_put_buffer(f, job->bioc->data, job->bioc->usage);
+            if (vmdesc && *json_writer_get(job->vmdesc)) {
+                json_writer_raw(vmdesc, NULL, json_writer_get(job->vmdesc));
+            }
+            trace_vmstate_downtime_save("non-iterable", se->idstr,
+                                        se->instance_id, job->duration_us);
+            continue;
+        }
+
         start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
         ret = vmstate_save(f, se, vmdesc, &local_err);
         if (ret) {
-            migrate_set_error(ms, local_err);
-            error_report_err(local_err);
-            qemu_file_set_error(f, ret);
-            return ret;
+            break;
         }
 
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
@@ -1679,6 +1788,24 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                     end_ts_each - start_ts_each);
     }
 
+    if (pool) {
+        /* Workers may still be running if we bailed out early */
+        thread_pool_free(pool);
+        for (i = 0; i < nr_handlers; i++) {
+            if (jobs[i]) {
+                vmstate_save_parallel_job_free(jobs[i]);
+            }
+        }
+        g_free(jobs);
+    }
+
+    if (ret) {
+        migrate_set_error(ms, local_err);
+        error_report_err(local_err);
+        qemu_file_set_error(f, ret);
+        return ret;
+    }
+
     if (!in_postcopy) {
         /* Postcopy stream will still be going */
         qemu_put_byte(f, QEMU_VM_EOF);
@@ -1994,6 +2121,20 @@ static int loadvm_postcopy_handle_advise(MigrationIncomingState *mis,
  * started.
  * There can be 0..many of these messages, each encoding multiple pages.
  */
+/*
+ * With postcopy-multifd the source syncs the multifd channels right before
+ * sending the first discard.  Wait for that sync, so that precopy pages that
+ * were still in flight are written before any discard is applied.
+ */
+static int loadvm_postcopy_prepare_discard(MigrationIncomingState *mis)
+{
+    if (migrate_postcopy_multifd()) {
+        multifd_recv_sync_main();
+    }
+
+    return postcopy_ram_prepare_discard(mis);
+}
+
 static int loadvm_postcopy_ram_handle_discard(MigrationIncomingState *mis,
                                               uint16_t len)
 {
@@ -2006,7 +2147,7 @@ static int loadvm_postcopy_ram_handle_discard(MigrationIncomingState *mis,
     switch (ps) {
     case POSTCOPY_INCOMING_ADVISE:
         /* 1st discard */
-        tmp = postcopy_ram_prepare_discard(mis);
+        tmp = loadvm_postcopy_prepare_discard(mis);
         if (tmp) {
             return tmp;
         }
@@ -2189,7 +2330,7 @@ static int loadvm_postcopy_handle_listen(MigrationIncomingState *mis)
          * so do the setup that's normally done at the time of the 1st discard.
          */
         if (migrate_postcopy_ram()) {
-            postcopy_ram_prepare_discard(mis);
+            loadvm_postcopy_prepare_discard(mis);
         }
     }
 
@@ -2209,6 +2350,10 @@ static int loadvm_postcopy_handle_listen(MigrationIncomingState *mis)
 
     trace_loadvm_postcopy_handle_listen("after uffd");
 
+    if (migrate_postcopy_multifd()) {
+        multifd_recv_postcopy_listen();
+    }
+
     if (postcopy_notify(POSTCOPY_NOTIFY_INBOUND_LISTEN, &local_err)) {
         error_report_err(local_err);
         return -1;
@@ -83,8 +83,32 @@ struct NBDRequestData {
     NBDClient *client;
     uint8_t *data;
     bool complete;
+    /* @data was sent with zero copy; keep it until this send completes */
+    ssize_t zero_copy_seq;
 };
 
+/* A read buffer that the kernel may still be sending from */
+typedef struct NBDZeroCopyBuf {
+    void *data;
+    ssize_t seq; /* value of zero_copy_queued after the last send */
+    QSIMPLEQ_ENTRY(NBDZeroCopyBuf) next;
+} NBDZeroCopyBuf;
+
+typedef QSIMPLEQ_HEAD(, NBDZeroCopyBuf) NBDZeroCopyBufList;
+
+/*
+ * Read buffers of a client that went away while the kernel was still
+ * sending from them.  The socket is kept open until the last of their
+ * completions has been reaped.
+ */
+typedef struct NBDZeroCopyDrain {
+    QIOChannelSocket *sioc;
+    NBDZeroCopyBufList bufs;
+    QEMUTimer *timer;
+} NBDZeroCopyDrain;
+
+#define NBD_ZERO_COPY_DRAIN_INTERVAL_MS 100
+
 struct NBDExport {
     BlockExport common;
 
@@ -99,6 +123,7 @@ struct NBDExport {
     Notifier eject_notifier;
 
     bool allocation_depth;
+    bool zero_copy;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
 };
@@ -149,6 +174,11 @@ struct NBDClient {
 
     uint32_t check_align; /* If non-zero, check for aligned client requests */
 
+    bool zero_copy_failed; /* kernel always copied, stop trying zero copy */
+    /* Buffers waiting for zero copy completion, protected by lock */
+    NBDZeroCopyBufList zero_copy_bufs;
+    unsigned nr_zero_copy_bufs;
+
     NBDMode mode;
     NBDMetaContexts contexts; /* Negotiated meta contexts */
 
@@ -1554,6 +1584,114 @@ static int coroutine_fn nbd_receive_request(NBDClient *client, NBDRequest *reque
 
 #define MAX_NBD_REQUESTS 16
 
+/*
+ * Free the buffers in @bufs whose zero copy sends have completed on @sioc,
+ * as far as the notifications reaped so far tell.  Returns the number of
+ * buffers freed.
+ */
+static unsigned nbd_zero_copy_free_completed(QIOChannelSocket *sioc,
+                                             NBDZeroCopyBufList *bufs)
+{
+    NBDZeroCopyBuf *buf;
+    unsigned freed = 0;
+
+    while ((buf = QSIMPLEQ_FIRST(bufs)) && buf->seq <= sioc->zero_copy_sent) {
+        QSIMPLEQ_REMOVE_HEAD(bufs, next);
+        qemu_vfree(buf->data);
+        g_free(buf);
+        freed++;
+    }
+    return freed;
+}
+
+/*
+ * Free the read buffers whose zero copy sends have completed.  Runs in
+ * export AioContext with client->lock held.
+ */
+static void nbd_client_reap_zero_copy(NBDClient *client)
+{
+    QIOChannelSocket *sioc = client->sioc;
+    unsigned freed;
+
+    if (QSIMPLEQ_EMPTY(&client->zero_copy_bufs)) {
+        return;
+    }
+
+    /* Errors show up on the next send, so just stop freeing here */
+    if (qio_channel_socket_zero_copy_poll(sioc, NULL) < 0) {
+        return;
+    }
+
+    if (!client->zero_copy_failed && sioc->zero_copy_sent &&
+        sioc->zero_copy_copied == sioc->zero_copy_sent) {
+        /* e.g. loopback: every send was copied anyway */
+        trace_nbd_co_send_zero_copy_disabled(client);
+        client->zero_copy_failed = true;
+    }
+
+    freed = nbd_zero_copy_free_completed(sioc, &client->zero_copy_bufs);
+    qatomic_set(&client->nr_zero_copy_bufs,
+                client->nr_zero_copy_bufs - freed);
+}
+
+static void nbd_zero_copy_drain_timer_cb(void *opaque)
+{
+    NBDZeroCopyDrain *drain = opaque;
+
+    if (qio_channel_socket_zero_copy_poll(drain->sioc, NULL) == 0) {
+        nbd_zero_copy_free_completed(drain->sioc, &drain->bufs);
+    }
+
+    if (!QSIMPLEQ_EMPTY(&drain->bufs)) {
+        timer_mod(drain->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  NBD_ZERO_COPY_DRAIN_INTERVAL_MS);
+        return;
+    }
+
+    trace_nbd_zero_copy_drain_done(drain->sioc);
+    timer_free(drain->timer);
+    object_unref(OBJECT(drain->sioc));
+    g_free(drain);
+}
+
+/*
+ * Called when the last reference to @client goes away.  The kernel may
+ * still be sending from buffers whose completions have not been reaped, and
+ * freeing them could hand memory that is about to go out on the wire to
+ * other users.  Keep such buffers, and the socket that will report their
+ * completions, until the completions have arrived.  They do even if the
+ * peer is gone because TCP eventually drops the data it cannot deliver.
+ *
+ * Runs in the main loop thread.
+ */
+static void nbd_client_drain_zero_copy(NBDClient *client)
+{
+    NBDZeroCopyDrain *drain;
+
+    if (QSIMPLEQ_EMPTY(&client->zero_copy_bufs)) {
+        return;
+    }
+
+    if (qio_channel_socket_zero_copy_poll(client->sioc, NULL) == 0) {
+        nbd_zero_copy_free_completed(client->sioc, &client->zero_copy_bufs);
+        if (QSIMPLEQ_EMPTY(&client->zero_copy_bufs)) {
+            return;
+        }
+    }
+
+    drain = g_new0(NBDZeroCopyDrain, 1);
+    drain->sioc = client->sioc;
+    object_ref(OBJECT(drain->sioc));
+    QSIMPLEQ_INIT(&drain->bufs);
+    QSIMPLEQ_CONCAT(&drain->bufs, &client->zero_copy_bufs);
+    drain->timer = aio_timer_new(qemu_get_aio_context(), QEMU_CLOCK_REALTIME,
+                                 SCALE_MS, nbd_zero_copy_drain_timer_cb,
+                                 drain);
+    trace_nbd_zero_copy_drain_start(drain->sioc);
+    timer_mod(drain->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+              NBD_ZERO_COPY_DRAIN_INTERVAL_MS);
+}
+
 /* Runs in export AioContext and main loop thread */
 void nbd_client_get(NBDClient *client)
 {
@@ -1570,6 +1708,7 @@ void nbd_client_put(NBDClient *client)
          */
         assert(client->closing);
 
+        nbd_client_drain_zero_copy(client);
         object_unref(OBJECT(client->sioc));
         object_unref(OBJECT(client->ioc));
         if (client->tlscreds) {
@@ -1653,11 +1792,21 @@ static void nbd_request_put(NBDRequestData *req)
 {
     NBDClient *client = req->client;
 
-    if (req->data) {
+    if (req->data && req->zero_copy_seq) {
+        NBDZeroCopyBuf *buf = g_new(NBDZeroCopyBuf, 1);
+
+        buf->data = req->data;
+        buf->seq = req->zero_copy_seq;
+        QSIMPLEQ_INSERT_TAIL(&client->zero_copy_bufs, buf, next);
+        qatomic_set(&client->nr_zero_copy_bufs,
+                    client->nr_zero_copy_bufs + 1);
+    } else if (req->data) {
         qemu_vfree(req->data);
     }
     g_free(req);
 
+    nbd_client_reap_zero_copy(client);
+
     client->nb_requests--;
 
     if (client->quiescing && client->nb_requests == 0) {
@@ -1931,6 +2080,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     }
 
     exp->allocation_depth = arg->allocation_depth;
+    exp->zero_copy = arg->zero_copy;
 
     /*
      * We need to inhibit request queuing in the block layer to ensure we can
@@ -2032,8 +2182,28 @@ const BlockExportDriver blk_exp_nbd = {
     .request_shutdown   = nbd_export_request_shutdown,
 };
 
-static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
-                                        unsigned niov, Error **errp)
+/*
+ * Zero copy has a fixed cost (page pinning and a completion notification
+ * per send), so only use it for read payloads that are large enough.  Read
+ * buffers are kept around until the kernel reports completion, so also
+ * bound how many of them can pile up.
+ */
+#define NBD_ZERO_COPY_MIN_SIZE (64 * KiB)
+#define NBD_ZERO_COPY_MAX_BUFS MAX_NBD_REQUESTS
+
+static bool nbd_client_use_zero_copy(NBDClient *client, uint64_t len)
+{
+    return client->exp && client->exp->zero_copy &&
+           !client->zero_copy_failed && len >= NBD_ZERO_COPY_MIN_SIZE &&
+           qatomic_read(&client->nr_zero_copy_bufs) < NBD_ZERO_COPY_MAX_BUFS &&
+           qio_channel_has_feature(client->ioc,
+                                   QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+}
+
+static int coroutine_fn nbd_co_send_iov_flags(NBDClient *client,
+                                              struct iovec *iov,
+                                              unsigned niov, int flags,
+                                              Error **errp)
 {
     int ret;
 
@@ -2041,7 +2211,23 @@ static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
     qemu_co_mutex_lock(&client->send_lock);
     client->send_coroutine = qemu_coroutine_self();
 
-    ret = qio_channel_writev_all(client->ioc, iov, niov, errp) < 0 ? -EIO : 0;
+    if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+        /*
+         * Only the payload in the last iovec goes zero copy.  It is the
+         * request's read buffer, which nbd_request_put() keeps until the
+         * kernel is done with it; the reply headers live on the caller's
+         * stack and are copied as usual.
+         */
+        ret = qio_channel_writev_all(client->ioc, iov, niov - 1, errp);
+        if (ret == 0) {
+            ret = qio_channel_writev_full_all(client->ioc, &iov[niov - 1], 1,
+                                              NULL, 0, flags, errp);
+        }
+        ret = ret < 0 ? -EIO : 0;
+    } else {
+        ret = qio_channel_writev_all(client->ioc, iov, niov, errp) < 0 ?
+              -EIO : 0;
+    }
 
     client->send_coroutine = NULL;
     qemu_co_mutex_unlock(&client->send_lock);
@@ -2049,6 +2235,25 @@ static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
     return ret;
 }
 
+static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
+                                        unsigned niov, Error **errp)
+{
+    return nbd_co_send_iov_flags(client, iov, niov, 0, errp);
+}
+
+/* Like nbd_co_send_iov, but @len bytes of read payload may go zero copy */
+static int coroutine_fn nbd_co_send_read_iov(NBDClient *client,
+                                             struct iovec *iov, unsigned niov,
+                                             uint64_t len, Error **errp)
+{
+    int flags = 0;
+
+    if (nbd_client_use_zero_copy(client, len)) {
+        flags |= QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+    }
+    return nbd_co_send_iov_flags(client, iov, niov, flags, errp);
+}
+
 static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
                                        uint64_t cookie)
 {
@@ -2080,7 +2285,7 @@ static int coroutine_fn nbd_co_send_simple_reply(NBDClient *client,
                                    nbd_err_lookup(nbd_err), len);
     set_be_simple_reply(&reply, nbd_err, request->cookie);
 
-    return nbd_co_send_iov(client, iov, 2, errp);
+    return nbd_co_send_read_iov(client, iov, 2, len, errp);
 }
 
 /*
@@ -2161,7 +2366,7 @@ static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
                  NBD_REPLY_TYPE_OFFSET_DATA, request);
     stq_be_p(&chunk.offset, offset);
 
-    return nbd_co_send_iov(client, iov, 3, errp);
+    return nbd_co_send_read_iov(client, iov, 3, size, errp);
 }
 
 static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
@@ -3145,7 +3350,17 @@ static coroutine_fn void nbd_trip(void *opaque)
                                      error_get_pretty(export_err), &local_err);
         error_free(export_err);
     } else {
+        ssize_t zero_copy_queued = client->sioc->zero_copy_queued;
+
         ret = nbd_handle_request(client, &request, req->data, &local_err);
+
+        /*
+         * Concurrent requests may have sent with zero copy in the meantime,
+         * in which case the buffer is just kept a little longer than needed.
+         */
+        if (client->sioc->zero_copy_queued != zero_copy_queued) {
+            req->zero_copy_seq = client->sioc->zero_copy_queued;
+        }
     }
     if (request.contexts && request.contexts != &client->contexts) {
         assert(request.type == NBD_CMD_BLOCK_STATUS);
@@ -3253,6 +3468,13 @@ static coroutine_fn void nbd_co_client_start(void *opaque)
     }
 
     timer_free(handshake_timer);
+
+    /* Zero copy only works on plain TCP, and only the payload is sent */
+    if (client->exp->zero_copy &&
+        client->ioc == QIO_CHANNEL(client->sioc)) {
+        qio_channel_socket_enable_zero_copy(client->sioc);
+    }
+
     WITH_QEMU_LOCK_GUARD(&client->lock) {
         nbd_client_receive_next_request(client);
     }
@@ -3284,6 +3506,7 @@ void nbd_client_new(QIOChannelSocket *sioc,
     client->tlsauthz = g_strdup(tlsauthz);
     client->handshake_max_secs = handshake_max_secs;
     client->sioc = sioc;
+    QSIMPLEQ_INIT(&client->zero_copy_bufs);
     qio_channel_set_delay(QIO_CHANNEL(sioc), false);
     object_ref(OBJECT(client->sioc));
     client->ioc = QIO_CHANNEL(sioc);
@@ -88,6 +88,9 @@ enum {
     OPTION_SKIP_BROKEN = 277,
 };
 
+/* Upper limit for qemu-img check --parallel */
+#define MAX_CHECK_PARALLEL 64
+
 typedef enum OutputFormat {
     OFORMAT_JSON,
     OFORMAT_HUMAN,
@@ -610,12 +613,12 @@ static int collect_image_check(BlockDriverState *bs,
                    ImageCheck *check,
                    const char *filename,
                    const char *fmt,
-                   int fix)
+                   int fix, int parallel)
 {
     int ret;
     BdrvCheckResult result;
 
-    ret = bdrv_check(bs, &result, fix);
+    ret = bdrv_check(bs, &result, fix, parallel);
     if (ret < 0) {
         return ret;
     }
@@ -668,6 +671,7 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
     bool quiet = false;
     bool image_opts = false;
     bool force_share = false;
+    int parallel = 1;
 
     fmt = NULL;
     cache = BDRV_DEFAULT_CACHE;
@@ -680,13 +684,14 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
             {"image-opts", no_argument, 0, OPTION_IMAGE_OPTS},
             {"cache", required_argument, 0, 'T'},
             {"repair", required_argument, 0, 'r'},
+            {"parallel", required_argument, 0, 'm'},
             {"force-share", no_argument, 0, 'U'},
             {"output", required_argument, 0, OPTION_OUTPUT},
             {"quiet", no_argument, 0, 'q'},
             {"object", required_argument, 0, OPTION_OBJECT},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, "hf:T:r:Uq",
+        c = getopt_long(argc, argv, "hf:T:r:m:Uq",
                         long_options, &option_index);
         if (c == -1) {
             break;
@@ -694,7 +699,8 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
         switch(c) {
         case 'h':
             cmd_help(ccmd, "[-f FMT | --image-opts] [-T CACHE_MODE] [-r leaks|all]\n"
-"        [-U] [--output human|json] [-q] [--object OBJDEF] FILE\n"
+"        [-m NUM_PARALLEL] [-U] [--output human|json] [-q] [--object OBJDEF]\n"
+"        FILE\n"
 ,
 "  -f, --format FMT\n"
 "     specifies the format of the image explicitly (default: probing is used)\n"
@@ -706,6 +712,8 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
 "  -r, --repair leaks|all\n"
 "     repair errors of the given category in the image (image will be\n"
 "     opened in read-write mode, incompatible with -U|--force-share)\n"
+"  -m, --parallel NUM_PARALLEL\n"
+"     number of metadata tables to check concurrently (default: 1)\n"
 "  -U, --force-share\n"
 "     open image in shared mode for concurrent access\n"
 "  --output human|json\n"
@@ -741,6 +749,13 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
                            optarg);
             }
             break;
+        case 'm':
+            parallel = cvtnum_full("parallelism", optarg, false, 1,
+                                   MAX_CHECK_PARALLEL);
+            if (parallel < 0) {
+                return 1;
+            }
+            break;
         case 'U':
             force_share = true;
             break;
@@ -776,7 +791,7 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
     bs = blk_bs(blk);
 
     check = g_new0(ImageCheck, 1);
-    ret = collect_image_check(bs, check, filename, fmt, fix);
+    ret = collect_image_check(bs, check, filename, fmt, fix, parallel);
 
     if (ret == -ENOTSUP) {
         error_report("This image format does not support checks");
@@ -805,7 +820,7 @@ static int img_check(const img_cmd_t *ccmd, int argc, char **argv)
 
         qapi_free_ImageCheck(check);
         check = g_new0(ImageCheck, 1);
-        ret = collect_image_check(bs, check, filename, fmt, 0);
+        ret = collect_image_check(bs, check, filename, fmt, 0, parallel);
 
         check->leaks_fixed          = leaks_fixed;
         check->has_leaks_fixed      = has_leaks_fixed;
@@ -1662,6 +1677,19 @@ enum ImgConvertBlockStatus {
 #define MAX_COROUTINES 16
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
+/*
+ * Upper limit for the number of entries in the extent map built before the
+ * copy starts.  Beyond that, the copy coroutines fall back to querying the
+ * block status themselves.
+ */
+#define MAX_CONVERT_EXTENTS (1024 * 1024)
+
+typedef struct ImgConvertExtent {
+    int64_t sector_num;
+    int64_t nb_sectors;
+    enum ImgConvertBlockStatus status;
+} ImgConvertExtent;
+
 typedef struct ImgConvertState {
     BlockBackend **src;
     int64_t *src_sectors;
@@ -1674,6 +1702,8 @@ typedef struct ImgConvertState {
     int64_t wr_offs;
     enum ImgConvertBlockStatus status;
     int64_t sector_next_status;
+    GArray *extents;
+    guint extent_idx;
     BlockBackend *target;
     bool has_zero_init;
     bool compressed;
@@ -1815,6 +1845,75 @@ convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
     return n;
 }
 
+/*
+ * Add the range returned by the last convert_iteration_sectors() call to the
+ * extent map, merging it with the previous extent if possible.
+ */
+static void convert_record_extent(ImgConvertState *s, int64_t sector_num,
+                                  int n)
+{
+    ImgConvertExtent *last;
+
+    if (!s->extents) {
+        return;
+    }
+
+    if (s->extents->len) {
+        last = &g_array_index(s->extents, ImgConvertExtent,
+                              s->extents->len - 1);
+        if (last->status == s->status &&
+            last->sector_num + last->nb_sectors == sector_num) {
+            last->nb_sectors += n;
+            return;
+        }
+    }
+
+    if (s->extents->len >= MAX_CONVERT_EXTENTS) {
+        g_array_free(s->extents, true);
+        s->extents = NULL;
+        return;
+    }
+
+    g_array_append_val(s->extents, ((ImgConvertExtent) {
+        .sector_num = sector_num,
+        .nb_sectors = n,
+        .status = s->status,
+    }));
+}
+
+/*
+ * Like convert_iteration_sectors(), but takes the allocation status from the
+ * extent map instead of querying the source.  Must be called with increasing
+ * @sector_num.
+ */
+static int convert_extent_sectors(ImgConvertState *s, int64_t sector_num)
+{
+    ImgConvertExtent *e;
+    int64_t n;
+
+    for (;;) {
+        assert(s->extent_idx < s->extents->len);
+        e = &g_array_index(s->extents, ImgConvertExtent, s->extent_idx);
+        if (sector_num < e->sector_num + e->nb_sectors) {
+            break;
+        }
+        s->extent_idx++;
+    }
+    assert(sector_num >= e->sector_num);
+
+    s->status = e->status;
+    n = MIN(e->sector_num + e->nb_sectors - sector_num,
+            BDRV_REQUEST_MAX_SECTORS);
+    if (s->status == BLK_DATA) {
+        n = MIN(n, s->buf_sectors);
+    }
+    if (s->compressed && n > s->cluster_sectors) {
+        n = QEMU_ALIGN_DOWN(n, s->cluster_sectors);
+    }
+
+    return n;
+}
+
 static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
                                         int nb_sectors, uint8_t *buf)
 {
@@ -1993,8 +2092,12 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
             qemu_co_mutex_unlock(&s->lock);
             break;
         }
-        WITH_GRAPH_RDLOCK_GUARD() {
-            n = convert_iteration_sectors(s, s->sector_num);
+        if (s->extents) {
+            n = convert_extent_sectors(s, s->sector_num);
+        } else {
+            WITH_GRAPH_RDLOCK_GUARD() {
+                n = convert_iteration_sectors(s, s->sector_num);
+            }
         }
         if (n < 0) {
             qemu_co_mutex_unlock(&s->lock);
@@ -2110,17 +2213,27 @@ static int convert_do_copy(ImgConvertState *s)
         s->buf_sectors = s->cluster_sectors;
     }
 
+    /*
+     * Walk the block status of the whole source once and remember it, so that
+     * the copy coroutines can issue large requests without another round
+     * trip to the source for every chunk.
+     */
+    s->extents = g_array_new(false, false, sizeof(ImgConvertExtent));
+    s->extent_idx = 0;
+
     while (sector_num < s->total_sectors) {
         bdrv_graph_rdlock_main_loop();
         n = convert_iteration_sectors(s, sector_num);
         bdrv_graph_rdunlock_main_loop();
         if (n < 0) {
-            return n;
+            ret = n;
+            goto out;
         }
         if (s->status == BLK_DATA || (!s->min_sparse && s->status == BLK_ZERO))
         {
             s->allocated_sectors += n;
         }
+        convert_record_extent(s, sector_num, n);
         sector_num += n;
     }
 
@@ -2139,15 +2252,18 @@ static int convert_do_copy(ImgConvertState *s)
         main_loop_wait(false);
     }
 
-    if (s->compressed && !s->ret) {
+    ret = s->ret;
+    if (s->compressed && !ret) {
         /* signal EOF to align */
         ret = blk_pwrite_compressed(s->target, 0, 0, NULL);
-        if (ret < 0) {
-            return ret;
-        }
     }
 
-    return s->ret;
+out:
+    if (s->extents) {
+        g_array_free(s->extents, true);
+        s->extents = NULL;
+    }
+    return ret;
 }
 
 /* Check that bitmaps can be copied, or output an error */
@@ -234,6 +234,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                dirty-ring-reap-threads=n (threads collecting KVM dirty rings, default 1)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n"
@@ -294,6 +295,13 @@ SRST
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
         record dirty pages in a bitmap.
 
+    ``dirty-ring-reap-threads=n``
+        When the KVM dirty ring is used, it controls how many threads
+        collect the rings of all vCPUs at once, for example when the
+        dirty log is synchronized for migration.  With many vCPUs, using
+        more threads shortens the time vCPUs with a full ring wait for.
+        By default, one thread collects all rings (dirty-ring-reap-threads=1).
+
     ``eager-split-size=n``
         KVM implements dirty page logging at the PAGE_SIZE granularity and
         enabling dirty-logging on a huge-page requires breaking it into
@@ -1508,6 +1516,16 @@ SRST
             supporting platforms, and 0 on other platforms. Setting it
             to 0 disables this feature.
 
+        ``l2-cache-shards``
+            Split the L2 table cache into this many independently
+            indexed sets, which makes lookups and evictions cheaper for
+            large caches (1 to 64; default: 1)
+
+        ``l2-prefetch-hints``
+            Remember which L2 tables were cached when the image was
+            closed and load them in the background when it is opened
+            again (on/off; default: off)
+
         ``pass-discard-request``
             Whether discard requests to the qcow2 device should be
             forwarded to the data source (on/off; default: on if
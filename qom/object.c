@@ -1096,6 +1096,8 @@ typedef struct OCFData
 {
     void (*fn)(ObjectClass *klass, void *opaque);
     const char *implements_type;
+    /* Set if implements_type can be checked without initializing classes */
+    TypeImpl *implements_ti;
     bool include_abstract;
     void *opaque;
 } OCFData;
@@ -1107,12 +1109,19 @@ static void object_class_foreach_tramp(gpointer key, gpointer value,
     TypeImpl *type = value;
     ObjectClass *k;
 
-    type_initialize(type);
-    k = type->class;
-
+    /*
+     * Filter on what is known from registration first, so that
+     * enumerating e.g. machine types does not initialize every class.
+     */
     if (!data->include_abstract && type->abstract) {
         return;
     }
+    if (data->implements_ti && !type_is_ancestor(type, data->implements_ti)) {
+        return;
+    }
+
+    type_initialize(type);
+    k = type->class;
 
     if (data->implements_type && 
         !object_class_dynamic_cast(k, data->implements_type)) {
@@ -1126,7 +1135,13 @@ void object_class_foreach(void (*fn)(ObjectClass *klass, void *opaque),
                           const char *implements_type, bool include_abstract,
                           void *opaque)
 {
-    OCFData data = { fn, implements_type, include_abstract, opaque };
+    OCFData data = { fn, implements_type, NULL, include_abstract, opaque };
+    TypeImpl *ti = type_get_by_name_noload(implements_type);
+
+    /* Interfaces are only known once the implementing class is set up */
+    if (ti && !type_is_ancestor(ti, type_interface)) {
+        data.implements_ti = ti;
+    }
 
     enumerating_types = true;
     g_hash_table_foreach(type_table_get(), object_class_foreach_tramp, &data);
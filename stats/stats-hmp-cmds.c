@@ -53,6 +53,11 @@ static void print_stats_schema_value(Monitor *mon, StatsSchemaValue *value)
     if (value->type == STATS_TYPE_LINEAR_HISTOGRAM && value->has_bucket_size) {
         monitor_printf(mon, ", bucket size=%d", value->bucket_size);
     }
+    if (value->type == STATS_TYPE_LOG_LINEAR_HISTOGRAM &&
+        value->has_bucket_size) {
+        monitor_printf(mon, ", %d buckets per power of two",
+                       value->bucket_size);
+    }
     monitor_printf(mon, ")");
 }
 
@@ -91,6 +96,12 @@ static void print_stats_results(Monitor *mon, StatsTarget target,
         monitor_printf(mon, "provider: %s\n",
                        StatsProvider_str(result->provider));
     }
+    if (target == STATS_TARGET_BLOCK && result->qom_path) {
+        monitor_printf(mon, "device: %s\n", result->qom_path);
+    }
+    if (result->iothread) {
+        monitor_printf(mon, "iothread: %s\n", result->iothread);
+    }
 
     for (stats_list = result->stats; stats_list;
              stats_list = stats_list->next,
@@ -156,6 +167,8 @@ static StatsFilter *stats_filter(StatsTarget target, const char *names,
         break;
     }
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
+    case STATS_TARGET_IOTHREAD:
         break;
     default:
         break;
@@ -229,6 +242,8 @@ void hmp_info_stats(Monitor *mon, const QDict *qdict)
         filter = stats_filter(target, names, cpu_index, provider);
         break;
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
+    case STATS_TARGET_IOTHREAD:
         filter = stats_filter(target, names, -1, provider);
         break;
     default:
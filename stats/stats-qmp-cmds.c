@@ -65,6 +65,16 @@ static bool invoke_stats_cb(StatsCallbacks *entry,
         }
         break;
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_IOTHREAD:
+        break;
+    case STATS_TARGET_BLOCK:
+        if (filter->u.block.has_devices) {
+            if (!filter->u.block.devices) {
+                /* No targets allowed?  Return no statistics.  */
+                return true;
+            }
+            targets = filter->u.block.devices;
+        }
         break;
     default:
         abort();
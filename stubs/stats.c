@@ -0,0 +1,19 @@
+#include "qemu/osdep.h"
+#include "system/stats.h"
+
+void add_stats_callbacks(StatsProvider provider,
+                         StatRetrieveFunc *stats_fn,
+                         SchemaRetrieveFunc *schemas_fn)
+{
+}
+
+void add_stats_schema(StatsSchemaList **schema_results,
+                      StatsProvider provider, StatsTarget target,
+                      StatsSchemaValueList *stats_list)
+{
+}
+
+bool apply_str_list_filter(const char *string, strList *list)
+{
+    return true;
+}
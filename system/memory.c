@@ -742,11 +742,39 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
-/* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+static bool flatview_equal(FlatView *a, FlatView *b)
 {
     int i;
-    FlatView *view;
+
+    if (a->nr != b->nr) {
+        return false;
+    }
+    for (i = 0; i < a->nr; i++) {
+        if (!flatrange_equal(&a->ranges[i], &b->ranges[i])
+            || a->ranges[i].dirty_log_mask != b->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Render a memory topology into a list of disjoint absolute ranges.
+ * If the result is identical to @old or to one of the views in @unique,
+ * that view is reused together with its dispatch tree instead of building
+ * a new one.  Views that end up in flat_views are added to @unique.
+ *
+ * A FlatView's root is only used for reference counting and debugging,
+ * so one view can serve several roots that flatten to the same ranges,
+ * e.g. per-device IOMMU address spaces while the IOMMU is bypassed.
+ * Since every commit renders all roots again, a root whose mapping
+ * diverges simply gets a view of its own.
+ */
+static FlatView *generate_memory_topology(MemoryRegion *mr, FlatView *old,
+                                          GPtrArray *unique)
+{
+    int i;
+    FlatView *view, *reuse = NULL;
 
     view = flatview_new(mr);
 
@@ -757,6 +785,25 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    if (old && flatview_equal(old, view)) {
+        reuse = old;
+    }
+    for (i = 0; !reuse && unique && i < unique->len; i++) {
+        if (flatview_equal(g_ptr_array_index(unique, i), view)) {
+            reuse = g_ptr_array_index(unique, i);
+        }
+    }
+    if (reuse) {
+        /* Never published, so it can go away right now.  */
+        flatview_destroy(view);
+        flatview_ref(reuse);
+        g_hash_table_replace(flat_views, mr, reuse);
+        if (unique && !g_ptr_array_find(unique, reuse, NULL)) {
+            g_ptr_array_add(unique, reuse);
+        }
+        return reuse;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -765,6 +812,9 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     address_space_dispatch_compact(view->dispatch);
     g_hash_table_replace(flat_views, mr, view);
+    if (unique) {
+        g_ptr_array_add(unique, view);
+    }
 
     return view;
 }
@@ -1046,7 +1096,7 @@ static void flatviews_init(void)
     flat_views = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
                                        (GDestroyNotify) flatview_unref);
     if (!empty_view) {
-        empty_view = generate_memory_topology(NULL);
+        empty_view = generate_memory_topology(NULL, NULL, NULL);
         /* We keep it alive forever in the global variable.  */
         flatview_ref(empty_view);
     } else {
@@ -1058,11 +1108,14 @@ static void flatviews_init(void)
 static void flatviews_reset(void)
 {
     AddressSpace *as;
+    GHashTable *old_views = flat_views;
+    g_autoptr(GPtrArray) unique = g_ptr_array_new();
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    /*
+     * Keep the old views alive until every root has been rendered, so
+     * that those whose ranges did not change can be reused as is.
+     */
+    flat_views = NULL;
     flatviews_init();
 
     /* Render unique FVs */
@@ -1073,7 +1126,15 @@ static void flatviews_reset(void)
             continue;
         }
 
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr,
+                                 old_views ? g_hash_table_lookup(old_views,
+                                                                 physmr)
+                                           : NULL,
+                                 unique);
+    }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
     }
 }
 
@@ -1086,6 +1147,13 @@ static void address_space_set_flatview(AddressSpace *as)
     assert(new_view);
 
     if (old_view == new_view) {
+        /*
+         * The view was reused by flatviews_reset(); listeners that rebuild
+         * their state between begin and commit still need every section.
+         */
+        if (!QTAILQ_EMPTY(&as->listeners)) {
+            address_space_update_topology_pass(as, old_view, new_view, true);
+        }
         return;
     }
 
@@ -1128,7 +1196,18 @@ static void address_space_update_topology(AddressSpace *as)
 
     flatviews_init();
     if (!g_hash_table_lookup(flat_views, physmr)) {
-        generate_memory_topology(physmr);
+        g_autoptr(GPtrArray) unique = g_ptr_array_new();
+        GHashTableIter iter;
+        gpointer view;
+
+        /* Devices are often added with the same mapping as their peers.  */
+        g_hash_table_iter_init(&iter, flat_views);
+        while (g_hash_table_iter_next(&iter, NULL, &view)) {
+            if (!g_ptr_array_find(unique, view, NULL)) {
+                g_ptr_array_add(unique, view);
+            }
+        }
+        generate_memory_topology(physmr, NULL, unique);
     }
     address_space_set_flatview(as);
 }
@@ -3229,6 +3308,7 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
     as->max_bounce_buffer_size = DEFAULT_MAX_BOUNCE_BUFFER_SIZE;
     as->bounce_buffer_size = 0;
+    as->bounce_buffer_cache = NULL;
     qemu_mutex_init(&as->map_client_list_lock);
     QLIST_INIT(&as->map_client_list);
     as->name = g_strdup(name ? name : "anonymous");
@@ -3241,6 +3321,7 @@ static void do_address_space_destroy(AddressSpace *as)
     assert(qatomic_read(&as->bounce_buffer_size) == 0);
     assert(QLIST_EMPTY(&as->map_client_list));
     qemu_mutex_destroy(&as->map_client_list_lock);
+    g_free(as->bounce_buffer_cache);
 
     assert(QTAILQ_EMPTY(&as->listeners));
 
@@ -1020,13 +1020,7 @@ bool cpu_physical_memory_snapshot_get_dirty(DirtyBitmapSnapshot *snap,
     end = TARGET_PAGE_ALIGN(start + length - snap->start) >> TARGET_PAGE_BITS;
     page = (start - snap->start) >> TARGET_PAGE_BITS;
 
-    while (page < end) {
-        if (test_bit(page, snap->dirty)) {
-            return true;
-        }
-        page++;
-    }
-    return false;
+    return find_next_bit(snap->dirty, end, page) < end;
 }
 
 static int subpage_register(subpage_t *mmio, uint32_t start, uint32_t end,
@@ -3274,6 +3268,7 @@ typedef struct {
     MemoryRegion *mr;
     hwaddr addr;
     size_t len;
+    size_t size;
     uint8_t buffer[];
 } BounceBuffer;
 
@@ -3451,7 +3446,19 @@ void *address_space_map(AddressSpace *as,
             return NULL;
         }
 
-        BounceBuffer *bounce = g_malloc0(l + sizeof(BounceBuffer));
+        /*
+         * Reuse the last released buffer if it is large enough.  Large
+         * buffers would otherwise be mmap()ed and munmap()ed by the
+         * allocator for every single request.
+         */
+        BounceBuffer *bounce = qatomic_xchg(&as->bounce_buffer_cache, NULL);
+        if (bounce && bounce->size >= l) {
+            memset(bounce->buffer, 0, l);
+        } else {
+            g_free(bounce);
+            bounce = g_malloc0(l + sizeof(BounceBuffer));
+            bounce->size = l;
+        }
         bounce->magic = BOUNCE_BUFFER_MAGIC;
         memory_region_ref(mr);
         bounce->mr = mr;
@@ -3508,6 +3515,7 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
     qatomic_sub(&as->bounce_buffer_size, bounce->len);
     bounce->magic = ~BOUNCE_BUFFER_MAGIC;
     memory_region_unref(bounce->mr);
+    bounce = qatomic_xchg(&as->bounce_buffer_cache, bounce);
     g_free(bounce);
     /* Write bounce_buffer_size before reading map_client_list. */
     smp_mb();
@@ -49,7 +49,10 @@ void debuginfo_lock(void)
 void debuginfo_query(struct debuginfo_query *q, size_t n)
 {
     const char *symbol, *file;
-    Dwfl_Module *dwfl_module;
+    Dwfl_Module *dwfl_module = NULL;
+    Dwarf_Addr mod_start = 0, mod_end = 0;
+    const char *sym_name = NULL;
+    uint64_t sym_start = 0, sym_end = 0;
     Dwfl_Line *dwfl_line;
     GElf_Off dwfl_offset;
     GElf_Sym dwfl_sym;
@@ -60,19 +63,42 @@ void debuginfo_query(struct debuginfo_query *q, size_t n)
         return;
     }
 
+    /*
+     * The queries usually come from a single TB, so consecutive addresses
+     * tend to be in the same module and symbol: remember the last ones
+     * rather than searching for them again.
+     */
     for (i = 0; i < n; i++) {
-        dwfl_module = dwfl_addrmodule(dwfl, q[i].address);
-        if (!dwfl_module) {
-            continue;
+        if (!dwfl_module ||
+            q[i].address < mod_start || q[i].address >= mod_end) {
+            dwfl_module = dwfl_addrmodule(dwfl, q[i].address);
+            if (!dwfl_module) {
+                continue;
+            }
+            dwfl_module_info(dwfl_module, NULL, &mod_start, &mod_end,
+                             NULL, NULL, NULL, NULL);
+            sym_name = NULL;
         }
 
         if (q[i].flags & DEBUGINFO_SYMBOL) {
-            symbol = dwfl_module_addrinfo(dwfl_module, q[i].address,
-                                          &dwfl_offset, &dwfl_sym,
-                                          NULL, NULL, NULL);
-            if (symbol) {
-                q[i].symbol = symbol;
-                q[i].offset = dwfl_offset;
+            if (sym_name &&
+                q[i].address >= sym_start && q[i].address < sym_end) {
+                q[i].symbol = sym_name;
+                q[i].offset = q[i].address - sym_start;
+            } else {
+                symbol = dwfl_module_addrinfo(dwfl_module, q[i].address,
+                                              &dwfl_offset, &dwfl_sym,
+                                              NULL, NULL, NULL);
+                sym_name = NULL;
+                if (symbol) {
+                    q[i].symbol = symbol;
+                    q[i].offset = dwfl_offset;
+                    if (dwfl_sym.st_size) {
+                        sym_name = symbol;
+                        sym_start = q[i].address - dwfl_offset;
+                        sym_end = sym_start + dwfl_sym.st_size;
+                    }
+                }
             }
         }
 
@@ -97,6 +97,15 @@ static void tci_args_rl(uint32_t insn, const void *tb_ptr,
     *l1 = sextract32(insn, 12, 20) + (void *)tb_ptr;
 }
 
+static void tci_args_rrcl(uint32_t insn, const uint32_t *tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = (int32_t)tb_ptr[0] + (void *)(tb_ptr + 1);
+}
+
 static void tci_args_rr(uint32_t insn, TCGReg *r0, TCGReg *r1)
 {
     *r0 = extract32(insn, 8, 4);
@@ -691,6 +700,22 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 tb_ptr = ptr;
             }
             break;
+        case INDEX_op_tci_brcond32:
+            tci_args_rrcl(insn, tb_ptr, &r0, &r1, &condition, &ptr);
+            tb_ptr++;
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            break;
+#if TCG_TARGET_REG_BITS == 64
+        case INDEX_op_tci_brcond64:
+            tci_args_rrcl(insn, tb_ptr, &r0, &r1, &condition, &ptr);
+            tb_ptr++;
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            break;
+#endif
         case INDEX_op_bswap16:
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = bswap16(regs[r1]);
@@ -920,6 +945,13 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
                            op_name, str_r(r0), ptr);
         break;
 
+    case INDEX_op_tci_brcond32:
+    case INDEX_op_tci_brcond64:
+        tci_args_rrcl(insn, tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        return 2 * sizeof(insn);
+
     case INDEX_op_setcond:
     case INDEX_op_tci_setcond32:
         tci_args_rrrc(insn, &r0, &r1, &r2, &c);
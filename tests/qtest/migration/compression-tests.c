@@ -153,6 +153,56 @@ static void test_precopy_unix_xbzrle(void)
     test_precopy_common(&args);
 }
 
+static void *
+migrate_hook_start_page_dedup(QTestState *from,
+                              QTestState *to)
+{
+    QDict *err;
+
+    /* The dedup index is sized by the xbzrle cache size */
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+
+    /* Page references need the ordering of the main channel */
+    err = qtest_qmp_assert_failure_ref(
+        from, "{ 'execute': 'migrate-set-capabilities',"
+        "'arguments': { 'capabilities': [ { "
+        "'capability': 'multifd', 'state': true } ] } }");
+    g_assert(qdict_haskey(err, "desc"));
+    qobject_unref(err);
+
+    return NULL;
+}
+
+static void migrate_hook_end_page_dedup(QTestState *from,
+                                        QTestState *to,
+                                        void *opaque)
+{
+    /*
+     * The guest only ever changes one byte per page, so there are plenty
+     * of identical pages at different addresses.
+     */
+    g_assert_cmpint(read_ram_property_int(from, "dedup-pages"), >, 0);
+}
+
+static void test_precopy_unix_page_dedup(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = uri,
+        .start_hook = migrate_hook_start_page_dedup,
+        .end_hook = migrate_hook_end_page_dedup,
+        .iterations = 2,
+        .start = {
+            .caps[MIGRATION_CAPABILITY_PAGE_DEDUP] = true,
+        },
+        /* Let the guest dirty pages between the rounds */
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void *
 migrate_hook_start_precopy_tcp_multifd_zlib(QTestState *from,
                                             QTestState *to)
@@ -219,6 +269,9 @@ void migration_test_add_compression(MigrationTestEnv *env)
                        test_multifd_tcp_uadk);
 #endif
 
+    migration_test_add("/migration/precopy/unix/page-dedup",
+                       test_precopy_unix_page_dedup);
+
     if (g_test_slow()) {
         migration_test_add("/migration/precopy/unix/xbzrle",
                            test_precopy_unix_xbzrle);
@@ -51,6 +51,23 @@ static void test_precopy_unix_plain(void)
     test_precopy_common(&args);
 }
 
+static void test_precopy_unix_parallel_save(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .listen_uri = uri,
+        .connect_uri = uri,
+        /*
+         * Devices with parallel_save set (the HPET and RTC on x86) are
+         * serialized on worker threads; the stream must still load.
+         */
+        .start.opts_source = "-global migration.x-parallel-save-threads=4",
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_unix_suspend_live(void)
 {
     g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
@@ -1279,6 +1296,11 @@ void migration_test_add_precopy(MigrationTestEnv *env)
     migration_test_add("/migration/precopy/tcp/plain/switchover-ack",
                        test_precopy_tcp_switchover_ack);
 
+    if (env->is_x86) {
+        migration_test_add("/migration/precopy/unix/parallel-save",
+                           test_precopy_unix_parallel_save);
+    }
+
 #ifndef _WIN32
     migration_test_add("/migration/precopy/fd/tcp",
                        test_precopy_fd_socket);
@@ -8,6 +8,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "qemu/module.h"
 #include "qemu/units.h"
 #include "libqtest.h"
@@ -15,6 +16,13 @@
 #include "libqos/pci.h"
 #include "block/nvme.h"
 
+#define NVME_TEST_QUEUE_DEPTH 8
+#define NVME_TEST_TIMEOUT_US (5 * G_USEC_PER_SEC)
+
+/* Admin queue doorbells, with a doorbell stride of 0 */
+#define NVME_TEST_SQ0TDBL 0x1000
+#define NVME_TEST_CQ0HDBL 0x1004
+
 typedef struct QNvme QNvme;
 
 struct QNvme {
@@ -142,6 +150,128 @@ static void nvmetest_pmr_reg_test(void *obj, void *data, QGuestAllocator *alloc)
     qpci_iounmap(pdev, pmr_bar);
 }
 
+typedef struct NvmeTestAdminQueue {
+    QPCIDevice *pdev;
+    QPCIBar bar;
+    uint64_t sq;
+    uint64_t cq;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+} NvmeTestAdminQueue;
+
+static void nvmetest_enable(NvmeTestAdminQueue *q, QNvme *nvme,
+                            QGuestAllocator *alloc)
+{
+    uint32_t cc = 0;
+    size_t cq_size = NVME_TEST_QUEUE_DEPTH * sizeof(NvmeCqe);
+
+    q->pdev = &nvme->dev;
+    qpci_device_enable(q->pdev);
+    q->bar = qpci_iomap(q->pdev, 0, NULL);
+
+    q->sq = guest_alloc(alloc, NVME_TEST_QUEUE_DEPTH * sizeof(NvmeCmd));
+    q->cq = guest_alloc(alloc, cq_size);
+    qtest_memset(q->pdev->bus->qts, q->cq, 0, cq_size);
+    q->sq_tail = 0;
+    q->cq_head = 0;
+
+    qpci_io_writel(q->pdev, q->bar, NVME_REG_AQA,
+                   (NVME_TEST_QUEUE_DEPTH - 1) << AQA_ACQS_SHIFT |
+                   (NVME_TEST_QUEUE_DEPTH - 1) << AQA_ASQS_SHIFT);
+    qpci_io_writeq(q->pdev, q->bar, NVME_REG_ASQ, q->sq);
+    qpci_io_writeq(q->pdev, q->bar, NVME_REG_ACQ, q->cq);
+
+    NVME_SET_CC_IOSQES(cc, 6);
+    NVME_SET_CC_IOCQES(cc, 4);
+    NVME_SET_CC_EN(cc, 1);
+    qpci_io_writel(q->pdev, q->bar, NVME_REG_CC, cc);
+
+    g_assert_cmpint(NVME_CSTS_RDY(qpci_io_readl(q->pdev, q->bar,
+                                                NVME_REG_CSTS)), ==, 1);
+}
+
+/* Submit @cmd on the admin queue and return its completion status */
+static uint16_t nvmetest_admin_cmd(NvmeTestAdminQueue *q, NvmeCmd *cmd,
+                                   uint32_t *result)
+{
+    QTestState *qts = q->pdev->bus->qts;
+    uint64_t cqe_addr = q->cq + q->cq_head * sizeof(NvmeCqe);
+    gint64 deadline = g_get_monotonic_time() + NVME_TEST_TIMEOUT_US;
+    NvmeCqe cqe;
+
+    cmd->cid = cpu_to_le16(q->sq_tail);
+    qtest_memwrite(qts, q->sq + q->sq_tail * sizeof(NvmeCmd),
+                   cmd, sizeof(*cmd));
+    q->sq_tail = (q->sq_tail + 1) % NVME_TEST_QUEUE_DEPTH;
+    qpci_io_writel(q->pdev, q->bar, NVME_TEST_SQ0TDBL, q->sq_tail);
+
+    /* The queues never wrap, so a set phase bit marks a new entry */
+    do {
+        g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+        qtest_memread(qts, cqe_addr, &cqe, sizeof(cqe));
+    } while (!(le16_to_cpu(cqe.status) & 0x1));
+
+    g_assert_cmpint(le16_to_cpu(cqe.cid), ==, le16_to_cpu(cmd->cid));
+    q->cq_head++;
+    g_assert_cmpint(q->cq_head, <, NVME_TEST_QUEUE_DEPTH);
+    qpci_io_writel(q->pdev, q->bar, NVME_TEST_CQ0HDBL, q->cq_head);
+
+    if (result) {
+        *result = le32_to_cpu(cqe.result);
+    }
+    return le16_to_cpu(cqe.status) >> 1;
+}
+
+static uint16_t nvmetest_set_feature(NvmeTestAdminQueue *q, uint8_t fid,
+                                     uint32_t value)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(fid),
+        .cdw11 = cpu_to_le32(value),
+    };
+
+    return nvmetest_admin_cmd(q, &cmd, NULL);
+}
+
+static uint32_t nvmetest_get_feature(NvmeTestAdminQueue *q, uint8_t fid)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_GET_FEATURES,
+        .cdw10 = cpu_to_le32(fid),
+    };
+    uint32_t result;
+
+    g_assert_cmpint(nvmetest_admin_cmd(q, &cmd, &result), ==, NVME_SUCCESS);
+    return result;
+}
+
+static void nvmetest_intc_feature_test(void *obj, void *data,
+                                       QGuestAllocator *alloc)
+{
+    NvmeTestAdminQueue q;
+
+    nvmetest_enable(&q, obj, alloc);
+
+    /* Coalescing is off by default */
+    g_assert_cmphex(nvmetest_get_feature(&q, NVME_INTERRUPT_COALESCING),
+                    ==, 0);
+
+    /* Aggregation Time of 10 (1 ms) and Threshold of 5 (6 entries) */
+    g_assert_cmpint(nvmetest_set_feature(&q, NVME_INTERRUPT_COALESCING,
+                                         0x0a05), ==, NVME_SUCCESS);
+    g_assert_cmphex(nvmetest_get_feature(&q, NVME_INTERRUPT_COALESCING),
+                    ==, 0x0a05);
+
+    /* The reserved upper half is not stored */
+    g_assert_cmpint(nvmetest_set_feature(&q, NVME_INTERRUPT_COALESCING,
+                                         0xffff0102), ==, NVME_SUCCESS);
+    g_assert_cmphex(nvmetest_get_feature(&q, NVME_INTERRUPT_COALESCING),
+                    ==, 0x0102);
+
+    qpci_iounmap(q.pdev, q.bar);
+}
+
 static void nvme_register_nodes(void)
 {
     QOSGraphEdgeOptions opts = {
@@ -168,6 +298,8 @@ static void nvme_register_nodes(void)
     });
 
     qos_add_test("reg-read", "nvme", nvmetest_reg_read_test, NULL);
+
+    qos_add_test("intc-feature", "nvme", nvmetest_intc_feature_test, NULL);
 }
 
 libqos_init(nvme_register_nodes);
@@ -449,6 +449,42 @@ static void test_lifecycle(void)
     g_assert(done); /* expect done to be true (second time) */
 }
 
+/*
+ * Check that coroutines with small stacks are not recycled for callers that
+ * want the default stack size
+ */
+
+static void coroutine_fn use_large_stack(void *opaque)
+{
+    /* Much more than COROUTINE_STACK_SIZE_SMALL */
+    char buf[512 * 1024];
+    bool *done = opaque;
+
+    memset(buf, 0x5a, sizeof(buf));
+    asm volatile("" : : "r"(buf) : "memory");
+    *done = buf[sizeof(buf) - 1] == 0x5a && buf[0] == 0x5a;
+}
+
+static void test_small_stack(void)
+{
+    Coroutine *coroutine;
+    bool done;
+    int i;
+
+    /* Fill the pool with small stack coroutines */
+    for (i = 0; i < 16; i++) {
+        done = false;
+        coroutine = qemu_coroutine_create_small(set_and_exit, &done);
+        qemu_coroutine_enter(coroutine);
+        g_assert(done);
+    }
+
+    done = false;
+    coroutine = qemu_coroutine_create(use_large_stack, &done);
+    qemu_coroutine_enter(coroutine);
+    g_assert(done);
+}
+
 
 #define RECORD_SIZE 10 /* Leave some room for expansion */
 struct coroutine_position {
@@ -650,6 +686,7 @@ int main(int argc, char **argv)
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
+    g_test_add_func("/basic/small-stack", test_small_stack);
     g_test_add_func("/basic/yield", test_yield);
     g_test_add_func("/basic/nesting", test_nesting);
     g_test_add_func("/basic/self", test_self);
@@ -793,6 +793,75 @@ static void test_hbitmap_serialize_zeroes(TestHBitmapData *data,
     }
 }
 
+static void test_hbitmap_meta_set(TestHBitmapData *data, const void *unused)
+{
+    HBitmap *meta;
+
+    hbitmap_test_init(data, L3, 0);
+    meta = hbitmap_create_meta(data->hb, L1);
+
+    hbitmap_set(data->hb, L1 + 3, 5);
+    g_assert_cmpint(hbitmap_count(meta), ==, L1);
+    g_assert(hbitmap_get(meta, L1));
+    g_assert_cmpint(hbitmap_next_dirty(meta, 0, L3), ==, L1);
+
+    /* Setting bits again does not change anything */
+    hbitmap_reset_all(meta);
+    hbitmap_set(data->hb, L1 + 3, 5);
+    g_assert(hbitmap_empty(meta));
+
+    /* Bits in a word that already had some bits set must be noticed */
+    hbitmap_set(data->hb, L1 + 10, 1);
+    g_assert(hbitmap_get(meta, L1));
+
+    hbitmap_reset_all(meta);
+    hbitmap_set(data->hb, L1 - 1, 2);
+    g_assert_cmpint(hbitmap_count(meta), ==, 2 * L1);
+
+    hbitmap_free_meta(data->hb);
+}
+
+static void test_hbitmap_meta_reset(TestHBitmapData *data, const void *unused)
+{
+    HBitmap *meta;
+
+    hbitmap_test_init(data, L3, 0);
+    meta = hbitmap_create_meta(data->hb, L1);
+
+    hbitmap_reset(data->hb, 0, L2);
+    g_assert(hbitmap_empty(meta));
+
+    hbitmap_set(data->hb, 2 * L1 + 7, 1);
+    hbitmap_reset_all(meta);
+    hbitmap_reset(data->hb, L1, 2 * L1);
+    g_assert_cmpint(hbitmap_count(meta), ==, 2 * L1);
+
+    hbitmap_reset_all(meta);
+    hbitmap_set(data->hb, 0, 1);
+    hbitmap_reset_all(meta);
+    hbitmap_reset_all(data->hb);
+    g_assert_cmpint(hbitmap_count(meta), ==, L3);
+
+    hbitmap_free_meta(data->hb);
+}
+
+static void test_hbitmap_meta_deserialize(TestHBitmapData *data,
+                                          const void *unused)
+{
+    HBitmap *meta;
+    uint64_t align;
+
+    hbitmap_test_init(data, L3, 0);
+    meta = hbitmap_create_meta(data->hb, L1);
+    align = hbitmap_serialization_align(data->hb);
+
+    hbitmap_deserialize_ones(data->hb, L2, align, true);
+    g_assert(hbitmap_get(meta, L2));
+    g_assert_cmpint(hbitmap_next_dirty(meta, 0, L3), ==, L2);
+
+    hbitmap_free_meta(data->hb);
+}
+
 static void hbitmap_test_add(const char *testpath,
                                    void (*test_func)(TestHBitmapData *data, const void *user_data))
 {
@@ -920,6 +989,72 @@ static void test_hbitmap_next_x_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_x_check(data, 0);
 }
 
+static void test_hbitmap_next_x_accel(TestHBitmapData *data,
+                                      const void *unused)
+{
+    do {
+        test_hbitmap_next_x_do(data, 0);
+        hbitmap_test_teardown(data, NULL);
+
+        /* Long runs of equal words to exercise the vector loops */
+        hbitmap_test_init(data, L3, 0);
+        hbitmap_set(data->hb, 0, L3);
+        hbitmap_reset(data->hb, L3 - 3 * L1 + 17, 1);
+        test_hbitmap_next_x_check(data, 0);
+        test_hbitmap_next_x_check(data, L2 + 1);
+        test_hbitmap_next_x_check_range(data, 0, L3 - 3 * L1 + 17);
+
+        hbitmap_reset_all(data->hb);
+        hbitmap_set(data->hb, 30 * L1 + 9, 1);
+        test_hbitmap_next_x_check(data, 0);
+        test_hbitmap_next_x_check_range(data, 1, 30 * L1);
+        test_hbitmap_next_x_check_range(data, 5, 31 * L1);
+        test_hbitmap_next_x_check_range(data, L1, 20 * L1);
+        test_hbitmap_next_x_check_range(data, 30 * L1 + 10, L1);
+        hbitmap_test_teardown(data, NULL);
+    } while (test_hbitmap_next_accel());
+}
+
+static void test_hbitmap_next_dirty_extents(TestHBitmapData *data,
+                                            const void *unused)
+{
+    HBitmapExtent ext[4];
+    int n;
+
+    hbitmap_test_init(data, L3, 0);
+
+    n = hbitmap_next_dirty_extents(data->hb, 0, L3, L1, ext, 4);
+    g_assert_cmpint(n, ==, 0);
+
+    hbitmap_set(data->hb, L1, 10);
+    hbitmap_set(data->hb, L2, 3 * L1);
+    hbitmap_set(data->hb, L3 - 5, 5);
+
+    n = hbitmap_next_dirty_extents(data->hb, 0, L3, L1, ext, 2);
+    g_assert_cmpint(n, ==, 2);
+    g_assert_cmpint(ext[0].start, ==, L1);
+    g_assert_cmpint(ext[0].count, ==, 10);
+    g_assert_cmpint(ext[1].start, ==, L2);
+    g_assert_cmpint(ext[1].count, ==, L1);
+
+    n = hbitmap_next_dirty_extents(data->hb, L2 + L1, L3, L1, ext, 4);
+    g_assert_cmpint(n, ==, 3);
+    g_assert_cmpint(ext[0].start, ==, L2 + L1);
+    g_assert_cmpint(ext[0].count, ==, L1);
+    g_assert_cmpint(ext[1].start, ==, L2 + 2 * L1);
+    g_assert_cmpint(ext[1].count, ==, L1);
+    g_assert_cmpint(ext[2].start, ==, L3 - 5);
+    g_assert_cmpint(ext[2].count, ==, 5);
+
+    n = hbitmap_next_dirty_extents(data->hb, L1 + 5, L3 - 3, INT64_MAX,
+                                   ext, 4);
+    g_assert_cmpint(n, ==, 3);
+    g_assert_cmpint(ext[0].start, ==, L1 + 5);
+    g_assert_cmpint(ext[0].count, ==, 5);
+    g_assert_cmpint(ext[1].count, ==, 3 * L1);
+    g_assert_cmpint(ext[2].count, ==, 2);
+}
+
 static void test_hbitmap_next_dirty_area_check_limited(TestHBitmapData *data,
                                                        int64_t offset,
                                                        int64_t count,
@@ -1097,12 +1232,19 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/iter/iter_and_reset",
                      test_hbitmap_iter_and_reset);
 
+    hbitmap_test_add("/hbitmap/meta/set", test_hbitmap_meta_set);
+    hbitmap_test_add("/hbitmap/meta/reset", test_hbitmap_meta_reset);
+    hbitmap_test_add("/hbitmap/meta/deserialize",
+                     test_hbitmap_meta_deserialize);
+
     hbitmap_test_add("/hbitmap/next_zero/next_x_0",
                      test_hbitmap_next_x_0);
     hbitmap_test_add("/hbitmap/next_zero/next_x_4",
                      test_hbitmap_next_x_4);
     hbitmap_test_add("/hbitmap/next_zero/next_x_after_truncate",
                      test_hbitmap_next_x_after_truncate);
+    hbitmap_test_add("/hbitmap/next_zero/next_x_accel",
+                     test_hbitmap_next_x_accel);
 
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_0",
                      test_hbitmap_next_dirty_area_0);
@@ -1112,6 +1254,8 @@ int main(int argc, char **argv)
                      test_hbitmap_next_dirty_area_4);
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
+    hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_extents",
+                     test_hbitmap_next_dirty_extents);
 
     g_test_run();
 
@@ -734,6 +734,31 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_accounting_units(void)
+{
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_OPS_TOTAL].avg = 150;
+    cfg.buckets[THROTTLE_BPS_READ].avg = 150 * 512;
+
+    throttle_init(&ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+
+    /* several operations at once are accounted like separate ones */
+    throttle_account_units(&ts, THROTTLE_READ, 3, 3 * 512);
+    throttle_account(&ts, THROTTLE_READ, 512);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 4));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_READ].level, 4));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_TOTAL].level, 4 * 512));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_READ].level, 4 * 512));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_WRITE].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_WRITE].level, 0));
+
+    /* the ops bucket is full after 15 operations (avg / 10) */
+    g_assert(!throttle_would_wait(&ts, QEMU_CLOCK_VIRTUAL, THROTTLE_READ));
+    throttle_account_units(&ts, THROTTLE_READ, 12, 0);
+    g_assert(throttle_would_wait(&ts, QEMU_CLOCK_VIRTUAL, THROTTLE_READ));
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -829,6 +854,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/accounting_units",   test_accounting_units);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
@@ -3157,8 +3157,8 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     int has_dirty = 0;
     pixman_image_t *tmpbuf = NULL;
     unsigned long offset;
-    int x;
-    uint8_t *guest_ptr, *server_ptr;
+    int x, xmax = DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
+    uint8_t *guest_ptr, *server_ptr, *guest_row, *server_row;
 
     struct timeval tv = { 0, 0 };
 
@@ -3201,22 +3201,22 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         y = offset / VNC_DIRTY_BPL(&vd->guest);
         x = offset % VNC_DIRTY_BPL(&vd->guest);
 
-        server_ptr = server_row0 + y * server_stride + x * cmp_bytes;
+        server_row = server_row0 + y * server_stride;
 
         if (vd->guest.format != VNC_SERVER_FB_FORMAT) {
             qemu_pixman_linebuf_fill(tmpbuf, vd->guest.fb, width, 0, y);
-            guest_ptr = (uint8_t *)pixman_image_get_data(tmpbuf);
+            guest_row = (uint8_t *)pixman_image_get_data(tmpbuf);
         } else {
-            guest_ptr = guest_row0 + y * guest_stride;
+            guest_row = guest_row0 + y * guest_stride;
         }
-        guest_ptr += x * cmp_bytes;
 
-        for (; x < DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
-             x++, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
+        /* Only visit the dirty blocks, updates are usually sparse */
+        for (; x < xmax; x = find_next_bit(vd->guest.dirty[y], xmax, x + 1)) {
             int _cmp_bytes = cmp_bytes;
-            if (!test_and_clear_bit(x, vd->guest.dirty[y])) {
-                continue;
-            }
+
+            clear_bit(x, vd->guest.dirty[y]);
+            guest_ptr = guest_row + x * cmp_bytes;
+            server_ptr = server_row + x * cmp_bytes;
             if ((x + 1) * cmp_bytes > line_bytes) {
                 _cmp_bytes = line_bytes - x * cmp_bytes;
             }
@@ -29,7 +29,7 @@
 #define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
 
 static void adjust_polling_time(AioContext *ctx, AioPolledEvent *poll,
-                                int64_t block_ns);
+                                int64_t block_ns, int64_t now);
 
 bool aio_poll_disabled(AioContext *ctx)
 {
@@ -396,7 +396,7 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
  */
 static bool aio_dispatch_ready_handlers(AioContext *ctx,
                                         AioHandlerList *ready_list,
-                                        int64_t block_ns)
+                                        int64_t block_ns, int64_t now)
 {
     bool progress = false;
     AioHandler *node;
@@ -410,7 +410,8 @@ static bool aio_dispatch_ready_handlers(AioContext *ctx,
          * add the handler to ctx->poll_aio_handlers.
          */
         if (ctx->poll_max_ns && QLIST_IS_INSERTED(node, node_poll)) {
-            adjust_polling_time(ctx, &node->poll, block_ns);
+            adjust_polling_time(ctx, &node->poll, block_ns, now);
+            node->poll.last_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
         }
     }
 
@@ -444,6 +445,7 @@ void aio_dispatch(AioContext *ctx)
 static bool run_poll_handlers_once(AioContext *ctx,
                                    AioHandlerList *ready_list,
                                    int64_t now,
+                                   int64_t elapsed_time,
                                    int64_t *timeout)
 {
     bool progress = false;
@@ -451,6 +453,17 @@ static bool run_poll_handlers_once(AioContext *ctx,
     AioHandler *tmp;
 
     QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
+        /*
+         * Handlers whose events don't usually arrive this quickly are only
+         * polled until their own polling time has run out.  Their events are
+         * picked up when polling ends, so a quiet handler doesn't cost CPU
+         * time for the whole polling window of a busy one.  The notifier is
+         * always polled so that aio_notify() is not delayed.
+         */
+        if (elapsed_time > node->poll.ns && node->opaque != &ctx->notifier) {
+            continue;
+        }
+
         if (node->io_poll(node->opaque)) {
             aio_add_poll_ready_handler(ready_list, node);
 
@@ -536,7 +549,7 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
                               int64_t max_ns, int64_t *timeout)
 {
     bool progress;
-    int64_t start_time, elapsed_time;
+    int64_t start_time, elapsed_time = 0;
 
     assert(qemu_lockcnt_count(&ctx->list_lock) > 0);
 
@@ -554,8 +567,8 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
 
     start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     do {
-        progress = run_poll_handlers_once(ctx, ready_list,
-                                          start_time, timeout);
+        progress = run_poll_handlers_once(ctx, ready_list, start_time,
+                                          elapsed_time, timeout);
         elapsed_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_time;
         max_ns = qemu_soonest_timeout(*timeout, max_ns);
         assert(!(max_ns && progress));
@@ -618,9 +631,20 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
     return false;
 }
 
+/*
+ * @block_ns is how long aio_poll() waited for any event and @now is when the
+ * wait ended.  With several polled handlers, a busy one keeps @block_ns short
+ * for all of them, so the time since this handler's previous event is used
+ * instead when it is known.  That interval is what polling would have to
+ * cover to catch the event.
+ */
 static void adjust_polling_time(AioContext *ctx, AioPolledEvent *poll,
-                                int64_t block_ns)
+                                int64_t block_ns, int64_t now)
 {
+    if (poll->last_ns) {
+        block_ns = MAX(now - poll->last_ns, 0);
+    }
+
     if (block_ns <= poll->ns) {
         /* This is the sweet spot, no adjustment needed */
     } else if (block_ns > ctx->poll_max_ns) {
@@ -666,6 +690,10 @@ bool aio_poll(AioContext *ctx, bool blocking)
     int64_t timeout;
     int64_t start = 0;
     int64_t block_ns = 0;
+    int64_t now = 0;
+    int64_t wait_start;
+    int64_t dispatch_start;
+    int64_t dispatch_ns;
 
     /*
      * There cannot be two concurrent aio_poll calls for the same AioContext (or
@@ -689,6 +717,11 @@ bool aio_poll(AioContext *ctx, bool blocking)
     progress = try_poll_mode(ctx, &ready_list, &timeout);
     assert(!(timeout && progress));
 
+    stat64_add(&ctx->stat_polls, 1);
+    if (progress) {
+        stat64_add(&ctx->stat_poll_hits, 1);
+    }
+
     /*
      * aio_notify can avoid the expensive event_notifier_set if
      * everything (file descriptors, bottom halves, timers) will
@@ -727,7 +760,10 @@ bool aio_poll(AioContext *ctx, bool blocking)
             progress = true;
         }
 
+        wait_start = get_clock();
         ctx->fdmon_ops->wait(ctx, &ready_list, timeout);
+        stat64_add(&ctx->stat_waits, 1);
+        stat64_add(&ctx->stat_wait_ns, get_clock() - wait_start);
     }
 
     if (use_notify_me) {
@@ -740,11 +776,13 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
     /* Calculate blocked time for adaptive polling */
     if (ctx->poll_max_ns) {
-        block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+        now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        block_ns = now - start;
     }
 
+    dispatch_start = ctx->poll_max_ns ? now : get_clock();
     progress |= aio_bh_poll(ctx);
-    progress |= aio_dispatch_ready_handlers(ctx, &ready_list, block_ns);
+    progress |= aio_dispatch_ready_handlers(ctx, &ready_list, block_ns, now);
 
     aio_free_deleted_handlers(ctx);
 
@@ -752,6 +790,10 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
     progress |= timerlistgroup_run_timers(&ctx->tlg);
 
+    dispatch_ns = get_clock() - dispatch_start;
+    stat64_add(&ctx->stat_dispatch_ns, dispatch_ns);
+    stat64_max(&ctx->stat_dispatch_max_ns, dispatch_ns);
+
     return progress;
 }
 
@@ -795,6 +837,7 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     qemu_lockcnt_inc(&ctx->list_lock);
     QLIST_FOREACH(node, &ctx->aio_handlers, node) {
         node->poll.ns = 0;
+        node->poll.last_ns = 0;
     }
     qemu_lockcnt_dec(&ctx->list_lock);
 
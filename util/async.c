@@ -217,6 +217,7 @@ int aio_bh_poll(AioContext *ctx)
                 ret = 1;
             }
             aio_bh_call(bh);
+            stat64_add(&ctx->stat_bhs, 1);
         }
         if (flags & (BH_DELETED | BH_ONESHOT)) {
             g_free(bh);
@@ -320,6 +321,16 @@ aio_ctx_prepare(GSource *source, gint    *timeout)
         *timeout = 0;
     }
 
+    /*
+     * Don't block if aio_notify() was called.  glib skips aio_ctx_check()
+     * for a source that is ready after prepare, so accept the notification
+     * here; otherwise ctx->notified would stay set and swallow later calls.
+     */
+    if (qatomic_read(&ctx->notified)) {
+        aio_notify_accept(ctx);
+        *timeout = 0;
+    }
+
     return *timeout == 0;
 }
 
@@ -385,6 +396,11 @@ aio_ctx_finalize(GSource     *source)
         luring_cleanup(ctx->linux_io_uring);
         ctx->linux_io_uring = NULL;
     }
+    if (ctx->linux_io_uring_cmd) {
+        luring_detach_aio_context(ctx->linux_io_uring_cmd, ctx);
+        luring_cleanup(ctx->linux_io_uring_cmd);
+        ctx->linux_io_uring_cmd = NULL;
+    }
 #endif
 
     assert(QSLIST_EMPTY(&ctx->scheduled_coroutines));
@@ -469,7 +485,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(false, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -483,6 +499,27 @@ LuringState *aio_get_linux_io_uring(AioContext *ctx)
     assert(ctx->linux_io_uring);
     return ctx->linux_io_uring;
 }
+
+LuringState *aio_setup_linux_io_uring_cmd(AioContext *ctx, Error **errp)
+{
+    if (ctx->linux_io_uring_cmd) {
+        return ctx->linux_io_uring_cmd;
+    }
+
+    ctx->linux_io_uring_cmd = luring_init(true, errp);
+    if (!ctx->linux_io_uring_cmd) {
+        return NULL;
+    }
+
+    luring_attach_aio_context(ctx->linux_io_uring_cmd, ctx);
+    return ctx->linux_io_uring_cmd;
+}
+
+LuringState *aio_get_linux_io_uring_cmd(AioContext *ctx)
+{
+    assert(ctx->linux_io_uring_cmd);
+    return ctx->linux_io_uring_cmd;
+}
 #endif
 
 void aio_notify(AioContext *ctx)
@@ -491,14 +528,24 @@ void aio_notify(AioContext *ctx)
      * Write e.g. ctx->bh_list before writing ctx->notified.  Pairs with
      * smp_mb() in aio_notify_accept().
      */
-    smp_wmb();
-    qatomic_set(&ctx->notified, true);
+    smp_mb__before_rmw();
+
+    /*
+     * If ctx->notified was already set, the event loop has not gone
+     * through aio_notify_accept() yet and will look at ctx->notified
+     * before it blocks again, so the earlier notification covers this
+     * one too.  This avoids an event_notifier_set() per call when many
+     * threads schedule work on the same AioContext.
+     */
+    if (qatomic_xchg(&ctx->notified, true)) {
+        return;
+    }
 
     /*
      * Write ctx->notified (and also ctx->bh_list) before reading ctx->notify_me.
      * Pairs with smp_mb() in aio_ctx_prepare or aio_poll.
      */
-    smp_mb();
+    smp_mb__after_rmw();
     if (qatomic_read(&ctx->notify_me)) {
         event_notifier_set(&ctx->notifier);
     }
@@ -603,6 +650,7 @@ AioContext *aio_context_new(Error **errp)
 
 #ifdef CONFIG_LINUX_IO_URING
     ctx->linux_io_uring = NULL;
+    ctx->linux_io_uring_cmd = NULL;
 #endif
 
     ctx->thread_pool = NULL;
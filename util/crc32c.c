@@ -27,6 +27,8 @@
 
 #include "qemu/osdep.h"
 #include "qemu/crc32c.h"
+#include "qemu/bswap.h"
+#include "host/cpuinfo.h"
 
 /*
  * This is the CRC-32C table
@@ -105,12 +107,30 @@ static const uint32_t crc32c_table[256] = {
 };
 
 
-uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *data,
+                               unsigned int length);
+
+static uint32_t crc32c_int(uint32_t crc, const uint8_t *data,
+                           unsigned int length)
 {
     while (length--) {
         crc = crc32c_table[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
     }
-    return crc^0xffffffff;
+    return crc;
+}
+
+#include "host/crc32c.c.inc"
+
+static crc32c_fn crc32c_accel;
+
+static void __attribute__((constructor)) crc32c_init(void)
+{
+    crc32c_accel = crc32c_best();
+}
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    return crc32c_accel(crc, data, length) ^ 0xffffffff;
 }
 
 uint32_t iov_crc32c(uint32_t crc, const struct iovec *iov, size_t iov_cnt)
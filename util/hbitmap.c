@@ -12,6 +12,7 @@
 #include "qemu/osdep.h"
 #include "qemu/hbitmap.h"
 #include "qemu/host-utils.h"
+#include "host/cpuinfo.h"
 #include "trace.h"
 #include "crypto/hash.h"
 
@@ -101,6 +102,48 @@ struct HBitmap {
     uint64_t sizes[HBITMAP_LEVELS];
 };
 
+/*
+ * Return the index of the first word in @words[@pos, @end) that is not
+ * equal to @skip, or @end if there is none.  @skip is 0 or ~0UL.
+ */
+typedef size_t (*hb_scan_fn)(const unsigned long *words, size_t pos,
+                             size_t end, unsigned long skip);
+
+static size_t hb_scan_int(const unsigned long *words, size_t pos, size_t end,
+                          unsigned long skip)
+{
+    while (pos < end && words[pos] == skip) {
+        pos++;
+    }
+    return pos;
+}
+
+#include "host/hbitmap-scan.c.inc"
+
+static hb_scan_fn hb_scan;
+static unsigned hb_scan_index;
+
+bool test_hbitmap_next_accel(void)
+{
+    if (hb_scan_index != 0) {
+        hb_scan = hb_scan_table[--hb_scan_index];
+        return true;
+    }
+    return false;
+}
+
+static void __attribute__((constructor)) hb_scan_init(void)
+{
+    hb_scan_index = hb_scan_best();
+    hb_scan = hb_scan_table[hb_scan_index];
+}
+
+/*
+ * Ranges of at most this many words of the last level are searched for
+ * dirty bits with a linear scan instead of walking the upper levels.
+ */
+#define HBITMAP_SCAN_DIRECT_WORDS 32
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -195,9 +238,12 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
 
 int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
 {
+    const unsigned long *last_lev = hb->levels[HBITMAP_LEVELS - 1];
     HBitmapIter hbi;
     int64_t first_dirty_off;
-    uint64_t end;
+    uint64_t end, first_bit, end_bit;
+    size_t pos, end_pos;
+    unsigned long cur;
 
     assert(start >= 0 && count >= 0);
 
@@ -207,8 +253,31 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
 
     end = count > hb->orig_size - start ? hb->orig_size : start + count;
 
-    hbitmap_iter_init(&hbi, hb, start);
-    first_dirty_off = hbitmap_iter_next(&hbi);
+    /*
+     * Callers often step through dense bitmaps or look at small ranges, so
+     * try the last level directly before setting up an iterator.
+     */
+    first_bit = start >> hb->granularity;
+    end_bit = ((end - 1) >> hb->granularity) + 1;
+    pos = first_bit >> BITS_PER_LEVEL;
+    end_pos = (end_bit + BITS_PER_LONG - 1) >> BITS_PER_LEVEL;
+
+    cur = last_lev[pos] & ~((1UL << (first_bit & (BITS_PER_LONG - 1))) - 1);
+    if (!cur && end_pos - pos <= HBITMAP_SCAN_DIRECT_WORDS) {
+        pos = hb_scan(last_lev, pos + 1, end_pos, 0);
+        if (pos == end_pos) {
+            return -1;
+        }
+        cur = last_lev[pos];
+    }
+
+    if (cur) {
+        first_dirty_off = ((uint64_t)pos << BITS_PER_LEVEL) + ctzl(cur);
+        first_dirty_off <<= hb->granularity;
+    } else {
+        hbitmap_iter_init(&hbi, hb, start);
+        first_dirty_off = hbitmap_iter_next(&hbi);
+    }
 
     if (first_dirty_off < 0 || first_dirty_off >= end) {
         return -1;
@@ -245,10 +314,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hb_scan(last_lev, pos + 1, sz, (unsigned long)-1);
         if (pos >= sz) {
             return -1;
         }
@@ -301,6 +367,25 @@ bool hbitmap_next_dirty_area(const HBitmap *hb, int64_t start, int64_t end,
     return true;
 }
 
+int hbitmap_next_dirty_extents(const HBitmap *hb, int64_t start, int64_t end,
+                               int64_t max_dirty_count,
+                               HBitmapExtent *extents, int nb_extents)
+{
+    int n = 0;
+
+    assert(nb_extents > 0);
+
+    while (n < nb_extents &&
+           hbitmap_next_dirty_area(hb, start, end, max_dirty_count,
+                                   &extents[n].start, &extents[n].count))
+    {
+        start = extents[n].start + extents[n].count;
+        n++;
+    }
+
+    return n;
+}
+
 bool hbitmap_status(const HBitmap *hb, int64_t start, int64_t count,
                     int64_t *pnum)
 {
@@ -464,7 +549,7 @@ static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
 void hbitmap_set(HBitmap *hb, uint64_t start, uint64_t count)
 {
     /* Compute range in the last layer.  */
-    uint64_t first, n;
+    uint64_t first, n, changed;
     uint64_t last = start + count - 1;
 
     if (count == 0) {
@@ -479,9 +564,14 @@ void hbitmap_set(HBitmap *hb, uint64_t start, uint64_t count)
     assert(last < hb->size);
     n = last - first + 1;
 
-    hb->count += n - hb_count_between(hb, first, last);
-    if (hb_set_between(hb, HBITMAP_LEVELS - 1, first, last) &&
-        hb->meta) {
+    /*
+     * The return value of hb_set_between() only says whether a word went
+     * from zero to non-zero, which is not enough for the meta bitmap.
+     */
+    changed = n - hb_count_between(hb, first, last);
+    hb->count += changed;
+    hb_set_between(hb, HBITMAP_LEVELS - 1, first, last);
+    if (changed && hb->meta) {
         hbitmap_set(hb->meta, start, count);
     }
 }
@@ -558,7 +648,7 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
 void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
 {
     /* Compute range in the last layer.  */
-    uint64_t first;
+    uint64_t first, changed;
     uint64_t last = start + count - 1;
     uint64_t gran = 1ULL << hb->granularity;
 
@@ -576,9 +666,10 @@ void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
     last >>= hb->granularity;
     assert(last < hb->size);
 
-    hb->count -= hb_count_between(hb, first, last);
-    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last) &&
-        hb->meta) {
+    changed = hb_count_between(hb, first, last);
+    hb->count -= changed;
+    hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last);
+    if (changed && hb->meta) {
         hbitmap_set(hb->meta, start, count);
     }
 }
@@ -593,6 +684,9 @@ void hbitmap_reset_all(HBitmap *hb)
     }
 
     hb->levels[0][0] = 1UL << (BITS_PER_LONG - 1);
+    if (hb->count && hb->meta) {
+        hbitmap_set(hb->meta, 0, hb->orig_size);
+    }
     hb->count = 0;
 }
 
@@ -704,6 +798,9 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     }
     serialization_chunk(hb, start, count, &cur, &el_count);
     end = cur + el_count;
+    if (hb->meta) {
+        hbitmap_set(hb->meta, start, MIN(count, hb->orig_size - start));
+    }
 
     while (cur != end) {
         memcpy(cur, buf, sizeof(*cur));
@@ -732,6 +829,9 @@ void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
+    if (hb->meta) {
+        hbitmap_set(hb->meta, start, MIN(count, hb->orig_size - start));
+    }
 
     memset(first, 0, el_count * sizeof(unsigned long));
     if (finish) {
@@ -749,6 +849,9 @@ void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
+    if (hb->meta) {
+        hbitmap_set(hb->meta, start, MIN(count, hb->orig_size - start));
+    }
 
     memset(first, 0xff, el_count * sizeof(unsigned long));
     if (finish) {
@@ -791,6 +894,27 @@ void hbitmap_free(HBitmap *hb)
     g_free(hb);
 }
 
+HBitmap *hbitmap_create_meta(HBitmap *hb, int chunk_size)
+{
+    assert(!(chunk_size & (chunk_size - 1)));
+    assert(!hb->meta);
+    hb->meta = hbitmap_alloc(hb->orig_size,
+                             hb->granularity + ctz32(chunk_size));
+    return hb->meta;
+}
+
+HBitmap *hbitmap_meta(const HBitmap *hb)
+{
+    return hb->meta;
+}
+
+void hbitmap_free_meta(HBitmap *hb)
+{
+    assert(hb->meta);
+    hbitmap_free(hb->meta);
+    hb->meta = NULL;
+}
+
 HBitmap *hbitmap_alloc(uint64_t size, int granularity)
 {
     HBitmap *hb = g_new0(struct HBitmap, 1);
@@ -837,6 +961,9 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
 
     /* bit sizes are identical; nothing to do. */
     if (size == hb->size) {
+        if (hb->meta) {
+            hbitmap_truncate(hb->meta, hb->orig_size);
+        }
         return;
     }
 
@@ -869,7 +996,7 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
         }
     }
     if (hb->meta) {
-        hbitmap_truncate(hb->meta, hb->size << hb->granularity);
+        hbitmap_truncate(hb->meta, hb->orig_size);
     }
 }
 
@@ -942,6 +1069,11 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
 
     /* Recompute the dirty count */
     result->count = hb_count_between(result, 0, result->size - 1);
+
+    /* Not worth finding out which words changed, just mark everything */
+    if (result->meta) {
+        hbitmap_set(result->meta, 0, result->orig_size);
+    }
 }
 
 char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)
@@ -42,6 +42,7 @@
 #include "qemu/cutils.h"
 #include "qemu/units.h"
 #include "qemu/thread-context.h"
+#include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
 
 #ifdef CONFIG_LINUX
@@ -434,11 +435,22 @@ static void *do_madv_populate_write_pages(void *arg)
 }
 
 static inline int get_memset_num_threads(size_t hpagesize, size_t numpages,
-                                         int max_threads)
+                                         int max_threads, ThreadContext *tc)
 {
     long host_procs = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long *bitmap, nbits;
     int ret = 1;
 
+    /*
+     * Threads created through a context inherit its affinity, usually the
+     * CPUs of the NUMA node the memory is bound to.  More threads than
+     * those CPUs would only compete for them.
+     */
+    if (tc && !qemu_thread_get_affinity(&tc->thread, &bitmap, &nbits)) {
+        host_procs = MIN(host_procs, (long)bitmap_count_one(bitmap, nbits));
+        g_free(bitmap);
+    }
+
     if (host_procs > 0) {
         ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT), max_threads);
     }
@@ -488,7 +500,7 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
     }
 
     context->num_threads =
-        get_memset_num_threads(hpagesize, numpages, max_threads);
+        get_memset_num_threads(hpagesize, numpages, max_threads, tc);
 
     if (g_once_init_enter(&initialized)) {
         qemu_mutex_init(&page_mutex);
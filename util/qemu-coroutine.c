@@ -44,6 +44,9 @@ enum {
  * .-------------------.
  * | Batch 1 | Batch 2 | per-thread local_pool (maximum 2 batches)
  * `-------------------'
+ *
+ * There is one such set of pools for every CoroutineStackClass.  The maximum
+ * size of the global pool applies to the sum of all classes.
  */
 typedef struct CoroutinePoolBatch {
     /* Batches are kept in a list */
@@ -56,15 +59,24 @@ typedef struct CoroutinePoolBatch {
 
 typedef QSLIST_HEAD(, CoroutinePoolBatch) CoroutinePool;
 
+typedef struct CoroutineLocalPools {
+    CoroutinePool pool[COROUTINE_STACK__MAX];
+} CoroutineLocalPools;
+
+static const size_t coroutine_stack_sizes[COROUTINE_STACK__MAX] = {
+    [COROUTINE_STACK_DEFAULT] = COROUTINE_STACK_SIZE,
+    [COROUTINE_STACK_SMALL] = COROUTINE_STACK_SIZE_SMALL,
+};
+
 /* Host operating system limit on number of pooled coroutines */
 static unsigned int global_pool_hard_max_size;
 
 static QemuMutex global_pool_lock; /* protects the following variables */
-static CoroutinePool global_pool = QSLIST_HEAD_INITIALIZER(global_pool);
+static CoroutinePool global_pool[COROUTINE_STACK__MAX];
 static unsigned int global_pool_size;
 static unsigned int global_pool_max_size = COROUTINE_POOL_BATCH_MAX_SIZE;
 
-QEMU_DEFINE_STATIC_CO_TLS(CoroutinePool, local_pool);
+QEMU_DEFINE_STATIC_CO_TLS(CoroutineLocalPools, local_pools);
 QEMU_DEFINE_STATIC_CO_TLS(Notifier, local_pool_cleanup_notifier);
 
 static CoroutinePoolBatch *coroutine_pool_batch_new(void)
@@ -88,15 +100,24 @@ static void coroutine_pool_batch_delete(CoroutinePoolBatch *batch)
     g_free(batch);
 }
 
+static CoroutinePool *get_local_pool(CoroutineStackClass stack_class)
+{
+    return &get_ptr_local_pools()->pool[stack_class];
+}
+
 static void local_pool_cleanup(Notifier *n, void *value)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
-    CoroutinePoolBatch *batch;
-    CoroutinePoolBatch *tmp;
+    CoroutineStackClass stack_class;
 
-    QSLIST_FOREACH_SAFE(batch, local_pool, next, tmp) {
-        QSLIST_REMOVE_HEAD(local_pool, next);
-        coroutine_pool_batch_delete(batch);
+    for (stack_class = 0; stack_class < COROUTINE_STACK__MAX; stack_class++) {
+        CoroutinePool *local_pool = get_local_pool(stack_class);
+        CoroutinePoolBatch *batch;
+        CoroutinePoolBatch *tmp;
+
+        QSLIST_FOREACH_SAFE(batch, local_pool, next, tmp) {
+            QSLIST_REMOVE_HEAD(local_pool, next);
+            coroutine_pool_batch_delete(batch);
+        }
     }
 }
 
@@ -111,9 +132,9 @@ static void local_pool_cleanup_init_once(void)
 }
 
 /* Helper to get the next unused coroutine from the local pool */
-static Coroutine *coroutine_pool_get_local(void)
+static Coroutine *coroutine_pool_get_local(CoroutineStackClass stack_class)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutinePool *local_pool = get_local_pool(stack_class);
     CoroutinePoolBatch *batch = QSLIST_FIRST(local_pool);
     Coroutine *co;
 
@@ -133,16 +154,16 @@ static Coroutine *coroutine_pool_get_local(void)
 }
 
 /* Get the next batch from the global pool */
-static void coroutine_pool_refill_local(void)
+static void coroutine_pool_refill_local(CoroutineStackClass stack_class)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutinePool *local_pool = get_local_pool(stack_class);
     CoroutinePoolBatch *batch = NULL;
 
     WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
-        batch = QSLIST_FIRST(&global_pool);
+        batch = QSLIST_FIRST(&global_pool[stack_class]);
 
         if (batch) {
-            QSLIST_REMOVE_HEAD(&global_pool, next);
+            QSLIST_REMOVE_HEAD(&global_pool[stack_class], next);
             global_pool_size -= batch->size;
         }
     }
@@ -154,14 +175,15 @@ static void coroutine_pool_refill_local(void)
 }
 
 /* Add a batch of coroutines to the global pool */
-static void coroutine_pool_put_global(CoroutinePoolBatch *batch)
+static void coroutine_pool_put_global(CoroutineStackClass stack_class,
+                                      CoroutinePoolBatch *batch)
 {
     WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
         unsigned int max = MIN(global_pool_max_size,
                                global_pool_hard_max_size);
 
         if (global_pool_size < max) {
-            QSLIST_INSERT_HEAD(&global_pool, batch, next);
+            QSLIST_INSERT_HEAD(&global_pool[stack_class], batch, next);
 
             /* Overshooting the max pool size is allowed */
             global_pool_size += batch->size;
@@ -174,21 +196,21 @@ static void coroutine_pool_put_global(CoroutinePoolBatch *batch)
 }
 
 /* Get the next unused coroutine from the pool or return NULL */
-static Coroutine *coroutine_pool_get(void)
+static Coroutine *coroutine_pool_get(CoroutineStackClass stack_class)
 {
     Coroutine *co;
 
-    co = coroutine_pool_get_local();
+    co = coroutine_pool_get_local(stack_class);
     if (!co) {
-        coroutine_pool_refill_local();
-        co = coroutine_pool_get_local();
+        coroutine_pool_refill_local(stack_class);
+        co = coroutine_pool_get_local(stack_class);
     }
     return co;
 }
 
 static void coroutine_pool_put(Coroutine *co)
 {
-    CoroutinePool *local_pool = get_ptr_local_pool();
+    CoroutinePool *local_pool = get_local_pool(co->stack_class);
     CoroutinePoolBatch *batch = QSLIST_FIRST(local_pool);
 
     if (unlikely(!batch)) {
@@ -203,7 +225,7 @@ static void coroutine_pool_put(Coroutine *co)
         /* Is the local pool full? */
         if (next) {
             QSLIST_REMOVE_HEAD(local_pool, next);
-            coroutine_pool_put_global(batch);
+            coroutine_pool_put_global(co->stack_class, batch);
         }
 
         batch = coroutine_pool_batch_new();
@@ -214,16 +236,18 @@ static void coroutine_pool_put(Coroutine *co)
     batch->size++;
 }
 
-Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
+static Coroutine *coroutine_create(CoroutineStackClass stack_class,
+                                   CoroutineEntry *entry, void *opaque)
 {
     Coroutine *co = NULL;
 
     if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
-        co = coroutine_pool_get();
+        co = coroutine_pool_get(stack_class);
     }
 
     if (!co) {
-        co = qemu_coroutine_new();
+        co = qemu_coroutine_new(coroutine_stack_sizes[stack_class]);
+        co->stack_class = stack_class;
     }
 
     co->entry = entry;
@@ -232,6 +256,24 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     return co;
 }
 
+Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
+{
+    return coroutine_create(COROUTINE_STACK_DEFAULT, entry, opaque);
+}
+
+Coroutine *qemu_coroutine_create_small(CoroutineEntry *entry, void *opaque)
+{
+    /*
+     * Sanitizers and SafeStack keep extra state on the stack, so do not
+     * second-guess their needs.
+     */
+#if defined(QEMU_SANITIZE_ADDRESS) || defined(CONFIG_SAFESTACK)
+    return coroutine_create(COROUTINE_STACK_DEFAULT, entry, opaque);
+#else
+    return coroutine_create(COROUTINE_STACK_SMALL, entry, opaque);
+#endif
+}
+
 static void coroutine_delete(Coroutine *co)
 {
     co->caller = NULL;
@@ -396,6 +438,11 @@ static unsigned int get_global_pool_hard_max_size(void)
 
 static void __attribute__((constructor)) qemu_coroutine_init(void)
 {
+    CoroutineStackClass stack_class;
+
     qemu_mutex_init(&global_pool_lock);
+    for (stack_class = 0; stack_class < COROUTINE_STACK__MAX; stack_class++) {
+        QSLIST_INIT(&global_pool[stack_class]);
+    }
     global_pool_hard_max_size = get_global_pool_hard_max_size();
 }
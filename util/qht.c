@@ -22,8 +22,8 @@
  * - Writes (i.e. insertions/removals) can be concurrent with writes to
  *   different buckets; writes to the same bucket are serialized through a lock.
  * - Optional auto-resizing: the hash table resizes up if the load surpasses
- *   a certain threshold. Resizing is done concurrently with readers; writes
- *   are serialized with the resize operation.
+ *   a certain threshold. Resizing is done concurrently with readers and
+ *   writers; a writer only waits for the bucket it needs to be moved.
  *
  * The key structure is the bucket, which is cacheline-sized. Buckets
  * contain a few hash values and pointers; the u32 hash values are stored in
@@ -43,14 +43,15 @@
  * just-removed entry. This makes lookups slightly faster, since the moment an
  * invalid entry is found, the (failed) lookup is over.
  *
- * Resizing is done by taking all bucket spinlocks (so that no other writers can
- * race with us) and then copying all entries into a new hash map. Then, the
- * ht->map pointer is set, and the old map is freed once no RCU readers can see
- * it anymore.
+ * Resizing moves the entries of one head bucket at a time into a new hash
+ * map, with that bucket's spinlock held. The old map points to the new one,
+ * and tracks how many of its buckets have been moved; readers and writers
+ * that find their bucket moved continue in the new map. Once all buckets are
+ * moved, the ht->map pointer is set, and the old map is freed once no RCU
+ * readers can see it anymore.
  *
- * Writers check for concurrent resizes by comparing ht->map before and after
- * acquiring their bucket lock. If they don't match, a resize has occurred
- * while the bucket spinlock was being acquired.
+ * Resets, iterations and resizes that also reset take all bucket spinlocks
+ * of the current map, and are serialized with each other through ht->lock.
  *
  * Related Work:
  * - Idea of cacheline-sized buckets with full hashes taken from:
@@ -176,6 +177,10 @@ struct qht_tsan_lock {
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @next: map that a resize moves the entries to, or NULL.
+ * @n_migrated: number of head buckets, starting from the first one, whose
+ *              entries have been moved to @next. Only grows, and only with
+ *              the lock of the bucket that was moved held.
  * @tsan_bucket_locks: Array of striped locks to be used only under TSAN.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
@@ -186,6 +191,8 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_map *next;
+    size_t n_migrated;
 #ifdef CONFIG_TSAN
     struct qht_tsan_lock tsan_bucket_locks[QHT_TSAN_BUCKET_LOCKS];
 #endif
@@ -194,6 +201,7 @@ struct qht_map {
 /* trigger a resize when n_added_buckets > n_buckets / div */
 #define QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV 8
 
+static void qht_do_resize(struct qht *ht, struct qht_map *new);
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
@@ -332,17 +340,17 @@ static void qht_map_unlock_buckets(struct qht_map *map)
 }
 
 /*
- * Call with at least a bucket lock held.
- * @map should be the value read before acquiring the lock (or locks).
+ * Whether the entries of head bucket @b have been moved to @map->next.
+ * Stable while @b's lock is held; readers check it within @b's seqlock.
  */
-static inline bool qht_map_is_stale__locked(const struct qht *ht,
-                                            const struct qht_map *map)
+static inline bool qht_bucket_is_migrated(const struct qht_map *map,
+                                          const struct qht_bucket *b)
 {
-    return map != ht->map;
+    return qatomic_load_acquire(&map->n_migrated) > (size_t)(b - map->buckets);
 }
 
 /*
- * Grab all bucket locks, and set @pmap after making sure the map isn't stale.
+ * Grab all bucket locks, and set @pmap to the current map.
  *
  * Pairs with qht_map_unlock_buckets(), hence the pass-by-reference.
  *
@@ -353,15 +361,7 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
 {
     struct qht_map *map;
 
-    map = qatomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
-    if (likely(!qht_map_is_stale__locked(ht, map))) {
-        *pmap = map;
-        return;
-    }
-    qht_map_unlock_buckets(map);
-
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
+    /* wait for any resize in progress, which holds ht->lock until done */
     qht_lock(ht);
     map = ht->map;
     qht_map_lock_buckets(map);
@@ -370,12 +370,11 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
 }
 
 /*
- * Get a head bucket and lock it, making sure its parent map is not stale.
+ * Get a head bucket and lock it, making sure its entries have not been
+ * moved to another map.
  * @pmap is filled with a pointer to the bucket's parent map.
  *
  * Unlock with qht_bucket_unlock.
- *
- * Note: callers cannot have ht->lock held.
  */
 static inline
 struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
@@ -385,21 +384,17 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     struct qht_map *map;
 
     map = qatomic_rcu_read(&ht->map);
-    b = qht_map_to_bucket(map, hash);
+    for (;;) {
+        b = qht_map_to_bucket(map, hash);
+        qht_bucket_lock(map, b);
+        if (likely(!qht_bucket_is_migrated(map, b))) {
+            break;
+        }
+        qht_bucket_unlock(map, b);
 
-    qht_bucket_lock(map, b);
-    if (likely(!qht_map_is_stale__locked(ht, map))) {
-        *pmap = map;
-        return b;
+        /* we raced with a resize; continue in the map it moves to */
+        map = qatomic_rcu_read(&map->next);
     }
-    qht_bucket_unlock(map, b);
-
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
-    qht_lock(ht);
-    map = ht->map;
-    b = qht_map_to_bucket(map, hash);
-    qht_bucket_lock(map, b);
-    qht_unlock(ht);
     *pmap = map;
     return b;
 }
@@ -443,6 +438,8 @@ static struct qht_map *qht_map_create(size_t n_buckets)
 
     map = g_malloc(sizeof(*map));
     map->n_buckets = n_buckets;
+    map->next = NULL;
+    map->n_migrated = 0;
 
     map->n_added_buckets = 0;
     map->n_added_buckets_threshold = n_buckets /
@@ -522,11 +519,6 @@ void qht_reset(struct qht *ht)
     qht_map_unlock_buckets(map);
 }
 
-static inline void qht_do_resize(struct qht *ht, struct qht_map *new)
-{
-    qht_do_resize_reset(ht, new, false);
-}
-
 static inline void qht_do_resize_and_reset(struct qht *ht, struct qht_map *new)
 {
     qht_do_resize_reset(ht, new, true);
@@ -579,17 +571,25 @@ void *qht_do_lookup(const struct qht_bucket *head, qht_lookup_func_t func,
 }
 
 static __attribute__((noinline))
-void *qht_lookup__slowpath(const struct qht_bucket *b, qht_lookup_func_t func,
+void *qht_lookup__slowpath(const struct qht_map *map, qht_lookup_func_t func,
                            const void *userp, uint32_t hash)
 {
+    const struct qht_bucket *b;
     unsigned int version;
     void *ret;
 
-    do {
+    for (;;) {
+        b = qht_map_to_bucket(map, hash);
         version = seqlock_read_begin(&b->sequence);
+        if (qht_bucket_is_migrated(map, b)) {
+            map = qatomic_rcu_read(&map->next);
+            continue;
+        }
         ret = qht_do_lookup(b, func, userp, hash);
-    } while (seqlock_read_retry(&b->sequence, version));
-    return ret;
+        if (!seqlock_read_retry(&b->sequence, version)) {
+            return ret;
+        }
+    }
 }
 
 void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
@@ -604,15 +604,17 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
-    ret = qht_do_lookup(b, func, userp, hash);
-    if (likely(!seqlock_read_retry(&b->sequence, version))) {
-        return ret;
+    if (likely(!qht_bucket_is_migrated(map, b))) {
+        ret = qht_do_lookup(b, func, userp, hash);
+        if (likely(!seqlock_read_retry(&b->sequence, version))) {
+            return ret;
+        }
     }
     /*
      * Removing the do/while from the fastpath gives a 4% perf. increase when
      * running a 100%-lookup microbenchmark.
      */
-    return qht_lookup__slowpath(b, func, userp, hash);
+    return qht_lookup__slowpath(map, func, userp, hash);
 }
 
 void *qht_lookup(const struct qht *ht, const void *userp, uint32_t hash)
@@ -871,8 +873,7 @@ do_qht_iter(struct qht *ht, const struct qht_iter *iter, void *userp)
 {
     struct qht_map *map;
 
-    map = qatomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
+    qht_map_lock_buckets__no_stale(ht, &map);
     qht_map_iter__all_locked(map, iter, userp);
     qht_map_unlock_buckets(map);
 }
@@ -913,6 +914,65 @@ static void qht_map_copy(void *p, uint32_t hash, void *userp)
     qht_insert__locked(ht, new, b, p, hash, NULL);
 }
 
+/*
+ * Move the entries of @head, a head bucket of @old, to @new.
+ * Call with @head's lock held.
+ */
+static void qht_bucket_migrate__locked(struct qht *ht, struct qht_map *old,
+                                       struct qht_bucket *head,
+                                       struct qht_map *new)
+{
+    struct qht_bucket *b = head;
+    int i;
+
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            struct qht_bucket *nb;
+
+            if (b->pointers[i] == NULL) {
+                break;
+            }
+            /* @new is visible to writers whose buckets were moved before */
+            nb = qht_map_to_bucket(new, b->hashes[i]);
+            qht_bucket_lock(new, nb);
+            qht_insert__locked(ht, new, nb, b->pointers[i], b->hashes[i],
+                               NULL);
+            qht_bucket_unlock(new, nb);
+        }
+        b = b->next;
+    } while (b);
+
+    /* pairs with qht_bucket_is_migrated() */
+    seqlock_write_begin(&head->sequence);
+    qatomic_store_release(&old->n_migrated, head - old->buckets + 1);
+    seqlock_write_end(&head->sequence);
+}
+
+/*
+ * Resize one head bucket at a time, so that writers only ever wait for the
+ * bucket they need, and then only while its entries are being moved.
+ * Call with ht->lock held.
+ */
+static void qht_do_resize(struct qht *ht, struct qht_map *new)
+{
+    struct qht_map *old = ht->map;
+    size_t i;
+
+    g_assert(new->n_buckets != old->n_buckets);
+    qatomic_rcu_set(&old->next, new);
+
+    for (i = 0; i < old->n_buckets; i++) {
+        struct qht_bucket *head = &old->buckets[i];
+
+        qht_bucket_lock(old, head);
+        qht_bucket_migrate__locked(ht, old, head, new);
+        qht_bucket_unlock(old, head);
+    }
+
+    qatomic_rcu_set(&ht->map, new);
+    call_rcu(old, qht_map_destroy, rcu);
+}
+
 /*
  * Atomically perform a resize and/or reset.
  * Call with ht->lock held.
@@ -944,6 +1004,9 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
     qht_map_iter__all_locked(old, &iter, &data);
     qht_map_debug__all_locked(new);
 
+    /* let writers waiting for the old buckets continue in @new */
+    qatomic_rcu_set(&old->next, new);
+    qatomic_store_release(&old->n_migrated, old->n_buckets);
     qatomic_rcu_set(&ht->map, new);
     qht_map_unlock_buckets(old);
     call_rcu(old, qht_map_destroy, rcu);
@@ -40,8 +40,8 @@ struct ThreadPoolElementAio {
     void *arg;
 
     /* Moving state out of THREAD_QUEUED is protected by lock.  After
-     * that, only the worker thread can write to it.  Reads and writes
-     * of state and ret are ordered with memory barriers.
+     * that, only the worker thread can write to it.  ret is published
+     * to the completion BH by thread_pool_push_done().
      */
     enum ThreadState state;
     int ret;
@@ -51,6 +51,12 @@ struct ThreadPoolElementAio {
 
     /* This list is only written by the thread pool's mother thread.  */
     QLIST_ENTRY(ThreadPoolElementAio) all;
+
+    /* Lock-free list of finished requests, see thread_pool_push_done().  */
+    QSLIST_ENTRY(ThreadPoolElementAio) done_next;
+
+    /* This list is only accessed by the thread pool's mother thread.  */
+    QSIMPLEQ_ENTRY(ThreadPoolElementAio) completed_next;
 };
 
 struct ThreadPoolAio {
@@ -63,6 +69,13 @@ struct ThreadPoolAio {
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElementAio) head;
+    QSIMPLEQ_HEAD(, ThreadPoolElementAio) completed;
+
+    /*
+     * Requests finished by worker threads, most recent first.  Pushed to
+     * without taking lock and emptied by thread_pool_completion_bh().
+     */
+    QSLIST_HEAD(, ThreadPoolElementAio) done_list;
 
     /* The following variables are protected by lock.  */
     QTAILQ_HEAD(, ThreadPoolElementAio) request_list;
@@ -74,6 +87,59 @@ struct ThreadPoolAio {
     int max_threads;
 };
 
+/*
+ * Hand a finished request over to the completion BH.  Only the thread that
+ * finds the list empty schedules the BH; everybody else knows that the BH is
+ * already pending and will pick up their request together with the first
+ * one, so a burst of completions costs a single BH invocation.
+ *
+ * The atomic update of the list head orders the write of req->ret before
+ * the BH's read.
+ */
+static void thread_pool_push_done(ThreadPoolAio *pool,
+                                  ThreadPoolElementAio *req)
+{
+    ThreadPoolElementAio *old;
+
+    do {
+        old = qatomic_read(&pool->done_list.slh_first);
+        req->done_next.sle_next = old;
+    } while (qatomic_cmpxchg(&pool->done_list.slh_first, old, req) != old);
+
+    if (!old) {
+        qemu_bh_schedule(pool->completion_bh);
+    }
+}
+
+/* Return the oldest finished request that has not been completed yet */
+static ThreadPoolElementAio *thread_pool_next_completed(ThreadPoolAio *pool)
+{
+    ThreadPoolElementAio *elem;
+
+    if (QSIMPLEQ_EMPTY(&pool->completed)) {
+        QSLIST_HEAD(, ThreadPoolElementAio) reversed, straight;
+
+        /* Synchronizes with the cmpxchg in thread_pool_push_done() */
+        QSLIST_MOVE_ATOMIC(&reversed, &pool->done_list);
+        QSLIST_INIT(&straight);
+
+        while (!QSLIST_EMPTY(&reversed)) {
+            elem = QSLIST_FIRST(&reversed);
+            QSLIST_REMOVE_HEAD(&reversed, done_next);
+            QSLIST_INSERT_HEAD(&straight, elem, done_next);
+        }
+        QSLIST_FOREACH(elem, &straight, done_next) {
+            QSIMPLEQ_INSERT_TAIL(&pool->completed, elem, completed_next);
+        }
+    }
+
+    elem = QSIMPLEQ_FIRST(&pool->completed);
+    if (elem) {
+        QSIMPLEQ_REMOVE_HEAD(&pool->completed, completed_next);
+    }
+    return elem;
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPoolAio *pool = opaque;
@@ -111,11 +177,9 @@ static void *worker_thread(void *opaque)
         ret = req->func(req->arg);
 
         req->ret = ret;
-        /* Write ret before state.  */
-        smp_wmb();
         req->state = THREAD_DONE;
 
-        qemu_bh_schedule(pool->completion_bh);
+        thread_pool_push_done(pool, req);
         qemu_mutex_lock(&pool->lock);
     }
 
@@ -174,24 +238,16 @@ static void spawn_thread(ThreadPoolAio *pool)
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPoolAio *pool = opaque;
-    ThreadPoolElementAio *elem, *next;
+    ThreadPoolElementAio *elem;
 
     defer_call_begin(); /* cb() may use defer_call() to coalesce work */
 
-restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
-            continue;
-        }
-
+    while ((elem = thread_pool_next_completed(pool))) {
         trace_thread_pool_complete_aio(pool, elem, elem->common.opaque,
                                        elem->ret);
         QLIST_REMOVE(elem, all);
 
         if (elem->common.cb) {
-            /* Read state before ret.  */
-            smp_rmb();
-
             /* Schedule ourselves in case elem->common.cb() calls aio_poll() to
              * wait for another request that completed at the same time.
              */
@@ -200,16 +256,12 @@ restart:
             elem->common.cb(elem->common.opaque, elem->ret);
 
             /* We can safely cancel the completion_bh here regardless of someone
-             * else having scheduled it meanwhile because we reenter the
-             * completion function anyway (goto restart).
+             * else having scheduled it meanwhile because the loop checks
+             * pool->done_list again before returning.
              */
             qemu_bh_cancel(pool->completion_bh);
-
-            qemu_aio_unref(elem);
-            goto restart;
-        } else {
-            qemu_aio_unref(elem);
         }
+        qemu_aio_unref(elem);
     }
 
     defer_call_end();
@@ -225,10 +277,10 @@ static void thread_pool_cancel(BlockAIOCB *acb)
     QEMU_LOCK_GUARD(&pool->lock);
     if (elem->state == THREAD_QUEUED) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
+        thread_pool_push_done(pool, elem);
     }
 
 }
@@ -332,6 +384,8 @@ static void thread_pool_init_one(ThreadPoolAio *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
+    QSIMPLEQ_INIT(&pool->completed);
+    QSLIST_INIT(&pool->done_list);
     QTAILQ_INIT(&pool->request_list);
 
     thread_pool_update_params(pool, ctx);
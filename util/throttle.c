@@ -462,6 +462,23 @@ bool throttle_schedule_timer(ThrottleState *ts,
     return true;
 }
 
+/* Check whether an I/O request could go through right now, without arming
+ * a timer
+ *
+ * @clock_type: the clock used for throttling
+ * @direction:  throttle direction
+ * @ret:        true if the request would have to wait
+ */
+bool throttle_would_wait(ThrottleState *ts, QEMUClockType clock_type,
+                         ThrottleDirection direction)
+{
+    int64_t next_timestamp;
+
+    return throttle_compute_timer(ts, direction,
+                                  qemu_clock_get_ns(clock_type),
+                                  &next_timestamp);
+}
+
 /* do the accounting for this operation
  *
  * @direction: throttle direction
@@ -469,6 +486,25 @@ bool throttle_schedule_timer(ThrottleState *ts,
  */
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size)
+{
+    double units = 1.0;
+
+    /* if cfg.op_size is defined and smaller than size we compute unit count */
+    if (ts->cfg.op_size && size > ts->cfg.op_size) {
+        units = (double) size / ts->cfg.op_size;
+    }
+
+    throttle_account_units(ts, direction, units, size);
+}
+
+/* do the accounting for a number of operations at once
+ *
+ * @direction: throttle direction
+ * @units:     the number of operations, in units of cfg.op_size
+ * @size:      the total size of the operations
+ */
+void throttle_account_units(ThrottleState *ts, ThrottleDirection direction,
+                            double units, uint64_t size)
 {
     static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
         { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
@@ -478,14 +514,9 @@ void throttle_account(ThrottleState *ts, ThrottleDirection direction,
         { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
         { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
     };
-    double units = 1.0;
     unsigned i;
 
     assert(direction < THROTTLE_MAX);
-    /* if cfg.op_size is defined and smaller than size we compute unit count */
-    if (ts->cfg.op_size && size > ts->cfg.op_size) {
-        units = (double) size / ts->cfg.op_size;
-    }
 
     for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
         LeakyBucket *bkt;